@@ -0,0 +1,421 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef INCLUDED_GR_BLUETOOTH_CHANNELIZER_H
+#define INCLUDED_GR_BLUETOOTH_CHANNELIZER_H
+
+#include <gr_bluetooth/api.h>
+#include <gnuradio/types.h>
+#include <gnuradio/filter/mmse_fir_interpolator_ff.h>
+#include <gnuradio/filter/freq_xlating_fir_filter.h>
+#include <boost/shared_ptr.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    class stage_stats;
+    class xlating_ddc;
+
+    /*!
+     * \brief Channel filters, demodulator and squelch of the multi blocks.
+     * \ingroup bluetooth
+     *
+     * Everything that turns a window of wideband input into the
+     * symbols of one classic or LE channel, with the noise floor of
+     * each channel, but none of the flowgraph plumbing.  multi_block is
+     * one; multi_sniffer's replay workers run one each.
+     */
+    class GR_BLUETOOTH_API channelizer
+    {
+    public:
+      /*!
+       * \brief Input item formats, interleaved I/Q as 32 bit floats
+       * ("cf32"), 16 bit integers ("sc16") or 8 bit integers ("sc8").
+       */
+      enum sample_format_t {
+        FORMAT_CF32 = 0,
+        FORMAT_SC16 = 1,
+        FORMAT_SC8  = 2
+      };
+
+      /* parse a format name, throws std::invalid_argument if unknown */
+      static sample_format_t sample_format(const std::string &name);
+
+      /* bytes per input item */
+      static size_t sample_size(sample_format_t format);
+
+      channelizer(double sample_rate, double center_freq, double squelch_threshold,
+                  sample_format_t input_format = FORMAT_CF32);
+      virtual ~channelizer();
+
+    protected:
+      channelizer() : d_interp(NULL) {} // to allow for pure virtual
+
+      /* replay workers drive channelizers of their own */
+      friend class multi_sniffer_impl;
+
+      /* symbols per second */
+      static const int SYMBOL_RATE = 1000000;
+
+      /* symbols per second of the LE 2M PHY */
+      static const int LE_2M_SYMBOL_RATE = 2000000;
+
+      static const int SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE = 68;
+      static const int SYMBOLS_PER_LOW_ENERGY_PREAMBLE_AA = 40;
+
+      /* GFSK access code and packet header, then the EDR guard time and sync */
+      static const int SYMBOLS_BEFORE_EDR_GUARD = 126;
+      static const int EDR_GUARD_SYMBOLS = 5;
+      static const int EDR_SYNC_SYMBOLS = 10;
+
+      /* length of time slot in symbols */
+      static const int SYMBOLS_PER_BASIC_RATE_SLOT    = 625;
+      static const int SYMBOLS_FOR_BASIC_RATE_HISTORY = 3125;
+
+      /* channel 0 in Hz */
+      static const uint32_t BASE_FREQUENCY = 2402000000UL;
+
+      /* channel width in Hz */
+      static const int CHANNEL_WIDTH = 1000000;
+
+      /* total number of samples elapsed */
+      uint64_t d_cumulative_count;
+
+      /*
+       * input samples each slot is searched in, the block's history():
+       * the slot itself, then enough to finish a packet starting in it
+       */
+      int d_input_history;
+
+      /* sample rate of raw input stream */
+      double d_sample_rate;
+
+      /* number of raw samples per symbol */
+      double d_samples_per_symbol;
+
+      /* number of raw samples per time slot (625 microseconds) */
+      double d_samples_per_slot;
+
+      /* center frequency of input stream */
+      double d_center_freq;
+
+      /* lowest frequency we can decode */
+      double d_low_freq;
+
+      /* highest frequency we can decode */
+      double d_high_freq;
+
+      /* decimation rate of digital downconverter */
+      int d_ddc_decimation_rate;
+
+      /* mm_cr variables, one set per symbol rate */
+      struct clock_recovery {
+        float gain_mu;		// gain for adjusting mu
+        float mu;			// fractional sample position [0.0, 1.0]
+        float omega_relative_limit;	// used to compute min and max omega
+        float omega;		// nominal frequency
+        float gain_omega;		// gain for adjusting omega
+        float omega_mid;		// average omega
+        float last_sample;
+
+        void init(float samples_per_symbol);
+      };
+      clock_recovery d_cr;
+
+      /* target SNR */
+      double d_target_snr;
+
+      /* channel filter coefficients for digital downconverter */
+      double d_channel_filter_width;
+      std::vector<float> d_channel_filter;
+      std::map<int, gr::filter::freq_xlating_fir_filter_ccf::sptr> d_channel_ddcs;
+
+      /*
+       * Noise floor of each classic channel: an exponentially weighted
+       * minimum of the channel energy, see check_snr().  0 until the
+       * channel has been seen.
+       */
+      std::vector<double> d_noise_floor;
+
+      /*
+       * Integer input is filtered directly by fused convert-and-filter
+       * DDCs in place of the freq_xlating_fir_filters above.
+       */
+      sample_format_t d_input_format;
+      std::map<int, boost::shared_ptr<xlating_ddc> > d_int_channel_ddcs;
+
+      /* input sample offset where channel extraction happens */
+      int d_first_channel_sample;
+
+      /* benchmark counter, see multi_block::channel_slots() */
+      std::vector<uint64_t> d_channel_slots;
+
+      /* per-stage timing, see multi_block::set_profiling() */
+      boost::shared_ptr<stage_stats> d_stats;
+
+      /* quadrature frequency demodulator sensitivity */
+      float d_demod_gain;
+
+      /* interpolator M&M clock recovery block */
+      gr::filter::mmse_fir_interpolator_ff *d_interp;
+
+      /*
+       * LE 2M PHY profile, see multi_block::set_le_2m(): a channel
+       * filter twice as wide, less decimation and its own clock
+       * recovery, run on the LE channels that pass the squelch.
+       */
+      bool d_le_2m;
+      int d_le_2m_decimation_rate;
+      std::vector<float> d_le_2m_filter;
+      std::map<int, gr::filter::freq_xlating_fir_filter_ccf::sptr> d_le_2m_ddcs;
+      std::map<int, boost::shared_ptr<xlating_ddc> > d_int_le_2m_ddcs;
+      float d_le_2m_demod_gain;
+      clock_recovery d_le_2m_cr;
+
+      /* search the 1M symbols for LE Coded packets too, see multi_block::set_le_coded() */
+      bool d_le_coded;
+
+      /* keep soft symbols for classic packets, see multi_block::set_soft_symbols() */
+      bool d_soft_symbols;
+
+      /* classic channels to decode, see multi_block::set_channel_mask() */
+      std::vector<bool> d_channel_mask;
+
+      /* slot number + 1 of the last slot each channel passed the squelch */
+      std::vector<uint64_t> d_last_active;
+
+      /* LLR units per unit of demodulator output */
+      float d_soft_scale;
+
+      /*
+       * Scratch buffers for searching one channel, sized once for
+       * d_input_history by set_input_history(): channel samples,
+       * demodulator and clock recovery output, then the symbols with
+       * their sample positions, soft values and EDR phase changes.
+       */
+      std::vector<gr_complex> d_ch_samples;
+      std::vector<float> d_demod_out;
+      std::vector<float> d_cr_out;
+      std::vector<char> d_symbols;
+      std::vector<float> d_positions;
+      std::vector<int8_t> d_soft;
+      std::vector<char> d_edr;
+
+      /* set d_input_history and size the scratch buffers for it */
+      void set_input_history(int samples);
+
+      /* set up the LE 2M profile, false if the sample rate is too low */
+      bool enable_le_2m(bool enabled);
+
+      /* input samples the channel DDC and the demodulator need beyond the symbols */
+      int channel_history();
+
+      /* grow d_input_history to hold an LE Coded packet */
+      void enable_le_coded(bool enabled);
+
+      /* move to a new centre frequency and channel mask */
+      void tune(double center_freq, const std::vector<bool> &channel_mask);
+
+      /*
+       * Forget the noise floors and clock recovery state, for input
+       * that does not carry on from the samples seen so far.
+       */
+      void restart();
+
+      /*
+       * M&M clock recovery, adapted from gr_clock_recovery_mm_ff.  If
+       * positions is given, it gets the input sample position of each
+       * output symbol.
+       */
+      int mm_cr(clock_recovery &cr, const float *in, int ninput_items,
+                float *out, int noutput_items, float *positions = NULL);
+      int mm_cr(const float *in, int ninput_items, float *out, int noutput_items,
+                float *positions = NULL)
+      {
+        return mm_cr(d_cr, in, ninput_items, out, noutput_items, positions);
+      }
+
+      /* fm demodulation, taken from gr_quadrature_demod_cf */
+      void demod(const gr_complex *in, float *out, int noutput_items, float gain);
+      void demod(const gr_complex *in, float *out, int noutput_items)
+      {
+        demod(in, out, noutput_items, d_demod_gain);
+      }
+
+      /* binary slicer, similar to gr_binary_slicer_fb */
+      void slicer(const float *in, char *out, int noutput_items);
+
+      /* soft slicer, clock recovered symbols as 8 bit LLRs */
+      void soft_slicer(const float *in, int8_t *out, int noutput_items);
+
+      /**
+       * Extract a single BT channel's worth of samples from the wider
+       * bandwidth samples.  energy is that of the first time slot, as
+       * from scan_channel().
+       */
+      int channel_samples( const double               freq,
+                           gr_vector_const_void_star& in,
+                           gr_vector_void_star&       out,
+                           double&                    energy,
+                           int                        ninput_items );
+
+      /*
+       * Cheap scan of a channel: filter only the samples of the first
+       * time slot into out and return their energy.  Returns the number
+       * of samples produced; finish_channel() completes the rest.
+       */
+      int scan_channel( const double               freq,
+                        gr_vector_const_void_star& in,
+                        gr_complex                *out,
+                        double&                    energy );
+
+      /*
+       * Complete the count samples from scan_channel() to what
+       * channel_samples() would have produced, returns the total.
+       */
+      int finish_channel( const double               freq,
+                          gr_vector_const_void_star& in,
+                          gr_complex                *out,
+                          int                        count,
+                          int                        ninput_items );
+
+      /*
+       * Feed the squelch of a channel one slot of input without
+       * searching it, to warm its noise floor up.
+       */
+      void warm_up( const double               freq,
+                    gr_vector_const_void_star& in );
+
+      /**
+       * Produce symbols stream for a single BT channel, developed
+       * from of the raw samples for a single BT channel, at most
+       * d_input_history of them.
+       */
+      int channel_symbols( gr_vector_const_void_star &in,
+                           char *out,
+                           int ninput_items,
+                           float *positions = NULL,
+                           int8_t *soft = NULL );
+
+      /*
+       * EDR payload of a classic packet: looks for the DPSK sync
+       * sequence one guard time after the GFSK header, whose last
+       * symbol is at channel sample position header_end, and writes
+       * the phase change of each following symbol (256 units per
+       * turn) to out.  Returns the number of symbols, 0 if there is
+       * no sync sequence.
+       */
+      int edr_phases( const gr_complex *samples,
+                      int               nsamples,
+                      float             header_end,
+                      char             *out,
+                      int               max );
+
+      /*
+       * LE 2M symbols of the LE channel at freq, straight from the raw
+       * samples, through d_ch_samples.  out must have room for
+       * d_input_history symbols.  Returns the number of symbols, 0 if
+       * 2M is off or freq has no 2M DDC.
+       */
+      int le_2m_symbols( const double               freq,
+                         gr_vector_const_void_star& in,
+                         char                      *out );
+
+      /*
+       * Squelch: snr is the channel energy over the tracked noise floor
+       * of the channel, in dB.  Call once per slot and channel, the
+       * floor is updated from the energy.
+       */
+      bool check_snr( const double               freq,
+                      const double               on_channel_energy,
+                      double&                    snr );
+
+      enum ddc_t {
+        DDC_CHANNEL = 0,
+        DDC_LE_2M   = 1
+      };
+
+      /*
+       * Run a DDC (see ddc_t) of a classic channel over input starting
+       * at item first.  Returns the number of samples produced, -1 if
+       * the channel has no such DDC.
+       */
+      int ddc_work( int                        classic_chan,
+                    ddc_t                      kind,
+                    gr_vector_const_void_star& in,
+                    int                        first,
+                    int                        ninput_items,
+                    gr_complex                *out );
+
+      /*
+       * Set available channels based on d_center_freq, d_sample_rate
+       * and d_channel_mask.  DDCs of channels that stay available are
+       * retuned, the others are created, with no noise floor yet, or
+       * dropped.
+       */
+      void set_channels();
+
+      /* returns relative (with respect to d_center_freq) frequency in Hz of given channel */
+      double channel_rel_freq(int channel);
+
+      double channel_abs_freq(int channel);
+
+      int abs_freq_channel(double freq);
+
+      /*
+       * Input sample at which a symbol (in 1M symbols) of the slot
+       * being searched starts.  Packets are searched for in the first
+       * slot of the d_input_history window, which starts d_input_history-1 samples
+       * before d_cumulative_count.
+       */
+      uint64_t symbol_sample(double symbol);
+
+    private:
+      /* channel samples of one time slot */
+      int slot_channel_samples();
+
+      /*
+       * The one energy estimate check_snr() gets, whether the channel
+       * was scanned or filtered whole: the first slot only
+       */
+      double slot_mean_energy(const gr_complex *samples, int nsamples);
+
+      /* DDC of one slot of a channel into out, with its energy */
+      int slot_energy( int                        classic_chan,
+                       gr_vector_const_void_star& in,
+                       gr_complex                *out,
+                       double&                    energy );
+
+      /* owns d_interp */
+      channelizer(const channelizer &);
+      channelizer &operator=(const channelizer &);
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_GR_BLUETOOTH_CHANNELIZER_H */
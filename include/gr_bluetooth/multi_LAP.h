@@ -50,7 +50,8 @@ namespace gr {
         * class. gr::bluetooth::multi_LAP::make is the public interface for
         * creating new instances.
         */
-       static sptr make(double sample_rate, double center_freq, double squelch_threshold);
+       static sptr make(double sample_rate, double center_freq, double squelch_threshold,
+                        const std::string &input_format = "cf32");
     };
 
   } // namespace bluetooth
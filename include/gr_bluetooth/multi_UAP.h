@@ -48,7 +48,8 @@ namespace gr {
         * class. gr::bluetooth::multi_UAP::make is the public interface for
         * creating new instances.
         */
-       static sptr make(double sample_rate, double center_freq, double squelch_threshold, int LAP);
+       static sptr make(double sample_rate, double center_freq, double squelch_threshold, int LAP,
+                        const std::string &input_format = "cf32");
     };
 
   } // namespace bluetooth
@@ -26,9 +26,11 @@
 #define INCLUDED_GR_BLUETOOTH_MULTI_BLOCK_H
 
 #include <gr_bluetooth/api.h>
+#include <gr_bluetooth/channelizer.h>
 #include <gnuradio/sync_block.h>
-#include <gnuradio/filter/mmse_fir_interpolator_ff.h>
-#include <gnuradio/filter/freq_xlating_fir_filter.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 
 namespace gr {
   namespace bluetooth {
@@ -37,130 +39,213 @@ namespace gr {
      * \brief Bluetooth multi-channel parent class.
      * \ingroup bluetooth
      */
-    class  GR_BLUETOOTH_API multi_block : virtual public gr::sync_block
+    class  GR_BLUETOOTH_API multi_block : virtual public gr::sync_block, public channelizer
     {
     protected:
       multi_block() {} // to allow for pure virtual
-      multi_block(double sample_rate, double center_freq, double squelch_threshold);
+      multi_block(double sample_rate, double center_freq, double squelch_threshold,
+                  sample_format_t input_format = FORMAT_CF32);
 
-      /* symbols per second */
-      static const int SYMBOL_RATE = 1000000;
+      /* capture sample index of the first input item and end of decoding, see set_window() */
+      uint64_t d_window_start;
+      uint64_t d_window_end;
 
-      static const int SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE = 68;
-      static const int SYMBOLS_PER_LOW_ENERGY_PREAMBLE_AA = 40;
+      /* has the decode window been processed? */
+      bool window_done() { return d_cumulative_count >= d_window_end; }
 
-      /* length of time slot in symbols */
-      static const int SYMBOLS_PER_BASIC_RATE_SLOT    = 625;
-      static const int SYMBOLS_FOR_BASIC_RATE_HISTORY = 3125;
-
-      /* channel 0 in Hz */
-      static const uint32_t BASE_FREQUENCY = 2402000000UL;
-
-      /* channel width in Hz */
-      static const int CHANNEL_WIDTH = 1000000;
-
-      /* total number of samples elapsed */
-      uint64_t d_cumulative_count;
-
-      /* sample rate of raw input stream */
-      double d_sample_rate;
-
-      /* number of raw samples per symbol */
-      double d_samples_per_symbol;
-
-      /* number of raw samples per time slot (625 microseconds) */
-      double d_samples_per_slot;
-
-      /* center frequency of input stream */
-      double d_center_freq;
-
-      /* lowest frequency we can decode */
-      double d_low_freq;
-
-      /* highest frequency we can decode */
-      double d_high_freq;
-
-      /* decimation rate of digital downconverter */
-      int d_ddc_decimation_rate;
-
-      /* mm_cr variables */
-      float d_gain_mu;		// gain for adjusting mu
-      float d_mu;				// fractional sample position [0.0, 1.0]
-      float d_omega_relative_limit;	// used to compute min and max omega
-      float d_omega;			// nominal frequency
-      float d_gain_omega;		// gain for adjusting omega
-      float d_omega_mid;		// average omega
-      float d_last_sample;
-
-      /* target SNR */
-      double d_target_snr;
-
-      /* channel filter coefficients for digital downconverter */
-      double d_channel_filter_width;
-      std::vector<float> d_channel_filter;
-      std::map<int, gr::filter::freq_xlating_fir_filter_ccf::sptr> d_channel_ddcs;
-
-      /* noise power filter coefficients */
-      double d_noise_filter_width;
-      std::vector<float> d_noise_filter;
-      std::map<int, gr::filter::freq_xlating_fir_filter_ccf::sptr> d_noise_ddcs;
-
-      /* input sample offset where channel and noise extraction happens */
-      int d_first_channel_sample;
-      int d_first_noise_sample;
-
-      /* quadrature frequency demodulator sensitivity */
-      float d_demod_gain;
-
-      /* interpolator M&M clock recovery block */
-      gr::filter::mmse_fir_interpolator_ff *d_interp;
+      /*
+       * Centre frequency and channel mask asked for by the setters or
+       * the "ctrl" port, applied by retune() between time slots.
+       */
+      std::mutex d_retune_mutex;
+      std::atomic<bool> d_retune_pending;
+      double d_pending_center_freq;
+      std::vector<bool> d_pending_channel_mask;
 
-      /* M&M clock recovery, adapted from gr_clock_recovery_mm_ff */
-      int mm_cr(const float *in, int ninput_items, float *out, int noutput_items);
+      /* packet counters, see packets_detected() */
+      uint64_t d_packets_detected;
+      uint64_t d_packets_decoded;
 
-      /* fm demodulation, taken from gr_quadrature_demod_cf */
-      void demod(const gr_complex *in, float *out, int noutput_items);
+      /* apply a pending retune, work() calls this before each slot */
+      void retune();
 
-      /* binary slicer, similar to gr_binary_slicer_fb */
-      void slicer(const float *in, char *out, int noutput_items);
+      /* "ctrl" message port handler */
+      void handle_ctrl(pmt::pmt_t msg);
 
-      /**
-       * Extract a single BT channel's worth of samples from the wider
-       * bandwidth samples.
+      /*
+       * Slot budget scheduler, see set_slot_budget().  Times are in
+       * microseconds; d_slot_debt_us is the overrun of earlier slots
+       * still to be made up.
        */
-      int channel_samples( const double               freq,
-                           gr_vector_const_void_star& in, 
-                           gr_vector_void_star&       out,
-                           double&                    energy,
-                           int                        ninput_items );
-
-      /**
-       * Produce symbols stream for a single BT channel, developed
-       * from of the raw samples for a single BT channel.
+      double d_slot_budget_us;
+      double d_slot_debt_us;
+      double d_channel_cost_us;
+      std::chrono::steady_clock::time_point d_slot_start;
+      std::chrono::steady_clock::time_point d_channel_start;
+      bool d_channel_open;
+      std::vector<int> d_slot_order;
+      size_t d_slot_forced;
+      int d_slot_rotation;
+
+      /* channel slots skipped over budget, per classic channel */
+      std::vector<uint64_t> d_channel_skips;
+
+      /* slots a channel counts as active after passing the squelch */
+      static const int ACTIVE_SLOTS = 1600;
+
+      /* at most this many slots of overrun are carried forward */
+      static const int MAX_DEBT_SLOTS = 4;
+
+      /*
+       * Start a time slot: the classic channels to look at, in order.
+       * Without a budget these are the channels of the band, low to
+       * high.  With one, channels in predicted (where tracked piconets
+       * hop in this slot) lead, then channels active in the last
+       * ACTIVE_SLOTS, then the rest, rotated so that all get a turn.
        */
-      int channel_symbols( gr_vector_const_void_star &in, 
-                           char *out, 
-                           int ninput_items );
+      const std::vector<int> &begin_slot(const std::vector<int> &predicted);
+      const std::vector<int> &begin_slot()
+      {
+        return begin_slot(std::vector<int>());
+      }
+
+      /*
+       * May the n-th channel of begin_slot() be decoded within the
+       * budget?  The predicted channels always are.  A channel that
+       * may not is counted as skipped.
+       */
+      bool in_budget(size_t n);
 
-      bool check_snr( const double               freq, 
-                      const double               on_channel_energy,
-                      double&                    snr, 
-                      gr_vector_const_void_star& in );
+      /* end of the time slot, carries any overrun into the next */
+      void end_slot();
 
       /* add some number of symbols to the block's history requirement */
       void set_symbol_history(int num_symbols);
 
-      /* set available channels based on d_center_freq and d_sample_rate */
-      void set_channels();
-
-      /* returns relative (with respect to d_center_freq) frequency in Hz of given channel */
-      double channel_rel_freq(int channel);
+    public:
+      /*!
+       * \brief Counters for benchmarking.
+       *
+       * Time slots processed on a classic channel (0-78), access codes
+       * and access addresses found, and packets with a decoded payload.
+       */
+      uint64_t channel_slots(int channel);
+      uint64_t packets_detected() { return d_packets_detected; }
+      uint64_t packets_decoded() { return d_packets_decoded; }
+
+      /*!
+       * \brief Decode only part of a capture.
+       *
+       * start is the capture sample index of the first input item, for
+       * input that does not begin at the start of the capture (a seeked
+       * file_source or sigmf_source).  Clocks, timestamps and "sample"
+       * offsets count from it, so with start on a multiple of
+       * samples_per_slot() they match those of a decode of the whole
+       * capture.  work() returns WORK_DONE once duration samples have
+       * been processed, 0 for no limit.  Call before the flowgraph starts.
+       */
+      void set_window(uint64_t start, uint64_t duration = 0);
+
+      /* the same in CLKN units (625 us time slots) */
+      void set_window_slots(uint64_t start_slot, uint64_t duration_slots = 0);
+
+      uint64_t window_start() { return d_window_start; }
+      uint64_t window_end() { return d_window_end; }
+      int samples_per_slot() { return (int) d_samples_per_slot; }
+
+      /*!
+       * \brief Demodulate the LE 2M PHY as well.
+       *
+       * LE channels that pass the squelch are also filtered 2 MHz wide
+       * and demodulated at 2 Msym/s.  Needs at least 4 samples per
+       * 1M symbol; returns false (and stays off) if the sample rate is
+       * lower.  Call before the flowgraph starts.
+       */
+      bool set_le_2m(bool enabled);
+      bool le_2m() { return d_le_2m; }
+
+      /*!
+       * \brief Search for LE Coded PHY (S=2 and S=8) packets as well.
+       *
+       * Coded packets are found by their 80 symbol preamble in the 1M
+       * symbol stream and FEC decoded; nothing is demodulated twice.
+       * The history grows to hold an S=2 packet with a 255 octet PDU
+       * behind the slot it starts in; S=8 PDUs fit up to about 60
+       * octets.  Call before the flowgraph starts.
+       */
+      void set_le_coded(bool enabled);
+      bool le_coded() { return d_le_coded; }
+
+      /*!
+       * \brief Decode classic packets from soft symbols.
+       *
+       * The clock recovered symbols are kept as 8 bit LLRs alongside
+       * the hard ones, and access code correlation, FEC 1/3 and FEC 2/3
+       * decoding weigh each symbol by its reliability.  The gain in
+       * header decoding allows a higher squelch threshold.
+       */
+      void set_soft_symbols(bool enabled) { d_soft_symbols = enabled; }
+      bool soft_symbols() { return d_soft_symbols; }
+
+      /*!
+       * \brief Retune while the flowgraph runs.
+       *
+       * From the next time slot on, the channel DDCs follow the new
+       * centre frequency: those of channels still in the band are
+       * retuned in place, the others are created or dropped.  Piconets,
+       * connections and clocks are kept.  Safe to call from any thread;
+       * also a "freq" entry (Hz) in a dict on the "ctrl" message port.
+       */
+      void set_center_freq(double center_freq);
+      double center_freq();
+
+      /*!
+       * \brief Decode only some classic channels (0-78), all if empty.
+       *
+       * Masked channels are not filtered at all, so this is how to
+       * shed CPU load.  A channel unmasked again starts its squelch
+       * over.  Takes effect like set_center_freq(); also a
+       * "channels" entry (vector of channel numbers) on "ctrl".
+       */
+      void set_channel_mask(const std::vector<int> &channels);
+      std::vector<int> channel_mask();
+
+      /*!
+       * \brief Degrade gracefully when the CPU cannot keep up.
+       *
+       * budget is the share of real time one time slot may take: 1.0
+       * allows 625 us of processing per 625 us slot, 0 (the default)
+       * sets no limit, as for file input.  Over budget, channels where
+       * tracked piconets hop come first, then channels with recent
+       * activity, then the others in turn; the rest of the slot's
+       * channels are skipped and counted.
+       */
+      void set_slot_budget(double budget);
+      double slot_budget();
+
+      /* channel slots skipped over budget, per classic channel and in all */
+      uint64_t channel_skips(int channel);
+      uint64_t skipped_channel_slots();
+
+      /*!
+       * \brief Per-stage timing of work().
+       *
+       * When enabled, time spent in channelization, SNR check, demod,
+       * clock recovery, slicing, access code/address search, packet
+       * construction, decoding and piconet discovery is accumulated
+       * per stage and per channel.  The report is printed to stderr
+       * when the flowgraph stops and is exported through ControlPort.
+       */
+      void set_profiling(bool enabled);
+      std::string profile_report();
 
-      double channel_abs_freq(int channel);
+      bool stop();
+      void setup_rpc();
 
-      int abs_freq_channel(double freq);
+      /* ControlPort getters for stage S, see stage_stats.h */
+      template <int S> double stage_total_ns();
+      template <int S> double stage_calls();
 
-    public:
       virtual int work (int noutput_items,
                         gr_vector_const_void_star &input_items,
                         gr_vector_void_star &output_items) = 0;
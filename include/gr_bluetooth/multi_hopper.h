@@ -29,6 +29,8 @@
 
 #include <gr_bluetooth/api.h>
 #include "gr_bluetooth/multi_block.h"
+#include <string>
+#include <vector>
 
 namespace gr {
   namespace bluetooth {
@@ -36,6 +38,18 @@ namespace gr {
     /*!
      * \brief Sniff Bluetooth packets.
      * \ingroup bluetooth
+     *
+     * Decoded packets are published as PDUs on the "packets" message
+     * port, see lib/packet_pdu.h for the metadata keys.
+     *
+     * One block follows any number of target piconets (LAPs) over a
+     * shared channelizer.  Targets still working on their UAP and clock
+     * are searched for on every channel; those with a known clock are
+     * only looked for on the channel they hop to.  Targets are added
+     * with add_target(), by messages on the "targets" port (a LAP, a
+     * dict with "lap" and optionally "remove"), or adopted from the
+     * packets the block finds itself or from multi_sniffer "packets"
+     * PDUs that carry a UAP, see set_adopt().
      */
     class GR_BLUETOOTH_API multi_hopper : virtual public multi_block
     {
@@ -50,7 +64,55 @@ namespace gr {
         * class. gr::bluetooth::multi_hopper::make is the public interface for
         * creating new instances.
         */
-       static sptr make(double sample_rate, double center_freq, double squelch_threshold, int LAP, bool aliased, bool tun);
+       static sptr make(double sample_rate, double center_freq, double squelch_threshold, int LAP, bool aliased, bool tun,
+                        const std::string &pcap_file = "",
+                        const std::string &input_format = "cf32");
+
+       /*!
+        * \brief Follow another piconet, or stop following one.
+        *
+        * A negative LAP given to make() starts without a target.
+        * add_target() returns false if max_targets() are followed
+        * already.
+        */
+       virtual bool add_target(int LAP) = 0;
+       virtual bool remove_target(int LAP) = 0;
+       virtual std::vector<int> targets() = 0;
+
+       /*!
+        * \brief Limit the number of targets, 0 for no limit.
+        *
+        * A target reversing its clock holds a 128 MB hop sequence
+        * until the clock is known, so only two do that at once and the
+        * others wait their turn.
+        */
+       virtual void set_max_targets(int max_targets) = 0;
+       virtual int max_targets() = 0;
+
+       /*!
+        * \brief Adopt piconets seen with packet headers as targets.
+        *
+        * A LAP is adopted once it has been seen in a few slots, or
+        * arrives in a "targets" PDU, and dropped again after about ten
+        * seconds without a packet.  Targets added any other way stay
+        * until they are removed.  While there is room for more targets, adoption keeps every
+        * channel searched.
+        */
+       virtual void set_adopt(bool adopt) = 0;
+       virtual bool adopt() = 0;
+
+       /*!
+        * \brief Configure the packet log.
+        *
+        * The format is "text", "json" or "binary".  Verbosity 0 is
+        * silent, 1 logs decoded packets, 2 adds ID and LE packets and 3
+        * adds UAP/clock discovery progress.  A rate limit of 0 disables
+        * limiting, an empty filename or "-" logs to stdout.
+        */
+       virtual bool set_log_format(const std::string &format) = 0;
+       virtual void set_log_verbosity(int level) = 0;
+       virtual void set_log_rate_limit(double per_second) = 0;
+       virtual bool set_log_file(const std::string &filename) = 0;
    };
 
   } // namespace bluetooth
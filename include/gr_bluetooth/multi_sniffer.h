@@ -29,14 +29,17 @@
 
 #include <gr_bluetooth/api.h>
 #include "gr_bluetooth/multi_block.h"
+#include <string>
 
 namespace gr {
   namespace bluetooth {
 
     /*!
-     * \brief <+description of block+>
+     * \brief Sniff classic and LE packets on every channel in the band.
      * \ingroup bluetooth
      *
+     * Decoded packets are published as PDUs on the "packets" message
+     * port, see lib/packet_pdu.h for the metadata keys.
      */
     class GR_BLUETOOTH_API multi_sniffer : virtual public multi_block
     {
@@ -51,7 +54,80 @@ namespace gr {
         * class. gr::bluetooth::multi_sniffer::make is the public interface for
         * creating new instances.
         */
-       static sptr make(double sample_rate, double center_freq, double squelch_threshold, bool tun);
+       static sptr make(double sample_rate, double center_freq, double squelch_threshold, bool tun,
+                        const std::string &pcap_file = "",
+                        const std::string &input_format = "cf32");
+
+       /*!
+        * \brief Configure the packet log.
+        *
+        * The format is "text", "json" or "binary".  Verbosity 0 is
+        * silent, 1 logs decoded packets, 2 adds ID and LE packets and 3
+        * adds UAP/clock discovery progress.  A rate limit of 0 disables
+        * limiting, an empty filename or "-" logs to stdout.
+        */
+       virtual bool set_log_format(const std::string &format) = 0;
+       virtual void set_log_verbosity(int level) = 0;
+       virtual void set_log_rate_limit(double per_second) = 0;
+       virtual bool set_log_file(const std::string &filename) = 0;
+
+       /*!
+        * \brief Follow LE connections.
+        *
+        * Connections are tracked from their CONNECT_REQ, predicting the
+        * data channel of each connection event with the channel
+        * selection algorithm (#1 or #2) it selects.  With following
+        * enabled, access addresses are only searched for on the
+        * advertising channels and on the data channels where a tracked
+        * connection has an event in the current slot, instead of on
+        * every channel.  replay() always searches every channel.
+        */
+       virtual void set_le_follow(bool enabled) = 0;
+
+       /*!
+        * \brief Follow classic piconets.
+        *
+        * Once the clock of a piconet is known (from hop reversal or an
+        * FHS packet), its channel in each slot follows from the hopping
+        * sequence.  With following enabled, those channels are searched
+        * for access codes whatever the squelch says.  Every other
+        * channel only gets a cheap energy scan of the slot and is
+        * filtered and searched in full when that passes the squelch.
+        */
+       virtual void set_classic_follow(bool enabled) = 0;
+
+       /*!
+        * \brief Accept LE data channel packets of unknown connections.
+        *
+        * By default data channel packets are only accepted from the
+        * access addresses of connections learned from a CONNECT_REQ.
+        * In promiscuous mode any access address is searched for, and a
+        * new one is admitted once two of its packets agree on the
+        * CRCInit recovered from their CRC.
+        */
+       virtual void set_le_promiscuous(bool enabled) = 0;
+
+       /*! \brief Number of LE connections being tracked. */
+       virtual int le_connections() = 0;
+
+       /*!
+        * \brief Decode a recording without running a flowgraph.
+        *
+        * The file is memory mapped and split into segments of time
+        * slots.  Channelization and access code/address detection run
+        * on the segments in parallel on the given number of threads (0
+        * for one per CPU), each segment reading the block's history
+        * before its first slot.  Every segment starts the squelch over,
+        * warmed up on the few slots before it, so the result does not
+        * depend on the number of threads.  Detections are then handled
+        * in timestamp order, as work() would have.  The format is
+        * "cf32", "sc16" or "sc8" and nsamples limits the number of
+        * samples read, 0 for the whole file.  Only the window given
+        * by set_window() is decoded, read directly from its start.
+        * Returns the number of samples processed.
+        */
+       virtual uint64_t replay(const std::string &filename, const std::string &format,
+                               int threads = 0, uint64_t nsamples = 0) = 0;
     };
 
   } // namespace bluetooth
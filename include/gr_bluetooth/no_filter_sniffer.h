@@ -29,14 +29,17 @@
 
 #include <gr_bluetooth/api.h>
 #include <gnuradio/sync_block.h>
+#include <string>
 
 namespace gr {
 namespace bluetooth {
 
     /*!
-     * \brief <+description of block+>
+     * \brief Sniff classic packets from a single channel symbol stream.
      * \ingroup bluetooth
      *
+     * Decoded packets are published as PDUs on the "packets" message
+     * port, see lib/packet_pdu.h for the metadata keys.
      */
     class GR_BLUETOOTH_API no_filter_sniffer : virtual public gr::sync_block
     {
@@ -52,6 +55,29 @@ namespace bluetooth {
              * creating new instances.
              */
             static sptr make(double sample_rate, double center_freq);
+
+            /*!
+             * \brief Configure the packet log.
+             *
+             * The format is "text", "json" or "binary".  Verbosity 0 is
+             * silent, 1 logs decoded packets, 2 adds ID and LE packets and 3
+             * adds UAP/clock discovery progress.  A rate limit of 0 disables
+             * limiting, an empty filename or "-" logs to stdout.
+             */
+            virtual bool set_log_format(const std::string &format) = 0;
+            virtual void set_log_verbosity(int level) = 0;
+            virtual void set_log_rate_limit(double per_second) = 0;
+            virtual bool set_log_file(const std::string &filename) = 0;
+
+            /*!
+             * \brief Counters for benchmarking.
+             *
+             * Time slots processed on a classic channel (0-78), access
+             * codes found, and packets with a decoded payload.
+             */
+            virtual uint64_t channel_slots(int channel) = 0;
+            virtual uint64_t packets_detected() = 0;
+            virtual uint64_t packets_decoded() = 0;
     };
 
 } // namespace bluetooth
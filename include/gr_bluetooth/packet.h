@@ -30,6 +30,7 @@
 #include <gr_bluetooth/api.h>
 #include <gnuradio/sync_block.h>
 #include <string>
+#include <vector>
 
 namespace gr {
   namespace bluetooth {
@@ -51,6 +52,10 @@ namespace gr {
 
       typedef boost::shared_ptr<packet> sptr;
 
+      /* longest payload: a 3-DH5 body of 1021 bytes, 2 bytes payload
+       * header and 2 bytes CRC */
+      static const int MAX_PAYLOAD_BITS = 8200;
+
     private:
       air_format d_format;
       double     d_freq;
@@ -77,11 +82,11 @@ namespace gr {
 
       /* The actual payload data in host format
        * Ready for passing to wireshark
-       * 2744 is the maximum length, but most packets are shorter.
+       * MAX_PAYLOAD_BITS is the maximum length, but most packets are shorter.
        * Dynamic allocation would probably be better in the long run but is
        * problematic in the short run.
        */
-      char d_payload[2744];
+      char d_payload[MAX_PAYLOAD_BITS];
       
       /* is the packet whitened? */
       bool d_whitened;
@@ -150,6 +155,9 @@ namespace gr {
       /* format payload for tun interface */
       virtual char *tun_format() = 0;
 
+      /* format packet for its pcap link type, returns number of bytes written */
+      virtual int pcap_format(uint8_t *buf, int buflen) = 0;
+
       /* check to see if the packet has a header */
       virtual bool header_present() = 0;
 
@@ -201,8 +209,15 @@ namespace gr {
       /* native (local) clock */
       uint32_t d_clkn;
 
+      /*
+       * Soft symbols are LLRs, positive for 1, with a symbol at the
+       * nominal deviation at SOFT_NOMINAL.  Where the functions below
+       * take soft symbols, they are optional and parallel the stream.
+       */
+      static const int SOFT_NOMINAL = 32;
+
       /* search a symbol stream to find a packet, return index */
-      static int sniff_ac(char *stream, int stream_length);
+      static int sniff_ac(char *stream, int stream_length, const int8_t *soft = NULL);
 
       /* Error correction coding for Access Code */
       static uint8_t *lfsr(uint8_t *data, int length, int k, uint8_t *g);
@@ -211,16 +226,16 @@ namespace gr {
       static uint8_t *acgen(int LAP);
 
       /* Decode 1/3 rate FEC, three like symbols in a row */
-      static bool unfec13(char *input, char *output, int length);
+      static bool unfec13(char *input, char *output, int length, const int8_t *soft = NULL);
 
       /* Decode 2/3 rate FEC, a (15,10) shortened Hamming code */
-      static char *unfec23(char *input, int length);
+      static char *unfec23(char *input, int length, const int8_t *soft = NULL);
 
       /* When passed 10 bits of data this returns a pointer to a 5 bit hamming code */
       //static char *fec23gen(char *data);
 
       /* Create an Access Code from LAP and check it against stream */
-      static bool check_ac(char *stream, int LAP);
+      static bool check_ac(char *stream, int LAP, const int8_t *soft = NULL);
 
       /* Create the 16bit CRC for classic packet payloads - input air order stream */
       static uint16_t crcgen(char *payload, int length, int UAP);
@@ -243,6 +258,9 @@ namespace gr {
       /* format payload for tun interface */
       virtual char *tun_format() = 0;
 
+      /* format packet as a LINKTYPE_BLUETOOTH_BREDR_BB record */
+      virtual int pcap_format(uint8_t *buf, int buflen) = 0;
+
       /* return the classic packet's LAP */
       virtual uint32_t get_LAP() = 0;
 
@@ -255,6 +273,13 @@ namespace gr {
       /* set the classic packet's NAP */
       virtual void set_NAP(uint16_t NAP) = 0;
 
+      /* number of payload header bytes: 0, 1, 2, or -1 for unknown */
+      virtual int get_payload_header_length() = 0;
+
+      /* LLID and flow fields of the payload header */
+      virtual uint8_t get_payload_llid() = 0;
+      virtual uint8_t get_payload_flow() = 0;
+
       /* return the classic_packet's clock (CLK1-27) */
       virtual uint32_t get_clock() = 0;
 
@@ -269,6 +294,19 @@ namespace gr {
       /* check to see if the classic packet has a header */
       virtual bool header_present() = 0;
 
+      /*
+       * Phase changes of the DPSK symbols after an EDR sync sequence,
+       * 256 units per turn.  Packet types with an EDR alias (2-DH1,
+       * 3-EV3, ...) are then decoded as EDR instead of basic rate.
+       */
+      virtual void set_edr_phases(const char *phases, int count) = 0;
+
+      /* payload rate in Mbps: 1 for basic rate, 2 or 3 for EDR */
+      virtual int get_rate() = 0;
+
+      /* soft symbols parallel to the stream the packet was made from */
+      virtual void set_soft_symbols(const int8_t *soft, int length) = 0;
+
       /* extract LAP from FHS payload */
       virtual uint32_t lap_from_fhs() = 0;
 
@@ -284,8 +322,9 @@ namespace gr {
       int get_channel( ) { return d_channel; }
     };
 
-#define LE_MAX_PDU_OCTETS 39
-#define LE_MAX_OCTETS     (1+4+LE_MAX_PDU_OCTETS+3)
+/* PDU after the 2 octet header: 255 for extended advertising, 251 on data channels */
+#define LE_MAX_PDU_OCTETS 255
+#define LE_MAX_OCTETS     (1+4+2+LE_MAX_PDU_OCTETS+3)
 #define LE_MAX_SYMBOLS    (8*LE_MAX_OCTETS)
 
     class GR_BLUETOOTH_API le_packet : virtual public packet
@@ -297,14 +336,67 @@ namespace gr {
 
       typedef boost::shared_ptr<le_packet> sptr;
 
-      static sptr make(char *stream, int length, double freq=0.0);
+      /* advertising channel PDU types */
+      enum {
+        ADV_IND         = 0,
+        ADV_DIRECT_IND  = 1,
+        ADV_NONCONN_IND = 2,
+        SCAN_REQ        = 3,
+        SCAN_RSP        = 4,
+        CONNECT_REQ     = 5,
+        ADV_SCAN_IND    = 6
+      };
+
+      /* longest data channel PDU, with data length extension */
+      static const unsigned MAX_DATA_PDU_OCTETS = 251;
+
+      /* data channel LLID of LL control PDUs */
+      static const int LLID_CONTROL = 3;
+
+      /* LE PHYs, numbered as in HCI */
+      enum {
+        PHY_1M    = 1,
+        PHY_2M    = 2,
+        PHY_CODED = 3
+      };
+
+      /* symbols of the LE Coded preamble and of FEC block 1 (AA, CI, TERM1 at S=8) */
+      static const int CODED_PREAMBLE_SYMBOLS = 80;
+      static const int CODED_BLOCK1_SYMBOLS   = 37 * 8;
+
+      /* CRCInit of the advertising channels */
+      static const uint32_t ADVERTISING_CRC_INIT = 0x555555;
+
+      /* lookup table for the CRC-24 shift register, one octet per step */
+      static const uint32_t CRC24_TABLE[256];
+
+      /*
+       * CRC-24 of header and PDU octets, as transmitted (first octet in
+       * the low bits).  crc_init is the CRCInit of the CONNECT_REQ.
+       */
+      static uint32_t crc24(uint32_t crc_init, const uint8_t *data, int length);
+
+      /* the CRCInit for which data has the given CRC, by running the LFSR backwards */
+      static uint32_t crc24_init(uint32_t crc, const uint8_t *data, int length);
+
+      /*
+       * stream holds the link layer symbols from the (last octet of
+       * the) preamble on, at one symbol per bit whatever the PHY.
+       */
+      static sptr make(char *stream, int length, double freq=0.0, int phy=PHY_1M);
       static int freq2chan(const double freq);
       static int chan2index(const int chan);
       static int freq2index(const double freq);
 
+      /* center frequency in Hz of a channel index (0-39) */
+      static double index2freq(const int index);
+
       /* whitening sequence indices */
       static const uint8_t INDICES[40];
 
+      /* whitening of the 16 header bits for each channel index, first bit in bit 0 */
+      static const uint16_t HEADER_WHITENING[40];
+
       /* lookup table for preamble hamming distance */
       static const uint8_t PREAMBLE_DISTANCE[512];
 
@@ -314,25 +406,76 @@ namespace gr {
       static const uint8_t ACCESS_ADDRESS_DISTANCE_2[256];
       static const uint8_t ACCESS_ADDRESS_DISTANCE_3[256];
 
-      /* lookup table for header hamming distances */
+      /*
+       * lookup table for header hamming distances, the MSB is the length:
+       * at least 6 octets on advertising channels, at most 251 on data
+       */
       static const uint8_t ACCESS_HEADER_DISTANCE_LSB[256];
       static const uint8_t ACCESS_HEADER_DISTANCE_MSB[256];
       static const uint8_t DATA_HEADER_DISTANCE_LSB[256];
       static const uint8_t DATA_HEADER_DISTANCE_MSB[256];
 
-      static int sniff_aa(char *stream, int stream_length, double freq);
+      /*
+       * Search for an LE packet starting in the first stream_length
+       * symbols; stream must hold 56 more symbols (preamble, AA and
+       * header) past that.  On data channels only the AAs in known_aa
+       * (sorted) are accepted, any AA if it is NULL.  Returns the
+       * offset of the first match, -1 if there is none.
+       */
+      static int sniff_aa(char *stream, int stream_length, double freq,
+                          const std::vector<uint32_t> *known_aa = NULL);
 
-      /* decode the packet header */
+      /*
+       * The same for LE 2M symbols, where the preamble is two octets.
+       * Returns the offset of the second preamble octet (where the
+       * packet looks like a 1M one), at least 8.
+       */
+      static int sniff_aa_2m(char *stream, int stream_length, double freq,
+                             const std::vector<uint32_t> *known_aa = NULL);
+
+      /*
+       * Search the 1M symbols for the start of an LE Coded preamble
+       * within the first stream_length symbols; stream must hold
+       * CODED_PREAMBLE_SYMBOLS more.  Returns -1 if there is none.
+       */
+      static int sniff_coded(char *stream, int stream_length);
+
+      /*
+       * FEC decode the LE Coded packet whose preamble starts at stream[0]
+       * into at most LE_MAX_SYMBOLS symbols laid out like an LE 1M
+       * packet for make().  Returns the number of symbols, 0 if FEC
+       * block 1 does not decode cleanly.  *coding is set to 2 or 8.
+       */
+      static int decode_coded(char *stream, int stream_length, char *out, int *coding);
+
+      /*
+       * De-whiten header, PDU and CRC and check them.  Returns false if
+       * the header is invalid, the packet runs past the symbols we have
+       * or the CRC fails.  On data channels the CRC is only checked once
+       * set_CRCInit() was called, see crc_checked().
+       */
       virtual bool decode_header() = 0;
        
-      /* decode the packet header */
+      /* make the PDU available as payload, after decode_header() */
       virtual void decode_payload() = 0;
+
+      /* CRCInit for the CRC check, advertising channels have their own */
+      virtual void set_CRCInit(uint32_t crc_init) = 0;
+
+      /* did decode_header() verify the CRC? */
+      virtual bool crc_checked() = 0;
+
+      /* CRCInit that would make this packet's CRC check, after decode_header() */
+      virtual uint32_t recover_CRCInit() = 0;
              
       /* print packet information */
       virtual void print() = 0;
        
       /* format payload for tun interface */
       virtual char *tun_format() = 0;
+
+      /* format packet as a LINKTYPE_BLUETOOTH_LE_LL record */
+      virtual int pcap_format(uint8_t *buf, int buflen) = 0;
        
       /* check to see if the packet has a header */
       virtual bool header_present() = 0;
@@ -341,6 +484,23 @@ namespace gr {
       virtual uint32_t get_AA() = 0;
 
       virtual int get_channel( ) = 0;
+
+      /* channel index (0-39), 37-39 are advertising channels */
+      virtual int get_index() = 0;
+
+      /* advertising channel header: PDU type and ChSel (channel selection algorithm #2) */
+      virtual int get_PDU_type() = 0;
+      virtual bool get_ChSel() = 0;
+
+      /* data channel header: LLID */
+      virtual int get_LLID() = 0;
+
+      /* PDU payload following the header, get_PDU_length() octets */
+      virtual unsigned get_PDU_length() = 0;
+      virtual const uint8_t *get_pdu() = 0;
+
+      /* PHY the packet was received on, PHY_1M, PHY_2M or PHY_CODED */
+      virtual int get_PHY() = 0;
     };
 
   } // namespace bluetooth
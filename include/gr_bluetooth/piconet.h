@@ -139,19 +139,76 @@ namespace gr {
        */
       static sptr make(const uint32_t aa);
 
+      /* access address of the advertising channels */
+      static const uint32_t ADVERTISING_AA = 0x8e89bed6;
+
+      /* number of data channels */
+      static const int DATA_CHANNELS = 37;
+
+      /*
+       * Follow the connection set up by a CONNECT_REQ packet received
+       * at timestamp_us.  Returns false if the packet is not a
+       * CONNECT_REQ or its parameters are out of range.
+       */
+      virtual bool follow(le_packet::sptr connect_req, uint64_t timestamp_us) = 0;
+
+      /* connection parameters, valid once following */
+      virtual bool following() = 0;
+      virtual uint32_t get_AA() = 0;
+      virtual uint32_t get_CRCInit() = 0;
+      virtual uint32_t get_interval_us() = 0;
+      virtual uint8_t get_hop_increment() = 0;
+      virtual uint64_t get_channel_map() = 0;
+      virtual bool csa2() = 0;
+
+      /*
+       * CRCInit of a connection whose CONNECT_REQ was missed, recovered
+       * from its data channel packets.  Such a connection is not
+       * followed, but its packets can be CRC checked.
+       */
+      virtual void set_CRCInit(uint32_t crc_init) = 0;
+
+      /* connection event with the anchor point nearest timestamp_us, -1 if none */
+      virtual int event(uint64_t timestamp_us) = 0;
+
+      /* expected anchor point of a connection event */
+      virtual uint64_t anchor(int counter) = 0;
+
+      /*
+       * Data channel indices (bit n for index n) of the connection
+       * events that may take place between start_us and end_us, allowing
+       * for the uncertainty of the anchor points.
+       */
+      virtual uint64_t channels(uint64_t start_us, uint64_t end_us) = 0;
+
+      /*
+       * A packet of the connection was received at timestamp_us:
+       * resynchronize the anchor points and pick up channel map and
+       * connection parameter updates.  Returns the connection event
+       * counter, -1 if not following (the packet still counts as a sign
+       * of life for expired()).
+       */
+      virtual int observe(le_packet::sptr pkt, uint64_t timestamp_us) = 0;
+
+      /*
+       * true if nothing was heard for longer than the supervision
+       * timeout (the longest one allowed if it is not known) or the
+       * connection was terminated
+       */
+      virtual bool expired(uint64_t timestamp_us) = 0;
+
       // -------------------------------------------------------------------
 
-      /* initialize the hop reversal process */
-      /* returns number of initial candidates for CLK1-27 */
+      /* returns 1 if the hopping parameters are known, 0 otherwise */
       virtual int init_hop_reversal(bool aliased) = 0;
 
-      /* look up channel for a particular hop */
+      /* data channel index (0-36) of connection event counter clock */
       virtual char hop(int clock) = 0;
 
-      /* return the observable channel (26-50) for a given channel (0-78) */
+      /* return the observable classic channel (26-50) for a data channel index (0-36) */
       virtual char aliased_channel(char channel) = 0;
 
-      /* reset alignment discovery */
+      /* stop following the connection */
       virtual void reset() = 0;
     };
 
@@ -0,0 +1,74 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann                                                                                            
+ * Copyright 2007 Dominic Spill                                                                                                                   
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ * 
+ * This file is part of gr-bluetooth
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_GR_BLUETOOTH_SIGMF_SINK_H
+#define INCLUDED_GR_BLUETOOTH_SIGMF_SINK_H
+
+#include <gr_bluetooth/api.h>
+#include <gnuradio/block.h>
+#include <stdint.h>
+#include <string>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*!
+     * \brief Write decoded packets as SigMF annotations.
+     * \ingroup bluetooth
+     *
+     * Connect the "packets" message port of a multi_sniffer or
+     * multi_hopper to this block's "packets" input.  Each packet
+     * becomes an annotation at its "sample" offset plus sample_offset
+     * (the index of the first sample the sniffer saw, when playback did
+     * not start at the beginning of the recording), covering its slots
+     * and channel.  When the flowgraph stops, meta_file is written with
+     * the given recording parameters, one capture segment and the
+     * annotations sorted by sample.  input_format is the multi block
+     * format of the recording, "cf32", "sc16" or "sc8".
+     */
+    class GR_BLUETOOTH_API sigmf_sink : virtual public gr::block
+    {
+    public:
+      typedef boost::shared_ptr<sigmf_sink> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of gr::bluetooth::sigmf_sink.
+       *
+       * To avoid accidental use of raw pointers, gr::bluetooth::sigmf_sink's
+       * constructor is in a private implementation
+       * class. gr::bluetooth::sigmf_sink::make is the public interface for
+       * creating new instances.
+       */
+      static sptr make(const std::string &meta_file, double sample_rate, double center_freq,
+                       const std::string &input_format = "cf32", uint64_t sample_offset = 0);
+
+      /*! \brief Number of annotations collected so far. */
+      virtual uint64_t annotations() = 0;
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_GR_BLUETOOTH_SIGMF_SINK_H */
@@ -0,0 +1,86 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann                                                                                            
+ * Copyright 2007 Dominic Spill                                                                                                                   
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ * 
+ * This file is part of gr-bluetooth
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_GR_BLUETOOTH_SIGMF_SOURCE_H
+#define INCLUDED_GR_BLUETOOTH_SIGMF_SOURCE_H
+
+#include <gr_bluetooth/api.h>
+#include <gnuradio/sync_block.h>
+#include <stdint.h>
+#include <string>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*!
+     * \brief Play back a SigMF recording.
+     * \ingroup bluetooth
+     *
+     * path is the .sigmf-meta or .sigmf-data file, or their common
+     * base name.  The data file is memory mapped and its samples are
+     * produced unconverted: cf32_le, ci16_le and ci8 recordings give
+     * items of the multi block input formats "cf32", "sc16" and "sc8",
+     * see input_format().  Playback starts at sample index start and
+     * ends after nsamples samples, 0 for the end of the file.
+     */
+    class GR_BLUETOOTH_API sigmf_source : virtual public gr::sync_block
+    {
+    public:
+      typedef boost::shared_ptr<sigmf_source> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of gr::bluetooth::sigmf_source.
+       *
+       * To avoid accidental use of raw pointers, gr::bluetooth::sigmf_source's
+       * constructor is in a private implementation
+       * class. gr::bluetooth::sigmf_source::make is the public interface for
+       * creating new instances.
+       */
+      static sptr make(const std::string &path, uint64_t start = 0, uint64_t nsamples = 0);
+
+      /*!
+       * \brief Recording parameters from the metadata, to configure
+       * the multi blocks with.
+       */
+      virtual double sample_rate() = 0;
+      virtual double center_freq() = 0;
+      virtual std::string input_format() = 0;
+
+      /*! \brief Number of samples in the data file. */
+      virtual uint64_t size() = 0;
+
+      /*!
+       * \brief Continue playback at the given sample index, playing
+       * nsamples from there as before.  Only while the flowgraph is
+       * stopped: the blocks downstream count samples from the items
+       * they get, so throws std::runtime_error while it runs.
+       */
+      virtual void seek(uint64_t sample) = 0;
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_GR_BLUETOOTH_SIGMF_SOURCE_H */
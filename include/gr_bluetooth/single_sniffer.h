@@ -31,9 +31,11 @@ namespace gr {
 namespace bluetooth {
 
     /*!
-     * \brief <+description of block+>
+     * \brief Demodulate and sniff classic packets on a single channel.
      * \ingroup bluetooth
      *
+     * Decoded packets are published as PDUs on the "packets" message
+     * port, see lib/packet_pdu.h for the metadata keys.
      */
     class GR_BLUETOOTH_API single_sniffer : virtual public gr::hier_block2
     {
@@ -49,6 +51,19 @@ namespace bluetooth {
              * creating new instances.
              */
             static sptr make(double sample_rate, double center_freq);
+
+            /*!
+             * \brief Counters for benchmarking.
+             *
+             * Time slots processed on a classic channel (0-78), access
+             * codes found, packets with a decoded payload, and channel
+             * slots skipped over a slot budget, which is always 0 as a
+             * single channel has no budget to keep.
+             */
+            virtual uint64_t channel_slots(int channel) = 0;
+            virtual uint64_t packets_detected() = 0;
+            virtual uint64_t packets_decoded() = 0;
+            virtual uint64_t skipped_channel_slots() = 0;
     };
 
 } // namespace bluetooth
@@ -0,0 +1,85 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann                                                                                            
+ * Copyright 2007 Dominic Spill                                                                                                                   
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ * 
+ * This file is part of gr-bluetooth
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_GR_BLUETOOTH_SYNTH_SOURCE_H
+#define INCLUDED_GR_BLUETOOTH_SYNTH_SOURCE_H
+
+#include <gr_bluetooth/api.h>
+#include <gnuradio/sync_block.h>
+#include <stdint.h>
+#include <string>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*!
+     * \brief Synthesize GFSK modulated Bluetooth packets.
+     * \ingroup bluetooth
+     *
+     * Produces complex baseband at any sample rate and center frequency
+     * that a multi_sniffer or multi_hopper can consume.  The master of
+     * the piconet LAP/UAP transmits in its even slots starting at CLK1-27
+     * clock, cycling through the comma separated packet types (ID, NULL,
+     * POLL, FHS, DM1, DH1, DM3, DH3, DM5, DH5, EV3, EV4, EV5, ADV_IND,
+     * ADV_DIRECT_IND, ADV_NONCONN_IND, SCAN_RSP, ADV_SCAN_IND).  Classic
+     * packets follow the real hopping sequence if channel is -1, else
+     * stay on that channel; LE advertising PDUs rotate through channels
+     * 37-39.  Packets outside the sampled band are skipped silently.
+     *
+     * density is the probability that a free master slot carries a
+     * packet, snr is the signal to noise ratio in dB within a 1 MHz
+     * channel and freq_offset a carrier offset in Hz applied to every
+     * packet.  The same seed always produces the same samples; seed 0
+     * picks a time based one.
+     */
+    class GR_BLUETOOTH_API synth_source : virtual public gr::sync_block
+    {
+    public:
+      typedef boost::shared_ptr<synth_source> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of gr::bluetooth::synth_source.
+       *
+       * To avoid accidental use of raw pointers, gr::bluetooth::synth_source's
+       * constructor is in a private implementation
+       * class. gr::bluetooth::synth_source::make is the public interface for
+       * creating new instances.
+       */
+      static sptr make(double sample_rate, double center_freq, int LAP, int UAP,
+                       int clock, const std::string &types = "DM1", int channel = -1,
+                       double density = 1.0, double snr = 30.0,
+                       double freq_offset = 0.0, int seed = 1);
+
+      /*!
+       * \brief Number of packets transmitted so far, including those
+       * outside the sampled band.
+       */
+      virtual uint64_t packets() = 0;
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_GR_BLUETOOTH_SYNTH_SOURCE_H */
@@ -0,0 +1,554 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Micro-benchmarks for the decode hot paths.  Every benchmark runs on
+ * fixed synthetic input so results are comparable between builds:
+ *
+ *   bench_bluetooth --benchmark_out=results.json --benchmark_out_format=json
+ *
+ * The decoder reports progress with printf(), so stdout is discarded
+ * and the benchmark report goes to stderr (or --benchmark_out).
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gr_bluetooth/channelizer.h"
+#include "bench_hooks.h"
+#include <benchmark/benchmark.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace gr::bluetooth;
+
+namespace {
+
+  const uint32_t LAP = 0x9e8b33;
+  const uint8_t  UAP = 0x47;
+
+  /* five slots, room for the longest packet */
+  const int    SLOT_SYMBOLS = 3125;
+
+  const double SAMPLE_RATE  = 4e6;
+  const double CENTER_FREQ  = 2441e6;
+
+  /* one bit per char, fixed seed */
+  std::vector<char> random_symbols(size_t n, unsigned seed)
+  {
+    std::mt19937 gen(seed);
+    std::vector<char> symbols(n);
+
+    for (size_t i = 0; i < n; i++)
+      symbols[i] = gen() & 1;
+    return symbols;
+  }
+
+  /* the 72 symbol access code (with trailer) for a LAP */
+  std::vector<char> access_code(uint32_t lap)
+  {
+    uint8_t *ac = classic_packet::acgen(lap);
+    std::vector<uint8_t> grdata(72);
+    int i;
+
+    for (i = 0; i < 9; i++)
+      packet::convert_to_grformat(ac[i], &grdata[i*8]);
+    free(ac);
+    return std::vector<char>(grdata.begin(), grdata.end());
+  }
+
+  /* 2-FSK at 1 Msym/s with 250 kHz deviation, offset from the center */
+  std::vector<gr_complex> fsk_samples(const std::vector<char> &symbols,
+                                      double sample_rate, double offset)
+  {
+    int sps = (int) (sample_rate / 1e6);
+    std::vector<gr_complex> samples(symbols.size() * sps);
+    double phase = 0.0;
+    size_t i;
+
+    for (i = 0; i < samples.size(); i++) {
+      double dev = symbols[i / sps] ? 250e3 : -250e3;
+      phase += 2.0 * M_PI * (offset + dev) / sample_rate;
+      samples[i] = gr_complex(cos(phase), sin(phase));
+    }
+    return samples;
+  }
+
+  /*
+   * Channel samples of a GFSK header followed by the EDR guard time,
+   * sync sequence and n random pi/4-DQPSK symbols, at sps samples per
+   * symbol.  With n < 0 the GFSK just goes on instead.
+   */
+  std::vector<gr_complex> edr_samples(int n, int sps)
+  {
+    static const double SYNC[10] = {
+      3 * M_PI_4, -3 * M_PI_4, 3 * M_PI_4, -3 * M_PI_4, 3 * M_PI_4,
+      -3 * M_PI_4, -M_PI_4, 3 * M_PI_4, 3 * M_PI_4, M_PI_4
+    };
+    int gfsk = (n < 0) ? 126 + 16 - n : 126;
+    std::vector<char> bits = random_symbols(gfsk + ((n < 0) ? 0 : 2 * n), 6);
+    std::vector<double> phases;
+    double phase = 0.0;
+    int i;
+
+    for (i = 0; i < gfsk; i++) {
+      phase += bits[i] ? 0.32 * M_PI : -0.32 * M_PI;
+      phases.push_back(phase);
+    }
+    if (n >= 0) {
+      /* guard and reference symbol */
+      for (i = 0; i < 6; i++)
+        phases.push_back(phase);
+      for (i = 0; i < 10; i++) {
+        phase += SYNC[i];
+        phases.push_back(phase);
+      }
+      for (i = 0; i < n; i++) {
+        phase += M_PI_4 + M_PI_2 * (2 * bits[gfsk + 2*i] + bits[gfsk + 2*i + 1]);
+        phases.push_back(phase);
+      }
+    }
+
+    std::vector<gr_complex> samples(phases.size() * sps);
+    for (i = 0; i < (int) samples.size(); i++)
+      samples[i] = std::polar(1.0f, (float) phases[i / sps]);
+    return samples;
+  }
+
+  /* exposes the channelizer stages multi_block runs */
+  class bench_block : public channelizer
+  {
+  public:
+    bench_block(double sample_rate, double center_freq,
+                sample_format_t format = FORMAT_CF32)
+      : channelizer(sample_rate, center_freq, 0.0, format)
+    {
+    }
+
+    using channelizer::demod;
+    using channelizer::mm_cr;
+    using channelizer::slicer;
+    using channelizer::channel_samples;
+    using channelizer::edr_phases;
+    using channelizer::channel_abs_freq;
+    using channelizer::d_input_history;
+    using channelizer::d_samples_per_slot;
+    using channelizer::d_ddc_decimation_rate;
+  };
+
+  /* a piconet part way through hop reversal, see bench_hooks */
+  class bench_piconet
+  {
+  public:
+    basic_rate_piconet::sptr d_pn;
+    std::vector<uint32_t> d_saved_candidates;
+
+    bench_piconet(uint32_t lap, uint8_t uap)
+      : d_pn(basic_rate_piconet::make(lap))
+    {
+      d_pn->set_UAP(uap);
+      d_saved_candidates = bench_hooks::start_reversal(d_pn);
+    }
+
+    void restore_candidates()
+    {
+      bench_hooks::restore_candidates(d_pn, d_saved_candidates);
+    }
+
+    /* channel the first candidate would be on after offset hops */
+    char channel_at(int offset)
+    {
+      return bench_hooks::hop_channel(d_pn, d_saved_candidates[0] + offset);
+    }
+  };
+
+  /* a slot of classic symbols with an access code at the given index */
+  std::vector<char> classic_slot(int ac_index)
+  {
+    std::vector<char> symbols = random_symbols(SLOT_SYMBOLS, 1);
+
+    if (ac_index >= 0) {
+      std::vector<char> ac = access_code(LAP);
+      std::copy(ac.begin(), ac.end(), symbols.begin() + ac_index);
+    }
+    return symbols;
+  }
+
+} // namespace
+
+// ---------------------------------------------------------------------
+// channelizer signal chain
+// ---------------------------------------------------------------------
+
+static void BM_demod(benchmark::State &state)
+{
+  boost::shared_ptr<bench_block> blk =
+    boost::shared_ptr<bench_block>(new bench_block(SAMPLE_RATE, CENTER_FREQ));
+  int n = state.range(0);
+  std::vector<gr_complex> in = fsk_samples(random_symbols(n, 2), 2e6, 0.0);
+  std::vector<float> out(in.size());
+
+  for (auto _ : state) {
+    blk->demod(&in[0], &out[0], in.size());
+    benchmark::DoNotOptimize(&out[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * in.size());
+}
+BENCHMARK(BM_demod)->Arg(625)->Arg(3125);
+
+static void BM_mm_cr(benchmark::State &state)
+{
+  boost::shared_ptr<bench_block> blk =
+    boost::shared_ptr<bench_block>(new bench_block(SAMPLE_RATE, CENTER_FREQ));
+  int n = state.range(0);
+  std::vector<gr_complex> iq = fsk_samples(random_symbols(n, 3), 2e6, 0.0);
+  std::vector<float> in(iq.size()), out(iq.size());
+
+  blk->demod(&iq[0], &in[0], iq.size());
+  for (auto _ : state) {
+    int produced = blk->mm_cr(&in[0], in.size(), &out[0], out.size());
+    benchmark::DoNotOptimize(produced);
+  }
+  state.SetItemsProcessed(state.iterations() * in.size());
+}
+BENCHMARK(BM_mm_cr)->Arg(625)->Arg(3125);
+
+static void BM_slicer(benchmark::State &state)
+{
+  boost::shared_ptr<bench_block> blk =
+    boost::shared_ptr<bench_block>(new bench_block(SAMPLE_RATE, CENTER_FREQ));
+  int n = state.range(0);
+  std::mt19937 gen(4);
+  std::vector<float> in(n);
+  std::vector<char> out(n);
+
+  for (int i = 0; i < n; i++)
+    in[i] = (gen() & 1) ? 1.0f : -1.0f;
+  for (auto _ : state) {
+    blk->slicer(&in[0], &out[0], n);
+    benchmark::DoNotOptimize(&out[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_slicer)->Arg(625)->Arg(3125);
+
+/*
+ * One slot of wideband input through one channel's DDC.  range(0) is
+ * the input format: cf32 goes through freq_xlating_fir_filter_ccf, sc16
+ * and sc8 through xlating_ddc with the conversion done in place.  For
+ * cf32 the separate conversion block is not counted.
+ */
+static void BM_channel_samples(benchmark::State &state)
+{
+  channelizer::sample_format_t format = (channelizer::sample_format_t) state.range(0);
+  boost::shared_ptr<bench_block> blk =
+    boost::shared_ptr<bench_block>(new bench_block(SAMPLE_RATE, CENTER_FREQ, format));
+  int ninput = blk->d_input_history + (int) blk->d_samples_per_slot;
+  int nsymbols = (int) (ninput / (SAMPLE_RATE / 1e6)) + 1;
+  std::vector<gr_complex> in = fsk_samples(random_symbols(nsymbols, 5), SAMPLE_RATE, 0.0);
+  std::vector<int16_t> in16(2 * in.size());
+  std::vector<int8_t> in8(2 * in.size());
+  for (size_t i = 0; i < in.size(); i++) {
+    in16[2*i]   = (int16_t) lrintf(in[i].real() * 16000);
+    in16[2*i+1] = (int16_t) lrintf(in[i].imag() * 16000);
+    in8[2*i]    = (int8_t) lrintf(in[i].real() * 100);
+    in8[2*i+1]  = (int8_t) lrintf(in[i].imag() * 100);
+  }
+  std::vector<gr_complex> out(ninput);
+  gr_vector_const_void_star inv(1);
+  gr_vector_void_star outv(1);
+  double energy;
+
+  if (format == channelizer::FORMAT_SC16)
+    inv[0] = &in16[0];
+  else if (format == channelizer::FORMAT_SC8)
+    inv[0] = &in8[0];
+  else
+    inv[0] = &in[0];
+  outv[0] = &out[0];
+  for (auto _ : state) {
+    int produced = blk->channel_samples(CENTER_FREQ, inv, outv, energy, ninput);
+    benchmark::DoNotOptimize(produced);
+  }
+  state.SetItemsProcessed(state.iterations() * (int64_t) blk->d_samples_per_slot);
+}
+BENCHMARK(BM_channel_samples)
+  ->Arg(channelizer::FORMAT_CF32)
+  ->Arg(channelizer::FORMAT_SC16)
+  ->Arg(channelizer::FORMAT_SC8);
+
+/* range(0) is the number of EDR payload symbols, -1 for a GFSK packet */
+static void BM_edr_phases(benchmark::State &state)
+{
+  boost::shared_ptr<bench_block> blk =
+    boost::shared_ptr<bench_block>(new bench_block(SAMPLE_RATE, CENTER_FREQ));
+  int sps = (int) (SAMPLE_RATE / 1e6) / blk->d_ddc_decimation_rate;
+  std::vector<gr_complex> in = edr_samples(state.range(0), sps);
+  std::vector<char> out(in.size());
+  /* center of the last header symbol */
+  float header_end = 125 * sps + sps / 2;
+
+  for (auto _ : state) {
+    int produced = blk->edr_phases(&in[0], in.size(), header_end, &out[0], out.size());
+    benchmark::DoNotOptimize(produced);
+  }
+  state.SetItemsProcessed(state.iterations() * std::max((int) state.range(0), 1));
+}
+BENCHMARK(BM_edr_phases)->Arg(-1)->Arg(2732);
+
+// ---------------------------------------------------------------------
+// classic packet
+// ---------------------------------------------------------------------
+
+/* range(0) is the access code position, -1 for a slot of noise */
+static void BM_sniff_ac(benchmark::State &state)
+{
+  std::vector<char> symbols = classic_slot(state.range(0));
+  int limit = 625;
+
+  for (auto _ : state) {
+    int index = classic_packet::sniff_ac(&symbols[0], limit);
+    benchmark::DoNotOptimize(index);
+  }
+  state.SetItemsProcessed(state.iterations() * limit);
+}
+BENCHMARK(BM_sniff_ac)->Arg(-1)->Arg(300);
+
+static void BM_check_ac(benchmark::State &state)
+{
+  std::vector<char> symbols = access_code(LAP);
+
+  for (auto _ : state) {
+    bool match = classic_packet::check_ac(&symbols[0], LAP);
+    benchmark::DoNotOptimize(match);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_check_ac);
+
+static void BM_unfec13(benchmark::State &state)
+{
+  int n = state.range(0);
+  std::vector<char> bits = random_symbols(n, 6);
+  std::vector<char> in(3 * n), out(n);
+
+  for (int i = 0; i < n; i++)
+    in[3*i] = in[3*i + 1] = in[3*i + 2] = bits[i];
+  for (auto _ : state) {
+    bool ok = classic_packet::unfec13(&in[0], &out[0], n);
+    benchmark::DoNotOptimize(ok);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_unfec13)->Arg(18)->Arg(240);
+
+static void BM_unfec23(benchmark::State &state)
+{
+  int n = state.range(0);
+  /* all zeros is a valid codeword, so the whole input gets decoded */
+  std::vector<char> in(n, 0);
+
+  for (auto _ : state) {
+    char *out = classic_packet::unfec23(&in[0], n);
+    benchmark::DoNotOptimize(out);
+    free(out);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_unfec23)->Arg(150)->Arg(2745);
+
+/* every block has two weak errors, which only soft decoding corrects */
+static void BM_unfec23_soft(benchmark::State &state)
+{
+  int n = state.range(0);
+  int nsymbols = (n + 9) / 10 * 15;
+  std::vector<char> in(nsymbols, 0);
+  std::vector<int8_t> soft(nsymbols, -classic_packet::SOFT_NOMINAL);
+
+  for (int i = 0; i < nsymbols; i += 15) {
+    in[i + 2] = in[i + 9] = 1;
+    soft[i + 2] = soft[i + 9] = 4;
+  }
+  for (auto _ : state) {
+    char *out = classic_packet::unfec23(&in[0], n, &soft[0]);
+    benchmark::DoNotOptimize(out);
+    free(out);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_unfec23_soft)->Arg(150)->Arg(2745);
+
+static void BM_crcgen(benchmark::State &state)
+{
+  int n = state.range(0);
+  std::vector<char> payload = random_symbols(n, 8);
+
+  for (auto _ : state) {
+    uint16_t crc = classic_packet::crcgen(&payload[0], n, UAP);
+    benchmark::DoNotOptimize(crc);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_crcgen)->Arg(8 * 27)->Arg(8 * 339);
+
+static void BM_unwhiten(benchmark::State &state)
+{
+  int n = state.range(0);
+  std::vector<char> symbols = classic_slot(0);
+  std::vector<char> out(n);
+  classic_packet::sptr pkt = classic_packet::make(&symbols[0], symbols.size(), 0, 2441e6);
+  int clock = 0;
+
+  for (auto _ : state) {
+    bench_hooks::unwhiten(pkt, &symbols[72], &out[0], clock++ & 0x3f, n, 0);
+    benchmark::DoNotOptimize(&out[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_unwhiten)->Arg(18)->Arg(2745);
+
+// ---------------------------------------------------------------------
+// basic rate piconet
+// ---------------------------------------------------------------------
+
+/* first packet of a discovery attempt: all 64 CLK1-6 candidates tried */
+static void BM_UAP_from_header(benchmark::State &state)
+{
+  std::vector<char> symbols = classic_slot(0);
+  classic_packet::sptr pkt =
+    classic_packet::make(&symbols[0], symbols.size(), 0, 2441e6);
+  basic_rate_piconet::sptr pn = basic_rate_piconet::make(LAP);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    pn->reset();
+    state.ResumeTiming();
+    bool found = pn->UAP_from_header(pkt);
+    benchmark::DoNotOptimize(found);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UAP_from_header);
+
+/* the full 2^27 hop sequence */
+static void BM_gen_hops(benchmark::State &state)
+{
+  bench_piconet pn(LAP, UAP);
+
+  for (auto _ : state)
+    bench_hooks::gen_hops(pn.d_pn);
+  state.SetItemsProcessed(state.iterations() * (int64_t) basic_rate_piconet::SEQUENCE_LENGTH);
+}
+BENCHMARK(BM_gen_hops)->Unit(benchmark::kMillisecond)->Iterations(3);
+
+/* one observed hop against the initial candidate list */
+static void BM_winnow(benchmark::State &state)
+{
+  bench_piconet pn(LAP, UAP);
+  int offset = 1;
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    pn.restore_candidates();
+    char channel = pn.channel_at(offset);
+    state.ResumeTiming();
+    int remaining = pn.d_pn->winnow(offset, channel);
+    benchmark::DoNotOptimize(remaining);
+  }
+  state.SetItemsProcessed(state.iterations() * pn.d_saved_candidates.size());
+}
+BENCHMARK(BM_winnow)->Unit(benchmark::kMicrosecond);
+
+// ---------------------------------------------------------------------
+// LE packet
+// ---------------------------------------------------------------------
+
+/* a slot of noise, the common case on a busy band */
+static void BM_sniff_aa(benchmark::State &state)
+{
+  std::vector<char> symbols = random_symbols(LE_MAX_SYMBOLS + 700, 9);
+  int limit = 625;
+
+  for (auto _ : state) {
+    int index = le_packet::sniff_aa(&symbols[0], limit, 2402e6);
+    benchmark::DoNotOptimize(index);
+  }
+  state.SetItemsProcessed(state.iterations() * limit);
+}
+BENCHMARK(BM_sniff_aa);
+
+/* CRC of a header and PDU, the check every LE packet now has to pass */
+static void BM_le_crc24(benchmark::State &state)
+{
+  int n = state.range(0);
+  std::vector<uint8_t> octets(n);
+  std::mt19937 gen(10);
+  for (int i = 0; i < n; i++)
+    octets[i] = gen() & 0xff;
+
+  for (auto _ : state) {
+    uint32_t crc = le_packet::crc24(le_packet::ADVERTISING_CRC_INIT, &octets[0], n);
+    benchmark::DoNotOptimize(crc);
+  }
+  state.SetBytesProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_le_crc24)->Arg(2 + 6)->Arg(2 + 37)->Arg(2 + 255);
+
+/* a false LE Coded preamble match: FEC block 1 is Viterbi decoded and rejected */
+static void BM_decode_coded(benchmark::State &state)
+{
+  std::vector<char> symbols = random_symbols(SLOT_SYMBOLS, 11);
+  char out[LE_MAX_SYMBOLS];
+  int coding;
+
+  for (auto _ : state) {
+    int n = le_packet::decode_coded(&symbols[0], symbols.size(), out, &coding);
+    benchmark::DoNotOptimize(n);
+  }
+}
+BENCHMARK(BM_decode_coded);
+
+int main(int argc, char **argv)
+{
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+
+  /* keep the decoder's printf() chatter out of the report */
+  if (!freopen("/dev/null", "w", stdout))
+    perror("freopen");
+
+  benchmark::ConsoleReporter reporter;
+  reporter.SetOutputStream(&std::cerr);
+  reporter.SetErrorStream(&std::cerr);
+  benchmark::RunSpecifiedBenchmarks(&reporter);
+  return 0;
+}
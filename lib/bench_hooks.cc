@@ -0,0 +1,90 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bench_hooks.h"
+#include "packet_impl.h"
+#include "piconet_impl.h"
+#include <string.h>
+
+namespace gr {
+  namespace bluetooth {
+
+    static basic_rate_piconet_impl *
+    piconet_impl(basic_rate_piconet::sptr pn)
+    {
+      return dynamic_cast<basic_rate_piconet_impl *>(pn.get());
+    }
+
+    void
+    bench_hooks::unwhiten(classic_packet::sptr pkt, char *input, char *output,
+                          int clock, int length, int skip)
+    {
+      dynamic_cast<classic_packet_impl *>(pkt.get())->unwhiten(input, output, clock,
+                                                               length, skip);
+    }
+
+    void
+    bench_hooks::gen_hops(basic_rate_piconet::sptr pn)
+    {
+      piconet_impl(pn)->gen_hops();
+    }
+
+    std::vector<uint32_t>
+    bench_hooks::start_reversal(basic_rate_piconet::sptr pn)
+    {
+      basic_rate_piconet_impl *impl = piconet_impl(pn);
+
+      impl->d_first_pkt_time = 0;
+      impl->d_clk_offset = 0;
+      impl->d_pattern_channels[0] = 0;
+      impl->init_hop_reversal(false);
+      return std::vector<uint32_t>(impl->d_clock_candidates,
+                                   impl->d_clock_candidates + impl->d_num_candidates);
+    }
+
+    void
+    bench_hooks::restore_candidates(basic_rate_piconet::sptr pn,
+                                    const std::vector<uint32_t> &candidates)
+    {
+      basic_rate_piconet_impl *impl = piconet_impl(pn);
+
+      memcpy(impl->d_clock_candidates, &candidates[0],
+             candidates.size() * sizeof(uint32_t));
+      impl->d_num_candidates = candidates.size();
+      impl->d_have_clk27 = false;
+    }
+
+    char
+    bench_hooks::hop_channel(basic_rate_piconet::sptr pn, uint32_t index)
+    {
+      return piconet_impl(pn)->d_sequence[index % basic_rate_piconet::SEQUENCE_LENGTH];
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
@@ -0,0 +1,71 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_BENCH_HOOKS_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_BENCH_HOOKS_H
+
+#include "gr_bluetooth/api.h"
+#include "gr_bluetooth/packet.h"
+#include "gr_bluetooth/piconet.h"
+#include <stdint.h>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * The impl class internals bench_bluetooth times.  The library is
+     * built with hidden visibility and the impl classes stay private,
+     * so the benchmark links against the library and reaches them
+     * through these exported friends.  Not an installed header.
+     */
+    class GR_BLUETOOTH_API bench_hooks
+    {
+    public:
+      /* classic_packet_impl::unwhiten() */
+      static void unwhiten(classic_packet::sptr pkt, char *input, char *output,
+                           int clock, int length, int skip);
+
+      /* basic_rate_piconet_impl::gen_hops() */
+      static void gen_hops(basic_rate_piconet::sptr pn);
+
+      /*
+       * Start a hop reversal as for a first packet at CLK 0 on channel
+       * 0, returns the initial CLK1-27 candidates
+       */
+      static std::vector<uint32_t> start_reversal(basic_rate_piconet::sptr pn);
+
+      /* put the candidates to winnow back, CLK1-27 unknown again */
+      static void restore_candidates(basic_rate_piconet::sptr pn,
+                                     const std::vector<uint32_t> &candidates);
+
+      /* channel of the hop sequence at index, see start_reversal() */
+      static char hop_channel(basic_rate_piconet::sptr pn, uint32_t index);
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_BENCH_HOOKS_H */
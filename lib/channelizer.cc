@@ -0,0 +1,841 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gr_bluetooth/channelizer.h"
+#include "gr_bluetooth/packet.h"
+#include "stage_stats.h"
+#include "xlating_ddc.h"
+#include <gnuradio/filter/firdes.h>
+#include <gnuradio/math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace gr {
+  namespace bluetooth {
+
+    channelizer::channelizer(double sample_rate, double center_freq, double squelch_threshold,
+                             sample_format_t input_format)
+    {
+      d_target_snr = squelch_threshold;
+      d_input_format = input_format;
+
+      d_cumulative_count = 0;
+      d_channel_slots.assign(79, 0);
+      d_noise_floor.assign(79, 0.0);
+      d_last_active.assign(79, 0);
+
+      d_stats = stage_stats::make();
+      d_sample_rate = sample_rate;
+      d_center_freq = center_freq;
+
+      /*
+       * how many time slots we attempt to decode on each hop:
+       * 1 for now, could be as many as 5 plus a little slop
+       */
+      int slots = 1;
+      d_samples_per_symbol = sample_rate / SYMBOL_RATE;
+      //FIXME make sure that d_samples_per_symbol >= 2 (requirement of clock_recovery_mm_ff)
+      d_samples_per_slot = (int) (SYMBOLS_PER_BASIC_RATE_SLOT * d_samples_per_symbol);
+      int history_required = (int) (slots * d_samples_per_slot);
+
+      /* channel filter coefficients */
+      double gain = 1;
+      d_channel_filter_width = 500000;
+      double transition_width = 300000;
+      d_channel_filter = gr::filter::firdes::low_pass( gain, 
+                                              sample_rate, 
+                                              d_channel_filter_width, 
+                                              transition_width, 
+                                              gr::filter::firdes::WIN_HANN);
+
+      /* we will decimate by the largest integer that results in enough samples per symbol */
+      d_ddc_decimation_rate = (int) (d_samples_per_symbol / 2);
+      double channel_samples_per_symbol = (d_samples_per_symbol / d_ddc_decimation_rate);
+
+      /* fm demodulator */
+      d_demod_gain = channel_samples_per_symbol / M_PI_2;
+
+      /* mm_cr variables */
+      d_cr.init(channel_samples_per_symbol);
+      d_interp = new gr::filter::mmse_fir_interpolator_ff();
+
+      /* LE 2M and Coded PHYs are off until asked for */
+      d_le_2m = false;
+      d_le_2m_decimation_rate = 0;
+      d_le_2m_demod_gain = 0;
+      d_le_coded = false;
+
+      /* all channels in the band, until masked or retuned */
+      d_channel_mask.assign(79, true);
+      set_channels();
+
+      /*
+       * Soft symbols are off until asked for.  With the demodulator gain
+       * above, a symbol at the nominal deviation (h = 0.32) comes out of
+       * clock recovery at 2h.
+       */
+      d_soft_symbols = false;
+      d_soft_scale = classic_packet::SOFT_NOMINAL / 0.64F;
+      
+      /* the required history is the slot data + channel DDC + demod */
+      set_input_history( history_required + channel_history() );
+      d_first_channel_sample = 0;
+    }
+
+    channelizer::~channelizer()
+    {
+      delete d_interp;
+    }
+
+    /* input samples the channel DDC and the demodulator need beyond the symbols */
+    int
+    channelizer::channel_history()
+    {
+      return (int) (d_channel_filter.size( ) + d_ddc_decimation_rate * d_interp->ntaps());
+    }
+
+    void
+    channelizer::set_input_history(int samples)
+    {
+      d_input_history = samples;
+
+      /* no more channel samples or symbols than input samples */
+      d_ch_samples.resize( samples + 1 );
+      d_demod_out.resize( samples + 1 );
+      d_cr_out.resize( samples + 1 );
+      d_symbols.resize( samples );
+      d_positions.resize( samples );
+      d_soft.resize( samples );
+      d_edr.resize( samples );
+    }
+
+    void
+    channelizer::tune(double center_freq, const std::vector<bool> &channel_mask)
+    {
+      if (center_freq != d_center_freq) {
+        d_center_freq = center_freq;
+        /* the passband ripple moves with the channels, start over */
+        d_noise_floor.assign(79, 0.0);
+      }
+      d_channel_mask = channel_mask;
+      set_channels();
+    }
+
+    void
+    channelizer::restart()
+    {
+      d_noise_floor.assign(79, 0.0);
+      d_last_active.assign(79, 0);
+      d_cr.init(d_samples_per_symbol / d_ddc_decimation_rate);
+      if (d_le_2m)
+        d_le_2m_cr.init(d_sample_rate / LE_2M_SYMBOL_RATE / d_le_2m_decimation_rate);
+    }
+
+    void
+    channelizer::clock_recovery::init(float samples_per_symbol)
+    {
+      gain_mu = 0.175;
+      mu = 0.32;
+      omega_relative_limit = 0.005;
+      omega = samples_per_symbol;
+      gain_omega = .25 * gain_mu * gain_mu;
+      omega_mid = omega;
+      last_sample = 0;
+    }
+
+    static inline float slice(float x)
+    {
+      return (x < 0) ? -1.0F : 1.0F;
+    }
+
+    /* M&M clock recovery, adapted from gr_clock_recovery_mm_ff */
+    int 
+    channelizer::mm_cr(clock_recovery &cr, const float *in, int ninput_items,
+                       float *out, int noutput_items, float *positions)
+    {
+      unsigned int ii = 0; /* input index */
+      int          oo = 0; /* output index */
+      unsigned int ni = ninput_items - d_interp->ntaps(); /* max input */
+      float        mm_val;
+      /* the interpolator output lies between its two middle taps */
+      float        center = d_interp->ntaps() / 2 - 1;
+
+      while ((oo < noutput_items) && (ii < ni)) {
+        // produce output sample
+        out[oo]        = d_interp->interpolate( &in[ii], cr.mu );
+        if (positions)
+          positions[oo] = ii + center + cr.mu;
+        mm_val         = slice(cr.last_sample) * out[oo] - slice(out[oo]) * cr.last_sample;
+        cr.last_sample = out[oo];
+        
+        cr.omega += cr.gain_omega * mm_val;
+        cr.omega  = cr.omega_mid + gr::branchless_clip( cr.omega-cr.omega_mid, 
+                                                        cr.omega_relative_limit );   // make sure we don't walk away
+        cr.mu    += cr.omega + cr.gain_mu * mm_val;
+
+        ii       += (int) floor( cr.mu );
+        cr.mu    -= floor( cr.mu );
+        oo++;
+      }
+
+      /* return number of output items produced */
+      return oo;
+    }
+
+    /* fm demodulation, taken from gr_quadrature_demod_cf */
+    void 
+    channelizer::demod(const gr_complex *in, float *out, int noutput_items, float gain)
+    {
+      int i;
+      gr_complex product;
+
+      for (i = 1; i < noutput_items; i++) {
+        gr_complex product = in[i] * conj (in[i-1]);
+        out[i] = gain * gr::fast_atan2f(imag(product), real(product));
+      }
+    }
+
+    /* binary slicer, similar to gr_binary_slicer_fb */
+    void 
+    channelizer::slicer(const float *in, char *out, int noutput_items)
+    {
+      int i;
+
+      for (i = 0; i < noutput_items; i++)
+        out[i] = (in[i] < 0) ? 0 : 1;
+    }
+
+    /* soft slicer, clock recovered symbols as 8 bit LLRs */
+    void
+    channelizer::soft_slicer(const float *in, int8_t *out, int noutput_items)
+    {
+      int i;
+
+      for (i = 0; i < noutput_items; i++) {
+        float llr = in[i] * d_soft_scale;
+        out[i] = (int8_t) lrintf(gr::branchless_clip(llr, 127.0F));
+      }
+    }
+
+    int 
+    channelizer::channel_samples( double                     freq,
+                                  gr_vector_const_void_star& in, 
+                                  gr_vector_void_star&       out,
+                                  double&                    energy,
+                                  int                        ninput_items )
+    {
+      int ddc_noutput_items       = 0;
+      int classic_chan = abs_freq_channel( freq );
+      d_stats->set_channel( classic_chan );
+      stage_timer timer( d_stats, stage_stats::STAGE_CHANNEL_SAMPLES );
+      ddc_noutput_items = ddc_work( classic_chan, DDC_CHANNEL, in, d_first_channel_sample,
+                                    ninput_items - d_first_channel_sample,
+                                    (gr_complex *) out[0] );
+
+      if (ddc_noutput_items > 0) {
+        d_channel_slots[classic_chan]++;
+        /* the squelch compares slots, so only the first one counts */
+        energy = slot_mean_energy( (const gr_complex *) out[0], ddc_noutput_items );
+      }
+      else {
+        /* not in the band, masked, or no output this time */
+        ddc_noutput_items = 0;
+        energy = 0.0;
+      }
+
+      return ddc_noutput_items;
+    }
+
+    /* whole channel samples covering the first time slot */
+    int
+    channelizer::slot_channel_samples()
+    {
+      return (int) ceil( d_samples_per_slot / d_ddc_decimation_rate );
+    }
+
+    /*
+     * Average mag2 of the channel samples of the first time slot, of
+     * at most nsamples.  Computed in place rather than with a throwaway
+     * complex_to_mag_squared block so that replay workers can run it
+     * concurrently.
+     */
+    double
+    channelizer::slot_mean_energy( const gr_complex *samples, int nsamples )
+    {
+      int count = std::min( slot_channel_samples( ), nsamples );
+      double energy = 0.0;
+      for( int i=0; i<count; i++ ) {
+        energy += std::norm( samples[i] );
+      }
+      return (count > 0) ? energy / count : 0.0;
+    }
+
+    int
+    channelizer::slot_energy( int                        classic_chan,
+                              gr_vector_const_void_star& in,
+                              gr_complex                *out,
+                              double&                    energy )
+    {
+      int count = slot_channel_samples( );
+      int ddc_noutput_items = ddc_work( classic_chan, DDC_CHANNEL, in, d_first_channel_sample,
+                                        count * d_ddc_decimation_rate + d_channel_filter.size( ) - 1,
+                                        out );
+      if (ddc_noutput_items <= 0) {
+        energy = 0.0;
+        return 0;
+      }
+
+      energy = slot_mean_energy( out, ddc_noutput_items );
+      return ddc_noutput_items;
+    }
+
+    int
+    channelizer::scan_channel( double                     freq,
+                               gr_vector_const_void_star& in,
+                               gr_complex                *out,
+                               double&                    energy )
+    {
+      int classic_chan = abs_freq_channel( freq );
+      d_stats->set_channel( classic_chan );
+      stage_timer timer( d_stats, stage_stats::STAGE_CHANNEL_SAMPLES );
+
+      int ddc_noutput_items = slot_energy( classic_chan, in, out, energy );
+      if (ddc_noutput_items > 0)
+        d_channel_slots[classic_chan]++;
+      return ddc_noutput_items;
+    }
+
+    void
+    channelizer::warm_up( double                     freq,
+                          gr_vector_const_void_star& in )
+    {
+      double energy, snr;
+      if (slot_energy( abs_freq_channel( freq ), in, &d_ch_samples[0], energy ) > 0)
+        check_snr( freq, energy, snr );
+    }
+
+    int
+    channelizer::finish_channel( double                     freq,
+                                 gr_vector_const_void_star& in,
+                                 gr_complex                *out,
+                                 int                        count,
+                                 int                        ninput_items )
+    {
+      stage_timer timer( d_stats, stage_stats::STAGE_CHANNEL_SAMPLES );
+
+      /* the DDCs keep their mixer phase, so the two parts join up */
+      int first = d_first_channel_sample + count * d_ddc_decimation_rate;
+      int ddc_noutput_items = ddc_work( abs_freq_channel( freq ), DDC_CHANNEL, in, first,
+                                        ninput_items - first, out + count );
+      return count + ((ddc_noutput_items > 0) ? ddc_noutput_items : 0);
+    }
+
+    int 
+    channelizer::channel_symbols( gr_vector_const_void_star& in, 
+                                  char *                     out, 
+                                  int                        ninput_items,
+                                  float *                    positions,
+                                  int8_t *                   soft )
+    {
+      /* fm demodulation */
+      int demod_noutput_items = ninput_items - 1;
+      float *demod_out = &d_demod_out[0];
+      gr_complex *ch_samps = (gr_complex *) in[0];
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_DEMOD );
+        demod( ch_samps, demod_out, demod_noutput_items );
+      }
+      
+      /* clock recovery */
+      int cr_ninput_items = demod_noutput_items;
+      int noutput_items = cr_ninput_items; // poor estimate but probably safe
+      float *cr_out = &d_cr_out[0];
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_MM_CR );
+        noutput_items = mm_cr(demod_out, cr_ninput_items, cr_out, noutput_items, positions);
+      }
+      
+      /* binary slicer */
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_SLICER );
+        slicer(cr_out, out, noutput_items);
+        if (soft)
+          soft_slicer(cr_out, soft, noutput_items);
+      }
+
+      /* demod_out[i] is the phase change from sample i-1 to sample i */
+      if (positions) {
+        for (int i = 0; i < noutput_items; i++)
+          positions[i] -= 0.5F;
+      }
+      
+      return noutput_items;
+    }
+
+    /* complex sample at a fractional position, linearly interpolated */
+    static inline gr_complex
+    sample_at(const gr_complex *samples, float t)
+    {
+      int i = (int) t;
+      float f = t - i;
+      return samples[i] + f * (samples[i+1] - samples[i]);
+    }
+
+    /* phase changes of the EDR sync sequence after the reference symbol */
+    static const float EDR_SYNC[] = {
+      3 * M_PI_4, -3 * M_PI_4, 3 * M_PI_4, -3 * M_PI_4, 3 * M_PI_4,
+      -3 * M_PI_4, -M_PI_4, 3 * M_PI_4, 3 * M_PI_4, M_PI_4
+    };
+
+    /* a phase in radians as 256 units per turn */
+    static inline uint8_t
+    phase_units(float phase)
+    {
+      return (uint8_t) ((int) lrintf(phase * (128 / M_PI)) & 0xff);
+    }
+
+    int
+    channelizer::edr_phases( const gr_complex *samples,
+                             int               nsamples,
+                             float             header_end,
+                             char             *out,
+                             int               max )
+    {
+      float sps = d_samples_per_symbol / d_ddc_decimation_rate;
+      /* the reference symbol follows the guard time, give or take a symbol */
+      float nominal = header_end + (1 + EDR_GUARD_SYMBOLS) * sps;
+      float last = nsamples - 2 - EDR_SYNC_SYMBOLS * sps;
+      float best_t = -1;
+      float best_metric = 0;
+      gr_complex best_sum = 0;
+      gr_complex prev, cur, change;
+      int k;
+
+      /*
+       * Timing search: correlate the normalized phase changes with the
+       * sync sequence.  The magnitude ignores a constant rotation, so
+       * the angle of the best sum is the frequency offset per symbol.
+       */
+      for (float t = std::max(nominal - sps, 0.0F); (t <= nominal + sps) && (t <= last); t += 0.25F) {
+        gr_complex sum = 0;
+        prev = sample_at( samples, t );
+        for (k = 0; k < EDR_SYNC_SYMBOLS; k++) {
+          cur = sample_at( samples, t + (k + 1) * sps );
+          change = cur * std::conj( prev );
+          float mag = std::abs( change );
+          if (mag > 0)
+            sum += change / mag * std::polar( 1.0F, (float) -EDR_SYNC[k] );
+          prev = cur;
+        }
+        if (std::norm( sum ) > best_metric) {
+          best_metric = std::norm( sum );
+          best_sum = sum;
+          best_t = t;
+        }
+      }
+      if (best_t < 0)
+        return 0;
+
+      /*
+       * Beyond pi/4 per symbol (125 kHz) the offset is not a real one:
+       * GFSK alternating between +/-pi/3 looks much like the sync
+       * sequence turned by pi.
+       */
+      float offset = gr::fast_atan2f( imag( best_sum ), real( best_sum ) );
+      if (fabsf( offset ) > M_PI_4)
+        return 0;
+
+      /* demand the sync sequence itself, allowing two symbol errors */
+      int matches = 0;
+      prev = sample_at( samples, best_t );
+      for (k = 0; k < EDR_SYNC_SYMBOLS; k++) {
+        cur = sample_at( samples, best_t + (k + 1) * sps );
+        change = cur * std::conj( prev );
+        uint8_t phase = phase_units( gr::fast_atan2f( imag( change ), real( change ) ) - offset );
+        if ((phase >> 6) == (phase_units( EDR_SYNC[k] ) >> 6))
+          matches++;
+        prev = cur;
+      }
+      if (matches < EDR_SYNC_SYMBOLS - 2)
+        return 0;
+
+      /* payload symbols up to the end of the samples */
+      int count = 0;
+      for (float t = best_t + (EDR_SYNC_SYMBOLS + 1) * sps;
+           (t < nsamples - 1) && (count < max); t += sps) {
+        cur = sample_at( samples, t );
+        change = cur * std::conj( prev );
+        out[count++] = (char) phase_units( gr::fast_atan2f( imag( change ), real( change ) ) - offset );
+        prev = cur;
+      }
+
+      return count;
+    }
+
+    int
+    channelizer::le_2m_symbols( const double               freq,
+                                gr_vector_const_void_star& in,
+                                char                      *out )
+    {
+      if (!d_le_2m)
+        return 0;
+
+      int classic_chan = abs_freq_channel( freq );
+      d_stats->set_channel( classic_chan );
+
+      /* the 2M DDC is shorter than the 1M one, so the same history covers it */
+      int nsamples;
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_CHANNEL_SAMPLES );
+        nsamples = ddc_work( classic_chan, DDC_LE_2M, in, d_first_channel_sample,
+                             d_input_history - d_first_channel_sample, &d_ch_samples[0] );
+      }
+      if (nsamples <= (int) d_interp->ntaps() + 1)
+        return 0;
+
+      int demod_noutput_items = nsamples - 1;
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_DEMOD );
+        demod( &d_ch_samples[0], &d_demod_out[0], demod_noutput_items, d_le_2m_demod_gain );
+      }
+
+      int noutput_items;
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_MM_CR );
+        noutput_items = mm_cr( d_le_2m_cr, &d_demod_out[0], demod_noutput_items,
+                               &d_cr_out[0], demod_noutput_items );
+      }
+
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_SLICER );
+        slicer( &d_cr_out[0], out, noutput_items );
+      }
+
+      return noutput_items;
+    }
+
+    bool
+    channelizer::enable_le_2m(bool enabled)
+    {
+      /* two channel samples per 2M symbol at least */
+      int decimation = (int) (d_samples_per_symbol / 4);
+      if (!enabled || (decimation < 1)) {
+        d_le_2m = false;
+        return !enabled;
+      }
+      if (d_le_2m)
+        return true;
+
+      d_le_2m_decimation_rate = decimation;
+      double channel_samples_per_symbol =
+        d_sample_rate / LE_2M_SYMBOL_RATE / d_le_2m_decimation_rate;
+      d_le_2m_demod_gain = channel_samples_per_symbol / M_PI_2;
+      d_le_2m_cr.init( channel_samples_per_symbol );
+
+      /* twice the bandwidth of the 1M channel filter */
+      d_le_2m_filter = gr::filter::firdes::low_pass( 1, 
+                                                     d_sample_rate, 
+                                                     2 * d_channel_filter_width, 
+                                                     600000, 
+                                                     gr::filter::firdes::WIN_HANN );
+
+      d_le_2m = true;
+      set_channels();
+      return true;
+    }
+
+    void
+    channelizer::enable_le_coded(bool enabled)
+    {
+      d_le_coded = enabled;
+      if (!enabled)
+        return;
+
+      /* preamble, FEC block 1, then header, PDU, CRC and TERM2 at S=2 */
+      int packet_symbols = le_packet::CODED_PREAMBLE_SYMBOLS + le_packet::CODED_BLOCK1_SYMBOLS +
+        2 * (8 * (2 + LE_MAX_PDU_OCTETS + 3) + 3);
+      int history_required = (int) ((SYMBOLS_PER_BASIC_RATE_SLOT + packet_symbols) *
+                                    d_samples_per_symbol) + channel_history();
+      if (d_input_history < history_required)
+        set_input_history( history_required );
+    }
+
+    /*
+     * The noise floor drops at once to the energy of a quieter slot and
+     * rises slowly with the energy of slots that fail the squelch.  A
+     * slot that passes only nudges it up, so that a step up in the noise
+     * (a gain change, a new interferer) cannot hold the squelch open.
+     */
+    static const double NOISE_FLOOR_RISE  = 1.0 / 64;
+    static const double NOISE_FLOOR_CREEP = 1.0023;     /* 0.01 dB */
+
+    bool 
+    channelizer::check_snr( const double               freq, 
+                            const double               on_channel_energy,
+                            double&                    snr )
+    {
+      stage_timer timer( d_stats, stage_stats::STAGE_CHECK_SNR );
+
+      int classic_chan = abs_freq_channel( freq );
+      if ((classic_chan < 0) || (classic_chan >= (int) d_noise_floor.size( )) ||
+          !(on_channel_energy > 0.0)) {
+        /* no samples, or not a number, must never reach the floor */
+        snr = 0.0;
+        return false;
+      }
+
+      double &noise = d_noise_floor[classic_chan];
+      if ((noise <= 0.0) || (on_channel_energy < noise))
+        noise = on_channel_energy;
+
+      snr = (noise > 0.0) ? 10.0 * log10( on_channel_energy / noise ) : 0.0;
+      bool ok = (snr >= d_target_snr);
+
+      if (ok) {
+        noise *= NOISE_FLOOR_CREEP;
+        d_last_active[classic_chan] = (uint64_t) (d_cumulative_count / d_samples_per_slot) + 1;
+      }
+      else
+        noise += NOISE_FLOOR_RISE * (on_channel_energy - noise);
+
+      return ok;
+    }
+
+    int
+    channelizer::ddc_work( int                        classic_chan,
+                           ddc_t                      kind,
+                           gr_vector_const_void_star& in,
+                           int                        first,
+                           int                        ninput_items,
+                           gr_complex                *out )
+    {
+      const char *start = ((const char *) in[0]) + first * sample_size( d_input_format );
+
+      if (d_input_format == FORMAT_CF32) {
+        std::map<int, gr::filter::freq_xlating_fir_filter_ccf::sptr> &ddcs =
+          (kind == DDC_LE_2M) ? d_le_2m_ddcs : d_channel_ddcs;
+        std::map<int, gr::filter::freq_xlating_fir_filter_ccf::sptr>::const_iterator ddci =
+          ddcs.find( classic_chan );
+        if (ddci == ddcs.end( ))
+          return -1;
+
+        gr::filter::freq_xlating_fir_filter_ccf::sptr ddc = ddci->second;
+        int noutput_items = ddc->fixed_rate_ninput_to_noutput( ninput_items - (ddc->history( ) - 1) );
+        gr_vector_const_void_star ddc_in( 1 );
+        gr_vector_void_star ddc_out( 1 );
+        ddc_in[0]  = start;
+        ddc_out[0] = out;
+        return ddc->work( noutput_items, ddc_in, ddc_out );
+      }
+
+      std::map<int, xlating_ddc::sptr> &ddcs =
+        (kind == DDC_LE_2M) ? d_int_le_2m_ddcs : d_int_channel_ddcs;
+      std::map<int, xlating_ddc::sptr>::const_iterator ddci = ddcs.find( classic_chan );
+      if (ddci == ddcs.end( ))
+        return -1;
+
+      xlating_ddc::sptr ddc = ddci->second;
+      int noutput_items = (ninput_items - (ddc->ntaps( ) - 1)) / ddc->decimation( );
+      if (noutput_items < 0)
+        noutput_items = 0;
+      if (d_input_format == FORMAT_SC16)
+        return ddc->filter( (const int16_t *) start, noutput_items, out );
+      return ddc->filter( (const int8_t *) start, noutput_items, out );
+    }
+
+    channelizer::sample_format_t
+    channelizer::sample_format(const std::string &name)
+    {
+      if (name == "cf32")
+        return FORMAT_CF32;
+      if (name == "sc16")
+        return FORMAT_SC16;
+      if (name == "sc8")
+        return FORMAT_SC8;
+      throw std::invalid_argument("unknown sample format " + name);
+    }
+
+    size_t
+    channelizer::sample_size(sample_format_t format)
+    {
+      switch (format) {
+      case FORMAT_SC16:
+        return 2 * sizeof(int16_t);
+      case FORMAT_SC8:
+        return 2 * sizeof(int8_t);
+      default:
+        return sizeof(gr_complex);
+      }
+    }
+
+    /*
+     * Move a cf32 DDC to a new offset.  freq_xlating_fir_filter_ccf
+     * rebuilds its taps in the next work() call and produces nothing
+     * in that call, so make it here instead of in the middle of a slot.
+     */
+    static void
+    retune_ddc(gr::filter::freq_xlating_fir_filter_ccf::sptr ddc, double offset)
+    {
+      if (ddc->center_freq( ) == offset)
+        return;
+      ddc->set_center_freq( offset );
+
+      gr_complex dummy;
+      gr_vector_const_void_star ddc_in( 1 );
+      gr_vector_void_star ddc_out( 1 );
+      ddc_in[0]  = &dummy;
+      ddc_out[0] = &dummy;
+      ddc->work( 0, ddc_in, ddc_out );
+    }
+
+    /*
+     * Integer input DDC of a channel at offset: kept if it is there
+     * already, rebuilt (they are just taps) only if the offset moved.
+     */
+    static void
+    retune_int_ddc(std::map<int, xlating_ddc::sptr> &ddcs, int ch, int decimation,
+                   const std::vector<float> &taps, double offset, double sample_rate)
+    {
+      std::map<int, xlating_ddc::sptr>::iterator ddci = ddcs.find( ch );
+      if ((ddci != ddcs.end( )) && (ddci->second->center_freq( ) == offset))
+        return;
+      ddcs[ch] = xlating_ddc::make( decimation, taps, offset, sample_rate );
+    }
+
+    /*
+     * Set available channels based on d_center_freq, d_sample_rate and
+     * d_channel_mask.  Runs again on every retune, so DDCs that exist
+     * are retuned rather than rebuilt.
+     */
+    void 
+    channelizer::set_channels()
+    {
+      /* center frequency described as a fractional channel */
+      double center = (d_center_freq - BASE_FREQUENCY) / CHANNEL_WIDTH;
+      /* bandwidth in terms of channels */
+      double channel_bandwidth = d_sample_rate / CHANNEL_WIDTH;
+      /* low edge of our received signal */
+      double low_edge = center - (channel_bandwidth / 2);
+      /* high edge of our received signal */
+      double high_edge = center + (channel_bandwidth / 2);
+      /* minimum bandwidth required per channel - ideally 1.0 (1 MHz), but can probably decode with a bit less */
+      double min_channel_width = 0.9;
+
+      int low_classic_channel = (int) (low_edge + (min_channel_width / 2) + 1);
+      low_classic_channel = (low_classic_channel < 0) ? 0 : low_classic_channel;
+
+      int high_classic_channel = (int) (high_edge - (min_channel_width / 2));
+      high_classic_channel = (high_classic_channel > 78) ? 78 : high_classic_channel;
+
+      d_low_freq = channel_abs_freq(low_classic_channel);
+      d_high_freq = channel_abs_freq(high_classic_channel);
+
+      for( int ch=0; ch<=78; ch++ ) {
+        /* LE channels are the even classic channels */
+        bool le_2m = d_le_2m && !(ch & 1);
+        if ((ch < low_classic_channel) || (ch > high_classic_channel) || !d_channel_mask[ch]) {
+          d_channel_ddcs.erase( ch );
+          d_int_channel_ddcs.erase( ch );
+          d_le_2m_ddcs.erase( ch );
+          d_int_le_2m_ddcs.erase( ch );
+          continue;
+        }
+
+        /* a channel coming (back) into use has no noise floor yet */
+        bool fresh = (d_input_format == FORMAT_CF32) ?
+          !d_channel_ddcs.count( ch ) : !d_int_channel_ddcs.count( ch );
+        if (fresh) {
+          d_noise_floor[ch] = 0.0;
+          d_last_active[ch] = 0;
+        }
+
+        double offset = channel_abs_freq( ch ) - d_center_freq;
+        if (d_input_format != FORMAT_CF32) {
+          retune_int_ddc( d_int_channel_ddcs, ch, d_ddc_decimation_rate, d_channel_filter,
+                          offset, d_sample_rate );
+          if (le_2m)
+            retune_int_ddc( d_int_le_2m_ddcs, ch, d_le_2m_decimation_rate, d_le_2m_filter,
+                            offset, d_sample_rate );
+          continue;
+        }
+
+        std::map<int, gr::filter::freq_xlating_fir_filter_ccf::sptr>::iterator ddci =
+          d_channel_ddcs.find( ch );
+        if (ddci != d_channel_ddcs.end( ))
+          retune_ddc( ddci->second, offset );
+        else
+          d_channel_ddcs[ch] = 
+            gr::filter::freq_xlating_fir_filter_ccf::make( d_ddc_decimation_rate, 
+                                                 d_channel_filter, 
+                                                 offset, 
+                                                 d_sample_rate );
+        if (!le_2m)
+          continue;
+        ddci = d_le_2m_ddcs.find( ch );
+        if (ddci != d_le_2m_ddcs.end( ))
+          retune_ddc( ddci->second, offset );
+        else
+          d_le_2m_ddcs[ch] =
+            gr::filter::freq_xlating_fir_filter_ccf::make( d_le_2m_decimation_rate, 
+                                                           d_le_2m_filter, 
+                                                           offset, 
+                                                           d_sample_rate );
+      }
+    }
+
+    /* returns relative (with respect to d_center_freq) frequency in Hz of given channel */
+    double 
+    channelizer::channel_rel_freq(int channel)
+    {
+      return channel_abs_freq(channel) - d_center_freq;
+    }
+
+    double 
+    channelizer::channel_abs_freq(int channel)
+    {
+      return BASE_FREQUENCY + (channel * CHANNEL_WIDTH);
+    }
+
+    int
+    channelizer::abs_freq_channel(double freq)
+    {
+      return (int) ((freq - BASE_FREQUENCY) / CHANNEL_WIDTH);
+    }
+
+    uint64_t
+    channelizer::symbol_sample(double symbol)
+    {
+      /* the zero history before the first sample counts as sample 0 */
+      double sample = (double) d_cumulative_count - (d_input_history - 1) +
+        d_first_channel_sample + symbol * d_samples_per_symbol;
+      return (sample > 0.0) ? (uint64_t) sample : 0;
+    }
+  } /* namespace bluetooth */
+} /* namespace gr */
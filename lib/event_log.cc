@@ -0,0 +1,468 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "event_log.h"
+#include <math.h>
+#include <string.h>
+
+namespace gr {
+  namespace bluetooth {
+
+    static const char *STATUS_NAMES[] = {
+      "detected", "decoded", "discovery", "lost_clock", "gave_up",
+      "following", "dropped"
+    };
+
+    event_log::sptr
+    event_log::make(size_t queue_depth)
+    {
+      return event_log::sptr(new event_log(queue_depth));
+    }
+
+    event_log::event_log(size_t queue_depth)
+      : d_ring(queue_depth), d_verbosity(LEVEL_STATUS), d_format(FORMAT_TEXT),
+        d_rate_limit(0.0), d_bucket_rate(0.0), d_tokens(0.0), d_dropped(0), d_suppressed(0),
+        d_out(stdout), d_running(true)
+    {
+      d_last_refill = std::chrono::steady_clock::now();
+      d_thread = std::thread(&event_log::run, this);
+    }
+
+    event_log::~event_log()
+    {
+      d_running = false;
+      d_cond.notify_one();
+      d_thread.join();
+
+      if (d_out != stdout)
+        fclose(d_out);
+      if ((d_dropped > 0) || (d_suppressed > 0)) {
+        fprintf(stderr, "event log: %llu records dropped, %llu rate limited\n",
+                (unsigned long long) d_dropped.load(),
+                (unsigned long long) d_suppressed.load());
+      }
+    }
+
+    bool
+    event_log::set_format(const std::string &format)
+    {
+      if (format == "text")
+        d_format = FORMAT_TEXT;
+      else if (format == "json")
+        d_format = FORMAT_JSON;
+      else if (format == "binary")
+        d_format = FORMAT_BINARY;
+      else
+        return false;
+      return true;
+    }
+
+    void
+    event_log::set_rate_limit(double per_second)
+    {
+      d_rate_limit = (per_second > 0.0) ? per_second : 0.0;
+    }
+
+    bool
+    event_log::set_file(const std::string &filename)
+    {
+      FILE *out = stdout;
+
+      if (!filename.empty() && (filename != "-")) {
+        out = fopen(filename.c_str(), "w");
+        if (!out) {
+          perror("fopen");
+          return false;
+        }
+      }
+
+      std::lock_guard<std::mutex> lock(d_mutex);
+      if (d_out != stdout)
+        fclose(d_out);
+      d_out = out;
+      return true;
+    }
+
+    event_log::record *
+    event_log::reserve(int level)
+    {
+      if (!enabled(level))
+        return NULL;
+
+      double rate = d_rate_limit.load(std::memory_order_relaxed);
+      if (rate > 0.0) {
+        /* token bucket holding at most one second worth of records */
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed = now - d_last_refill;
+        d_last_refill = now;
+        if (rate != d_bucket_rate) {
+          /* limit changed, start with a full bucket */
+          d_bucket_rate = rate;
+          d_tokens = rate;
+        }
+        d_tokens += elapsed.count() * rate;
+        if (d_tokens > rate)
+          d_tokens = rate;
+        if (d_tokens < 1.0) {
+          d_suppressed++;
+          return NULL;
+        }
+        d_tokens -= 1.0;
+      }
+
+      record *r = d_ring.reserve();
+      if (!r) {
+        d_dropped++;
+        return NULL;
+      }
+      memset(r, 0, sizeof(*r));
+      r->snr = NAN;
+      return r;
+    }
+
+    void
+    event_log::commit()
+    {
+      /* only wake the formatter if it may have gone to sleep */
+      if (d_ring.commit())
+        d_cond.notify_one();
+    }
+
+    void
+    event_log::classic(kind_t kind, status_t status, classic_packet::sptr pkt,
+                       uint32_t clkn, uint64_t timestamp_us, double snr)
+    {
+      int level;
+
+      if (kind == EVENT_ID)
+        level = LEVEL_DETECTED;
+      else if (status == STATUS_DECODED)
+        level = LEVEL_DECODED;
+      else
+        level = LEVEL_STATUS;
+
+      record *r = reserve(level);
+      if (!r)
+        return;
+
+      r->timestamp_us = timestamp_us;
+      r->clkn         = clkn;
+      r->address      = pkt->get_LAP();
+      r->snr          = snr;
+      r->channel      = pkt->get_channel();
+      r->kind         = kind;
+      r->status       = status;
+      if (status == STATUS_DECODED) {
+        r->type                  = pkt->get_type();
+        r->length                = pkt->get_payload_length();
+        r->payload_header_length = pkt->get_payload_header_length();
+        r->llid                  = pkt->get_payload_llid();
+        r->flow                  = pkt->get_payload_flow();
+      }
+      commit();
+    }
+
+    void
+    event_log::le(le_packet::sptr pkt, double freq, uint32_t clkn,
+                  uint64_t timestamp_us, double snr)
+    {
+      record *r = reserve(LEVEL_DETECTED);
+      if (!r)
+        return;
+
+      r->timestamp_us = timestamp_us;
+      r->clkn         = clkn;
+      r->address      = pkt->get_AA();
+      r->snr          = snr;
+      r->channel      = le_packet::freq2index(freq);
+      r->kind         = EVENT_LE;
+      r->status       = STATUS_DETECTED;
+      r->data_length  = pkt->pcap_format(r->data, sizeof(r->data));
+      commit();
+    }
+
+    void
+    event_log::fhs(uint32_t lap, uint8_t uap, uint16_t nap, uint32_t clk,
+                   uint32_t clkn, uint64_t timestamp_us)
+    {
+      record *r = reserve(LEVEL_DECODED);
+      if (!r)
+        return;
+
+      r->timestamp_us = timestamp_us;
+      r->clkn         = clkn;
+      r->address      = lap;
+      r->kind         = EVENT_FHS;
+      r->status       = STATUS_DECODED;
+      r->uap          = uap;
+      r->nap          = nap;
+      r->clock        = clk;
+      commit();
+    }
+
+    void
+    event_log::target(uint32_t lap, bool following, uint32_t clkn,
+                      uint64_t timestamp_us)
+    {
+      record *r = reserve(LEVEL_STATUS);
+      if (!r)
+        return;
+
+      r->timestamp_us = timestamp_us;
+      r->clkn         = clkn;
+      r->address      = lap;
+      r->kind         = EVENT_TARGET;
+      r->status       = following ? STATUS_FOLLOWING : STATUS_DROPPED;
+      commit();
+    }
+
+    void
+    event_log::run()
+    {
+      while (d_running || !d_ring.empty()) {
+        std::unique_lock<std::mutex> lock(d_mutex);
+        record *r;
+
+        if (d_ring.empty()) {
+          d_cond.wait_for(lock, std::chrono::milliseconds(10));
+          continue;
+        }
+
+        /* format everything queued so far, then flush once */
+        while ((r = d_ring.front())) {
+          switch (d_format.load()) {
+          case FORMAT_JSON:
+            write_json(*r);
+            break;
+          case FORMAT_BINARY:
+            fwrite(r, sizeof(*r), 1, d_out);
+            break;
+          default:
+            write_text(*r);
+            break;
+          }
+          d_ring.pop();
+        }
+        fflush(d_out);
+      }
+    }
+
+    /* same layout as the sniffers' original console output */
+    void
+    event_log::write_text(const record &r)
+    {
+      if (r.kind == EVENT_LE) {
+        write_le_text(r);
+        return;
+      }
+      if (r.kind == EVENT_FHS) {
+        fprintf(d_out, "FHS contents: BD_ADDR %2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x, CLK %07x\n",
+                (r.nap >> 8) & 0xff, r.nap & 0xff, r.uap,
+                (r.address >> 16) & 0xff, (r.address >> 8) & 0xff, r.address & 0xff,
+                r.clock);
+        return;
+      }
+      if (r.kind == EVENT_TARGET) {
+        fprintf(d_out, (r.status == STATUS_FOLLOWING) ? "following LAP %06x\n" :
+                "no longer following LAP %06x\n", r.address);
+        return;
+      }
+
+      fprintf(d_out, "time %6d, ", r.clkn);
+      if (!isnan(r.snr))
+        fprintf(d_out, "snr=%.1f, ", r.snr);
+      fprintf(d_out, "channel %2d, LAP %06x ", r.channel, r.address);
+
+      if (r.kind == EVENT_ID) {
+        fprintf(d_out, "ID\n");
+        return;
+      }
+
+      switch (r.status) {
+      case STATUS_DECODED:
+        fprintf(d_out, "%s\n", classic_packet::TYPE_NAMES[r.type & 0xf].c_str());
+        if (r.payload_header_length > 0) {
+          fprintf(d_out, "  LLID: %d\n", r.llid);
+          fprintf(d_out, "  flow: %d\n", r.flow);
+          fprintf(d_out, "  payload length: %d\n", r.length);
+        }
+        break;
+      case STATUS_DISCOVERY:
+        fprintf(d_out, "working on UAP/CLK1-6\n");
+        break;
+      case STATUS_LOST_CLOCK:
+        fprintf(d_out, "lost clock!\n");
+        break;
+      case STATUS_GAVE_UP:
+        fprintf(d_out, "giving up on queued packet!\n");
+        break;
+      default:
+        fprintf(d_out, "\n");
+        break;
+      }
+    }
+
+    /* decode the LE header and PDU the way le_packet::print() does */
+    void
+    event_log::write_le_text(const record &r)
+    {
+      const uint8_t *pdu = &r.data[6];
+      unsigned avail = (r.data_length > 6) ? r.data_length - 6 : 0;
+      uint16_t header = r.data[4] | (((uint16_t) r.data[5]) << 8);
+      unsigned i;
+
+      fprintf(d_out, "time %6d, ", r.clkn);
+      if (!isnan(r.snr))
+        fprintf(d_out, "snr=%.1f, ", r.snr);
+
+      if (r.channel >= 37) {
+        unsigned type   = header & 0xf;
+        unsigned length = (header >> 8) & 0xff;
+        if (length > avail)
+          length = avail;
+
+        fprintf(d_out, "BTLE index=%02d, AA=%08x, PDUType=%d, TxAdd=%d, RxAdd=%d, Length=%d\n",
+                r.channel, r.address, type, (header >> 6) & 1, (header >> 7) & 1,
+                (header >> 8) & 0xff);
+        switch (type) {
+        case 0:
+        case 2:
+        case 4:
+        case 6:
+          fprintf(d_out, "  AdvA=%02x%02x%02x%02x%02x%02x\n",
+                  pdu[0], pdu[1], pdu[2], pdu[3], pdu[4], pdu[5]);
+          fprintf(d_out, (type == 4) ? "\n  (char) ScanRspData=" : "\n  (char) AdvData=");
+          for (i = 6; i < length; i++) {
+            char c = (char) pdu[i];
+            if ((c < ' ') || (c > '~'))
+              c = '.';
+            fprintf(d_out, " %c", c);
+          }
+          fprintf(d_out, (type == 4) ? "\n  (byte) ScanRspData=" : "\n  (byte) AdvData=");
+          for (i = 6; i < length; i++)
+            fprintf(d_out, "%02x", pdu[i]);
+          fprintf(d_out, "\n");
+          break;
+        case 1:
+          fprintf(d_out, "  AdvA=%02x%02x%02x%02x%02x%02x\n"
+                  "  InitA=%02x%02x%02x%02x%02x%02x\n",
+                  pdu[0], pdu[1], pdu[2], pdu[3], pdu[4], pdu[5],
+                  pdu[6], pdu[7], pdu[8], pdu[9], pdu[10], pdu[11]);
+          break;
+        case 3:
+          fprintf(d_out, "  ScanA=%02x%02x%02x%02x%02x%02x\n"
+                  "  AdvA=%02x%02x%02x%02x%02x%02x\n",
+                  pdu[0], pdu[1], pdu[2], pdu[3], pdu[4], pdu[5],
+                  pdu[6], pdu[7], pdu[8], pdu[9], pdu[10], pdu[11]);
+          break;
+        case 5:
+          fprintf(d_out, "  InitA=%02x%02x%02x%02x%02x%02x\n"
+                  "  AdvA=%02x%02x%02x%02x%02x%02x\n",
+                  pdu[0], pdu[1], pdu[2], pdu[3], pdu[4], pdu[5],
+                  pdu[6], pdu[7], pdu[8], pdu[9], pdu[10], pdu[11]);
+          {
+            uint32_t AA        = pdu[12] | (((uint32_t) pdu[13]) << 8) |
+              (((uint32_t) pdu[14]) << 16) | (((uint32_t) pdu[15]) << 24);
+            uint32_t CRCInit   = pdu[16] | (((uint32_t) pdu[17]) << 8) |
+              (((uint32_t) pdu[18]) << 16);
+            uint16_t WinOffset = pdu[20] | (((uint16_t) pdu[21]) << 8);
+            uint16_t Interval  = pdu[22] | (((uint16_t) pdu[23]) << 8);
+            uint16_t Latency   = pdu[24] | (((uint16_t) pdu[25]) << 8);
+            uint16_t Timeout   = pdu[26] | (((uint16_t) pdu[27]) << 8);
+            uint64_t ChM       = pdu[28] | (((uint64_t) pdu[29]) << 8) |
+              (((uint64_t) pdu[30]) << 16) | (((uint64_t) pdu[31]) << 24) |
+              (((uint64_t) pdu[32]) << 32);
+            fprintf(d_out, "  AA=%08x, CRCInit=%06x, WinSize=%d, WinOffset=%d\n",
+                    AA, CRCInit, pdu[19], WinOffset);
+            fprintf(d_out, "  Interval=%d, Latency=%d, Timeout=%d, ChM=%010llx, Hop=%d, SCA=%d\n",
+                    Interval, Latency, Timeout, (unsigned long long) ChM,
+                    pdu[33] & 0x1f, (pdu[33] >> 5) & 7);
+          }
+          break;
+        default:
+          break;
+        }
+      }
+      else {
+        fprintf(d_out, "BTLE index=%02d, AA=%08x, LLID=%d, NESN=%d, SN=%d, MD=%d, Length=%d\n",
+                r.channel, r.address, header & 3, (header >> 2) & 1,
+                (header >> 3) & 1, (header >> 4) & 1, (header >> 8) & 0xff);
+      }
+    }
+
+    void
+    event_log::write_json(const record &r)
+    {
+      unsigned i;
+
+      fprintf(d_out, "{\"ts_us\":%llu,\"clkn\":%u",
+              (unsigned long long) r.timestamp_us, r.clkn);
+
+      switch (r.kind) {
+      case EVENT_ID:
+        fprintf(d_out, ",\"event\":\"id\",\"channel\":%d,\"lap\":\"%06x\"",
+                r.channel, r.address);
+        break;
+      case EVENT_CLASSIC:
+        fprintf(d_out, ",\"event\":\"classic\",\"channel\":%d,\"lap\":\"%06x\"",
+                r.channel, r.address);
+        if (r.status == STATUS_DECODED) {
+          fprintf(d_out, ",\"type\":\"%s\",\"length\":%d",
+                  classic_packet::TYPE_NAMES[r.type & 0xf].c_str(), r.length);
+          if (r.payload_header_length > 0)
+            fprintf(d_out, ",\"llid\":%d,\"flow\":%d", r.llid, r.flow);
+        }
+        break;
+      case EVENT_LE:
+        fprintf(d_out, ",\"event\":\"le\",\"index\":%d,\"aa\":\"%08x\",\"data\":\"",
+                r.channel, r.address);
+        for (i = 0; i < r.data_length; i++)
+          fprintf(d_out, "%02x", r.data[i]);
+        fprintf(d_out, "\"");
+        break;
+      case EVENT_FHS:
+        fprintf(d_out, ",\"event\":\"fhs\",\"bd_addr\":\"%2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x\",\"clk\":%u",
+                (r.nap >> 8) & 0xff, r.nap & 0xff, r.uap,
+                (r.address >> 16) & 0xff, (r.address >> 8) & 0xff, r.address & 0xff,
+                r.clock);
+        break;
+      case EVENT_TARGET:
+        fprintf(d_out, ",\"event\":\"target\",\"lap\":\"%06x\"", r.address);
+        break;
+      }
+
+      if (r.status <= STATUS_DROPPED)
+        fprintf(d_out, ",\"status\":\"%s\"", STATUS_NAMES[r.status]);
+      if (!isnan(r.snr))
+        fprintf(d_out, ",\"snr\":%.1f", r.snr);
+      fprintf(d_out, "}\n");
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
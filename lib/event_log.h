@@ -0,0 +1,191 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_EVENT_LOG_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_EVENT_LOG_H
+
+#include "gr_bluetooth/packet.h"
+#include "spsc_ring.h"
+#include <boost/shared_ptr.hpp>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * Structured packet log.  The decode path fills fixed size binary
+     * records in a lock-free ring; a separate thread formats them as
+     * text, JSON lines or raw records, so a slow terminal or file never
+     * stalls work().  Records above the verbosity level are never
+     * queued, and an optional rate limit (records per second) caps the
+     * output volume on a busy band.
+     */
+    class event_log
+    {
+    public:
+      enum format_t {
+        FORMAT_TEXT   = 0,
+        FORMAT_JSON   = 1,
+        FORMAT_BINARY = 2
+      };
+
+      /* verbosity levels, each includes the ones below it */
+      enum level_t {
+        LEVEL_QUIET    = 0,     /* nothing */
+        LEVEL_DECODED  = 1,     /* decoded packets and FHS contents */
+        LEVEL_DETECTED = 2,     /* ID and LE packets */
+        LEVEL_STATUS   = 3      /* UAP/clock discovery progress */
+      };
+
+      enum kind_t {
+        EVENT_ID      = 0,      /* classic packet without header */
+        EVENT_CLASSIC = 1,      /* classic packet with header */
+        EVENT_LE      = 2,      /* LE packet */
+        EVENT_FHS     = 3,      /* contents of a decoded FHS packet */
+        EVENT_TARGET  = 4       /* a piconet started or stopped being followed */
+      };
+
+      enum status_t {
+        STATUS_DETECTED   = 0,  /* access code / address found */
+        STATUS_DECODED    = 1,  /* header and payload decoded */
+        STATUS_DISCOVERY  = 2,  /* queued for UAP/CLK1-6 discovery */
+        STATUS_LOST_CLOCK = 3,  /* failed to decode with the known clock */
+        STATUS_GAVE_UP    = 4,  /* queued packet could not be decoded */
+        STATUS_FOLLOWING  = 5,  /* target added */
+        STATUS_DROPPED    = 6   /* target removed */
+      };
+
+      /*
+       * One log record.  This is also the on-disk layout of the binary
+       * format: sizeof(record) bytes per event in host byte order.
+       */
+      struct record {
+        uint64_t timestamp_us;  /* capture time since start */
+        uint32_t clkn;          /* native clock (or piconet clock) */
+        uint32_t address;       /* LAP, or AA for LE */
+        float    snr;           /* dB, NAN if not known */
+        int16_t  channel;       /* classic channel, or LE channel index */
+        uint8_t  kind;          /* kind_t */
+        uint8_t  status;        /* status_t */
+        uint8_t  type;          /* classic packet type */
+        int8_t   payload_header_length;
+        uint8_t  llid;
+        uint8_t  flow;
+        uint16_t length;        /* classic payload length */
+        uint16_t nap;           /* FHS only */
+        uint8_t  uap;           /* FHS only */
+        uint16_t data_length;
+        uint32_t clock;         /* FHS only, CLK in 625 us units */
+        uint8_t  data[LE_MAX_OCTETS]; /* LE: AA, header, PDU and CRC */
+      };
+
+      typedef boost::shared_ptr<event_log> sptr;
+
+      static sptr make(size_t queue_depth = 4096);
+
+      event_log(size_t queue_depth);
+      ~event_log();
+
+      /* "text", "json" or "binary", returns false if unknown */
+      bool set_format(const std::string &format);
+
+      /* see level_t */
+      void set_verbosity(int level) { d_verbosity = level; }
+      int verbosity() { return d_verbosity.load(); }
+
+      /* maximum records per second, 0 for no limit */
+      void set_rate_limit(double per_second);
+
+      /* send output to a file instead of stdout, "" or "-" for stdout */
+      bool set_file(const std::string &filename);
+
+      /* would a record at this level be written? */
+      bool enabled(int level) { return level <= d_verbosity.load(std::memory_order_relaxed); }
+
+      /* log a classic packet, or an ID packet if kind is EVENT_ID */
+      void classic(kind_t kind, status_t status, classic_packet::sptr pkt,
+                   uint32_t clkn, uint64_t timestamp_us, double snr);
+
+      /* log an LE packet */
+      void le(le_packet::sptr pkt, double freq, uint32_t clkn,
+              uint64_t timestamp_us, double snr);
+
+      /* log the contents of a decoded FHS packet */
+      void fhs(uint32_t lap, uint8_t uap, uint16_t nap, uint32_t clk,
+               uint32_t clkn, uint64_t timestamp_us);
+
+      /* log a target being added (following) or removed */
+      void target(uint32_t lap, bool following, uint32_t clkn, uint64_t timestamp_us);
+
+      /* records lost because the ring was full / the rate limit was hit */
+      uint64_t dropped() { return d_dropped.load(); }
+      uint64_t suppressed() { return d_suppressed.load(); }
+
+    private:
+      spsc_ring<record> d_ring;
+
+      std::atomic<int>    d_verbosity;
+      std::atomic<int>    d_format;
+      std::atomic<double> d_rate_limit;
+
+      /* token bucket, only touched by the producer */
+      double d_bucket_rate;
+      double d_tokens;
+      std::chrono::steady_clock::time_point d_last_refill;
+
+      std::atomic<uint64_t> d_dropped;
+      std::atomic<uint64_t> d_suppressed;
+
+      /* output stream, guarded by d_mutex */
+      FILE *d_out;
+
+      std::atomic<bool>       d_running;
+      std::mutex              d_mutex;
+      std::condition_variable d_cond;
+      std::thread             d_thread;
+
+      /* slot for a record at this level, NULL if it is filtered or lost */
+      record *reserve(int level);
+      void commit();
+
+      /* formatter thread body */
+      void run();
+
+      void write_text(const record &r);
+      void write_json(const record &r);
+      void write_le_text(const record &r);
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_EVENT_LOG_H */
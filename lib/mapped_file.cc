@@ -0,0 +1,103 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "mapped_file.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gr {
+  namespace bluetooth {
+
+    mapped_file::sptr
+    mapped_file::make(const std::string &filename, multi_block::sample_format_t format)
+    {
+      return mapped_file::sptr(new mapped_file(filename, format));
+    }
+
+    mapped_file::mapped_file(const std::string &filename, multi_block::sample_format_t format)
+      : d_format(format), d_item_size(multi_block::sample_size(format)),
+        d_data(NULL), d_length(0), d_size(0)
+    {
+      struct stat st;
+      int fd = open(filename.c_str(), O_RDONLY);
+      if (fd == -1) {
+        perror(filename.c_str());
+        return;
+      }
+      if ((fstat(fd, &st) == -1) || (st.st_size == 0)) {
+        close(fd);
+        return;
+      }
+
+      void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      /* the mapping keeps its own reference to the file */
+      close(fd);
+      if (data == MAP_FAILED) {
+        perror("mmap");
+        return;
+      }
+      madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+      d_data = (const char *) data;
+      d_length = st.st_size;
+      d_size = d_length / d_item_size;
+    }
+
+    mapped_file::~mapped_file()
+    {
+      if (d_data)
+        munmap((void *) d_data, d_length);
+    }
+
+    const void *
+    mapped_file::items(int64_t first, size_t count, std::vector<char> &buf) const
+    {
+      if ((first >= 0) && (first + count <= d_size))
+        return d_data + first * d_item_size;
+
+      /* zeros before the start and after the end of the file */
+      size_t skip = (first < 0) ? -first : 0;
+      if (skip > count)
+        skip = count;
+      uint64_t start = first + skip;
+      size_t avail = (start < d_size) ? d_size - start : 0;
+      size_t n = (count - skip < avail) ? count - skip : avail;
+
+      buf.assign(count * d_item_size, 0);
+      if (n > 0)
+        memcpy(&buf[skip * d_item_size], d_data + start * d_item_size, n * d_item_size);
+      return &buf[0];
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
@@ -0,0 +1,79 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_MAPPED_FILE_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_MAPPED_FILE_H
+
+#include "gr_bluetooth/multi_block.h"
+#include <boost/shared_ptr.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * Read-only memory map of a recorded IQ file, in any of the
+     * multi_block input formats.
+     */
+    class mapped_file
+    {
+    public:
+      typedef boost::shared_ptr<mapped_file> sptr;
+
+      static sptr make(const std::string &filename, multi_block::sample_format_t format);
+
+      mapped_file(const std::string &filename, multi_block::sample_format_t format);
+      ~mapped_file();
+
+      bool is_open() const { return d_data != NULL; }
+
+      multi_block::sample_format_t format() const { return d_format; }
+
+      /* number of complete complex samples in the file */
+      uint64_t size() const { return d_size; }
+
+      /*
+       * count items in the file's format starting at sample first,
+       * which may be negative: samples before the start (or after the
+       * end) of the file are zero, like the history a flowgraph
+       * prepends.  Returns a pointer into the map when the range lies
+       * inside the file, otherwise a zero padded copy in buf.
+       */
+      const void *items(int64_t first, size_t count, std::vector<char> &buf) const;
+
+    private:
+      multi_block::sample_format_t d_format;
+      size_t      d_item_size;
+      const char *d_data;
+      size_t      d_length;
+      uint64_t    d_size;
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_MAPPED_FILE_H */
@@ -27,6 +27,7 @@
 
 #include <gnuradio/io_signature.h>
 #include "multi_LAP_impl.h"
+#include "stage_stats.h"
 extern "C"
 {
   #include <btbb.h>
@@ -37,18 +38,21 @@ namespace gr {
   namespace bluetooth {
 
     multi_LAP::sptr
-    multi_LAP::make(double sample_rate, double center_freq, double squelch_threshold)
+    multi_LAP::make(double sample_rate, double center_freq, double squelch_threshold,
+                    const std::string &input_format)
     {
-      return gnuradio::get_initial_sptr (new multi_LAP_impl(sample_rate, center_freq, squelch_threshold));
+      return gnuradio::get_initial_sptr (new multi_LAP_impl(sample_rate, center_freq, squelch_threshold,
+                                                            input_format));
     }
 
     /*
      * The private constructor
      */
-    multi_LAP_impl::multi_LAP_impl(double sample_rate, double center_freq, double squelch_threshold)
-      : multi_block(sample_rate, center_freq, squelch_threshold),
+    multi_LAP_impl::multi_LAP_impl(double sample_rate, double center_freq, double squelch_threshold,
+                                   const std::string &input_format)
+      : multi_block(sample_rate, center_freq, squelch_threshold, sample_format(input_format)),
         gr::sync_block ("bluetooth multi LAP block",
-                       gr::io_signature::make (1, 1, sizeof (gr_complex)),
+                       gr::io_signature::make (1, 1, sample_size (sample_format (input_format))),
                        gr::io_signature::make (0, 0, 0))
     {
       set_symbol_history(SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE);
@@ -69,19 +73,27 @@ namespace gr {
     {
 	  int offset;
 	  double freq;
-	  char symbols[history()]; //poor estimate but safe
+	  char *symbols = &d_symbols[0];
 	  btbb_packet *pkt = NULL;
 	  int max_ac_errs = 1;
 
-	for (freq = d_low_freq; freq <= d_high_freq; freq += 1e6)
+	if (window_done())
+	  return WORK_DONE;
+	retune();
+
+	const std::vector<int> &channels = begin_slot();
+	for (size_t n = 0; n < channels.size(); n++)
 	{
-          gr_complex *ch_samples = new gr_complex[noutput_items+10000];
+          if (!in_budget( n ))
+            continue;
+          freq = channel_abs_freq( channels[n] );
+          gr_complex *ch_samples = &d_ch_samples[0];
           gr_vector_void_star btch( 1 );
           btch[0] = ch_samples;
           double on_channel_energy, snr;
           int ch_count = channel_samples( freq, input_items, btch, on_channel_energy, history() );
 
-          if (check_snr( freq, on_channel_energy, snr, input_items )) {
+          if (check_snr( freq, on_channel_energy, snr )) {
             gr_vector_const_void_star cbtch( 1 );
             cbtch[0] = ch_samples;
             int num_symbols = channel_symbols( cbtch, symbols, ch_count );
@@ -90,8 +102,12 @@ namespace gr {
               /* don't look beyond one slot for ACs */
               int latest_ac = ((num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
                 (num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
-			  offset = btbb_find_ac(symbols, latest_ac, LAP_ANY, max_ac_errs, &pkt);
+			  {
+			    stage_timer timer( d_stats, stage_stats::STAGE_SNIFF_AC );
+			    offset = btbb_find_ac(symbols, latest_ac, LAP_ANY, max_ac_errs, &pkt);
+			  }
               if (offset >= 0) {
+                d_packets_detected++;
 				// Don't know clkn
 				btbb_packet_set_data(pkt, symbols + offset, num_symbols - offset, (freq/1e6)-2402, 0);
                 printf("GOT PACKET: ch=%d, LAP=%06x, err=%u at time slot %d\n",
@@ -101,8 +117,8 @@ namespace gr {
               }
             }
           }
-          delete [] ch_samples;
 	}
+	end_slot();
 	d_cumulative_count += (int) d_samples_per_slot;
 
 	/* 
@@ -35,7 +35,8 @@ namespace gr {
       // Nothing to declare in this block.
 
     public:
-      multi_LAP_impl(double sample_rate, double center_freq, double squelch_threshold);
+      multi_LAP_impl(double sample_rate, double center_freq, double squelch_threshold,
+                     const std::string &input_format);
       ~multi_LAP_impl();
 
       // Where all the action really happens
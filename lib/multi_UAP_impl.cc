@@ -29,24 +29,28 @@
 
 #include <gnuradio/io_signature.h>
 #include "multi_UAP_impl.h"
+#include "stage_stats.h"
 #include <stdio.h>
 
 namespace gr {
   namespace bluetooth {
 
     multi_UAP::sptr
-    multi_UAP::make(double sample_rate, double center_freq, double squelch_threshold, int LAP)
+    multi_UAP::make(double sample_rate, double center_freq, double squelch_threshold, int LAP,
+                    const std::string &input_format)
     {
-      return gnuradio::get_initial_sptr (new multi_UAP_impl(sample_rate, center_freq, squelch_threshold, LAP));
+      return gnuradio::get_initial_sptr (new multi_UAP_impl(sample_rate, center_freq, squelch_threshold, LAP,
+                                                            input_format));
     }
 
     /*
      * The private constructor
      */
-    multi_UAP_impl::multi_UAP_impl(double sample_rate, double center_freq, double squelch_threshold, int LAP)
-      : multi_block(sample_rate, center_freq, squelch_threshold),
+    multi_UAP_impl::multi_UAP_impl(double sample_rate, double center_freq, double squelch_threshold, int LAP,
+                                   const std::string &input_format)
+      : multi_block(sample_rate, center_freq, squelch_threshold, sample_format(input_format)),
         gr::sync_block ("bluetooth multi UAP block",
-                       gr::io_signature::make (1, 1, sizeof (gr_complex)),
+                       gr::io_signature::make (1, 1, sample_size (sample_format (input_format))),
                        gr::io_signature::make (0, 0, 0))
     {
 	  d_LAP = LAP;
@@ -71,19 +75,27 @@ namespace gr {
       int offset, max_ac_errs = 2;
       uint32_t clkn; /* native (local) clock in 625 us */
       double freq;
-      char symbols[history()]; //poor estimate but safe
+      char *symbols = &d_symbols[0];
 	  btbb_packet *pkt = NULL;
 
+      if (window_done())
+        return WORK_DONE;
+      retune();
+
       clkn = (int) (d_cumulative_count / d_samples_per_slot) & 0x7ffffff;
 
-      for (freq = d_low_freq; freq <= d_high_freq; freq += 1e6)
+      const std::vector<int> &channels = begin_slot();
+      for (size_t n = 0; n < channels.size(); n++)
 	{
-          gr_complex *ch_samples = new gr_complex[noutput_items+10000];
+          if (!in_budget( n ))
+            continue;
+          freq = channel_abs_freq( channels[n] );
+          gr_complex *ch_samples = &d_ch_samples[0];
           gr_vector_void_star btch( 1 );
           btch[0] = ch_samples;
           double on_channel_energy, snr;
           int ch_count = channel_samples( freq, input_items, btch, on_channel_energy, history() );
-          if (check_snr( freq, on_channel_energy, snr, input_items )) {
+          if (check_snr( freq, on_channel_energy, snr )) {
             gr_vector_const_void_star cbtch( 1 );
             cbtch[0] = ch_samples;
             int num_symbols = channel_symbols( cbtch, symbols, ch_count );
@@ -92,20 +104,29 @@ namespace gr {
               /* don't look beyond one slot for ACs */
               int latest_ac = ((num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
                 (num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
-			  offset = btbb_find_ac(symbols, latest_ac, d_LAP, max_ac_errs, &pkt);
+			  {
+			    stage_timer timer( d_stats, stage_stats::STAGE_SNIFF_AC );
+			    offset = btbb_find_ac(symbols, latest_ac, d_LAP, max_ac_errs, &pkt);
+			  }
               if (offset >= 0) {
+                d_packets_detected++;
 				// Don't know clkn
 				btbb_packet_set_data(pkt, symbols + offset, num_symbols - offset, (freq/1e6)-2402, 0);
                 if (btbb_header_present(pkt)) {
-                  if (btbb_uap_from_header(pkt, d_piconet))
+                  bool found;
+                  {
+                    stage_timer timer( d_stats, stage_stats::STAGE_DISCOVERY );
+                    found = btbb_uap_from_header(pkt, d_piconet);
+                  }
+                  if (found)
                     exit(0);
                   break;
                 }
               }
             }
           }
-          delete [] ch_samples;
 	}
+      end_slot();
       d_cumulative_count += (int) d_samples_per_slot;
 
       /* 
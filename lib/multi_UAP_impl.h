@@ -45,7 +45,8 @@ namespace gr {
       btbb_piconet *d_piconet;
 
     public:
-      multi_UAP_impl(double sample_rate, double center_freq, double squelch_threshold, int LAP);
+      multi_UAP_impl(double sample_rate, double center_freq, double squelch_threshold, int LAP,
+                     const std::string &input_format);
       ~multi_UAP_impl();
 
       // Where all the action really happens
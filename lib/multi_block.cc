@@ -29,336 +29,379 @@
 
 #include <gnuradio/io_signature.h>
 #include "gr_bluetooth/multi_block.h"
-#include "gr_bluetooth/packet.h"
-#include <gnuradio/filter/firdes.h>
-#include <gnuradio/math.h>
+#include "stage_stats.h"
+#include <boost/bind.hpp>
 #include <stdio.h>
-#include <gnuradio/blocks/complex_to_mag_squared.h>
+#include <stdint.h>
+#include <stdexcept>
+#ifdef GR_CTRLPORT
+#include <gnuradio/rpcregisterhelpers.h>
+#endif
 
 namespace gr {
   namespace bluetooth {
-    multi_block::multi_block(double sample_rate, double center_freq, double squelch_threshold)
+
+    multi_block::multi_block(double sample_rate, double center_freq, double squelch_threshold,
+                             sample_format_t input_format)
       : gr::sync_block ("bluetooth multi block",
-                       gr::io_signature::make (1, 1, sizeof (gr_complex)),
-                       gr::io_signature::make (0, 0, 0))
+                       gr::io_signature::make (1, 1, sample_size (input_format)),
+                       gr::io_signature::make (0, 0, 0)),
+        channelizer (sample_rate, center_freq, squelch_threshold, input_format)
     {
-      d_target_snr = squelch_threshold;
-
-      d_cumulative_count = 0;
-      d_sample_rate = sample_rate;
-      d_center_freq = center_freq;
-
-      /*
-       * how many time slots we attempt to decode on each hop:
-       * 1 for now, could be as many as 5 plus a little slop
-       */
-      int slots = 1;
-      d_samples_per_symbol = sample_rate / SYMBOL_RATE;
-      //FIXME make sure that d_samples_per_symbol >= 2 (requirement of clock_recovery_mm_ff)
-      d_samples_per_slot = (int) (SYMBOLS_PER_BASIC_RATE_SLOT * d_samples_per_symbol);
-      int history_required = (int) (slots * d_samples_per_slot);
-
-      /* channel filter coefficients */
-      double gain = 1;
-      d_channel_filter_width = 500000;
-      double transition_width = 300000;
-      d_channel_filter = gr::filter::firdes::low_pass( gain, 
-                                              sample_rate, 
-                                              d_channel_filter_width, 
-                                              transition_width, 
-                                              gr::filter::firdes::WIN_HANN);
-
-      /* noise filter coefficients */
-      double n_gain = 1;
-      d_noise_filter_width = 22500;
-      double n_trans_width = 10000;
-      d_noise_filter = gr::filter::firdes::low_pass( n_gain, 
-                                            sample_rate, 
-                                            d_noise_filter_width, 
-                                            n_trans_width, 
-                                            gr::filter::firdes::WIN_HANN );
-
-      /* we will decimate by the largest integer that results in enough samples per symbol */
-      d_ddc_decimation_rate = (int) (d_samples_per_symbol / 2);
-      double channel_samples_per_symbol = (d_samples_per_symbol / d_ddc_decimation_rate);
-
-      set_channels();
-
-      /* fm demodulator */
-      d_demod_gain = channel_samples_per_symbol / M_PI_2;
-
-      /* mm_cr variables */
-      d_gain_mu = 0.175;
-      d_mu = 0.32;
-      d_omega_relative_limit = 0.005;
-      d_omega = channel_samples_per_symbol;
-      d_gain_omega = .25 * d_gain_mu * d_gain_mu;
-      d_omega_mid = d_omega;
-      d_interp = new gr::filter::mmse_fir_interpolator_ff();
-      d_last_sample = 0;
-      
-      /* the required history is the slot data + the max of either
-         channed DDC + demod, or noise DDC */
-      int channel_history = (int) (d_channel_filter.size( ) + 
-                                   d_ddc_decimation_rate * d_interp->ntaps());
-      int noise_history   = (int) d_noise_filter.size( );
-      if (channel_history > noise_history) {
-        history_required += channel_history;
-        d_first_channel_sample = 0;
-        d_first_noise_sample   = (channel_history - noise_history);
-      }
-      else {
-        history_required += noise_history;
-        d_first_noise_sample   = 0;
-        d_first_channel_sample = (noise_history - channel_history);
-      }
-
-      printf( "history set to %d samples: channel=%d, noise=%d\n", 
-              history_required, channel_history, noise_history );
+      d_window_start = 0;
+      d_window_end = UINT64_MAX;
+      d_packets_detected = 0;
+      d_packets_decoded = 0;
+
+      /* no slot budget until asked for */
+      d_slot_budget_us = 0;
+      d_slot_debt_us = 0;
+      d_channel_cost_us = 0;
+      d_channel_open = false;
+      d_slot_forced = 0;
+      d_slot_rotation = 0;
+      d_channel_skips.assign(79, 0);
+
+      d_retune_pending = false;
+      d_pending_center_freq = d_center_freq;
+      d_pending_channel_mask = d_channel_mask;
+
+      message_port_register_in(pmt::mp("ctrl"));
+      set_msg_handler(pmt::mp("ctrl"), boost::bind(&multi_block::handle_ctrl, this, _1));
+
+      printf( "history set to %d samples: channel=%d\n", 
+              d_input_history, channel_history() );
+
+      set_history( d_input_history );
+    }
 
-      set_history( history_required );
-    }  
+    bool
+    multi_block::set_le_2m(bool enabled)
+    {
+      return enable_le_2m(enabled);
+    }
 
-    static inline float slice(float x)
+    void
+    multi_block::set_le_coded(bool enabled)
     {
-      return (x < 0) ? -1.0F : 1.0F;
+      enable_le_coded(enabled);
+      if ((int) history() < d_input_history)
+        set_history( d_input_history );
     }
 
-    /* M&M clock recovery, adapted from gr_clock_recovery_mm_ff */
-    int 
-    multi_block::mm_cr(const float *in, int ninput_items, float *out, int noutput_items)
+    uint64_t
+    multi_block::channel_slots(int channel)
     {
-      unsigned int ii = 0; /* input index */
-      int          oo = 0; /* output index */
-      unsigned int ni = ninput_items - d_interp->ntaps(); /* max input */
-      float        mm_val;
-
-      while ((oo < noutput_items) && (ii < ni)) {
-        // produce output sample
-		//printf("d_mu %3.3f\n", d_mu);
-        out[oo]       = d_interp->interpolate( &in[ii], d_mu );
-        mm_val        = slice(d_last_sample) * out[oo] - slice(out[oo]) * d_last_sample;
-        d_last_sample = out[oo];
-        
-        d_omega += d_gain_omega * mm_val;
-        d_omega  = d_omega_mid + gr::branchless_clip( d_omega-d_omega_mid, 
-                                                     d_omega_relative_limit );   // make sure we don't walk away
-        d_mu    += d_omega + d_gain_mu * mm_val;
-
-        ii      += (int) floor( d_mu );
-        d_mu    -= floor( d_mu );
-        oo++;
-      }
+      if ((channel < 0) || (channel >= (int) d_channel_slots.size()))
+        return 0;
+      return d_channel_slots[channel];
+    }
 
-      /* return number of output items produced */
-      return oo;
+    void
+    multi_block::set_slot_budget(double budget)
+    {
+      d_slot_budget_us = (budget > 0) ? budget * 1e6 * d_samples_per_slot / d_sample_rate : 0;
+      d_slot_debt_us = 0;
     }
 
-    /* fm demodulation, taken from gr_quadrature_demod_cf */
-    void 
-    multi_block::demod(const gr_complex *in, float *out, int noutput_items)
+    double
+    multi_block::slot_budget()
     {
-      int i;
-      gr_complex product;
+      return d_slot_budget_us * d_sample_rate / d_samples_per_slot / 1e6;
+    }
 
-      for (i = 1; i < noutput_items; i++) {
-        gr_complex product = in[i] * conj (in[i-1]);
-        out[i] = d_demod_gain * gr::fast_atan2f(imag(product), real(product));
-      }
+    uint64_t
+    multi_block::channel_skips(int channel)
+    {
+      if ((channel < 0) || (channel >= (int) d_channel_skips.size()))
+        return 0;
+      return d_channel_skips[channel];
     }
 
-    /* binary slicer, similar to gr_binary_slicer_fb */
-    void 
-    multi_block::slicer(const float *in, char *out, int noutput_items)
+    uint64_t
+    multi_block::skipped_channel_slots()
     {
-      int i;
+      uint64_t total = 0;
+      for (size_t ch = 0; ch < d_channel_skips.size(); ch++)
+        total += d_channel_skips[ch];
+      return total;
+    }
 
-      for (i = 0; i < noutput_items; i++)
-        out[i] = (in[i] < 0) ? 0 : 1;
+    static inline double
+    elapsed_us(std::chrono::steady_clock::time_point from,
+               std::chrono::steady_clock::time_point to)
+    {
+      return std::chrono::duration<double, std::micro>(to - from).count();
     }
 
-    int 
-    multi_block::channel_samples( double                     freq,
-                                  gr_vector_const_void_star& in, 
-                                  gr_vector_void_star&       out,
-                                  double&                    energy,
-                                  int                        ninput_items )
+    const std::vector<int> &
+    multi_block::begin_slot(const std::vector<int> &predicted)
     {
-      int ddc_noutput_items       = 0;
-      int classic_chan = abs_freq_channel( freq );
-      std::map<int, gr::filter::freq_xlating_fir_filter_ccf::sptr>::const_iterator ddci = 
-        d_channel_ddcs.find( classic_chan );
-
-      if (ddci != d_channel_ddcs.end( )) {
-        gr::filter::freq_xlating_fir_filter_ccf::sptr ddc = ddci->second;
-        int ddc_samples = ninput_items - (ddc->history( ) - 1) - d_first_channel_sample;
-		// This changes how many iterations it takes to crash... Definitely on to something.
-		//printf("ddc_samples: %i\n", ddc_samples);
-		//printf("fcs: %i\n", d_first_channel_sample);
-        gr_vector_const_void_star ddc_in( 1 );
-        ddc_in[0] = &(((gr_complex *) in[0])[d_first_channel_sample]);
-        ddc_noutput_items = ddc->fixed_rate_ninput_to_noutput( ddc_samples ); // ddc_samples
-		//printf("ddc_noutput_items: %i\n", ddc_noutput_items);
-		//gr_vector_void_star ddc_out( 1 );
-		//ddc_out[0] = out[0];//malloc(100000);
-        ddc_noutput_items = ddc->work( ddc_noutput_items, ddc_in, out );
-		//printf("after work %i\n", ddc_noutput_items);
-        gr::blocks::complex_to_mag_squared::sptr mag2 = gr::blocks::complex_to_mag_squared::make( 1 );
-		//printf("past\n");
-        float *mag2_out = new float[ddc_noutput_items];
-        gr_vector_void_star mag2_out_vector( 1 );
-        mag2_out_vector[0] = &mag2_out[0];
-        gr_vector_const_void_star ddc_out_const( 1 );
-        ddc_out_const[0] = out[0];
-        (void) mag2->work( ddc_noutput_items, ddc_out_const, mag2_out_vector );
-        energy = 0.0;
-        for( unsigned i=0; i<ddc_noutput_items; i++ ) {
-          energy += mag2_out[i];
+      int low = abs_freq_channel( d_low_freq );
+      int high = abs_freq_channel( d_high_freq );
+      if (low < 0)
+        low = 0;
+      if (high > 78)
+        high = 78;
+
+      d_slot_order.clear();
+      if (d_slot_budget_us <= 0) {
+        for (int ch = low; ch <= high; ch++) {
+          if (d_channel_mask[ch])
+            d_slot_order.push_back(ch);
         }
-        energy /= ddc_noutput_items;
-		delete [] mag2_out;
-		//free(ddc_out[0]);
-        //energy /= d_channel_filter_width;
+        d_slot_forced = d_slot_order.size();
+        return d_slot_order;
       }
-      else {
-        energy = 1.0;
+
+      bool taken[79] = { false };
+      for (size_t i = 0; i < predicted.size(); i++) {
+        int ch = predicted[i];
+        if ((ch >= low) && (ch <= high) && d_channel_mask[ch] && !taken[ch]) {
+          d_slot_order.push_back(ch);
+          taken[ch] = true;
+        }
+      }
+      d_slot_forced = d_slot_order.size();
+
+      /* active channels, then the others, each from a rotating start */
+      uint64_t slot = (uint64_t) (d_cumulative_count / d_samples_per_slot);
+      int span = high - low + 1;
+      for (int pass = 0; (pass < 2) && (span > 0); pass++) {
+        for (int i = 0; i < span; i++) {
+          int ch = low + (i + d_slot_rotation) % span;
+          if (taken[ch] || !d_channel_mask[ch])
+            continue;
+          bool active = d_last_active[ch] && (slot + 1 - d_last_active[ch] < ACTIVE_SLOTS);
+          if (active == (pass == 0)) {
+            d_slot_order.push_back(ch);
+            taken[ch] = true;
+          }
+        }
       }
+      d_slot_rotation = (d_slot_rotation + 1) % 79;
 
-      return ddc_noutput_items;
+      d_slot_start = std::chrono::steady_clock::now();
+      d_channel_open = false;
+      return d_slot_order;
     }
 
-    int 
-    multi_block::channel_symbols( gr_vector_const_void_star& in, 
-                                  char *                     out, 
-                                  int                        ninput_items )
+    bool
+    multi_block::in_budget(size_t n)
     {
-      /* fm demodulation */
-      int demod_noutput_items = ninput_items - 1;
-      float demod_out[demod_noutput_items];
-      gr_complex *ch_samps = (gr_complex *) in[0];
-      demod( ch_samps, demod_out, demod_noutput_items );
-      
-      /* clock recovery */
-      int cr_ninput_items = demod_noutput_items;
-      int noutput_items = cr_ninput_items; // poor estimate but probably safe
-      float cr_out[noutput_items];
-      noutput_items = mm_cr(demod_out, cr_ninput_items, cr_out, noutput_items);
-      
-      /* binary slicer */
-      slicer(cr_out, out, noutput_items);
-      
-      return noutput_items;
+      if (d_slot_budget_us <= 0)
+        return true;
+
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if (d_channel_open)
+        d_channel_cost_us += (elapsed_us(d_channel_start, now) - d_channel_cost_us) / 16;
+
+      if ((n >= d_slot_forced) &&
+          (elapsed_us(d_slot_start, now) + d_channel_cost_us > d_slot_budget_us - d_slot_debt_us)) {
+        d_channel_skips[d_slot_order[n]]++;
+        d_channel_open = false;
+        return false;
+      }
+
+      d_channel_start = now;
+      d_channel_open = true;
+      return true;
     }
 
-    bool 
-    multi_block::check_snr( const double               freq, 
-                            const double               on_channel_energy,
-                            double&                    snr,
-                            gr_vector_const_void_star& in )
+    void
+    multi_block::end_slot()
     {
-      double off_channel_energy = 0.0;
-
-      int classic_chan = abs_freq_channel( freq );
-      std::map<int, gr::filter::freq_xlating_fir_filter_ccf::sptr>::const_iterator nddci = 
-        d_noise_ddcs.find( classic_chan );
-
-      if (nddci != d_noise_ddcs.end( )) {
-        gr::filter::freq_xlating_fir_filter_ccf::sptr nddc = nddci->second;
-        gr_vector_const_void_star ddc_in( 1 );
-        ddc_in[0] = &(((gr_complex *) in[0])[d_first_noise_sample]);
-        int ddc_noutput_items = nddc->fixed_rate_ninput_to_noutput( (int) d_samples_per_slot );
-        gr_complex ddc_out[ddc_noutput_items];
-        gr_vector_void_star ddc_out_vector( 1 );
-        gr_vector_const_void_star ddc_out_const( 1 );
-        ddc_out_vector[0] = &ddc_out[0];
-        ddc_out_const[0]  = &ddc_out[0];
-        ddc_noutput_items = nddc->work( ddc_noutput_items, ddc_in, ddc_out_vector );
-      
-        // average mag2 for valley
-        gr::blocks::complex_to_mag_squared::sptr mag2 = gr::blocks::complex_to_mag_squared::make( 1 );
-        float mag2_out[ddc_noutput_items];
-        gr_vector_void_star mag2_out_vector( 1 );
-        mag2_out_vector[0] = &mag2_out[0];
-        (void) mag2->work( ddc_noutput_items, ddc_out_const, mag2_out_vector );
-        for( unsigned i=0; i<ddc_noutput_items; i++ ) {
-          off_channel_energy += mag2_out[i];
-        }
-        off_channel_energy /= ddc_noutput_items;
-        //off_channel_energy /= d_noise_filter_width;
-      }
-      else {
-        off_channel_energy = 1.0;
+      if (d_slot_budget_us <= 0)
+        return;
+
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if (d_channel_open)
+        d_channel_cost_us += (elapsed_us(d_channel_start, now) - d_channel_cost_us) / 16;
+      d_channel_open = false;
+
+      /* what this slot took beyond its budget is owed by the next ones */
+      d_slot_debt_us += elapsed_us(d_slot_start, now) - d_slot_budget_us;
+      if (d_slot_debt_us < 0)
+        d_slot_debt_us = 0;
+      if (d_slot_debt_us > MAX_DEBT_SLOTS * d_slot_budget_us)
+        d_slot_debt_us = MAX_DEBT_SLOTS * d_slot_budget_us;
+    }
+
+    void
+    multi_block::set_window(uint64_t start, uint64_t duration)
+    {
+      d_window_start = start;
+      d_window_end = duration ? start + duration : UINT64_MAX;
+      d_cumulative_count = start;
+    }
+
+    void
+    multi_block::set_window_slots(uint64_t start_slot, uint64_t duration_slots)
+    {
+      /* work() advances by whole samples per slot, so must this */
+      uint64_t samples_per_slot = (uint64_t) d_samples_per_slot;
+      set_window(start_slot * samples_per_slot, duration_slots * samples_per_slot);
+    }
+
+    void
+    multi_block::set_profiling(bool enabled)
+    {
+      if (enabled && !d_stats->enabled())
+        d_stats->reset();
+      d_stats->set_enabled(enabled);
+    }
+
+    std::string
+    multi_block::profile_report()
+    {
+      return d_stats->report();
+    }
+
+    bool
+    multi_block::stop()
+    {
+      if (d_stats->enabled())
+        fprintf(stderr, "%s stage profile:\n%s", alias().c_str(), d_stats->report().c_str());
+      if (skipped_channel_slots() > 0)
+        fprintf(stderr, "%s: %llu channel slots skipped over the slot budget\n",
+                alias().c_str(), (unsigned long long) skipped_channel_slots());
+      return gr::sync_block::stop();
+    }
+
+    template <int S> double
+    multi_block::stage_total_ns()
+    {
+      return d_stats->total_ns(S);
+    }
+
+    template <int S> double
+    multi_block::stage_calls()
+    {
+      return (double) d_stats->calls(S);
+    }
+
+#ifdef GR_CTRLPORT
+    /* registers the getters of stage S and all stages after it */
+    template <int S>
+    struct stage_rpc
+    {
+      static void add(multi_block *block)
+      {
+        std::string name(stage_stats::STAGE_NAMES[S]);
+        block->add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<multi_block, double>(
+            block->alias(), (name + "_ns").c_str(),
+            &multi_block::stage_total_ns<S>,
+            pmt::mp(0.0), pmt::mp(1.0e15), pmt::mp(0.0),
+            "ns", ("Total time in " + name).c_str(),
+            RPC_PRIVLVL_MIN, DISPTIME | DISPOPTSTRIP)));
+        block->add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<multi_block, double>(
+            block->alias(), (name + "_calls").c_str(),
+            &multi_block::stage_calls<S>,
+            pmt::mp(0.0), pmt::mp(1.0e15), pmt::mp(0.0),
+            "calls", ("Calls to " + name).c_str(),
+            RPC_PRIVLVL_MIN, DISPTIME | DISPOPTSTRIP)));
+        stage_rpc<S+1>::add(block);
       }
+    };
 
-      snr = 10.0 * log10( on_channel_energy / off_channel_energy );
+    template <>
+    struct stage_rpc<stage_stats::NUM_STAGES>
+    {
+      static void add(multi_block *block) {}
+    };
+#endif
 
-      return (snr >= d_target_snr);
+    void
+    multi_block::setup_rpc()
+    {
+#ifdef GR_CTRLPORT
+      stage_rpc<0>::add(this);
+#endif
     }
 
     /* add some number of symbols to the block's history requirement */
     void 
     multi_block::set_symbol_history(int num_symbols)
     {
-      set_history((int) (history() + (num_symbols * d_samples_per_symbol)));
+      set_input_history( d_input_history + (int) (num_symbols * d_samples_per_symbol) );
+      set_history( d_input_history );
     }
 
-    /* set available channels based on d_center_freq and d_sample_rate */
-    void 
-    multi_block::set_channels()
+    void
+    multi_block::set_center_freq(double center_freq)
+    {
+      std::lock_guard<std::mutex> lock(d_retune_mutex);
+      d_pending_center_freq = center_freq;
+      d_retune_pending = true;
+    }
+
+    double
+    multi_block::center_freq()
+    {
+      std::lock_guard<std::mutex> lock(d_retune_mutex);
+      return d_pending_center_freq;
+    }
+
+    void
+    multi_block::set_channel_mask(const std::vector<int> &channels)
     {
-      /* center frequency described as a fractional channel */
-      double center = (d_center_freq - BASE_FREQUENCY) / CHANNEL_WIDTH;
-      /* bandwidth in terms of channels */
-      double channel_bandwidth = d_sample_rate / CHANNEL_WIDTH;
-      /* low edge of our received signal */
-      double low_edge = center - (channel_bandwidth / 2);
-      /* high edge of our received signal */
-      double high_edge = center + (channel_bandwidth / 2);
-      /* minimum bandwidth required per channel - ideally 1.0 (1 MHz), but can probably decode with a bit less */
-      double min_channel_width = 0.9;
-
-      int low_classic_channel = (int) (low_edge + (min_channel_width / 2) + 1);
-      low_classic_channel = (low_classic_channel < 0) ? 0 : low_classic_channel;
-
-      int high_classic_channel = (int) (high_edge - (min_channel_width / 2));
-      high_classic_channel = (high_classic_channel > 78) ? 78 : high_classic_channel;
-
-      d_low_freq = channel_abs_freq(low_classic_channel);
-      d_high_freq = channel_abs_freq(high_classic_channel);
-
-      for( int ch=low_classic_channel; ch<=high_classic_channel; ch++ ) {
-        double freq = channel_abs_freq( ch );
-        d_channel_ddcs[ch] = 
-          gr::filter::freq_xlating_fir_filter_ccf::make( d_ddc_decimation_rate, 
-                                               d_channel_filter, 
-                                               freq-d_center_freq, 
-                                               d_sample_rate );
-        d_noise_ddcs[ch] = 
-          gr::filter::freq_xlating_fir_filter_ccf::make( d_ddc_decimation_rate, 
-                                               d_noise_filter, 
-                                               freq+790000.0-d_center_freq, 
-                                               d_sample_rate );
+      std::lock_guard<std::mutex> lock(d_retune_mutex);
+      d_pending_channel_mask.assign(79, channels.empty());
+      for (size_t i = 0; i < channels.size(); i++) {
+        if ((channels[i] >= 0) && (channels[i] <= 78))
+          d_pending_channel_mask[channels[i]] = true;
       }
+      d_retune_pending = true;
     }
 
-    /* returns relative (with respect to d_center_freq) frequency in Hz of given channel */
-    double 
-    multi_block::channel_rel_freq(int channel)
+    std::vector<int>
+    multi_block::channel_mask()
     {
-      return channel_abs_freq(channel) - d_center_freq;
+      std::lock_guard<std::mutex> lock(d_retune_mutex);
+      std::vector<int> channels;
+      for (int ch = 0; ch <= 78; ch++) {
+        if (d_pending_channel_mask[ch])
+          channels.push_back(ch);
+      }
+      return channels;
     }
 
-    double 
-    multi_block::channel_abs_freq(int channel)
+    void
+    multi_block::retune()
     {
-      return BASE_FREQUENCY + (channel * CHANNEL_WIDTH);
+      if (!d_retune_pending.load(std::memory_order_acquire))
+        return;
+
+      std::lock_guard<std::mutex> lock(d_retune_mutex);
+      tune(d_pending_center_freq, d_pending_channel_mask);
+      d_retune_pending = false;
     }
 
-    int
-    multi_block::abs_freq_channel(double freq)
+    void
+    multi_block::handle_ctrl(pmt::pmt_t msg)
     {
-      return (int) ((freq - BASE_FREQUENCY) / CHANNEL_WIDTH);
+      if (!pmt::is_dict(msg))
+        return;
+
+      pmt::pmt_t freq = pmt::dict_ref(msg, pmt::mp("freq"), pmt::PMT_NIL);
+      if (pmt::is_number(freq))
+        set_center_freq(pmt::to_double(freq));
+
+      pmt::pmt_t channels = pmt::dict_ref(msg, pmt::mp("channels"), pmt::PMT_NIL);
+      if (pmt::is_s32vector(channels)) {
+        size_t n;
+        const int32_t *elements = pmt::s32vector_elements(channels, n);
+        set_channel_mask(std::vector<int>(elements, elements + n));
+      }
+      else if (pmt::is_vector(channels)) {
+        std::vector<int> mask;
+        for (size_t i = 0; i < pmt::length(channels); i++)
+          mask.push_back((int) pmt::to_long(pmt::vector_ref(channels, i)));
+        set_channel_mask(mask);
+      }
     }
+
   } /* namespace bluetooth */
 } /* namespace gr */
-
@@ -29,41 +29,58 @@
 
 #include <gnuradio/io_signature.h>
 #include "multi_hopper_impl.h"
+#include "stage_stats.h"
+#include <boost/bind.hpp>
+#include <algorithm>
 
 namespace gr {
   namespace bluetooth {
 
     multi_hopper::sptr
-    multi_hopper::make(double sample_rate, double center_freq, double squelch_threshold, int LAP, bool aliased, bool tun)
+    multi_hopper::make(double sample_rate, double center_freq, double squelch_threshold, int LAP, bool aliased, bool tun,
+                       const std::string &pcap_file, const std::string &input_format)
     {
-      return gnuradio::get_initial_sptr (new multi_hopper_impl(sample_rate, center_freq, squelch_threshold, LAP, aliased, tun));
+      return gnuradio::get_initial_sptr (new multi_hopper_impl(sample_rate, center_freq, squelch_threshold, LAP, aliased, tun,
+                                                               pcap_file, input_format));
     }
 
     /*
      * The private constructor
      */
-    multi_hopper_impl::multi_hopper_impl(double sample_rate, double center_freq, double squelch_threshold, int LAP, bool aliased, bool tun)
-      : multi_block(sample_rate, center_freq, squelch_threshold),
+    multi_hopper_impl::multi_hopper_impl(double sample_rate, double center_freq, double squelch_threshold, int LAP, bool aliased, bool tun,
+                                         const std::string &pcap_file, const std::string &input_format)
+      : multi_block(sample_rate, center_freq, squelch_threshold, sample_format(input_format)),
         gr::sync_block ("bluetooth multi hopper block",
-                       gr::io_signature::make (1, 1, sizeof (gr_complex)),
-                       gr::io_signature::make (0, 0, 0))
+                       gr::io_signature::make (1, 1, sample_size (sample_format (input_format))),
+                       gr::io_signature::make (0, 0, 0)),
+        d_targets_pending(false), d_max_targets(MAX_TARGETS), d_adopt(false)
     {
-        d_LAP = LAP;
 	d_aliased = aliased;
 	d_tun = tun;
 	set_symbol_history(SYMBOLS_FOR_BASIC_RATE_HISTORY);
-	d_piconet = basic_rate_piconet::make(d_LAP);
+	if (LAP >= 0)
+		add_target(LAP);
 
 	/* Tun interface */
 	if(d_tun) {
-		strncpy(chan_name, "btbb", sizeof(chan_name)-1);
-
-		if((d_tunfd = mktun(chan_name, d_ether_addr)) == -1) {
-			fprintf(stderr, "warning: was not able to open TUN device, "
-			  "disabling Wireshark interface\n");
+		d_tun_writer = tun_writer::make("btbb");
+		if(!d_tun_writer->is_open()) {
+			d_tun = false;
 			// throw std::runtime_error("cannot open TUN device");
 		}
 	}
+
+	/* pcapng file */
+	if(!pcap_file.empty()) {
+		d_pcap = pcapng_writer::make(pcap_file);
+		if(!d_pcap->is_open())
+			d_pcap.reset();
+	}
+
+	d_log = event_log::make();
+	message_port_register_out(d_pdu.port());
+	message_port_register_in(pmt::mp("targets"));
+	set_msg_handler(pmt::mp("targets"), boost::bind(&multi_hopper_impl::handle_targets, this, _1));
     }
 
     /*
@@ -73,69 +90,248 @@ namespace gr {
     {
     }
 
+    bool
+    multi_hopper_impl::add_target(int LAP)
+    {
+      LAP &= 0xffffff;
+      std::lock_guard<std::mutex> lock(d_target_mutex);
+      if (std::find(d_target_list.begin(), d_target_list.end(), LAP) != d_target_list.end())
+        return true;
+      int max_targets = d_max_targets.load();
+      if ((max_targets > 0) && ((int) d_target_list.size() >= max_targets))
+        return false;
+      d_target_list.push_back(LAP);
+      d_targets_pending = true;
+      return true;
+    }
+
+    bool
+    multi_hopper_impl::remove_target(int LAP)
+    {
+      LAP &= 0xffffff;
+      std::lock_guard<std::mutex> lock(d_target_mutex);
+      std::vector<int>::iterator it = std::find(d_target_list.begin(), d_target_list.end(), LAP);
+      if (it == d_target_list.end())
+        return false;
+      d_target_list.erase(it);
+      d_targets_pending = true;
+      return true;
+    }
+
+    std::vector<int>
+    multi_hopper_impl::targets()
+    {
+      std::lock_guard<std::mutex> lock(d_target_mutex);
+      return d_target_list;
+    }
+
+    void
+    multi_hopper_impl::update_targets()
+    {
+      if (!d_targets_pending.exchange(false))
+        return;
+
+      std::vector<int> list;
+      std::vector<int> sightings;
+      {
+        std::lock_guard<std::mutex> lock(d_target_mutex);
+        list = d_target_list;
+        sightings.swap(d_pdu_sightings);
+      }
+      uint32_t clkn = (uint32_t) (d_cumulative_count / d_samples_per_slot) & 0x7ffffff;
+      uint64_t slot = (uint64_t) (d_cumulative_count / d_samples_per_slot);
+      uint64_t timestamp_us = (uint64_t) (d_cumulative_count * (1e6 / d_sample_rate));
+
+      std::vector<uint32_t> removed;
+      d_targets.for_each([&](uint32_t lap, basic_rate_piconet::sptr &pn) {
+        if (std::find(list.begin(), list.end(), (int) lap) == list.end())
+          removed.push_back(lap);
+      });
+      for (size_t i = 0; i < removed.size(); i++) {
+        d_targets.erase(removed[i]);
+        d_adopted.erase(removed[i]);
+        d_log->target(removed[i], false, clkn, timestamp_us);
+      }
+
+      std::vector<int> added;
+      for (size_t i = 0; i < list.size(); i++) {
+        if (!d_targets.find(list[i])) {
+          d_targets[list[i]] = basic_rate_piconet::make(list[i]);
+          added.push_back(list[i]);
+          d_log->target(list[i], true, clkn, timestamp_us);
+        }
+      }
+
+      /* a PDU is a sighting, new targets from one are adopted ones */
+      for (size_t i = 0; i < sightings.size(); i++) {
+        uint64_t *adopted = d_adopted.find(sightings[i]);
+        if (adopted)
+          *adopted = slot + 1;
+        else if (std::find(added.begin(), added.end(), sightings[i]) != added.end())
+          d_adopted[sightings[i]] = slot + 1;
+      }
+    }
+
+    bool
+    multi_hopper_impl::adopt_target(int LAP)
+    {
+      if (!add_target(LAP))
+        return false;
+      std::lock_guard<std::mutex> lock(d_target_mutex);
+      d_pdu_sightings.push_back(LAP & 0xffffff);
+      d_targets_pending = true;
+      return true;
+    }
+
+    void
+    multi_hopper_impl::handle_targets(pmt::pmt_t msg)
+    {
+      /* a multi_sniffer PDU, adopt piconets that have shown a UAP */
+      if (pmt::is_pair(msg) && pmt::is_u8vector(pmt::cdr(msg))) {
+        pmt::pmt_t meta = pmt::car(msg);
+        pmt::pmt_t lap = pmt::dict_ref(meta, pmt::mp("lap"), pmt::PMT_NIL);
+        if (d_adopt && pmt::is_integer(lap) && pmt::dict_has_key(meta, pmt::mp("uap")))
+          adopt_target((int) pmt::to_long(lap));
+        return;
+      }
+
+      if (pmt::is_integer(msg)) {
+        add_target((int) pmt::to_long(msg));
+        return;
+      }
+
+      if (!pmt::is_dict(msg))
+        return;
+
+      pmt::pmt_t lap = pmt::dict_ref(msg, pmt::mp("lap"), pmt::PMT_NIL);
+      if (!pmt::is_integer(lap))
+        return;
+      pmt::pmt_t remove = pmt::dict_ref(msg, pmt::mp("remove"), pmt::PMT_F);
+      if (pmt::is_bool(remove) && pmt::to_bool(remove))
+        remove_target((int) pmt::to_long(lap));
+      else
+        add_target((int) pmt::to_long(lap));
+    }
+
+    bool
+    multi_hopper_impl::sighted(uint32_t lap, uint64_t slot)
+    {
+      sighting *candidate = d_adopt_candidates.find(lap);
+      if (!candidate) {
+        /*
+         * noise leaves a candidate for every random LAP, keep that
+         * bounded by dropping the one seen longest ago
+         */
+        if (d_adopt_candidates.size() >= MAX_ADOPT_CANDIDATES) {
+          uint32_t oldest_lap = 0;
+          uint64_t oldest = UINT64_MAX;
+          d_adopt_candidates.for_each([&](uint32_t key, sighting &s) {
+            if (s.slot < oldest) {
+              oldest = s.slot;
+              oldest_lap = key;
+            }
+          });
+          d_adopt_candidates.erase(oldest_lap);
+        }
+        candidate = &d_adopt_candidates[lap];
+      }
+
+      /* a second packet in the same slot proves nothing more */
+      if (candidate->slot == slot + 1)
+        return false;
+      if (candidate->slot && (slot + 1 - candidate->slot > ADOPT_WINDOW))
+        candidate->count = 0;
+      candidate->slot = slot + 1;
+      if (++candidate->count < ADOPT_SIGHTINGS)
+        return false;
+
+      d_adopt_candidates.erase(lap);
+      return true;
+    }
+
+    void
+    multi_hopper_impl::expire_targets(uint64_t slot)
+    {
+      std::vector<uint32_t> expired;
+      d_adopted.for_each([&](uint32_t lap, uint64_t &last) {
+        if (slot + 1 - last > ADOPT_TIMEOUT)
+          expired.push_back(lap);
+      });
+      for (size_t i = 0; i < expired.size(); i++) {
+        d_adopted.erase(expired[i]);
+        remove_target(expired[i]);
+      }
+      if (!expired.empty())
+        update_targets();
+    }
+
+    int
+    multi_hopper_impl::observed_channel(basic_rate_piconet::sptr piconet, uint32_t clkn)
+    {
+      int channel = piconet->hop((clkn + piconet->get_offset()) & 0x7ffffff);
+      if (channel < 0)
+        return -1;
+      /* an aliasing receiver sees the hop on a different channel */
+      if (d_aliased)
+        channel = piconet->aliased_channel(channel);
+      double freq = channel_abs_freq(channel);
+      if ((freq < d_low_freq) || (freq > d_high_freq))
+        return -1;
+      return channel;
+    }
+
     int
     multi_hopper_impl::work(int noutput_items,
                             gr_vector_const_void_star &input_items,
                             gr_vector_void_star &output_items)
     {
-      int retval, latest_ac;
       uint32_t clkn; /* native (local) clock in 625 us */
-      double freq;
-      char symbols[history()+40]; //poor estimate but safe
 
-      clkn = (int) (d_cumulative_count / d_samples_per_slot) & 0x7ffffff;
+      if (window_done())
+        return WORK_DONE;
+      retune();
+      update_targets();
 
-      if (d_piconet->have_clk27()) {
-        /* now that we know the clock and UAP, follow along and sniff each time slot on the correct channel */
-        hopalong(input_items, symbols, clkn, noutput_items);
-      } 
-      else {
-        for (freq = d_low_freq; freq <= d_high_freq; freq += 1e6) {
-          gr_complex ch_samples[noutput_items];
-          gr_vector_void_star btch( 1 );
-          btch[0] = ch_samples;
-          double on_channel_energy, snr;
-          int ch_count = channel_samples( freq, input_items, btch, on_channel_energy, history() );
-          bool brok = check_snr( freq, on_channel_energy, snr, input_items );
-          if (brok) {
-            gr_vector_const_void_star cbtch( 1 );
-            cbtch[0] = ch_samples;
-            int num_symbols = channel_symbols( cbtch, symbols, ch_count );
-            
-            if (num_symbols >= SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) {
-              /* don't look beyond one slot for ACs */
-              latest_ac = ((num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
-                (num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
-              retval = classic_packet::sniff_ac(symbols, latest_ac);
-              if(retval > -1) {
-                classic_packet::sptr packet = classic_packet::make(
-                                                                   &symbols[retval], num_symbols - retval,
-                                                                   clkn, freq);
-                if (packet->get_LAP() == d_LAP && packet->header_present()) {
-                  if (!d_piconet->have_clk6()) {
-                    /* working on CLK1-6/UAP discovery */
-                    d_piconet->UAP_from_header(packet);
-                    if (d_piconet->have_clk6()) {
-                      /* got CLK1-6/UAP, start working on CLK1-27 */
-                      d_piconet->init_hop_reversal(d_aliased);
-                      /* use previously observed packets to eliminate candidates */
-                      d_piconet->winnow();
-                    }
-                  } else {
-                    /* continue working on CLK1-27 */
-                    /* we need timing information from an additional packet, so run through UAP_from_header() again */
-                    d_piconet->UAP_from_header(packet);
-                    if (!d_piconet->have_clk6()) {
-                      break;
-                    }
-                    d_piconet->winnow();
-                  }
-                  break;
-                }
-              }
-            }
-          }
+      uint64_t slot = (uint64_t) (d_cumulative_count / d_samples_per_slot);
+      clkn = slot & 0x7ffffff;
+      d_discovered.clear();
+      expire_targets(slot);
+      start_reversals();
+
+      /*
+       * Targets with a known clock are only looked for on the channel
+       * they hop to.  While any target is still working on its UAP and
+       * clock, or new ones may be adopted, every channel is searched,
+       * the predicted ones first.
+       */
+      int max_targets = d_max_targets.load();
+      bool hunting = d_adopt && ((max_targets == 0) || ((int) d_targets.size() < max_targets));
+      std::vector<int> predicted;
+      bool taken[79] = { false };
+      d_targets.for_each([&](uint32_t lap, basic_rate_piconet::sptr &pn) {
+        if (!pn->have_clk27()) {
+          hunting = true;
+          return;
+        }
+        int channel = observed_channel(pn, clkn);
+        if ((channel >= 0) && !taken[channel]) {
+          predicted.push_back(channel);
+          taken[channel] = true;
         }
+      });
+
+      if (hunting) {
+        const std::vector<int> &channels = begin_slot(predicted);
+        for (size_t n = 0; n < channels.size(); n++) {
+          if (!in_budget( n ))
+            continue;
+          search_channel(channels[n], input_items, clkn);
+        }
+        end_slot();
+      }
+      else {
+        for (size_t n = 0; n < predicted.size(); n++)
+          search_channel(predicted[n], input_items, clkn);
       }
       d_cumulative_count += (int) d_samples_per_slot;
         
@@ -150,61 +346,171 @@ namespace gr {
     }
 
     void
-    multi_hopper_impl::hopalong(gr_vector_const_void_star &input_items,
-                                char *symbols, uint32_t clkn, int noutput_items)
+    multi_hopper_impl::search_channel(int channel, gr_vector_const_void_star &input_items,
+                                      uint32_t clkn)
     {
+      gr_complex *ch_samples = &d_ch_samples[0];
+      char *symbols = &d_symbols[0];
       int ac_index, latest_ac;
-      uint32_t clock27 = (clkn + d_piconet->get_offset()) & 0x7ffffff;
-      double obs_freq, freq = channel_abs_freq( d_piconet->hop(clock27) );
-      if (d_aliased)
-        obs_freq = channel_abs_freq( d_piconet->aliased_channel( d_piconet->hop(clock27) ) );
-      else
-        obs_freq = freq;
-      if ((obs_freq >= d_low_freq) && (obs_freq <= d_high_freq)) {
-        gr_complex ch_samples[noutput_items];
-        gr_vector_void_star btch( 1 );
-        btch[0] = ch_samples;
-        double on_channel_energy, snr;
-        int ch_count = channel_samples( freq, input_items, btch, on_channel_energy, history() );
-        bool brok = check_snr( freq, on_channel_energy, snr, input_items );
-        if (brok) {
-          gr_vector_const_void_star cbtch( 1 );
-          cbtch[0] = ch_samples;
-          int num_symbols = channel_symbols( cbtch, symbols, ch_count );
-          if (num_symbols >= SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE ) {
-            latest_ac = ((num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
-              (num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
-            ac_index = classic_packet::sniff_ac(symbols, latest_ac);
-            if(ac_index > -1) {
-              classic_packet::sptr packet = classic_packet::make(&symbols[ac_index], num_symbols - ac_index, 0, obs_freq);
-              if(packet->get_LAP() == d_LAP) {
-                printf("clock 0x%07x, channel %2d: ", clock27, packet->get_channel( ));
-                if (packet->header_present()) {
-                  packet->set_UAP(d_piconet->get_UAP());
-                  packet->set_clock(clock27, true);
-                  packet->decode();
-                  if(packet->got_payload()) {
-                    packet->print();
-                    if(d_tun) {
-                      /* include 9 bytes for meta data & packet header */
-                      int length = packet->get_payload_length() + 9;
-                      char *data = packet->tun_format();
-                      int addr = (packet->get_UAP() << 24) | packet->get_LAP();
-                      write_interface(d_tunfd, (unsigned char *)data, length, 0, addr, ETHER_TYPE);
-                      free(data);
-                    }
-                  }
-                } else {
-                  printf("ID\n");
-                  if(d_tun) {
-                    int addr = (d_piconet->get_UAP() << 24) | packet->get_LAP();
-                    write_interface(d_tunfd, NULL, 0, 0, addr, ETHER_TYPE);
-                  }
-                }
-              }
-            }
+      double freq = channel_abs_freq( channel );
+      double on_channel_energy, snr;
+
+      /* filter the rest of the slot only if the channel passes the squelch */
+      int ch_count = scan_channel( freq, input_items, ch_samples, on_channel_energy );
+      if (!check_snr( freq, on_channel_energy, snr ))
+        return;
+      ch_count = finish_channel( freq, input_items, ch_samples, ch_count, history() );
+
+      gr_vector_const_void_star cbtch( 1 );
+      cbtch[0] = ch_samples;
+      int num_symbols = channel_symbols( cbtch, symbols, ch_count );
+      if (num_symbols < SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE)
+        return;
+
+      /* don't look beyond one slot for ACs */
+      latest_ac = ((num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
+        (num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_SNIFF_AC );
+        ac_index = classic_packet::sniff_ac(symbols, latest_ac);
+      }
+      if (ac_index < 0)
+        return;
+
+      d_packets_detected++;
+      classic_packet::sptr packet;
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_PACKET );
+        packet = classic_packet::make(&symbols[ac_index], num_symbols - ac_index,
+                                      clkn, freq);
+      }
+
+      uint32_t lap = packet->get_LAP();
+      uint64_t slot = (uint64_t) (d_cumulative_count / d_samples_per_slot);
+      basic_rate_piconet::sptr *target = d_targets.find(lap);
+      if (!target) {
+        /* inquiry access codes do not belong to a piconet */
+        if (!d_adopt || !packet->header_present() || (lap == GIAC) || (lap == LIAC))
+          return;
+        if (!sighted(lap, slot) || !add_target(lap))
+          return;
+        update_targets();
+        target = d_targets.find(lap);
+        if (!target)
+          return;
+        d_adopted[lap] = slot + 1;
+      }
+
+      uint64_t *adopted = d_adopted.find(lap);
+      if (adopted)
+        *adopted = slot + 1;
+
+      basic_rate_piconet::sptr piconet = *target;
+      if (piconet->have_clk27()) {
+        /* only trust the clock on the channel it predicts */
+        if (observed_channel(piconet, clkn) == channel)
+          hopalong(piconet, packet, clkn, snr, symbol_sample( ac_index ));
+      }
+      else if (packet->header_present()) {
+        /* discovery needs its timing from one packet per slot */
+        if (std::find(d_discovered.begin(), d_discovered.end(), lap) != d_discovered.end())
+          return;
+        d_discovered.push_back(lap);
+        discover(lap, piconet, packet);
+      }
+    }
+
+    void
+    multi_hopper_impl::start_reversals()
+    {
+      for (size_t i = 0; i < d_reversing.size(); ) {
+        /* done when the clock is known, gone, or the target is */
+        basic_rate_piconet::sptr *target = d_targets.find(d_reversing[i]);
+        if (!target || !(*target)->have_clk6() || (*target)->have_clk27())
+          d_reversing.erase(d_reversing.begin() + i);
+        else
+          i++;
+      }
+
+      while ((d_reversing.size() < MAX_CLOCK_REVERSALS) && !d_reversal_queue.empty()) {
+        uint32_t lap = d_reversal_queue.front();
+        d_reversal_queue.pop_front();
+        basic_rate_piconet::sptr *target = d_targets.find(lap);
+        if (!target || !(*target)->have_clk6() || (*target)->have_clk27())
+          continue;
+        stage_timer timer( d_stats, stage_stats::STAGE_DISCOVERY );
+        (*target)->init_hop_reversal(d_aliased);
+        /* use previously observed packets to eliminate candidates */
+        (*target)->winnow();
+        d_reversing.push_back(lap);
+      }
+    }
+
+    void
+    multi_hopper_impl::discover(uint32_t lap, basic_rate_piconet::sptr piconet, classic_packet::sptr packet)
+    {
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_DISCOVERY );
+        if (!piconet->have_clk6()) {
+          /* working on CLK1-6/UAP discovery */
+          piconet->UAP_from_header(packet);
+          if (!piconet->have_clk6())
+            return;
+          /* got CLK1-6/UAP, queue it for CLK1-27 */
+          if (std::find(d_reversal_queue.begin(), d_reversal_queue.end(), lap) == d_reversal_queue.end())
+            d_reversal_queue.push_back(lap);
+        } else {
+          /* continue working on CLK1-27 */
+          /* we need timing information from an additional packet, so run through UAP_from_header() again */
+          piconet->UAP_from_header(packet);
+          /* a queued target only collects hops until its turn comes */
+          if (piconet->have_clk6()
+              && (std::find(d_reversing.begin(), d_reversing.end(), lap) != d_reversing.end()))
+            piconet->winnow();
+        }
+      }
+      start_reversals();
+    }
+
+    void
+    multi_hopper_impl::hopalong(basic_rate_piconet::sptr piconet, classic_packet::sptr packet,
+                                uint32_t clkn, double snr, uint64_t sample)
+    {
+      uint32_t clock27 = (clkn + piconet->get_offset()) & 0x7ffffff;
+      uint64_t timestamp_us = (uint64_t) (d_cumulative_count * (1e6 / d_sample_rate));
+      if (packet->header_present()) {
+        packet->set_UAP(piconet->get_UAP());
+        packet->set_clock(clock27, true);
+        {
+          stage_timer timer( d_stats, stage_stats::STAGE_DECODE );
+          packet->decode();
+        }
+        if(packet->got_payload()) {
+          d_packets_decoded++;
+          d_log->classic(event_log::EVENT_CLASSIC, event_log::STATUS_DECODED, packet,
+                         clock27, timestamp_us, snr);
+          message_port_pub(d_pdu.port(), d_pdu.make(packet, clock27, timestamp_us, sample, snr));
+          if(d_tun) {
+            /* include 9 bytes for meta data & packet header */
+            int length = packet->get_payload_length() + 9;
+            char *data = packet->tun_format();
+            int addr = (packet->get_UAP() << 24) | packet->get_LAP();
+            d_tun_writer->push((unsigned char *)data, length, 0, addr, ETHER_TYPE);
+            free(data);
           }
+          if(d_pcap)
+            d_pcap->write(packet, timestamp_us);
+        }
+      } else {
+        d_log->classic(event_log::EVENT_ID, event_log::STATUS_DETECTED, packet,
+                       clock27, timestamp_us, snr);
+        message_port_pub(d_pdu.port(), d_pdu.make(packet, clock27, timestamp_us, sample, snr));
+        if(d_tun) {
+          int addr = (piconet->get_UAP() << 24) | packet->get_LAP();
+          d_tun_writer->push(NULL, 0, 0, addr, ETHER_TYPE);
         }
+        if(d_pcap)
+          d_pcap->write(packet, timestamp_us);
       }
     }
 
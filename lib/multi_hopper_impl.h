@@ -28,7 +28,14 @@
 
 #include "gr_bluetooth/multi_hopper.h"
 #include "gr_bluetooth/piconet.h"
-#include "tun.h"
+#include "event_log.h"
+#include "packet_pdu.h"
+#include "pcapng.h"
+#include "piconet_table.h"
+#include "tun_writer.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
 
 namespace gr {
   namespace bluetooth {
@@ -36,35 +43,149 @@ namespace gr {
     class multi_hopper_impl : virtual public multi_hopper
     {
     private:
-	/* LAP of the target piconet */
-	uint32_t d_LAP;
-
 	/* true if using a particular aliasing receiver implementation */
 	bool d_aliased;
 
 	/* Using tun for output */
 	bool d_tun;
 
-	/* the piconet we are monitoring */
-        basic_rate_piconet::sptr d_piconet;
+	/* the piconets we are monitoring, only touched by work() */
+	piconet_table<basic_rate_piconet::sptr> d_targets;
+
+	/*
+	 * LAPs requested by add_target()/remove_target() or the "targets"
+	 * port, applied to d_targets at the start of the next slot
+	 */
+	std::mutex		d_target_mutex;
+	std::vector<int>	d_target_list;
+	std::atomic<bool>	d_targets_pending;
+	std::atomic<int>	d_max_targets;
+	std::atomic<bool>	d_adopt;
+
+	/*
+	 * LAPs that arrived in "targets" PDUs since the last
+	 * update_targets(), guarded by d_target_mutex
+	 */
+	std::vector<int>	d_pdu_sightings;
+
+	/* bring d_targets in line with d_target_list */
+	void update_targets();
+
+	/* add_target() for a LAP adopted from a PDU, so it can expire */
+	bool adopt_target(int LAP);
+
+	/* add or remove targets from a "targets" message */
+	void handle_targets(pmt::pmt_t msg);
+
+	/* default limit on the number of targets, see set_max_targets() */
+	static const int MAX_TARGETS = 16;
+
+	/*
+	 * Adoption.  A LAP becomes a target once its header packets have
+	 * been seen in ADOPT_SIGHTINGS slots, no more than ADOPT_WINDOW
+	 * slots apart, so a false access code hit on noise does not.  An
+	 * adopted target that has not been seen for ADOPT_TIMEOUT slots
+	 * is dropped again.  This includes targets adopted from "targets"
+	 * PDUs; ones added with add_target() or an integer or dict message
+	 * are kept until they are removed.
+	 */
+	static const int ADOPT_SIGHTINGS = 3;
+	static const uint64_t ADOPT_WINDOW = 1600;
+	static const uint64_t ADOPT_TIMEOUT = 16000;
+	static const size_t MAX_ADOPT_CANDIDATES = 256;
+
+	struct sighting {
+		uint64_t slot;	/* slot + 1 of the latest sighting, 0 if none */
+		int count;
+
+		sighting() : slot(0), count(0) {}
+	};
+
+	/* LAPs that may be adopted */
+	piconet_table<sighting> d_adopt_candidates;
+
+	/* adopted targets, with the slot + 1 they were last seen in */
+	piconet_table<uint64_t> d_adopted;
+
+	/* count a sighting of a LAP that is not a target, true to adopt it */
+	bool sighted(uint32_t lap, uint64_t slot);
+
+	/* drop adopted targets that have gone quiet */
+	void expire_targets(uint64_t slot);
+
+	/* LAPs that went through discovery in the current slot */
+	std::vector<uint32_t> d_discovered;
+
+	/*
+	 * Clock reversal holds the whole 128 MB hopping sequence of the
+	 * piconet and each piconet has its own, so no more than
+	 * MAX_CLOCK_REVERSALS targets reverse at once.  The others wait in
+	 * d_reversal_queue, still collecting the hops they will winnow
+	 * with once they get their turn.
+	 */
+	static const size_t MAX_CLOCK_REVERSALS = 2;
+	std::vector<uint32_t> d_reversing;
+	std::deque<uint32_t> d_reversal_queue;
+
+	/* retire finished reversals and start queued ones */
+	void start_reversals();
+
+	static const uint32_t GIAC = 0x9E8B33;
+	static const uint32_t LIAC = 0x9E8B00;
+
+	/*
+	 * look for a packet on one channel and hand it to the target it
+	 * belongs to
+	 */
+	void search_channel(int channel, gr_vector_const_void_star &input_items,
+			uint32_t clkn);
+
+	/* channel a piconet with a known clock is observed on in this slot */
+	int observed_channel(basic_rate_piconet::sptr piconet, uint32_t clkn);
+
+	/* use a packet of a target without a clock for UAP/clock discovery */
+	void discover(uint32_t lap, basic_rate_piconet::sptr piconet, classic_packet::sptr packet);
 
 	/*
-	 * follow a piconet's hopping sequence and look for packets on the
-	 * appropriate channel for each time slot
+	 * decode a packet found on the channel a target with a known clock
+	 * hops to in this slot, sample is where it starts in the input
 	 */
-	void hopalong(gr_vector_const_void_star &input_items, char *symbols,
-			uint32_t clkn, int noutput_items);
+	void hopalong(basic_rate_piconet::sptr piconet, classic_packet::sptr packet,
+			uint32_t clkn, double snr, uint64_t sample);
 
-	/* Tun stuff */
-	int			d_tunfd;	// TUN fd
-	char			chan_name[20];  // TUN interface name
-	unsigned char		d_ether_addr[ETH_ALEN];
+	/* Tun stuff, frames are written from a separate thread */
+	tun_writer::sptr	d_tun_writer;
 	static const unsigned short ETHER_TYPE = 0xFFF0;
 
+	/* pcapng file output, NULL if disabled */
+	pcapng_writer::sptr	d_pcap;
+
+	/* packet log, formatted on its own thread */
+	event_log::sptr		d_log;
+
+	/* builds the PDUs published on the "packets" port */
+	packet_pdu		d_pdu;
+
     public:
-      multi_hopper_impl(double sample_rate, double center_freq, double squelch_threshold, int LAP, bool aliased, bool tun);
+      multi_hopper_impl(double sample_rate, double center_freq, double squelch_threshold, int LAP, bool aliased, bool tun,
+                        const std::string &pcap_file, const std::string &input_format);
       ~multi_hopper_impl();
 
+      /* packet log configuration */
+      bool set_log_format(const std::string &format) { return d_log->set_format(format); }
+      void set_log_verbosity(int level) { d_log->set_verbosity(level); }
+      void set_log_rate_limit(double per_second) { d_log->set_rate_limit(per_second); }
+      bool set_log_file(const std::string &filename) { return d_log->set_file(filename); }
+
+      /* targets */
+      bool add_target(int LAP);
+      bool remove_target(int LAP);
+      std::vector<int> targets();
+      void set_max_targets(int max_targets) { d_max_targets = (max_targets > 0) ? max_targets : 0; }
+      int max_targets() { return d_max_targets.load(); }
+      void set_adopt(bool adopt) { d_adopt = adopt; }
+      bool adopt() { return d_adopt.load(); }
+
       // Where all the action really happens
       int work(int noutput_items,
 	       gr_vector_const_void_star &input_items,
@@ -29,6 +29,13 @@
 
 #include <gnuradio/io_signature.h>
 #include "multi_sniffer_impl.h"
+#include "stage_stats.h"
+#include <math.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 
 namespace gr {
   namespace bluetooth {
@@ -41,35 +48,52 @@ namespace gr {
 	  
     multi_sniffer::sptr
     multi_sniffer::make(double sample_rate, double center_freq,
-                        double squelch_threshold, bool tun)
+                        double squelch_threshold, bool tun,
+                        const std::string &pcap_file, const std::string &input_format)
     {
       return gnuradio::get_initial_sptr (new multi_sniffer_impl(sample_rate, center_freq, 
-                                                                squelch_threshold, tun));
+                                                                squelch_threshold, tun,
+                                                                pcap_file, input_format));
     }
 
     /*
      * The private constructor
      */
     multi_sniffer_impl::multi_sniffer_impl(double sample_rate, double center_freq,
-                                           double squelch_threshold, bool tun)
-      : multi_block(sample_rate, center_freq, squelch_threshold),
+                                           double squelch_threshold, bool tun,
+                                           const std::string &pcap_file,
+                                           const std::string &input_format)
+      : multi_block(sample_rate, center_freq, squelch_threshold, sample_format(input_format)),
         gr::sync_block ("bluetooth multi sniffer block",
-                       gr::io_signature::make (1, 1, sizeof (gr_complex)),
+                       gr::io_signature::make (1, 1, sample_size (sample_format (input_format))),
                        gr::io_signature::make (0, 0, 0))
     {
       d_tun = tun;
+      d_packet_sample = 0;
+      d_le_follow = false;
+      d_classic_follow = false;
+      d_le_promiscuous = false;
       set_symbol_history(SYMBOLS_FOR_BASIC_RATE_HISTORY);
 
+      d_log = event_log::make();
+      message_port_register_out(d_pdu.port());
+
       /* Tun interface */
       if (d_tun) {
-        strncpy(d_chan_name, "btbb", sizeof(d_chan_name)-1);
-        if ((d_tunfd = mktun(d_chan_name, d_ether_addr)) == -1) {
-          fprintf(stderr,
-                  "warning: was not able to open TUN device, "
-                  "disabling Wireshark interface\n");
+        d_tun_writer = tun_writer::make("btbb");
+        if (!d_tun_writer->is_open()) {
+          d_tun = false;
           // throw std::runtime_error("cannot open TUN device");
         }
       }
+
+      /* pcapng file */
+      if (!pcap_file.empty()) {
+        d_pcap = pcapng_writer::make(pcap_file);
+        if (!d_pcap->is_open()) {
+          d_pcap.reset();
+        }
+      }
     }
 
     /*
@@ -84,75 +108,21 @@ namespace gr {
                               gr_vector_const_void_star& input_items,
                               gr_vector_void_star&       output_items )
     {
-      for (double freq = d_low_freq; freq <= d_high_freq; freq += 1e6) {   
-        gr_complex *ch_samples = new gr_complex[noutput_items+100000];
-        gr_vector_void_star btch( 1 );
-        btch[0] = ch_samples;
-        double on_channel_energy, snr;
-        int ch_count = channel_samples( freq, input_items, btch, on_channel_energy, history() );
-        bool brok; // = check_basic_rate_squelch(input_items);
-        bool leok = brok = check_snr( freq, on_channel_energy, snr, input_items );
-
-        /* number of symbols available */
-        if (brok || leok) {
-          int sym_length = history();
-          char *symbols = new char[sym_length];
-          /* pointer to our starting place for sniff_ */
-          char *symp = symbols;
-          gr_vector_const_void_star cbtch( 1 );
-          cbtch[0] = ch_samples;
-          int len = channel_symbols( cbtch, symbols, ch_count );
-          delete [] ch_samples;
-          
-          if (brok) {
-            int limit = ((len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
-              (len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
-        
-            /* look for multiple packets in this slot */
-            while (limit >= 0) {
-              /* index to start of packet */
-              int i = classic_packet::sniff_ac(symp, limit);
-              if (i >= 0) {
-                int step = i + SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE;
-                ac(&symp[i], len - i, freq, snr);
-                len   -= step;
-				if(step >= sym_length) error_out("Bad step");
-                symp   = &symp[step];
-                limit -= step;
-              } 
-              else {
-                break;
-              }
-            }
-          }
-
-          if (leok) {
-            symp = symbols;
-            int limit = ((len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
-              (len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
-
-            while (limit >= 0) {
-              int i = le_packet::sniff_aa(symp, limit, freq);
-              if (i >= 0) {
-                int step = i + SYMBOLS_PER_LOW_ENERGY_PREAMBLE_AA;
-				//printf("symp[%i], len-i = %i\n", i, len-i);
-                aa(&symp[i], len - i, freq, snr);
-                len   -= step;
-				if(step >= sym_length) error_out("Bad step");
-                symp   = &symp[step];
-                limit -= step;
-              }
-              else {
-                break;
-              }
-            }
-          }
-          delete [] symbols;
-        }
-        else {
-          delete [] ch_samples;
-        }
+      if (window_done())
+        return WORK_DONE;
+      retune();
+
+      uint64_t le_data_channels = le_channels();
+
+      std::vector<bool> followed;
+      const std::vector<int> &channels = begin_slot( hop_channels( le_data_channels, followed ) );
+      for (size_t n = 0; n < channels.size(); n++) {
+        if (!in_budget( n ))
+          continue;
+        search_channel( *this, channels[n], input_items, followed[channels[n]],
+                        le_data_channels, NULL );
       }
+      end_slot();
       d_cumulative_count += (int) d_samples_per_slot;
       
       /* 
@@ -165,29 +135,465 @@ namespace gr {
       return (int) d_samples_per_slot;
     }
 
+    void
+    multi_sniffer_impl::search_channel( channelizer               &ch,
+                                        int                        channel,
+                                        gr_vector_const_void_star &input_items,
+                                        bool                       followed,
+                                        uint64_t                   le_data_channels,
+                                        std::vector<detection>    *found )
+    {
+      /* replay workers know no piconets, so follow nothing and filter nothing */
+      bool classic_follow = !found && d_classic_follow;
+      bool le_follow = !found && d_le_follow;
+      const std::vector<uint32_t> *known_aa = (found || d_le_promiscuous) ? NULL : &d_known_aa;
+
+      double freq = ch.channel_abs_freq( channel );
+      gr_complex *ch_samples = &ch.d_ch_samples[0];
+      gr_vector_void_star btch( 1 );
+      btch[0] = ch_samples;
+      double on_channel_energy, snr;
+      int ch_count;
+      bool brok, leok;
+      if (classic_follow && !followed) {
+        /* no followed piconet hops here, only look for new ones */
+        ch_count = ch.scan_channel( freq, input_items, ch_samples, on_channel_energy );
+        leok = brok = ch.check_snr( freq, on_channel_energy, snr );
+        if (brok)
+          ch_count = ch.finish_channel( freq, input_items, ch_samples, ch_count, ch.d_input_history );
+      }
+      else {
+        ch_count = ch.channel_samples( freq, input_items, btch, on_channel_energy, ch.d_input_history );
+        leok = brok = ch.check_snr( freq, on_channel_energy, snr );
+        /*
+         * a followed piconet hops here, search whatever the squelch
+         * says, as long as there are samples enough to demodulate
+         */
+        if (followed && (ch_count > (int) ch.d_interp->ntaps() + 1))
+          brok = true;
+      }
+
+      /* when following, skip data channels without a connection event */
+      if (leok && le_follow) {
+        int index = le_packet::freq2index(freq);
+        if ((index < 0) || ((index < low_energy_piconet::DATA_CHANNELS) &&
+                            !(le_data_channels & (1ULL << index))))
+          leok = false;
+      }
+
+      /* no data channel packet can pass the filter before a connection is known */
+      if (leok && known_aa && known_aa->empty()) {
+        int index = le_packet::freq2index(freq);
+        if ((index >= 0) && (index < low_energy_piconet::DATA_CHANNELS))
+          leok = false;
+      }
+
+      /* number of symbols available */
+      if (brok || leok) {
+        int sym_length = ch.d_input_history;
+        char *symbols = &ch.d_symbols[0];
+        /* pointer to our starting place for sniff_ */
+        char *symp = symbols;
+        gr_vector_const_void_star cbtch( 1 );
+        cbtch[0] = ch_samples;
+        /* channel sample position of each symbol, for EDR demodulation */
+        float *positions = &ch.d_positions[0];
+        /* soft symbols only matter for classic packets */
+        int8_t *softp = (ch.d_soft_symbols && brok) ? &ch.d_soft[0] : NULL;
+        int len = ch.channel_symbols( cbtch, symbols, ch_count, positions, softp );
+        int num_symbols = len;
+        
+        if (brok) {
+          int limit = ((len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
+            (len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
+      
+          /* look for multiple packets in this slot */
+          while (limit >= 0) {
+            /* index to start of packet */
+            int i;
+            {
+              stage_timer timer( ch.d_stats, stage_stats::STAGE_SNIFF_AC );
+              i = classic_packet::sniff_ac(symp, limit,
+                                           softp ? softp + (symp - symbols) : NULL);
+            }
+            if (i >= 0) {
+              int step = i + SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE;
+              /* an EDR payload switches to DPSK after the header and guard */
+              int header_end = (symp - symbols) + i + SYMBOLS_BEFORE_EDR_GUARD - 1;
+              int edr_len = 0;
+              if (header_end < num_symbols) {
+                stage_timer timer( ch.d_stats, stage_stats::STAGE_DEMOD );
+                edr_len = ch.edr_phases( ch_samples, ch_count, positions[header_end],
+                                         &ch.d_edr[0], ch.d_edr.size() );
+              }
+              found_packet(ch, found, false, &symp[i], len - i, freq, snr,
+                           ch.symbol_sample( (symp - symbols) + i ), le_packet::PHY_1M,
+                           &ch.d_edr[0], edr_len, softp ? softp + (symp - symbols) + i : NULL);
+              len   -= step;
+              if(step >= sym_length) error_out("Bad step");
+              symp   = &symp[step];
+              limit -= step;
+            } 
+            else {
+              break;
+            }
+          }
+        }
+
+        if (leok) {
+          symp = symbols;
+          len  = num_symbols;
+          int limit = ((len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
+            (len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
+
+          while (limit >= 0) {
+            int i;
+            {
+              stage_timer timer( ch.d_stats, stage_stats::STAGE_SNIFF_AA );
+              i = le_packet::sniff_aa(symp, limit, freq, known_aa);
+            }
+            if (i >= 0) {
+              int step = i + SYMBOLS_PER_LOW_ENERGY_PREAMBLE_AA;
+              found_packet(ch, found, true, &symp[i], len - i, freq, snr,
+                           ch.symbol_sample( (symp - symbols) + i ));
+              len   -= step;
+              if(step >= sym_length) error_out("Bad step");
+              symp   = &symp[step];
+              limit -= step;
+            }
+            else {
+              break;
+            }
+          }
+        }
+
+        if (leok && ch.d_le_coded)
+          sniff_le_coded(ch, symbols, num_symbols, freq, snr, found);
+      }
+
+      /* the 2M PHY only where the 1M channel filter saw energy */
+      if (leok && ch.d_le_2m && (le_packet::freq2index(freq) >= 0))
+        sniff_le_2m(ch, freq, input_items, snr, found);
+    }
+
+    void
+    multi_sniffer_impl::found_packet(channelizer &ch, std::vector<detection> *found,
+                                     bool le, char *symbols, int len, double freq, double snr,
+                                     uint64_t sample, int phy, const char *edr, int edr_len,
+                                     const int8_t *soft)
+    {
+      if (!found) {
+        d_packet_sample = sample;
+        if (le)
+          aa(symbols, len, freq, snr, phy);
+        else
+          ac(symbols, len, freq, snr, edr, edr_len, soft);
+        return;
+      }
+
+      found->push_back(detection());
+      detection &d = found->back();
+      d.le = le;
+      d.phy = phy;
+      d.cumulative_count = ch.d_cumulative_count;
+      d.sample = sample;
+      d.freq = freq;
+      d.snr = snr;
+      d.symbols.assign(symbols, symbols + len);
+      d.edr.assign(edr, edr + edr_len);
+      if (soft)
+        d.soft.assign(soft, soft + len);
+    }
+
+    uint64_t
+    multi_sniffer_impl::replay(const std::string &filename, const std::string &format,
+                               int threads, uint64_t nsamples)
+    {
+      mapped_file::sptr file = mapped_file::make(filename, sample_format(format));
+      if (!file->is_open())
+        throw std::runtime_error("cannot map " + filename);
+
+      /* decode window, clipped to the file */
+      uint64_t start = d_window_start;
+      uint64_t total = (file->size() > start) ? file->size() - start : 0;
+      if (d_window_end - start < total)
+        total = d_window_end - start;
+      if (nsamples && (nsamples < total))
+        total = nsamples;
+      int samples_per_slot = (int) d_samples_per_slot;
+      uint64_t slots = total / samples_per_slot;
+      uint64_t nsegments = (slots + REPLAY_SEGMENT_SLOTS - 1) / REPLAY_SEGMENT_SLOTS;
+
+      if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+      if ((uint64_t) threads > nsegments)
+        threads = std::max((uint64_t) 1, nsegments);
+
+      /* each worker has a channelizer of its own, set up like ours */
+      retune();
+      sample_format_t input_format = sample_format(format);
+      std::vector<boost::shared_ptr<channelizer> > workers;
+      for (int w = 0; w < threads; w++) {
+        boost::shared_ptr<channelizer> worker(new channelizer(d_sample_rate, d_center_freq,
+                                                              d_target_snr, input_format));
+        worker->set_input_history(d_input_history);
+        worker->enable_le_2m(d_le_2m);
+        worker->enable_le_coded(d_le_coded);
+        worker->d_soft_symbols = d_soft_symbols;
+        worker->tune(d_center_freq, d_channel_mask);
+        worker->d_stats->set_enabled(d_stats->enabled());
+        workers.push_back(worker);
+      }
+
+      /* replay searches every channel in the band and the mask */
+      std::vector<int> channels;
+      for (int ch = 0; ch <= 78; ch++) {
+        double freq = channel_abs_freq(ch);
+        if ((freq >= d_low_freq) && (freq <= d_high_freq) && d_channel_mask[ch])
+          channels.push_back(ch);
+      }
+
+      /*
+       * Workers claim segments in order but may finish out of order.
+       * This thread handles the detections of each segment as soon as
+       * it and all earlier ones are done; workers stay at most a few
+       * segments per thread ahead to bound memory.
+       */
+      std::vector<std::vector<detection> > results(nsegments);
+      std::vector<bool> done(nsegments, false);
+      std::mutex mutex;
+      std::condition_variable cond;
+      uint64_t next = 0, handled = 0;
+      const uint64_t window = 4 * threads;
+
+      std::vector<std::thread> pool;
+      for (int w = 0; w < threads; w++) {
+        pool.push_back(std::thread([&, w]() {
+          std::vector<char> buf;
+          for (;;) {
+            uint64_t seg;
+            {
+              std::unique_lock<std::mutex> lock(mutex);
+              cond.wait(lock, [&]() { return (next >= nsegments) || (next - handled < window); });
+              seg = next++;
+            }
+            if (seg >= nsegments)
+              break;
+
+            uint64_t first = seg * REPLAY_SEGMENT_SLOTS;
+            replay_segment(*workers[w], *file, first,
+                           std::min((uint64_t) REPLAY_SEGMENT_SLOTS, slots - first),
+                           channels, buf, &results[seg]);
+            {
+              std::lock_guard<std::mutex> lock(mutex);
+              done[seg] = true;
+            }
+            cond.notify_all();
+          }
+        }));
+      }
+
+      for (uint64_t seg = 0; seg < nsegments; seg++) {
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cond.wait(lock, [&]() { return done[seg]; });
+        }
+
+        std::vector<detection> &detections = results[seg];
+        for (size_t i = 0; i < detections.size(); i++) {
+          detection &d = detections[i];
+          d_cumulative_count = d.cumulative_count;
+          d_packet_sample = d.sample;
+          if (d.le)
+            aa(&d.symbols[0], d.symbols.size(), d.freq, d.snr, d.phy);
+          else
+            ac(&d.symbols[0], d.symbols.size(), d.freq, d.snr,
+               d.edr.empty() ? NULL : &d.edr[0], d.edr.size(),
+               d.soft.empty() ? NULL : &d.soft[0]);
+        }
+        std::vector<detection>().swap(detections);
+
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          handled++;
+        }
+        cond.notify_all();
+      }
+
+      for (size_t w = 0; w < pool.size(); w++)
+        pool[w].join();
+
+      /* fold the workers' counters into ours */
+      for (size_t w = 0; w < workers.size(); w++) {
+        for (size_t ch = 0; ch < d_channel_slots.size(); ch++)
+          d_channel_slots[ch] += workers[w]->d_channel_slots[ch];
+        d_stats->merge(*workers[w]->d_stats);
+      }
+      d_cumulative_count = start + slots * samples_per_slot;
+
+      return slots * samples_per_slot;
+    }
+
+    void
+    multi_sniffer_impl::replay_segment(channelizer &ch, const mapped_file &file,
+                                       uint64_t first_slot, uint64_t nslots,
+                                       const std::vector<int> &channels,
+                                       std::vector<char> &buf, std::vector<detection> *found)
+    {
+      int samples_per_slot = (int) ch.d_samples_per_slot;
+
+      /*
+       * Start the squelch over on the slots before the segment, or on
+       * its own first slots at the start of the window, so that what
+       * a segment finds does not depend on what its worker saw last.
+       */
+      uint64_t warmup = std::min((uint64_t) REPLAY_WARMUP_SLOTS, first_slot);
+      uint64_t first_warmup = first_slot - warmup;
+      uint64_t nwarmup = warmup ? warmup : std::min((uint64_t) REPLAY_WARMUP_SLOTS, nslots);
+      ch.restart();
+
+      /* as in a flowgraph, each slot sees d_input_history samples ending with its first */
+      uint64_t slot_sample = d_window_start + first_warmup * samples_per_slot;
+      int64_t first = (int64_t) slot_sample - (ch.d_input_history - 1);
+      size_t count = (warmup + nslots - 1) * samples_per_slot + ch.d_input_history;
+      const char *in = (const char *) file.items(first, count, buf);
+      size_t slot_bytes = samples_per_slot * sample_size(ch.d_input_format);
+
+      gr_vector_const_void_star input_items( 1 );
+      for (uint64_t slot = 0; slot < nwarmup; slot++) {
+        input_items[0] = in + slot * slot_bytes;
+        for (size_t n = 0; n < channels.size(); n++)
+          ch.warm_up( ch.channel_abs_freq( channels[n] ), input_items );
+      }
+
+      ch.d_cumulative_count = slot_sample + warmup * samples_per_slot;
+      for (uint64_t slot = warmup; slot < warmup + nslots; slot++) {
+        input_items[0] = in + slot * slot_bytes;
+        for (size_t n = 0; n < channels.size(); n++)
+          search_channel( ch, channels[n], input_items, false, 0, found );
+        ch.d_cumulative_count += samples_per_slot;
+      }
+    }
+
+    /* capture time of the current slot in microseconds */
+    uint64_t
+    multi_sniffer_impl::timestamp_us()
+    {
+      return (uint64_t) (d_cumulative_count * (1e6 / d_sample_rate));
+    }
+
+    /*
+     * work() searches for packets starting in the first time slot of
+     * the history() samples ending at d_cumulative_count, take the
+     * middle of that slot.
+     */
+    uint64_t
+    multi_sniffer_impl::packet_time_us()
+    {
+      uint64_t first = (d_cumulative_count >= history()) ? d_cumulative_count - history() + 1 : 0;
+      return (uint64_t) (first * (1e6 / d_sample_rate)) + SYMBOLS_PER_BASIC_RATE_SLOT / 2;
+    }
+
+    /*
+     * Packets queued for discovery are decoded slots after they were
+     * found, place those at the start of their own slot.
+     */
+    uint64_t
+    multi_sniffer_impl::packet_sample(classic_packet::sptr pkt)
+    {
+      uint32_t clkn = (int) (d_cumulative_count / d_samples_per_slot) & 0x7ffffff;
+      uint32_t age = (clkn - pkt->d_clkn) & 0x7ffffff;
+      if (age == 0)
+        return d_packet_sample;
+
+      uint64_t first = symbol_sample( 0 );
+      uint64_t back = (uint64_t) (age * d_samples_per_slot);
+      return (first > back) ? first - back : 0;
+    }
+
+    uint64_t
+    multi_sniffer_impl::le_channels()
+    {
+      if (d_low_energy_piconets.size() == 0)
+        return 0;
+
+      uint64_t t = packet_time_us();
+      uint64_t mask = 0;
+      std::vector<uint32_t> expired;
+      d_low_energy_piconets.for_each([&](uint32_t aa, low_energy_piconet::sptr &pn) {
+        if (pn->expired(t))
+          expired.push_back(aa);
+        else
+          mask |= pn->channels(t - SYMBOLS_PER_BASIC_RATE_SLOT / 2,
+                               t + SYMBOLS_PER_BASIC_RATE_SLOT / 2);
+      });
+      for (size_t i = 0; i < expired.size(); i++)
+        d_low_energy_piconets.erase(expired[i]);
+      if (!expired.empty())
+        update_known_aa();
+
+      return mask;
+    }
+
+    std::vector<int>
+    multi_sniffer_impl::hop_channels(uint64_t le_data_channels, std::vector<bool> &followed)
+    {
+      std::vector<int> channels;
+      followed.assign(79, false);
+      if (!d_classic_follow && (slot_budget() <= 0))
+        return channels;
+
+      uint32_t clkn = (int) (d_cumulative_count / d_samples_per_slot) & 0x7ffffff;
+      d_basic_rate_piconets.for_each([&](uint32_t lap, basic_rate_piconet::sptr &pn) {
+        if (!pn->have_clk27())
+          return;
+        int channel = pn->hop((clkn + pn->get_offset()) & 0x7ffffff);
+        if ((channel >= 0) && (channel <= 78)) {
+          channels.push_back(channel);
+          followed[channel] = d_classic_follow;
+        }
+      });
+      if (slot_budget() <= 0)
+        return channels;
+      for (int index = 0; index < low_energy_piconet::DATA_CHANNELS; index++) {
+        if (le_data_channels & (1ULL << index))
+          channels.push_back(abs_freq_channel(le_packet::index2freq(index)));
+      }
+      return channels;
+    }
+
     /* handle AC */
     void 
-    multi_sniffer_impl::ac(char *symbols, int len, double freq, double snr)
+    multi_sniffer_impl::ac(char *symbols, int len, double freq, double snr,
+                           const char *edr, int edr_len, const int8_t *soft)
     {
       /* native (local) clock in 625 us */	
       uint32_t clkn = (int) (d_cumulative_count / d_samples_per_slot) & 0x7ffffff;
-      classic_packet::sptr pkt = classic_packet::make(symbols, len, clkn, freq);
+      classic_packet::sptr pkt;
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_PACKET );
+        pkt = classic_packet::make(symbols, len, clkn, freq);
+        if (edr_len > 0)
+          pkt->set_edr_phases(edr, edr_len);
+        if (soft)
+          pkt->set_soft_symbols(soft, len);
+      }
       uint32_t lap = pkt->get_LAP();
-
-      printf("time %6d, snr=%.1f, channel %2d, LAP %06x ", 
-             clkn, snr, pkt->get_channel( ), lap);
+      d_packets_detected++;
 
       if (pkt->header_present()) {
-        if (!d_basic_rate_piconets[lap]) {
-          d_basic_rate_piconets[lap] = basic_rate_piconet::make(lap);
+        basic_rate_piconet::sptr& slot = d_basic_rate_piconets[lap];
+        if (!slot) {
+          slot = basic_rate_piconet::make(lap);
         }
-        basic_rate_piconet::sptr pn = d_basic_rate_piconets[lap];
+        /* decode() may insert into the table via fhs(), so hold a copy */
+        basic_rate_piconet::sptr pn = slot;
 
         if (pn->have_clk6() && pn->have_UAP()) {
-          decode(pkt, pn, true);
+          decode(pkt, pn, true, snr);
         } 
         else {
-          discover(pkt, pn);
+          discover(pkt, pn, snr);
         }
 
         /*
@@ -199,45 +605,187 @@ namespace gr {
         }
       } 
       else {
+        d_log->classic(event_log::EVENT_ID, event_log::STATUS_DETECTED, pkt,
+                       clkn, timestamp_us(), snr);
+        message_port_pub(d_pdu.port(), d_pdu.make(pkt, clkn, timestamp_us(), d_packet_sample, snr));
+        if (d_pcap) {
+          d_pcap->write(pkt, timestamp_us());
+        }
         id(lap);
       }
     }
 
     /* handle AA */
     void
-    multi_sniffer_impl::aa(char *symbols, int len, double freq, double snr)
+    multi_sniffer_impl::aa(char *symbols, int len, double freq, double snr, int phy)
     {
-      le_packet::sptr pkt = le_packet::make(symbols, len, freq);
+      le_packet::sptr pkt;
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_PACKET );
+        pkt = le_packet::make(symbols, len, freq, phy);
+      }
       uint32_t clkn = (int) (d_cumulative_count / d_samples_per_slot) & 0x7ffffff;
+      uint32_t aa = pkt->get_AA( );
+
+      /* data channel packets of a known connection can be CRC checked */
+      low_energy_piconet::sptr *pn = NULL;
+      bool advertising = (pkt->get_index() >= low_energy_piconet::DATA_CHANNELS);
+      if (!advertising) {
+        pn = d_low_energy_piconets.find(aa);
+        if (pn)
+          pkt->set_CRCInit((*pn)->get_CRCInit());
+        else if (!d_le_promiscuous)
+          return;
+      }
+      d_packets_detected++;
 
-      printf("time %6d, snr=%.1f, ", clkn, snr);
-      pkt->print( );
+      /* drop noise before it costs a log record, a PDU or a pcap write */
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_DECODE );
+        if (!pkt->decode_header())
+          return;
+      }
+      if (!pkt->crc_checked() && !confirm(pkt))
+        return;
+      pkt->decode_payload();
+      d_packets_decoded++;
 
-      if (pkt->header_present()) {
-        uint32_t aa = pkt->get_AA( );
-        if (!d_low_energy_piconets[aa]) {
-          d_low_energy_piconets[aa] = low_energy_piconet::make(aa);
+      d_log->le(pkt, freq, clkn, timestamp_us(), snr);
+      message_port_pub(d_pdu.port(), d_pdu.make(pkt, le_packet::freq2index(freq),
+                                                clkn, timestamp_us(), d_packet_sample, snr));
+
+      if (d_pcap) {
+        d_pcap->write(pkt, timestamp_us());
+      }
+
+      if (advertising) {
+        /* a CONNECT_REQ tells us how to follow the new connection */
+        if (pkt->get_PDU_type() == le_packet::CONNECT_REQ)
+          discover(pkt, low_energy_piconet::make(aa));
+      }
+      else if ((pn = d_low_energy_piconets.find(aa))) {
+        decode(pkt, *pn);
+      }
+    }
+
+    /*
+     * A data channel packet of a connection whose CONNECT_REQ we missed.
+     * Any 24 bit CRC can be matched by some CRCInit, so one packet proves
+     * nothing; accept the access address once two packets agree on it.
+     */
+    bool
+    multi_sniffer_impl::confirm(le_packet::sptr pkt)
+    {
+      uint32_t aa = pkt->get_AA();
+      uint32_t crc_init = pkt->recover_CRCInit();
+      uint32_t *candidate = d_le_crc_candidates.find(aa);
+
+      if (!candidate || (*candidate != crc_init)) {
+        /* noise leaves a candidate for every random AA, keep that bounded */
+        if (d_le_crc_candidates.size() >= MAX_CRC_CANDIDATES)
+          d_le_crc_candidates = piconet_table<uint32_t>();
+        d_le_crc_candidates[aa] = crc_init;
+        return false;
+      }
+
+      d_le_crc_candidates.erase(aa);
+      low_energy_piconet::sptr pn = low_energy_piconet::make(aa);
+      pn->set_CRCInit(crc_init);
+      d_low_energy_piconets[aa] = pn;
+      update_known_aa();
+      return true;
+    }
+
+    void
+    multi_sniffer_impl::update_known_aa()
+    {
+      d_known_aa.clear();
+      d_low_energy_piconets.for_each([&](uint32_t aa, low_energy_piconet::sptr &pn) {
+        d_known_aa.push_back(aa);
+      });
+      std::sort(d_known_aa.begin(), d_known_aa.end());
+    }
+
+    void
+    multi_sniffer_impl::sniff_le_2m(channelizer &ch, double freq, gr_vector_const_void_star &in,
+                                    double snr, std::vector<detection> *found)
+    {
+      const std::vector<uint32_t> *known_aa = (found || d_le_promiscuous) ? NULL : &d_known_aa;
+      /* the 1M search is done with the scratch buffers by now */
+      char *symbols = &ch.d_symbols[0];
+      int len = ch.le_2m_symbols(freq, in, symbols);
+      char *symp = symbols;
+
+      /* a time slot is twice as many 2M symbols */
+      int limit = ((len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < 2 * SYMBOLS_PER_BASIC_RATE_SLOT) ?
+        (len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : 2 * SYMBOLS_PER_BASIC_RATE_SLOT;
+
+      while (limit >= 0) {
+        int i;
+        {
+          stage_timer timer( ch.d_stats, stage_stats::STAGE_SNIFF_AA );
+          i = le_packet::sniff_aa_2m(symp, limit, freq, known_aa);
         }
-        low_energy_piconet::sptr pn = d_low_energy_piconets[aa];
+        if (i < 0)
+          break;
+
+        int step = i + SYMBOLS_PER_LOW_ENERGY_PREAMBLE_AA;
+        /* two 2M symbols to a 1M one */
+        found_packet(ch, found, true, &symp[i], len - i, freq, snr,
+                     ch.symbol_sample( ((symp - symbols) + i) / 2.0 ), le_packet::PHY_2M);
+        len   -= step;
+        symp   = &symp[step];
+        limit -= step;
       }
-      else {
-        // TODO: log AA
+    }
+
+    void
+    multi_sniffer_impl::sniff_le_coded(channelizer &ch, char *symbols, int len, double freq,
+                                       double snr, std::vector<detection> *found)
+    {
+      char *symp = symbols;
+      int limit = ((len - le_packet::CODED_PREAMBLE_SYMBOLS) < SYMBOLS_PER_BASIC_RATE_SLOT) ?
+        (len - le_packet::CODED_PREAMBLE_SYMBOLS) : SYMBOLS_PER_BASIC_RATE_SLOT;
+
+      while (limit > 0) {
+        int i;
+        {
+          stage_timer timer( ch.d_stats, stage_stats::STAGE_SNIFF_AA );
+          i = le_packet::sniff_coded(symp, limit);
+        }
+        if (i < 0)
+          break;
+
+        /* FEC decode into the 1M layout, aa() takes it from there */
+        char link_symbols[LE_MAX_SYMBOLS];
+        int coding, n;
+        {
+          stage_timer timer( ch.d_stats, stage_stats::STAGE_PACKET );
+          n = le_packet::decode_coded(&symp[i], len - i, link_symbols, &coding);
+        }
+        if (n > 0)
+          found_packet(ch, found, true, link_symbols, n, freq, snr,
+                       ch.symbol_sample( (symp - symbols) + i ), le_packet::PHY_CODED);
+
+        int step = i + le_packet::CODED_PREAMBLE_SYMBOLS;
+        len   -= step;
+        symp   = &symp[step];
+        limit -= step;
       }
     }
 
     /* handle ID packet (no header) */
     void multi_sniffer_impl::id(uint32_t lap)
     {
-      printf("ID\n");
       if (d_tun) {
-        write_interface(d_tunfd, NULL, 0, 0, lap, ETHER_TYPE);
+        d_tun_writer->push(NULL, 0, 0, lap, ETHER_TYPE);
       }
     }
 
     /* decode packets with headers */
     void multi_sniffer_impl::decode(classic_packet::sptr pkt,
                                     basic_rate_piconet::sptr pn, 
-                                    bool first_run)
+                                    bool first_run, double snr)
     {
       uint32_t clock; /* CLK of target piconet */
 
@@ -245,10 +793,16 @@ namespace gr {
       pkt->set_clock(clock, pn->have_clk27());
       pkt->set_UAP(pn->get_UAP());
 
-      pkt->decode();
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_DECODE );
+        pkt->decode();
+      }
 
       if (pkt->got_payload()) {
-        pkt->print();
+        d_packets_decoded++;
+        d_log->classic(event_log::EVENT_CLASSIC, event_log::STATUS_DECODED, pkt,
+                       pkt->d_clkn, timestamp_us(), snr);
+        message_port_pub(d_pdu.port(), d_pdu.make(pkt, pkt->d_clkn, timestamp_us(), packet_sample(pkt), snr));
         if (d_tun) {
           uint64_t addr = (pkt->get_UAP() << 24) | pkt->get_LAP();
 
@@ -261,62 +815,79 @@ namespace gr {
           int length = pkt->get_payload_length() + 9;
           char *data = pkt->tun_format();
 
-          write_interface(d_tunfd, (unsigned char *)data, length,
-                          0, addr, ETHER_TYPE);
+          d_tun_writer->push((unsigned char *)data, length,
+                             0, addr, ETHER_TYPE);
           free(data);
         }
+        if (d_pcap) {
+          d_pcap->write(pkt, timestamp_us());
+        }
         if (pkt->get_type() == 2)
           fhs(pkt);
       } else if (first_run) {
-        printf("lost clock!\n");
+        d_log->classic(event_log::EVENT_CLASSIC, event_log::STATUS_LOST_CLOCK, pkt,
+                       pkt->d_clkn, timestamp_us(), snr);
         pn->reset();
 
         /* start rediscovery with this packet */
-        discover(pkt, pn);
+        discover(pkt, pn, snr);
       } else {
-        printf("Giving up on queued packet!\n");
+        d_log->classic(event_log::EVENT_CLASSIC, event_log::STATUS_GAVE_UP, pkt,
+                       pkt->d_clkn, timestamp_us(), snr);
       }
     }
 
+    /* resynchronize a followed connection */
     void multi_sniffer_impl::decode(le_packet::sptr pkt, 
                                     low_energy_piconet::sptr pn) {
-      
+      stage_timer timer( d_stats, stage_stats::STAGE_DECODE );
+      pn->observe(pkt, packet_time_us());
     }
 
     /* work on UAP/CLK1-6 discovery */
     void multi_sniffer_impl::discover(classic_packet::sptr pkt,
-                                      basic_rate_piconet::sptr pn)
+                                      basic_rate_piconet::sptr pn,
+                                      double snr)
     {
-      printf("working on UAP/CLK1-6\n");
+      d_log->classic(event_log::EVENT_CLASSIC, event_log::STATUS_DISCOVERY, pkt,
+                     pkt->d_clkn, timestamp_us(), snr);
 
       /* store packet for decoding after discovery is complete */
       pn->enqueue(pkt);
 
-      if (pn->UAP_from_header(pkt))
+      bool found;
+      {
+        stage_timer timer( d_stats, stage_stats::STAGE_DISCOVERY );
+        found = pn->UAP_from_header(pkt);
+      }
+      if (found)
         /* success! decode the stored packets */
         recall(pn);
     }
 
+    /* start following the connection set up by a CONNECT_REQ */
     void multi_sniffer_impl::discover(le_packet::sptr pkt, 
                                       low_energy_piconet::sptr pn) {
+      stage_timer timer( d_stats, stage_stats::STAGE_DISCOVERY );
+      if (pn->follow(pkt, packet_time_us())) {
+        d_low_energy_piconets[pn->get_AA()] = pn;
+        update_known_aa();
+      }
     }
 
     /* decode stored packets */
     void multi_sniffer_impl::recall(basic_rate_piconet::sptr pn)
     {
       packet::sptr pkt;
-      printf("Decoding queued packets\n");
-      
+
+      /* the SNR of queued packets was not kept */
       while (pkt = pn->dequeue()) {
         classic_packet::sptr cpkt = boost::dynamic_pointer_cast<classic_packet>(pkt);
-        printf("time %6d, channel %2d, LAP %06x ", cpkt->d_clkn,
-               cpkt->get_channel(), cpkt->get_LAP());
-        decode(cpkt, pn, false);
+        decode(cpkt, pn, false, NAN);
       }
-      
-      printf("Finished decoding queued packets\n");
     }
 
+    /* nothing is queued for LE, the CONNECT_REQ gives all we need */
     void multi_sniffer_impl::recall(low_energy_piconet::sptr pn) {
     }
 
@@ -328,7 +899,6 @@ namespace gr {
       uint16_t nap;
       uint32_t clk;
       uint32_t offset;
-      basic_rate_piconet::sptr pn;
 
       /* caller should have checked got_payload() and get_type() */
 
@@ -340,22 +910,13 @@ namespace gr {
       clk = pkt->clock_from_fhs() << 1;
       offset = (clk - pkt->d_clkn) & 0x7ffffff;
 
-      printf("FHS contents: BD_ADDR ");
-
-      printf("%2.2x:", (nap >> 8) & 0xff);
-      printf("%2.2x:", nap & 0xff);
-      printf("%2.2x:", uap);
-      printf("%2.2x:", (lap >> 16) & 0xff);
-      printf("%2.2x:", (lap >> 8) & 0xff);
-      printf("%2.2x", lap & 0xff);
-
-      printf(", CLK %07x\n", clk);
+      d_log->fhs(lap, uap, nap, clk, pkt->d_clkn, timestamp_us());
 
       /* make use of this information from now on */
-      if (!d_basic_rate_piconets[lap]) {
-        d_basic_rate_piconets[lap] = basic_rate_piconet::make(lap);
+      basic_rate_piconet::sptr& pn = d_basic_rate_piconets[lap];
+      if (!pn) {
+        pn = basic_rate_piconet::make(lap);
       }
-      pn = d_basic_rate_piconets[lap];
 	
       pn->set_UAP(uap);
       pn->set_NAP(nap);
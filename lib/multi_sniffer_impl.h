@@ -29,8 +29,12 @@
 #include "gr_bluetooth/multi_sniffer.h"
 #include "gr_bluetooth/packet.h"
 #include "gr_bluetooth/piconet.h"
-#include "tun.h"
-#include <map>
+#include "event_log.h"
+#include "mapped_file.h"
+#include "packet_pdu.h"
+#include "pcapng.h"
+#include "piconet_table.h"
+#include "tun_writer.h"
 
 namespace gr {
   namespace bluetooth {
@@ -45,32 +49,145 @@ namespace gr {
       /* Using tun for output */
       bool d_tun;
 
-      /* Tun stuff */
-      int d_tunfd;
-      char d_chan_name[20];
-      unsigned char d_ether_addr[ETH_ALEN];
+      /* Tun stuff, frames are written from a separate thread */
+      tun_writer::sptr d_tun_writer;
       static const unsigned short ETHER_TYPE = 0xFFF0;
 
-      /* the piconets we are monitoring */
-      std::map<int, basic_rate_piconet::sptr> d_basic_rate_piconets;
-      std::map<uint32_t, low_energy_piconet::sptr> d_low_energy_piconets;
-
-      /* handle AC */
-      void ac(char *symbols, int len, double freq, double snr);
+      /* pcapng file output, NULL if disabled */
+      pcapng_writer::sptr d_pcap;
+
+      /* packet log, formatted on its own thread */
+      event_log::sptr d_log;
+
+      /* builds the PDUs published on the "packets" port */
+      packet_pdu d_pdu;
+
+      /* slots per replay segment */
+      static const int REPLAY_SEGMENT_SLOTS = 256;
+
+      /* an AC or AA found by a replay worker, handled later in order */
+      struct detection {
+        bool              le;
+        int               phy;
+        uint64_t          cumulative_count;
+        uint64_t          sample;
+        double            freq;
+        double            snr;
+        std::vector<char> symbols;
+        std::vector<char> edr;     /* classic: EDR phase changes, if any */
+        std::vector<int8_t> soft;  /* classic: soft symbols, if kept */
+      };
+
+      /* slots before each replay segment its squelch is warmed up on */
+      static const int REPLAY_WARMUP_SLOTS = 8;
+
+      /*
+       * Search one channel of the slot ch is at.  With found NULL the
+       * packets go to ac() and aa(), as work() does with the block's
+       * own channelizer; replay workers pass found instead, and search
+       * promiscuously without following anything.
+       */
+      void search_channel(channelizer &ch, int channel, gr_vector_const_void_star &in,
+                          bool followed, uint64_t le_data_channels,
+                          std::vector<detection> *found);
+
+      /* hand a packet starting at input sample sample to ac() or aa(), or record it in found */
+      void found_packet(channelizer &ch, std::vector<detection> *found,
+                        bool le, char *symbols, int len, double freq, double snr,
+                        uint64_t sample, int phy = le_packet::PHY_1M,
+                        const char *edr = NULL, int edr_len = 0, const int8_t *soft = NULL);
+
+      /*
+       * Search channels for nslots slots of a mapped file, first_slot
+       * counted from the window start, after warming the squelch up
+       */
+      void replay_segment(channelizer &ch, const mapped_file &file, uint64_t first_slot,
+                          uint64_t nslots, const std::vector<int> &channels,
+                          std::vector<char> &buf, std::vector<detection> *found);
+
+      /* capture time of the current slot in microseconds */
+      uint64_t timestamp_us();
+
+      /* approximate capture time of a packet found in the current slot */
+      uint64_t packet_time_us();
 
-      /* handle AA */
-      void aa(char *symbols, int len, double freq, double snr);
+      /* the piconets we are monitoring */
+      piconet_table<basic_rate_piconet::sptr> d_basic_rate_piconets;
+      piconet_table<low_energy_piconet::sptr> d_low_energy_piconets;
+
+      /*
+       * AAs of the LE connections in d_low_energy_piconets, sorted, for
+       * sniff_aa() to filter data channel packets with
+       */
+      std::vector<uint32_t> d_known_aa;
+      void update_known_aa();
+
+      /* accept data channel packets of unknown connections, see confirm() */
+      bool d_le_promiscuous;
+
+      /* CRCInit recovered from one packet of an unknown LE connection, by AA */
+      piconet_table<uint32_t> d_le_crc_candidates;
+      static const size_t MAX_CRC_CANDIDATES = 1024;
+
+      /* only search the data channels of followed LE connection events */
+      bool d_le_follow;
+
+      /*
+       * Data channel indices with a connection event in the current
+       * slot, dropping connections that have timed out.
+       */
+      uint64_t le_channels();
+
+      /* only scan for new classic piconets off the followed hops */
+      bool d_classic_follow;
+
+      /*
+       * Classic channels that piconets with a known clock and the
+       * followed LE connections use in the current slot, for the slot
+       * budget scheduler.  followed gets the classic ones if
+       * d_classic_follow is set.
+       */
+      std::vector<int> hop_channels(uint64_t le_data_channels, std::vector<bool> &followed);
+
+      /*
+       * input sample the packet handed to ac() or aa() starts at, set
+       * by found_packet() or replay()
+       */
+      uint64_t d_packet_sample;
+
+      /* input sample a classic packet starts at, see packet_pdu.h */
+      uint64_t packet_sample(classic_packet::sptr pkt);
+
+      /* handle AC, with the EDR phase changes after its header and soft symbols if any */
+      void ac(char *symbols, int len, double freq, double snr,
+              const char *edr = NULL, int edr_len = 0, const int8_t *soft = NULL);
+
+      /* handle AA, symbols laid out as for LE 1M whatever the PHY */
+      void aa(char *symbols, int len, double freq, double snr,
+              int phy = le_packet::PHY_1M);
+
+      /* search the channel at freq for LE 2M packets, see search_channel() */
+      void sniff_le_2m(channelizer &ch, double freq, gr_vector_const_void_star &in,
+                       double snr, std::vector<detection> *found);
+
+      /* search 1M symbols for LE Coded packets, see search_channel() */
+      void sniff_le_coded(channelizer &ch, char *symbols, int len, double freq,
+                          double snr, std::vector<detection> *found);
+
+      /* accept an LE data channel packet whose CRCInit is not known yet */
+      bool confirm(le_packet::sptr pkt);
 
       /* handle ID packet (no header) */
       void id(uint32_t lap);
 
       /* decode packets with headers */
       void decode(classic_packet::sptr pkt, basic_rate_piconet::sptr pn,
-                  bool first_run);
+                  bool first_run, double snr);
       void decode(le_packet::sptr pkt, low_energy_piconet::sptr pn);
 
       /* work on UAP/CLK1-6 discovery */
-      void discover(classic_packet::sptr pkt, basic_rate_piconet::sptr pn);
+      void discover(classic_packet::sptr pkt, basic_rate_piconet::sptr pn,
+                    double snr);
       void discover(le_packet::sptr pkt, low_energy_piconet::sptr pn);
 
       /* decode stored packets */
@@ -81,9 +198,24 @@ namespace gr {
       void fhs(classic_packet::sptr pkt);
 
     public:
-      multi_sniffer_impl(double sample_rate, double center_freq, double squelch_threshold, bool tun);
+      multi_sniffer_impl(double sample_rate, double center_freq, double squelch_threshold, bool tun,
+                         const std::string &pcap_file, const std::string &input_format);
       ~multi_sniffer_impl();
 
+      /* packet log configuration */
+      bool set_log_format(const std::string &format) { return d_log->set_format(format); }
+      void set_log_verbosity(int level) { d_log->set_verbosity(level); }
+      void set_log_rate_limit(double per_second) { d_log->set_rate_limit(per_second); }
+      bool set_log_file(const std::string &filename) { return d_log->set_file(filename); }
+
+      uint64_t replay(const std::string &filename, const std::string &format,
+                      int threads, uint64_t nsamples);
+
+      void set_le_follow(bool enabled) { d_le_follow = enabled; }
+      void set_classic_follow(bool enabled) { d_classic_follow = enabled; }
+      void set_le_promiscuous(bool enabled) { d_le_promiscuous = enabled; }
+      int le_connections() { return (int) d_low_energy_piconets.size(); }
+
       // Where all the action really happens
       int work(int                        noutput_items,
 	       gr_vector_const_void_star& input_items,
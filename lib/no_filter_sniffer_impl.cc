@@ -52,6 +52,13 @@ namespace bluetooth {
         d_channel_freq = BASE_FREQUENCY + (d_channel * CHANNEL_WIDTH);
 
         d_cumulative_count = 0;
+        d_packet_sample = 0;
+        d_packet_clkn = 0;
+        d_packets_detected = 0;
+        d_packets_decoded = 0;
+
+        d_log = event_log::make();
+        message_port_register_out(d_pdu.port());
 
         /* we want to have 5 slots (max packet length) available in the history */
         set_history((sample_rate/SYMBOL_RATE)*SYMBOLS_FOR_BASIC_RATE_HISTORY);
@@ -97,19 +104,21 @@ namespace bluetooth {
     {
         /* native (local) clock in 625 us */	
         uint32_t clkn = (int) ((d_cumulative_count+offset-history()) / 625) & 0x7ffffff;
-        /* same clock in ms */
-        double time_ms = ((double) d_cumulative_count+offset-history())/1000;
+        /* the history() items end at d_cumulative_count */
+        uint64_t end = d_cumulative_count + offset;
+        d_packet_sample = (end >= history() - 1) ? end - (history() - 1) : 0;
+        d_packet_clkn = clkn;
         classic_packet::sptr pkt = classic_packet::make(symbols, max_len, clkn, freq);
         uint32_t lap = pkt->get_LAP();
-
-        printf("time %6d (%6.1f ms), channel %2d, LAP %06x ", 
-                clkn, time_ms, pkt->get_channel( ), lap);
+        d_packets_detected++;
 
         if (pkt->header_present()) {
-            if (!d_basic_rate_piconets[lap]) {
-                d_basic_rate_piconets[lap] = basic_rate_piconet::make(lap);
+            basic_rate_piconet::sptr& slot = d_basic_rate_piconets[lap];
+            if (!slot) {
+                slot = basic_rate_piconet::make(lap);
             }
-            basic_rate_piconet::sptr pn = d_basic_rate_piconets[lap];
+            /* decode() may insert into the table via fhs(), so hold a copy */
+            basic_rate_piconet::sptr pn = slot;
 
             if (pn->have_clk6() && pn->have_UAP()) {
                 decode(pkt, pn, true);
@@ -127,14 +136,22 @@ namespace bluetooth {
             }
         } 
         else {
-            id(lap);
+            d_log->classic(event_log::EVENT_ID, event_log::STATUS_DETECTED, pkt,
+                    clkn, clkn * 625ULL, NAN);
+            message_port_pub(d_pdu.port(), d_pdu.make(pkt, clkn, clkn * 625ULL, d_packet_sample, NAN));
         }
     }
 
-    /* handle ID packet (no header) */
-    void no_filter_sniffer_impl::id(uint32_t lap)
+    /*
+     * Packets queued for discovery are decoded after later ones were
+     * found, place those by their clock.  The input is one symbol per
+     * item, 625 to a slot.
+     */
+    uint64_t no_filter_sniffer_impl::packet_sample(classic_packet::sptr pkt)
     {
-        printf("ID\n");
+        uint32_t age = (d_packet_clkn - pkt->d_clkn) & 0x7ffffff;
+        uint64_t back = age * (uint64_t) SYMBOLS_PER_BASIC_RATE_SLOT;
+        return (d_packet_sample > back) ? d_packet_sample - back : 0;
     }
 
     /* decode packets with headers */
@@ -151,17 +168,23 @@ namespace bluetooth {
         pkt->decode();
 
         if (pkt->got_payload()) {
-            pkt->print();
+            d_packets_decoded++;
+            d_log->classic(event_log::EVENT_CLASSIC, event_log::STATUS_DECODED, pkt,
+                    pkt->d_clkn, pkt->d_clkn * 625ULL, NAN);
+            message_port_pub(d_pdu.port(), d_pdu.make(pkt, pkt->d_clkn, pkt->d_clkn * 625ULL,
+                                                      packet_sample(pkt), NAN));
             if (pkt->get_type() == 2)
                 fhs(pkt);
         } else if (first_run) {
-            printf("lost clock!\n");
+            d_log->classic(event_log::EVENT_CLASSIC, event_log::STATUS_LOST_CLOCK, pkt,
+                    pkt->d_clkn, pkt->d_clkn * 625ULL, NAN);
             pn->reset();
 
             /* start rediscovery with this packet */
             discover(pkt, pn);
         } else {
-            printf("Giving up on queued packet!\n");
+            d_log->classic(event_log::EVENT_CLASSIC, event_log::STATUS_GAVE_UP, pkt,
+                    pkt->d_clkn, pkt->d_clkn * 625ULL, NAN);
         }
     }
 
@@ -169,7 +192,8 @@ namespace bluetooth {
     void no_filter_sniffer_impl::discover(classic_packet::sptr pkt,
             basic_rate_piconet::sptr pn)
     {
-        printf("working on UAP/CLK1-6\n");
+        d_log->classic(event_log::EVENT_CLASSIC, event_log::STATUS_DISCOVERY, pkt,
+                pkt->d_clkn, pkt->d_clkn * 625ULL, NAN);
 
         /* store packet for decoding after discovery is complete */
         pn->enqueue(pkt);
@@ -183,16 +207,11 @@ namespace bluetooth {
     void no_filter_sniffer_impl::recall(basic_rate_piconet::sptr pn)
     {
         packet::sptr pkt;
-        printf("Decoding queued packets\n");
 
         while (pkt = pn->dequeue()) {
             classic_packet::sptr cpkt = boost::dynamic_pointer_cast<classic_packet>(pkt);
-            printf("time %6d, channel %2d, LAP %06x ", cpkt->d_clkn,
-                    cpkt->get_channel(), cpkt->get_LAP());
             decode(cpkt, pn, false);
         }
-
-        printf("Finished decoding queued packets\n");
     }
 
     /* pull information out of FHS packet */
@@ -203,7 +222,6 @@ namespace bluetooth {
         uint16_t nap;
         uint32_t clk;
         uint32_t offset;
-        basic_rate_piconet::sptr pn;
 
         /* caller should have checked got_payload() and get_type() */
 
@@ -215,22 +233,13 @@ namespace bluetooth {
         clk = pkt->clock_from_fhs() << 1;
         offset = (clk - pkt->d_clkn) & 0x7ffffff;
 
-        printf("FHS contents: BD_ADDR ");
-
-        printf("%2.2x:", (nap >> 8) & 0xff);
-        printf("%2.2x:", nap & 0xff);
-        printf("%2.2x:", uap);
-        printf("%2.2x:", (lap >> 16) & 0xff);
-        printf("%2.2x:", (lap >> 8) & 0xff);
-        printf("%2.2x", lap & 0xff);
-
-        printf(", CLK %07x\n", clk);
+        d_log->fhs(lap, uap, nap, clk, pkt->d_clkn, pkt->d_clkn * 625ULL);
 
         /* make use of this information from now on */
-        if (!d_basic_rate_piconets[lap]) {
-            d_basic_rate_piconets[lap] = basic_rate_piconet::make(lap);
+        basic_rate_piconet::sptr& pn = d_basic_rate_piconets[lap];
+        if (!pn) {
+            pn = basic_rate_piconet::make(lap);
         }
-        pn = d_basic_rate_piconets[lap];
 
         pn->set_UAP(uap);
         pn->set_NAP(nap);
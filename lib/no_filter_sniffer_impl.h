@@ -29,8 +29,10 @@
 #include "gr_bluetooth/no_filter_sniffer.h"
 #include "gr_bluetooth/packet.h"
 #include "gr_bluetooth/piconet.h"
+#include "event_log.h"
+#include "packet_pdu.h"
+#include "piconet_table.h"
 #include <math.h>
-#include <map>
 
 namespace gr {
 namespace bluetooth {
@@ -55,6 +57,17 @@ namespace bluetooth {
             /* total number of samples elapsed */
             uint64_t d_cumulative_count;
 
+            /* input item the packet handed to ac() starts at, and its clock */
+            uint64_t d_packet_sample;
+            uint32_t d_packet_clkn;
+
+            /* input item a packet starts at, see packet_pdu.h */
+            uint64_t packet_sample(classic_packet::sptr pkt);
+
+            /* benchmark counters */
+            uint64_t d_packets_detected;
+            uint64_t d_packets_decoded;
+
             /* frequency and number of the channel being decoded */
             double d_channel_freq;
             int d_channel;
@@ -64,14 +77,17 @@ namespace bluetooth {
             static const uint32_t LIAC = 0x9E8B00;
 
             /* the piconets we are monitoring */
-            std::map<int, basic_rate_piconet::sptr> d_basic_rate_piconets;
+            piconet_table<basic_rate_piconet::sptr> d_basic_rate_piconets;
+
+            /* packet log, formatted on its own thread */
+            event_log::sptr d_log;
+
+            /* builds the PDUs published on the "packets" port */
+            packet_pdu d_pdu;
 
             /* handle AC */
             void ac(char *symbols, int max_len, double freq, int offset);
 
-            /* handle ID packet (no header) */
-            void id(uint32_t lap);
-
             /* decode packets with headers */
             void decode(classic_packet::sptr pkt, basic_rate_piconet::sptr pn,
                     bool first_run);
@@ -89,6 +105,19 @@ namespace bluetooth {
             no_filter_sniffer_impl(double sample_rate, double center_freq);
             ~no_filter_sniffer_impl();
 
+            /* packet log configuration */
+            bool set_log_format(const std::string &format) { return d_log->set_format(format); }
+            void set_log_verbosity(int level) { d_log->set_verbosity(level); }
+            void set_log_rate_limit(double per_second) { d_log->set_rate_limit(per_second); }
+            bool set_log_file(const std::string &filename) { return d_log->set_file(filename); }
+
+            /* benchmark counters, the input is one symbol per sample */
+            uint64_t channel_slots(int channel) {
+                return (channel == d_channel) ? d_cumulative_count / SYMBOLS_PER_BASIC_RATE_SLOT : 0;
+            }
+            uint64_t packets_detected() { return d_packets_detected; }
+            uint64_t packets_decoded() { return d_packets_decoded; }
+
             // Where all the action really happens
             int work(int                        noutput_items,
                     gr_vector_const_void_star& input_items,
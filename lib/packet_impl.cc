@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <iostream>
+#include <algorithm>
 
 namespace gr {
   namespace bluetooth {
@@ -241,10 +242,13 @@ namespace gr {
       d_have_clk27     = false;
       d_have_payload   = false;
       d_payload_length = 0;
+      d_edr_length     = 0;
+      d_rate           = 1;
+      d_have_soft      = false;
     }
 
     /* search a symbol stream to find a classic_packet, return index */
-    int classic_packet::sniff_ac(char *stream, int stream_length)
+    int classic_packet::sniff_ac(char *stream, int stream_length, const int8_t *soft)
     {
       /* Looks for an AC in the stream */
       int count;
@@ -259,7 +263,7 @@ namespace gr {
         if ((PREAMBLE_DISTANCE[preamble] + BARKER_DISTANCE[barker]) 
             <= max_distance) {
           uint32_t LAP = air_to_host32( &symbols[38], 24 );
-          if (check_ac( symbols, LAP )) {
+          if (check_ac( symbols, LAP, soft ? &soft[count] : NULL )) {
             return count;
           }
         }
@@ -364,7 +368,7 @@ namespace gr {
     }
 
     /* Decode 1/3 rate FEC, three like symbols in a row */
-    bool classic_packet::unfec13(char *input, char *output, int length)
+    bool classic_packet::unfec13(char *input, char *output, int length, const int8_t *soft)
     {
       int a, b, c, i;
       int be = 0; /* bit errors */
@@ -375,23 +379,171 @@ namespace gr {
         c = a + 2;
         output[i] = ((input[a] & input[b]) | (input[b] & input[c]) |
                      (input[c] & input[a]));
-        be += ((input[a] ^ input[b]) | (input[b] ^ input[c]) |
-               (input[c] ^ input[a]));
+        if (!soft) {
+          be += ((input[a] ^ input[b]) | (input[b] ^ input[c]) |
+                 (input[c] ^ input[a]));
+          continue;
+        }
+
+        /*
+         * Soft combining: one confident symbol can outvote two weak
+         * ones, and a weak symbol disagreeing with the decision is
+         * not counted as an error.
+         */
+        int sum = soft[a] + soft[b] + soft[c];
+        if (sum != 0)
+          output[i] = (sum > 0);
+        for (int j = a; j <= c; j++) {
+          if ((input[j] != output[i]) && (abs(soft[j]) >= SOFT_NOMINAL / 2)) {
+            be++;
+            break;
+          }
+        }
       }
 
       return (be < (length / 4));
     }
 
+    /* generator polynomial of the (15,10) shortened Hamming code */
+    static uint8_t FEC23_GENERATOR[] = {1,1,0,1,0,1};
+
+    /*
+     * (15,10) lookup tables.  A block is packed into an int with its
+     * first symbol in bit 14: parity[] maps the 10 data bits to the 5
+     * parity bits lfsr() would generate, and syndrome[] maps the parity
+     * mismatch to the symbol a single error is in, 15 for no error and
+     * -1 for an uncorrectable one (the code only detects double errors).
+     */
+    struct fec23_tables
+    {
+      uint8_t parity[1024];
+      int8_t  syndrome[32];
+
+      fec23_tables()
+      {
+        int data, i, j;
+
+        for (data = 0; data < 1024; data++) {
+          /* lfsr() on a stack register */
+          uint8_t cw[5] = {0, 0, 0, 0, 0}, feedback;
+          for (i = 9; i >= 0; i--) {
+            feedback = ((data >> (9 - i)) & 1) ^ cw[4];
+            for (j = 4; j > 0; j--)
+              cw[j] = (FEC23_GENERATOR[j] && feedback) ? (cw[j - 1] ^ feedback) : cw[j - 1];
+            cw[0] = FEC23_GENERATOR[0] && feedback;
+          }
+          parity[data] = 0;
+          for (i = 0; i < 5; i++)
+            parity[data] = (parity[data] << 1) | cw[i];
+        }
+
+        for (i = 0; i < 32; i++)
+          syndrome[i] = -1;
+        syndrome[0] = 15;
+        for (i = 0; i < 10; i++)
+          syndrome[parity[1 << (9 - i)]] = i;
+        for (i = 10; i < 15; i++)
+          syndrome[1 << (14 - i)] = i;
+      }
+    };
+    static const fec23_tables FEC23;
+
+    static int fec23_pack(const char *input)
+    {
+      int block = 0;
+      for (int i = 0; i < 15; i++)
+        block = (block << 1) | (input[i] & 1);
+      return block;
+    }
+
+    /* correct a packed block in place, false if uncorrectable */
+    static bool fec23_correct(int &block)
+    {
+      int error = FEC23.syndrome[FEC23.parity[block >> 5] ^ (block & 0x1f)];
+      if (error < 0)
+        return false;
+      if (error < 15)
+        block ^= 1 << (14 - error);
+      return true;
+    }
+
+    static void fec23_unpack(int block, char *output)
+    {
+      for (int i = 0; i < 10; i++)
+        output[i] = (block >> (14 - i)) & 1;
+    }
+
+    /* Decode one 15 symbol block of 2/3 rate FEC, false if uncorrectable */
+    static bool unfec23_block(char *input, char *output)
+    {
+      int block = fec23_pack(input);
+      if (!fec23_correct(block))
+        return false;
+      fec23_unpack(block, output);
+      return true;
+    }
+
+    /*
+     * Soft decode one 15 symbol block (Chase decoding): flip every
+     * combination of the two least reliable symbols, decode each trial
+     * and keep the codeword closest to the soft symbols.  This corrects
+     * most double errors, which the code alone can only detect.
+     */
+    static bool unfec23_soft_block(char *input, const int8_t *soft, char *output)
+    {
+      int weak0 = -1, weak1 = -1;
+      int best = -1, best_block = 0;
+      int i, flips;
+
+      for (i = 0; i < 15; i++) {
+        if ((weak0 < 0) || (abs(soft[i]) < abs(soft[weak0]))) {
+          weak1 = weak0;
+          weak0 = i;
+        }
+        else if ((weak1 < 0) || (abs(soft[i]) < abs(soft[weak1]))) {
+          weak1 = i;
+        }
+      }
+
+      int received = fec23_pack(input);
+      for (flips = 0; (flips < 4) && (best != 0); flips++) {
+        int trial = received;
+        if (flips & 1)
+          trial ^= 1 << (14 - weak0);
+        if (flips & 2)
+          trial ^= 1 << (14 - weak1);
+        if (!fec23_correct(trial))
+          continue;
+
+        /* distance is the reliability of the symbols we disagree with */
+        int differ = trial ^ received;
+        int distance = 0;
+        for (i = 0; i < 15; i++)
+          if (differ & (1 << (14 - i)))
+            distance += abs(soft[i]);
+
+        if ((best < 0) || (distance < best)) {
+          best = distance;
+          best_block = trial;
+        }
+      }
+
+      if (best < 0)
+        return false;
+      fec23_unpack(best_block, output);
+      return true;
+    }
+
     /* Decode 2/3 rate FEC, a (15,10) shortened Hamming code */
-    char *classic_packet::unfec23(char *input, int length)
+    char *classic_packet::unfec23(char *input, int length, const int8_t *soft)
     {
       /* input points to the input data
        * length is length in bits of the data
        * before it was encoded with fec2/3 */
       int iptr, optr, blocks;
       char* output;
-      uint8_t difference, count, *codeword;
-      uint8_t fecgen[] = {1,1,0,1,0,1};
+      uint8_t difference;
+      bool ok;
 
       iptr = -15;
       optr = -10;
@@ -408,67 +560,42 @@ namespace gr {
         optr += 10;
         blocks--;
 
-        // copy data to output
-        for(count=0;count<10;count++)
-          output[optr+count] = input[iptr+count];
-
-        // call fec23gen on data to generate the codeword
-        //codeword = fec23gen(input+iptr);
-        codeword = lfsr((uint8_t *) input+iptr, 15, 10, fecgen);
-
-        // compare codeword to the 5 received bits
-        difference = 0;
-        for(count=0;count<5;count++)
-          if(codeword[count]!=input[iptr+10+count])
-            difference++;
-
-        /* no errors or single bit errors (errors in the parity bit):
-         * (a strong hint it's a real packet) */
-        if((0==difference) || (1==difference)) {
-          free(codeword);
-          continue;
-        }
-
-        // multiple different bits in the codeword
-        for(count=0;count<5;count++) {
-          difference |= codeword[count] ^ input[iptr+10+count];
-          difference <<= 1;
-        }
-        free(codeword);
-
-        switch (difference) {
-          /* comments are the bit that's wrong and the value
-           * of difference in binary, from the BT spec */
-          // 1000000000 11010
-        case 26: output[optr] ^= 1; break;
-          // 0100000000 01101
-        case 13: output[optr+1] ^= 1; break;
-          // 0010000000 11100
-        case 28: output[optr+2] ^= 1; break;
-          // 0001000000 01110
-        case 14: output[optr+3] ^= 1; break;
-          // 0000100000 00111
-        case 7: output[optr+4] ^= 1; break;
-          // 0000010000 11001
-        case 25: output[optr+5] ^= 1; break;
-          // 0000001000 10110
-        case 22: output[optr+6] ^= 1; break;
-          // 0000000100 01011
-        case 11: output[optr+7] ^= 1; break;
-          // 0000000010 11111
-        case 31: output[optr+8] ^= 1; break;
-          // 0000000001 10101
-        case 21: output[optr+9] ^= 1; break;
-          /* not one of these errors, probably multiple bit errors
-           * or maybe not a real packet, safe to drop it? */
-        default: free(output); return NULL;
+        if (soft)
+          ok = unfec23_soft_block(input+iptr, soft+iptr, output+optr);
+        else
+          ok = unfec23_block(input+iptr, output+optr);
+        if (!ok) {
+          free(output);
+          return NULL;
         }
       }
       return output;
     }
 
+    void classic_packet_impl::set_soft_symbols(const int8_t *soft, int length)
+    {
+      if (length > d_length)
+        length = d_length;
+      memcpy(d_soft, soft, length);
+      /* symbols past the end carry no information */
+      memset(d_soft + length, 0, MAX_SYMBOLS - length);
+      d_have_soft = true;
+    }
+
+    bool classic_packet_impl::fec13(char *stream, char *output, int length)
+    {
+      return unfec13(stream, output, length,
+                     d_have_soft ? d_soft + (stream - d_symbols) : NULL);
+    }
+
+    char *classic_packet_impl::fec23(char *stream, int length)
+    {
+      return unfec23(stream, length,
+                     d_have_soft ? d_soft + (stream - d_symbols) : NULL);
+    }
+
     /* Create an Access Code from LAP and check it against stream */
-    bool classic_packet::check_ac(char *stream, int LAP)
+    bool classic_packet::check_ac(char *stream, int LAP, const int8_t *soft)
     {
       int count, aclength, biterrors;
       uint8_t *ac, *grdata;
@@ -486,6 +613,23 @@ namespace gr {
         convert_to_grformat(ac[count], &grdata[count*8]);
       free(ac);
 
+      /*
+       * Soft correlation: each wrong symbol costs its reliability, so
+       * that weak errors are forgiven and confident ones are not.  The
+       * limit is tighter than the 7 bit errors allowed below, which
+       * keeps about the same false alarm rate on noise.
+       */
+      if (soft) {
+        int total = 0, wrong = 0;
+        for(count = 0; count < SYMBOLS_PER_BASIC_RATE_ACCESS_CODE; count++) {
+          total += abs(soft[count]);
+          if(grdata[count] != stream[count])
+            wrong += abs(soft[count]);
+        }
+        free(grdata);
+        return (wrong * SYMBOLS_PER_BASIC_RATE_ACCESS_CODE < 5 * total);
+      }
+
       for(count = 0; count < SYMBOLS_PER_BASIC_RATE_ACCESS_CODE; count++)
 	{
           if(grdata[count] != stream[count])
@@ -608,6 +752,28 @@ namespace gr {
       return reverse(hec);
     }
 
+    /* EDR rate in Mbps of the EDR alias of a packet type, 0 if it has none */
+    static int edr_rate(int type)
+    {
+      switch(type)
+	{
+        case(4):  /* 2-DH1 */
+        case(6):  /* 2-EV3 */
+        case(10): /* 2-DH3 */
+        case(12): /* 2-EV5 */
+        case(14): /* 2-DH5 */
+          return 2;
+        case(7):  /* 3-EV3 */
+        case(8):  /* 3-DH1 */
+        case(11): /* 3-DH3 */
+        case(13): /* 3-EV5 */
+        case(15): /* 3-DH5 */
+          return 3;
+        default:
+          return 0;
+	}
+    }
+
     /* check if the classic_packet's CRC is correct for a given clock (CLK1-6) */
     int classic_packet_impl::crc_check(int clock)
     {
@@ -619,7 +785,10 @@ namespace gr {
        */
       int retval = 1;
 
-      switch(d_packet_type)
+      /* behind an EDR sync sequence, the type is the EDR alias */
+      if (d_edr_length > 0 && edr_rate(d_packet_type))
+        retval = EDR(clock);
+      else switch(d_packet_type)
 	{
         case 2:/* FHS */
           retval = fhs(clock);
@@ -665,8 +834,9 @@ namespace gr {
                           d_packet_type != 5))
         return 1;
 
-      /* EV3 and EV5 have a relatively high false positive rate */
-      if (retval > 1 && (d_packet_type == 7 || d_packet_type == 13))
+      /* EV3 and EV5 (and 2/3-EV3, 2/3-EV5) have a relatively high false positive rate */
+      if (retval > 1 && (d_packet_type == 7 || d_packet_type == 13 ||
+                         (d_rate == 2 && (d_packet_type == 6 || d_packet_type == 12))))
         return 1;
 
       return retval;
@@ -697,7 +867,7 @@ namespace gr {
       if (size < d_payload_length * 12)
         return 1; //FIXME should throw exception
 
-      char *corrected = unfec23(stream, d_payload_length * 8);
+      char *corrected = fec23(stream, d_payload_length * 8);
       if (!corrected)
         return 0;
 
@@ -732,7 +902,7 @@ namespace gr {
           if(fec) {
             if(size < 30)
               return false; //FIXME should throw exception
-            char *corrected = unfec23(stream, 16);
+            char *corrected = fec23(stream, 16);
             if (!corrected)
               return false;
             unwhiten(corrected, d_payload_header, clock, 16, 18);
@@ -748,7 +918,7 @@ namespace gr {
         if(fec) {
           if(size < 15)
             return false; //FIXME should throw exception
-          char *corrected = unfec23(stream, 8);
+          char *corrected = fec23(stream, 8);
           if (!corrected)
             return false;
           unwhiten(corrected, d_payload_header, clock, 8, 18);
@@ -815,7 +985,7 @@ namespace gr {
       if(bitlength > size)
         return 1; //FIXME should throw exception
 
-      char *corrected = unfec23(stream, bitlength);
+      char *corrected = fec23(stream, bitlength);
       if (!corrected)
         return 0;
       unwhiten(corrected, d_payload, clock, bitlength, 18);
@@ -896,15 +1066,15 @@ namespace gr {
       int bits;
 
       /* check CRC for any integer byte length up to maxlength */
-      for (d_payload_length = 0;
-           d_payload_length < maxlength; d_payload_length++) {
+      for (d_payload_length = 1;
+           d_payload_length <= maxlength; d_payload_length++) {
 
-        bits = d_payload_length * 8;
+        bits = (d_payload_length - 1) * 8;
 
         /* unwhiten next byte */
         if ((bits + 8) > size)
           return 1; //FIXME should throw exception
-        unwhiten(stream, d_payload + bits, clock, 8, 18 + bits);
+        unwhiten(stream + bits, d_payload + bits, clock, 8, 18 + bits);
 
         if ((d_payload_length > 2) && (payload_crc()))
           return 10;
@@ -937,14 +1107,14 @@ namespace gr {
       int syms = 0; /* number of symbols we have decoded */
       int bits = 0; /* number of payload bits we have decoded */
 
-      d_payload_length = 1;
+      d_payload_length = 3;
 
       while (syms < maxlength) {
 
         /* unfec/unwhiten next block (15 symbols -> 10 bits) */
         if (syms + 15 > size)
           return 1; //FIXME should throw exception
-        corrected = unfec23(stream + syms, 10);
+        corrected = fec23(stream + syms, 10);
         if (!corrected) {
           free(corrected);
           if (syms < minlength)
@@ -954,6 +1124,8 @@ namespace gr {
         }
         unwhiten(corrected, d_payload + bits, clock, 10, 18 + bits);
         free(corrected);
+        syms += 15;
+        bits += 10;
 
         /* check CRC one byte at a time */
         while (d_payload_length * 8 <= bits) {
@@ -961,8 +1133,6 @@ namespace gr {
             return 10;
           d_payload_length++;
         }
-        syms += 15;
-        bits += 10;
       }
       return 1;
     }
@@ -982,15 +1152,104 @@ namespace gr {
       int bits;
 
       /* check CRC for any integer byte length up to maxlength */
-      for (d_payload_length = 0;
-           d_payload_length < maxlength; d_payload_length++) {
+      for (d_payload_length = 1;
+           d_payload_length <= maxlength; d_payload_length++) {
 
-        bits = d_payload_length * 8;
+        bits = (d_payload_length - 1) * 8;
 
         /* unwhiten next byte */
         if ((bits + 8) > size)
           return 1; //FIXME should throw exception
-        unwhiten(stream, d_payload + bits, clock, 8, 18 + bits);
+        unwhiten(stream + bits, d_payload + bits, clock, 8, 18 + bits);
+
+        if ((d_payload_length > 2) && (payload_crc()))
+          return 10;
+      }
+      return 1;
+    }
+
+    void classic_packet_impl::set_edr_phases(const char *phases, int count)
+    {
+      if (count > MAX_SYMBOLS)
+        count = MAX_SYMBOLS;
+      memcpy(d_edr_phases, phases, count);
+      d_edr_length = count;
+    }
+
+    /*
+     * EDR packets (2/3-DHx ACL and 2/3-EVx eSCO).  The DPSK symbols are
+     * Gray coded into bits, after which the payload is whitened and
+     * CRC protected like a DH or EV packet, with a 2 byte payload
+     * header for every ACL type.
+     */
+    int classic_packet_impl::EDR(int clock)
+    {
+      /* pi/4-DQPSK: 00 pi/4, 01 3pi/4, 11 -3pi/4, 10 -pi/4 */
+      static const uint8_t DQPSK_BITS[4] = {0, 1, 3, 2};
+      /* 8DPSK: 000 0, 001 pi/4, 011 pi/2, 010 3pi/4,
+       *        110 pi, 111 -3pi/4, 101 -pi/2, 100 -pi/4 */
+      static const uint8_t D8PSK_BITS[8] = {0, 1, 3, 2, 6, 7, 5, 4};
+
+      int bitlength;
+      /* maximum payload body length, eSCO has no payload header */
+      int max_length;
+      bool acl = true;
+      int rate = edr_rate(d_packet_type);
+
+      switch(d_packet_type)
+	{
+        case(4):  max_length = 54;   break; /* 2-DH1 */
+        case(8):  max_length = 83;   break; /* 3-DH1 */
+        case(10): max_length = 367;  break; /* 2-DH3 */
+        case(11): max_length = 552;  break; /* 3-DH3 */
+        case(14): max_length = 679;  break; /* 2-DH5 */
+        case(15): max_length = 1021; break; /* 3-DH5 */
+        case(6):  max_length = 60;  acl = false; break; /* 2-EV3 */
+        case(7):  max_length = 90;  acl = false; break; /* 3-EV3 */
+        case(12): max_length = 360; acl = false; break; /* 2-EV5 */
+        case(13): max_length = 540; acl = false; break; /* 3-EV5 */
+        default: /* no EDR alias */
+          return 0;
+	}
+      d_rate = rate;
+
+      /* demap the DPSK symbols */
+      char stream[MAX_PAYLOAD_BITS];
+      int size = 0;
+      for (int i = 0; (i < d_edr_length) && (size + rate <= MAX_PAYLOAD_BITS); i++) {
+        uint8_t phase = (uint8_t) d_edr_phases[i];
+        uint8_t bits = (rate == 2) ? DQPSK_BITS[phase >> 6]
+                                   : D8PSK_BITS[(uint8_t) (phase + 16) >> 5];
+        for (int b = rate - 1; b >= 0; b--)
+          stream[size++] = (bits >> b) & 0x01;
+      }
+
+      if (acl) {
+        if(!decode_payload_header(stream, clock, 2, size, false))
+          return 0;
+        /* check that the length indicated in the payload header is within spec */
+        if(d_payload_length > max_length + 4)
+          /* could be encrypted */
+          return 1;
+        bitlength = d_payload_length*8;
+        if(bitlength > size)
+          return 1;
+
+        unwhiten(stream, d_payload, clock, bitlength, 18);
+        if (payload_crc())
+          return 10;
+        return 1;
+      }
+
+      /* check CRC for any integer byte length up to max_length + 2 bytes CRC */
+      for (d_payload_length = 1;
+           d_payload_length <= max_length + 2; d_payload_length++) {
+        int bits = (d_payload_length - 1) * 8;
+
+        /* unwhiten next byte */
+        if ((bits + 8) > size)
+          return 1;
+        unwhiten(stream + bits, d_payload + bits, clock, 8, 18 + bits);
 
         if ((d_payload_length > 2) && (payload_crc()))
           return 10;
@@ -1015,7 +1274,7 @@ namespace gr {
       case 5:/* HV1 */
         {
           char corrected[80];
-          if (!unfec13(stream, corrected, 80))
+          if (!fec13(stream, corrected, 80))
             return 0;
           d_payload_length = 10;
           unwhiten(corrected, d_payload, clock, d_payload_length*8, 18);
@@ -1023,7 +1282,7 @@ namespace gr {
         break;
       case 6:/* HV2 */
         {
-          char *corrected = unfec23(stream, 160);
+          char *corrected = fec23(stream, 160);
           if (!corrected)
             return 0;
           d_payload_length = 20;
@@ -1051,7 +1310,7 @@ namespace gr {
       char header[18];
       char unwhitened[18];
 
-      if (!unfec13(stream, header, 18))
+      if (!fec13(stream, header, 18))
         return 0;
       unwhiten(header, unwhitened, clock, 18, 0);
       uint16_t hdr_data = air_to_host16(unwhitened, 10);
@@ -1071,7 +1330,7 @@ namespace gr {
       char header[18];
       uint8_t UAP;
 
-      if (d_have_clk6 && unfec13(stream, header, 18)) {
+      if (d_have_clk6 && fec13(stream, header, 18)) {
         unwhiten(header, d_packet_header, d_clock, 18, 0);
         uint16_t hdr_data = air_to_host16(d_packet_header, 10);
         uint8_t hec = air_to_host8(&d_packet_header[10], 8);
@@ -1079,12 +1338,10 @@ namespace gr {
         if (UAP == d_UAP) {
           d_packet_type = air_to_host8(&d_packet_header[3], 4);
           return true;
-        } else {
-          printf("bad HEC! %02x %02x %i ", UAP, d_UAP, air_to_host8(&d_packet_header[3], 4));
         }
       }
-	
-      printf("failed to decode header\n");
+
+      /* callers report the failure through the event log */
       return false;
     }
 
@@ -1092,6 +1349,13 @@ namespace gr {
     {
       d_payload_header_length = 0;
 
+      /* the DPSK sync sequence tells EDR packets from basic rate ones */
+      if (d_edr_length > 0 && edr_rate(d_packet_type)) {
+        EDR(d_clock);
+        d_have_payload = true;
+        return;
+      }
+
       switch(d_packet_type)
 	{
         case 0: /* NULL */
@@ -1109,50 +1373,43 @@ namespace gr {
           DM(d_clock);
           break;
         case 4: /* DH1 */
-          /* assuming DH1 but could be 2-DH1 */
           DH(d_clock);
           break;
         case 5: /* HV1 */
           HV(d_clock);
           break;
         case 6: /* HV2 */
+          /* or 2-EV3, decoded as EDR above */
           HV(d_clock);
           break;
-        case 7: /* HV3/EV3/3-EV3 */
+        case 7: /* HV3/EV3 */
           /* decode as EV3 if CRC checks out */
           if (EV3(d_clock) <= 1)
             /* otherwise assume HV3 */
             HV(d_clock);
-          /* don't know how to decode 3-EV3 */
           break;
         case 8: /* DV */
-          /* assuming DV but could be 3-DH1 */
           DM(d_clock);
           break;
         case 9: /* AUX1 */
           DH(d_clock);
           break;
         case 10: /* DM3 */
-          /* assuming DM3 but could be 2-DH3 */
           DM(d_clock);
           break;
         case 11: /* DH3 */
-          /* assuming DH3 but could be 3-DH3 */
           DH(d_clock);
           break;
         case 12: /* EV4 */
-          /* assuming EV4 but could be 2-EV5 */
           EV4(d_clock);
           break;
         case 13: /* EV5 */
-          /* assuming EV5 but could be 3-EV5 */
           EV5(d_clock);
+          break;
         case 14: /* DM5 */
-          /* assuming DM5 but could be 2-DH5 */
           DM(d_clock);
           break;
         case 15: /* DH5 */
-          /* assuming DH5 but could be 3-DH5 */
           DH(d_clock);
           break;
 	}
@@ -1201,6 +1458,67 @@ namespace gr {
       return tun_format;
     }
 
+    /* BR/EDR baseband pseudo-header flags, as read by Wireshark */
+    static const uint16_t BREDR_DEWHITENED      = 0x0001;
+    static const uint16_t BREDR_REFLAP_VALID    = 0x0010;
+    static const uint16_t BREDR_PAYLOAD_PRESENT = 0x0020;
+    static const uint16_t BREDR_REFUAP_VALID    = 0x0080;
+
+    /* size of the BR/EDR baseband pseudo-header */
+    static const int BREDR_BB_HEADER_LENGTH = 22;
+
+    int classic_packet_impl::pcap_format(uint8_t *buf, int buflen)
+    {
+      int payload_length = d_have_payload ? d_payload_length : 0;
+      int length = BREDR_BB_HEADER_LENGTH + payload_length;
+      uint32_t bt_header = 0;
+      uint32_t ref_lap_uap = d_LAP;
+      uint16_t flags = BREDR_DEWHITENED | BREDR_REFLAP_VALID;
+      int i;
+
+      if (length > buflen)
+        return 0;
+
+      if (d_have_payload) {
+        /* packet header was unwhitened by decode_header() */
+        bt_header = air_to_host32(d_packet_header, 18);
+        flags |= BREDR_PAYLOAD_PRESENT;
+      }
+      if (d_have_UAP) {
+        ref_lap_uap |= ((uint32_t) d_UAP) << 24;
+        flags |= BREDR_REFUAP_VALID;
+      }
+
+      /* everything in the pseudo-header is little endian */
+      buf[0]  = get_channel( ) & 0xff;
+      buf[1]  = 0;              /* signal power, not valid */
+      buf[2]  = 0;              /* noise power, not valid */
+      buf[3]  = 0;              /* access code offenses */
+      buf[4]  = d_rate - 1;     /* transport any, basic rate or EDR 2/3 Mbps */
+      buf[5]  = 0;              /* corrected header bits */
+      buf[6]  = 0;              /* corrected payload bits */
+      buf[7]  = 0;
+      buf[8]  = d_LAP & 0xff;
+      buf[9]  = (d_LAP >> 8) & 0xff;
+      buf[10] = (d_LAP >> 16) & 0xff;
+      buf[11] = 0;
+      buf[12] = ref_lap_uap & 0xff;
+      buf[13] = (ref_lap_uap >> 8) & 0xff;
+      buf[14] = (ref_lap_uap >> 16) & 0xff;
+      buf[15] = (ref_lap_uap >> 24) & 0xff;
+      buf[16] = bt_header & 0xff;
+      buf[17] = (bt_header >> 8) & 0xff;
+      buf[18] = (bt_header >> 16) & 0xff;
+      buf[19] = 0;
+      buf[20] = flags & 0xff;
+      buf[21] = (flags >> 8) & 0xff;
+
+      for(i=0;i<payload_length;i++)
+        buf[i+BREDR_BB_HEADER_LENGTH] = air_to_host8(&d_payload[i*8], 8);
+
+      return length;
+    }
+
     /* check to see if the packet has a header */
     bool classic_packet_impl::header_present()
     {
@@ -1277,9 +1595,9 @@ namespace gr {
     // -------------------------------------------------------------------
 
     le_packet::sptr 
-    le_packet::make(char *stream, int length, double freq) 
+    le_packet::make(char *stream, int length, double freq, int phy) 
     {
-      return le_packet::sptr(new le_packet_impl(stream, length, freq));
+      return le_packet::sptr(new le_packet_impl(stream, length, freq, phy));
     }
 
     int le_packet::freq2chan(const double freq) {
@@ -1313,6 +1631,101 @@ namespace gr {
       return chan2index( chan );
     }
 
+    double le_packet::index2freq(const int index) {
+      if (index == 37)
+        return 2402000000.0;
+      if (index == 38)
+        return 2426000000.0;
+      if (index == 39)
+        return 2480000000.0;
+      if (index <= 10)
+        return 2404000000.0 + index * 2000000.0;
+      return 2428000000.0 + (index - 11) * 2000000.0;
+    }
+
+    /* reflected CRC-24 polynomial 0x00065b, shifted out LSB first */
+    const uint32_t le_packet::CRC24_TABLE[] = {
+      0x000000, 0x01b4c0, 0x036980, 0x02dd40, 0x06d300, 0x0767c0,
+      0x05ba80, 0x040e40, 0x0da600, 0x0c12c0, 0x0ecf80, 0x0f7b40,
+      0x0b7500, 0x0ac1c0, 0x081c80, 0x09a840, 0x1b4c00, 0x1af8c0,
+      0x182580, 0x199140, 0x1d9f00, 0x1c2bc0, 0x1ef680, 0x1f4240,
+      0x16ea00, 0x175ec0, 0x158380, 0x143740, 0x103900, 0x118dc0,
+      0x135080, 0x12e440, 0x369800, 0x372cc0, 0x35f180, 0x344540,
+      0x304b00, 0x31ffc0, 0x332280, 0x329640, 0x3b3e00, 0x3a8ac0,
+      0x385780, 0x39e340, 0x3ded00, 0x3c59c0, 0x3e8480, 0x3f3040,
+      0x2dd400, 0x2c60c0, 0x2ebd80, 0x2f0940, 0x2b0700, 0x2ab3c0,
+      0x286e80, 0x29da40, 0x207200, 0x21c6c0, 0x231b80, 0x22af40,
+      0x26a100, 0x2715c0, 0x25c880, 0x247c40, 0x6d3000, 0x6c84c0,
+      0x6e5980, 0x6fed40, 0x6be300, 0x6a57c0, 0x688a80, 0x693e40,
+      0x609600, 0x6122c0, 0x63ff80, 0x624b40, 0x664500, 0x67f1c0,
+      0x652c80, 0x649840, 0x767c00, 0x77c8c0, 0x751580, 0x74a140,
+      0x70af00, 0x711bc0, 0x73c680, 0x727240, 0x7bda00, 0x7a6ec0,
+      0x78b380, 0x790740, 0x7d0900, 0x7cbdc0, 0x7e6080, 0x7fd440,
+      0x5ba800, 0x5a1cc0, 0x58c180, 0x597540, 0x5d7b00, 0x5ccfc0,
+      0x5e1280, 0x5fa640, 0x560e00, 0x57bac0, 0x556780, 0x54d340,
+      0x50dd00, 0x5169c0, 0x53b480, 0x520040, 0x40e400, 0x4150c0,
+      0x438d80, 0x423940, 0x463700, 0x4783c0, 0x455e80, 0x44ea40,
+      0x4d4200, 0x4cf6c0, 0x4e2b80, 0x4f9f40, 0x4b9100, 0x4a25c0,
+      0x48f880, 0x494c40, 0xda6000, 0xdbd4c0, 0xd90980, 0xd8bd40,
+      0xdcb300, 0xdd07c0, 0xdfda80, 0xde6e40, 0xd7c600, 0xd672c0,
+      0xd4af80, 0xd51b40, 0xd11500, 0xd0a1c0, 0xd27c80, 0xd3c840,
+      0xc12c00, 0xc098c0, 0xc24580, 0xc3f140, 0xc7ff00, 0xc64bc0,
+      0xc49680, 0xc52240, 0xcc8a00, 0xcd3ec0, 0xcfe380, 0xce5740,
+      0xca5900, 0xcbedc0, 0xc93080, 0xc88440, 0xecf800, 0xed4cc0,
+      0xef9180, 0xee2540, 0xea2b00, 0xeb9fc0, 0xe94280, 0xe8f640,
+      0xe15e00, 0xe0eac0, 0xe23780, 0xe38340, 0xe78d00, 0xe639c0,
+      0xe4e480, 0xe55040, 0xf7b400, 0xf600c0, 0xf4dd80, 0xf56940,
+      0xf16700, 0xf0d3c0, 0xf20e80, 0xf3ba40, 0xfa1200, 0xfba6c0,
+      0xf97b80, 0xf8cf40, 0xfcc100, 0xfd75c0, 0xffa880, 0xfe1c40,
+      0xb75000, 0xb6e4c0, 0xb43980, 0xb58d40, 0xb18300, 0xb037c0,
+      0xb2ea80, 0xb35e40, 0xbaf600, 0xbb42c0, 0xb99f80, 0xb82b40,
+      0xbc2500, 0xbd91c0, 0xbf4c80, 0xbef840, 0xac1c00, 0xada8c0,
+      0xaf7580, 0xaec140, 0xaacf00, 0xab7bc0, 0xa9a680, 0xa81240,
+      0xa1ba00, 0xa00ec0, 0xa2d380, 0xa36740, 0xa76900, 0xa6ddc0,
+      0xa40080, 0xa5b440, 0x81c800, 0x807cc0, 0x82a180, 0x831540,
+      0x871b00, 0x86afc0, 0x847280, 0x85c640, 0x8c6e00, 0x8ddac0,
+      0x8f0780, 0x8eb340, 0x8abd00, 0x8b09c0, 0x89d480, 0x886040,
+      0x9a8400, 0x9b30c0, 0x99ed80, 0x985940, 0x9c5700, 0x9de3c0,
+      0x9f3e80, 0x9e8a40, 0x972200, 0x9696c0, 0x944b80, 0x95ff40,
+      0x91f100, 0x9045c0, 0x929880, 0x932c40
+    };
+
+    uint32_t le_packet::crc24(uint32_t crc_init, const uint8_t *data, int length) {
+      /* the shift register holds CRCInit bit reversed */
+      uint32_t state = 0;
+      int i;
+      for( i=0; i<24; i++ ) {
+        state |= ((crc_init >> i) & 1) << (23 - i);
+      }
+
+      for( i=0; i<length; i++ ) {
+        state = (state >> 8) ^ CRC24_TABLE[(state ^ data[i]) & 0xff];
+      }
+      return state;
+    }
+
+    uint32_t le_packet::crc24_init(uint32_t crc, const uint8_t *data, int length) {
+      uint32_t state = crc;
+      int i, j;
+
+      /* undo each shift, last bit first */
+      for( i=length-1; i>=0; i-- ) {
+        for( j=7; j>=0; j-- ) {
+          uint32_t feedback = (state >> 23) & 1;
+          if (feedback) {
+            state ^= 0xda6000;
+          }
+          state = ((state << 1) | (feedback ^ ((data[i] >> j) & 1))) & 0xffffff;
+        }
+      }
+
+      uint32_t crc_init = 0;
+      for( i=0; i<24; i++ ) {
+        crc_init |= ((state >> i) & 1) << (23 - i);
+      }
+      return crc_init;
+    }
+
     const uint8_t le_packet::PREAMBLE_DISTANCE[] = {
       4,4,3,4,4,3,4,4,3,4,2,3,4,4,3,4,4,3,4,4,3,2,4,3,4,4,3,4,4,3,4,4,3,4,2,
       3,4,4,3,4,2,3,1,2,3,4,2,3,4,4,3,4,4,3,4,4,3,4,2,3,4,4,3,4,4,3,4,4,3,2,
@@ -1403,16 +1816,16 @@ namespace gr {
 
     const uint8_t le_packet::ACCESS_HEADER_DISTANCE_MSB[] = {
       1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 
-      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 1, 1, 
-      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 
-      1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 
-      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 
-      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 
-      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 
-      3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 
-      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 
-      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
     };
 
     const uint8_t le_packet::DATA_HEADER_DISTANCE_LSB[] = {
@@ -1431,16 +1844,16 @@ namespace gr {
 
     const uint8_t le_packet::DATA_HEADER_DISTANCE_MSB[] = {
       0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
-      0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 
-      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 
-      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 
-      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 
-      2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 
-      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 
-      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 
-      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 
-      2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 
-      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1
     };
 
     const uint8_t le_packet::INDICES[] = {
@@ -1449,16 +1862,28 @@ namespace gr {
       107, 113, 86, 8, 70, 125
     };
 
+    const uint16_t le_packet::HEADER_WHITENING[] = {
+      0xb240, 0x4089, 0x57d2, 0xa51b, 0x7964, 0x8bad, 0x9cf6, 0x6e3f,
+      0x2408, 0xd6c1, 0xc19a, 0x3353, 0xef2c, 0x1de5, 0x0abe, 0xf877,
+      0x9ed0, 0x6c19, 0x7b42, 0x898b, 0x55f4, 0xa73d, 0xb066, 0x42af,
+      0x0898, 0xfa51, 0xed0a, 0x1fc3, 0xc3bc, 0x3175, 0x262e, 0xd4e7,
+      0xeb60, 0x19a9, 0x0ef2, 0xfc3b, 0x2044, 0xd28d, 0xc5d6, 0x371f
+    };
+
+    /* symbols in the search window: preamble, AA and header */
+    static const int AA_WINDOW_SYMBOLS = 8 + 32 + 16;
+
     int
-    le_packet::sniff_aa(char *stream, int stream_length, double freq)
+    le_packet::sniff_aa(char *stream, int stream_length, double freq,
+                        const std::vector<uint32_t> *known_aa)
     {
       /* Looks for AA */
       int count;
       int index = freq2index( freq );
-      int distance = 0;
       const uint8_t *phlsb, *phmsb;
+      bool advertising = (index >= 37);
 
-      if (index >= 37) {
+      if (advertising) {
         // access channel
         phlsb = ACCESS_HEADER_DISTANCE_LSB;
         phmsb = ACCESS_HEADER_DISTANCE_MSB;
@@ -1470,112 +1895,379 @@ namespace gr {
         phlsb = DATA_HEADER_DISTANCE_LSB;
         phmsb = DATA_HEADER_DISTANCE_MSB;
       }
+      if (stream_length <= 0)
+        return -1;
 
-      for( count=0; count<stream_length; count++ ) {
-        char *   symbols    = &stream[count];
-        uint16_t preamble   = air_to_host16(&symbols[0], 9);
-        char hbuf[16];
-        unsigned hi, wi;
-
-        // de-whiten 
-        for( hi=0, wi=INDICES[index]; hi<16; hi++, wi=(wi+1)%127 ) {
-          hbuf[hi] = symbols[hi+40] ^ WHITENING_DATA[wi];
-        }
-
-        uint8_t  header_lsb = air_to_host8(&hbuf[0], 8);
-        uint8_t  header_msb = air_to_host8(&hbuf[8], 8);
-
-        int preamble_distance = PREAMBLE_DISTANCE[preamble];
-        int header_distance   = phlsb[header_lsb] + phmsb[header_msb];       
-        int distance          = preamble_distance + header_distance;
-
-        int max_distance = 0;
-
-        if (index >= 37) {
-          // access channel
-          uint8_t aabyte = air_to_host8(&symbols[8], 8);
-          int aa_distance = ACCESS_ADDRESS_DISTANCE_0[aabyte];
-          aabyte = air_to_host8(&symbols[16], 8);
-          aa_distance += ACCESS_ADDRESS_DISTANCE_1[aabyte];
-          aabyte = air_to_host8(&symbols[24], 8);
-          aa_distance += ACCESS_ADDRESS_DISTANCE_2[aabyte];
-          aabyte = air_to_host8(&symbols[32], 8);
-          aa_distance += ACCESS_ADDRESS_DISTANCE_3[aabyte];
-          if (!aa_distance && distance) {
-            printf( "preamble_distance=%d, header_distance=%d, aa_distance=%d\n", 
-                    preamble_distance, header_distance, aa_distance );
-            if (preamble_distance) {
-              printf( "preamble=0x%03x\n", preamble );
-            }
-            if (header_distance) {
-              printf( "de_whitened: header_lsb=0x%02x, header_msb=0x%02x\n", header_lsb, header_msb );
-              uint8_t  raw_lsb = air_to_host8(&stream[40], 8);
-              uint8_t  raw_msb = air_to_host8(&stream[48], 8);
-              printf( "raw:         header_lsb=0x%02x, header_msb=0x%02x\n", raw_lsb, raw_msb );
-            }
+      /*
+       * Sliding register of the symbols at stream[count], first symbol
+       * in bit 0: preamble in bits 0-7, AA in bits 8-39 and the (still
+       * whitened) header in bits 40-55.  Each step shifts in one symbol
+       * instead of regathering all 56.
+       */
+      uint64_t window = 0;
+      for (int i = 0; i < AA_WINDOW_SYMBOLS; i++)
+        window |= (uint64_t) (stream[i] & 1) << i;
+
+      /* advertising access address */
+      const uint32_t adv_aa    = 0x8e89bed6;
+      const uint16_t whitening = HEADER_WHITENING[index];
+
+      for( count=0; ; count++ ) {
+        /* alternating preamble, continued by the first bit of the AA */
+        int preamble_distance = __builtin_popcount( (uint32_t) (window & 0x1ff) ^ 0xaa );
+        if (preamble_distance > 4)
+          preamble_distance = 9 - preamble_distance;
+
+        uint16_t header = (uint16_t) (window >> 40) ^ whitening;
+        int distance    = preamble_distance + phlsb[header & 0xff] + phmsb[header >> 8];
+
+        if (advertising) {
+          if (distance <= 2) {
+            uint32_t aa = (uint32_t) (window >> 8);
+            if (distance + __builtin_popcount( aa ^ adv_aa ) <= 2)
+              return count;
           }
-          distance += aa_distance;
-          max_distance += 2;
         }
+        else if (distance == 0) {
+          if (!known_aa || std::binary_search(known_aa->begin(), known_aa->end(),
+                                              (uint32_t) (window >> 8)))
+            return count;
+        }
+
+        if (count + 1 >= stream_length)
+          break;
+        window = (window >> 1) |
+          ((uint64_t) (stream[count + AA_WINDOW_SYMBOLS] & 1) << (AA_WINDOW_SYMBOLS - 1));
+      }
+
+      return -1;
+    }
+
+    int
+    le_packet::sniff_aa_2m(char *stream, int stream_length, double freq,
+                           const std::vector<uint32_t> *known_aa)
+    {
+      int offset = 8;
+
+      while (offset < stream_length) {
+        int i = sniff_aa(&stream[offset], stream_length - offset, freq, known_aa);
+        if (i < 0)
+          return -1;
+        i += offset;
+
+        /* the first preamble octet continues the alternation of the second */
+        int distance = 0;
+        for (int k = 1; k <= 8; k++)
+          distance += (stream[i - k] & 1) != ((stream[i] & 1) ^ (k & 1));
+        if (distance <= 1)
+          return i;
+
+        offset = i + 1;
+      }
 
-        if (distance <= max_distance) {
+      return -1;
+    }
+
+    /* LE Coded preamble: "00111100" ten times, first symbol in bit 0 */
+    static const uint64_t CODED_PREAMBLE = 0x3c3c3c3c3c3c3c3cULL;
+
+    static int
+    coded_preamble_distance(const char *symbols)
+    {
+      int distance = 0;
+      for (int i = 0; i < le_packet::CODED_PREAMBLE_SYMBOLS; i++)
+        distance += (symbols[i] & 1) != ((CODED_PREAMBLE >> (i & 63)) & 1);
+      return distance;
+    }
+
+    int
+    le_packet::sniff_coded(char *stream, int stream_length)
+    {
+      if (stream_length <= 0)
+        return -1;
+
+      /* the last 64 symbols of the preamble, as in sniff_aa() */
+      const int tail = CODED_PREAMBLE_SYMBOLS - 64;
+      uint64_t window = 0;
+      for (int i = 0; i < 64; i++)
+        window |= (uint64_t) (stream[tail + i] & 1) << i;
+
+      for (int count = 0; ; count++) {
+        if ((__builtin_popcountll( window ^ CODED_PREAMBLE ) <= 6) &&
+            (coded_preamble_distance( &stream[count] ) <= 8)) {
+          /*
+           * Noise ahead of the preamble may look like one more period
+           * of it.  One period too late, the first octet of FEC block 1
+           * differs in at least 4 symbols, so move on while that is
+           * not worse.
+           */
+          int distance = coded_preamble_distance( &stream[count] );
+          while (count + 8 < stream_length) {
+            int later = coded_preamble_distance( &stream[count + 8] );
+            if (later > distance)
+              break;
+            distance = later;
+            count += 8;
+          }
           return count;
         }
+
+        if (count + 1 >= stream_length)
+          break;
+        window = (window >> 1) |
+          ((uint64_t) (stream[count + CODED_PREAMBLE_SYMBOLS] & 1) << 63);
       }
 
       return -1;
     }
 
-    le_packet_impl::le_packet_impl(char *stream, int length, double freq)
-      : packet(stream, length, freq)
+    /*
+     * Viterbi decoder for the LE Coded convolutional code (K=4,
+     * G0 = 1+D+D^2+D^3, G1 = 1+D^2+D^3) followed by the pattern mapper
+     * (S=8: coded 0 -> 0011, 1 -> 1100; S=2: as is).  Each of nbits
+     * input bits takes `coding` symbols.  The encoder starts in state
+     * 0; if terminated it also ends there.  Returns the path metric
+     * (symbol errors) of the decoded bits.
+     */
+    static int
+    coded_viterbi(const char *symbols, int nbits, int coding, bool terminated, char *out)
     {
-      d_index = freq2index( freq );
+      const int STATES = 8;
+      const int INF = 1 << 20;
+      int metric[STATES], next[STATES];
+      std::vector<uint8_t> decisions(nbits);
+      int per_coded = coding / 2;
+
+      for (int s = 0; s < STATES; s++)
+        metric[s] = s ? INF : 0;
+
+      for (int n = 0; n < nbits; n++) {
+        /* cost of each coded bit value for the two coded bits of this input bit */
+        int cost[2][2];
+        for (int c = 0; c < 2; c++) {
+          const char *p = &symbols[(2 * n + c) * per_coded];
+          int ones = 0;
+          if (per_coded == 4) {
+            /* distance to 0011, the distance to 1100 is 4 minus that */
+            ones = (p[0] & 1) + (p[1] & 1) + !(p[2] & 1) + !(p[3] & 1);
+            cost[c][0] = ones;
+            cost[c][1] = 4 - ones;
+          }
+          else {
+            cost[c][0] = p[0] & 1;
+            cost[c][1] = !(p[0] & 1);
+          }
+        }
 
-      (void) ::memcpy( &d_link_symbols[0], stream, LE_MAX_SYMBOLS );
+        uint8_t decision = 0;
+        for (int s = 0; s < STATES; s++)
+          next[s] = INF;
+        for (int s = 0; s < STATES; s++) {
+          if (metric[s] >= INF)
+            continue;
+          /* state bit 0 is the previous input bit, bit 2 the oldest */
+          int s0 = s & 1, s1 = (s >> 1) & 1, s2 = (s >> 2) & 1;
+          for (int b = 0; b < 2; b++) {
+            int a0 = b ^ s0 ^ s1 ^ s2;
+            int a1 = b ^ s1 ^ s2;
+            int t = ((s << 1) | b) & 7;
+            int m = metric[s] + cost[0][a0] + cost[1][a1];
+            if (m < next[t]) {
+              next[t] = m;
+              /* remember the bit shifted out to reach t */
+              decision = (decision & ~(1 << t)) | (s2 << t);
+            }
+          }
+        }
+        decisions[n] = decision;
+        for (int s = 0; s < STATES; s++)
+          metric[s] = next[s];
+      }
 
-      unsigned i, wi = INDICES[d_index];
-      for( i=40; i<LE_MAX_SYMBOLS; i++, wi=(wi+1)%127 ) {
-        d_link_symbols[i] ^= WHITENING_DATA[wi];
+      int state = 0;
+      if (!terminated) {
+        for (int s = 1; s < STATES; s++) {
+          if (metric[s] < metric[state])
+            state = s;
+        }
       }
+      int best = metric[state];
+
+      for (int n = nbits - 1; n >= 0; n--) {
+        out[n] = state & 1;
+        state = (state >> 1) | (((decisions[n] >> state) & 1) << 2);
+      }
+
+      return best;
+    }
+
+    int
+    le_packet::decode_coded(char *stream, int stream_length, char *out, int *coding)
+    {
+      /* FEC block 1: AA, CI and TERM1, always S=8 */
+      const int block1_bits = 32 + 2 + 3;
+      char block1[block1_bits];
+      char *symbols = &stream[CODED_PREAMBLE_SYMBOLS];
+      int available = stream_length - CODED_PREAMBLE_SYMBOLS;
+
+      if (available < CODED_BLOCK1_SYMBOLS)
+        return 0;
+      int errors = coded_viterbi(symbols, block1_bits, 8, true, block1);
+
+      /* a quarter of the 296 symbols wrong is too far gone for a valid AA */
+      int ci = block1[32] | (block1[33] << 1);
+      if ((errors > CODED_BLOCK1_SYMBOLS / 4) || (ci > 1))
+        return 0;
+      *coding = ci ? 2 : 8;
+
+      /* preamble octet and AA, as an LE 1M packet would have them */
+      for (int i = 0; i < 32; i++)
+        out[8 + i] = block1[i];
+      for (int i = 0; i < 8; i++)
+        out[7 - i] = !out[8] ^ (i & 1);
+
+      /* FEC block 2: header, PDU and CRC (still whitened), then TERM2 */
+      symbols   += CODED_BLOCK1_SYMBOLS;
+      available -= CODED_BLOCK1_SYMBOLS;
+      int nbits = available / *coding;
+      if (nbits > (int) LE_MAX_SYMBOLS - 40)
+        nbits = LE_MAX_SYMBOLS - 40;
+      if (nbits < 16)
+        return 0;
+      coded_viterbi(symbols, nbits, *coding, false, &out[40]);
+
+      return 40 + nbits;
+    }
+
+    le_packet_impl::le_packet_impl(char *stream, int length, double freq, int phy)
+      : packet(stream, length, freq)
+    {
+      d_phy     = phy;
+      d_index   = freq2index( freq );
+      d_channel = freq2chan( freq );
+
+      d_num_symbols = (length < (int) LE_MAX_SYMBOLS) ? length : LE_MAX_SYMBOLS;
+      (void) ::memcpy( &d_link_symbols[0], stream, d_num_symbols );
 
       d_AA             = air_to_host32(&d_link_symbols[8], 32);
       d_whitened       = true;
       d_have_payload   = false;
       d_payload_length = 0;
 
-      uint16_t header = air_to_host16(&d_link_symbols[40], 16);
+      d_pdu            = &d_octets[2];
+      d_unwhitened     = false;
+      d_have_CRCInit   = (d_index >= 37);
+      d_CRCInit        = ADVERTISING_CRC_INIT;
+      d_crc_checked    = false;
+      d_have_header    = false;
+
+      /*
+       * Only the header is de-whitened here, the rest waits for
+       * decode_header() so false AA matches stay cheap.
+       */
+      uint16_t header = air_to_host16(&d_link_symbols[40], 16) ^ HEADER_WHITENING[d_index];
       if (d_index >= 37) {
         d_PDU_Type   = (header >> 0) & 0xf;
+        d_ChSel      = (header >> 5) & 1;
         d_TxAdd      = (header >> 6) & 1;
         d_RxAdd      = (header >> 7) & 1;
-        d_PDU_Length = (header >> 8) & 0x3f;
+        d_PDU_Length = (header >> 8) & 0xff;
       }
       else {
         d_LLID       = (header >> 0) & 3;
         d_NESN       = (header >> 2) & 1;
         d_SN         = (header >> 3) & 1;
         d_MD         = (header >> 4) & 1;
-        d_PDU_Length = (header >> 8) & 0x1f;
+        d_PDU_Length = (header >> 8) & 0xff;
       }
+    }
 
-      unsigned pi;
-      for( pi=0, i=56; i+8<LE_MAX_SYMBOLS; pi++, i+=8 ) {
-        d_pdu[pi] = air_to_host8(&d_link_symbols[i], 8);
+    le_packet_impl::~le_packet_impl( )
+    {
+    }
+
+    bool le_packet_impl::unwhiten()
+    {
+      if (d_unwhitened)
+        return true;
+
+      unsigned length = octets();
+      if ((length > sizeof(d_octets)) || ((int) (40 + 8*length) > d_num_symbols)) {
+        return false;
       }
+
+      /* whitening starts with the header, right after the AA */
+      char obuf[8];
+      unsigned i, j, wi = INDICES[d_index];
+      for( i=0; i<length; i++ ) {
+        for( j=0; j<8; j++, wi=(wi+1)%127 ) {
+          obuf[j] = d_link_symbols[40+8*i+j] ^ WHITENING_DATA[wi];
+        }
+        d_octets[i] = air_to_host8(obuf, 8);
+      }
+      d_unwhitened = true;
+
+      return true;
     }
 
-    le_packet_impl::~le_packet_impl( )
+    uint32_t le_packet_impl::received_crc()
     {
+      unsigned c = 2 + d_PDU_Length;
+      return d_octets[c] | (d_octets[c+1] << 8) | (d_octets[c+2] << 16);
     }
 
     bool le_packet_impl::decode_header()
     {
-      return false; // FIXME: TODO
+      d_have_header = false;
+      d_crc_checked = false;
+
+      /* cheap header checks before touching the PDU */
+      if (d_index >= 37) {
+        /* every advertising PDU starts with an address */
+        if (d_PDU_Length < 6) {
+          return false;
+        }
+      }
+      else if ((d_LLID == 0) || (d_PDU_Length > MAX_DATA_PDU_OCTETS)) {
+        /* reserved, or longer than data length extension allows */
+        return false;
+      }
+
+      if (!unwhiten()) {
+        return false;
+      }
+
+      if (d_have_CRCInit) {
+        if (crc24(d_CRCInit, d_octets, 2 + d_PDU_Length) != received_crc()) {
+          return false;
+        }
+        d_crc_checked = true;
+      }
+
+      d_have_header = true;
+      return true;
+    }
+
+    uint32_t le_packet_impl::recover_CRCInit()
+    {
+      if (!unwhiten())
+        return 0;
+      return crc24_init(received_crc(), d_octets, 2 + d_PDU_Length);
     }
     
     void le_packet_impl::decode_payload()
     {
-      // FIXME: TODO
+      if (!d_have_header) {
+        return;
+      }
+
+      /* the PDU in host order, as for classic payloads */
+      unsigned i;
+      for( i=0; i<d_PDU_Length; i++ ) {
+        d_payload[i] = (char) d_pdu[i];
+      }
+      d_payload_length = d_PDU_Length;
+      d_have_payload   = true;
     }
            
     void le_packet_impl::print()
@@ -1666,12 +2358,33 @@ namespace gr {
       
     char *le_packet_impl::tun_format()
     {
-      return (char*)calloc(256,1); // FIXME: TODO
+      /* the LINKTYPE_BLUETOOTH_LE_LL record */
+      char *tun_format = (char *) malloc(4 + sizeof(d_octets));
+      pcap_format((uint8_t *) tun_format, 4 + sizeof(d_octets));
+      return tun_format;
+    }
+      
+    int le_packet_impl::pcap_format(uint8_t *buf, int buflen)
+    {
+      /* AA, header, PDU and CRC, all in on-air byte order */
+      unsigned length = 4 + octets();
+
+      if (!unwhiten() || ((int) length > buflen)) {
+        return 0;
+      }
+
+      buf[0] = d_AA & 0xff;
+      buf[1] = (d_AA >> 8) & 0xff;
+      buf[2] = (d_AA >> 16) & 0xff;
+      buf[3] = (d_AA >> 24) & 0xff;
+      (void) ::memcpy( &buf[4], d_octets, octets() );
+
+      return (int) length;
     }
       
     bool le_packet_impl::header_present()
     {
-      return false; // FIXME: TODO
+      return d_have_header;
     }
 
   } /* namespace bluetooth */
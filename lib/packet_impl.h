@@ -35,6 +35,9 @@ namespace gr {
     class classic_packet_impl : virtual public classic_packet
     {
     private:
+      /* bench_bluetooth times unwhiten() */
+      friend class bench_hooks;
+
       /* lower address part found in access code */
       uint32_t d_LAP;
 
@@ -72,6 +75,21 @@ namespace gr {
       /* CLK1-27 of master */
       uint32_t d_clock;
 
+      /* DPSK phase changes after an EDR sync sequence, see set_edr_phases() */
+      char d_edr_phases[MAX_SYMBOLS];
+      int d_edr_length;
+
+      /* payload rate in Mbps */
+      int d_rate;
+
+      /* soft symbols parallel to d_symbols, see set_soft_symbols() */
+      int8_t d_soft[MAX_SYMBOLS];
+      bool d_have_soft;
+
+      /* FEC decoding of symbols in d_symbols, soft if we have soft symbols */
+      bool fec13(char *stream, char *output, int length);
+      char *fec23(char *stream, int length);
+
       /* type-specific CRC checks and decoding */
       int fhs(int clock);
       int DM(int clock);
@@ -80,6 +98,7 @@ namespace gr {
       int EV4(int clock);
       int EV5(int clock);
       int HV(int clock);
+      int EDR(int clock);
 
       /* decode payload header, return value indicates success */
       bool decode_payload_header(char *stream, int clock, int header_bytes, int size, bool fec);
@@ -106,6 +125,17 @@ namespace gr {
       /* set the classic_packet's NAP */
       void set_NAP(uint16_t NAP);
 
+      /* EDR payload symbols and the rate the payload was decoded at */
+      void set_edr_phases(const char *phases, int count);
+      int get_rate() { return d_rate; }
+
+      void set_soft_symbols(const int8_t *soft, int length);
+
+      /* payload header length and fields */
+      int get_payload_header_length() { return d_payload_header_length; }
+      uint8_t get_payload_llid() { return d_payload_llid; }
+      uint8_t get_payload_flow() { return d_payload_flow; }
+
       /* set the classic_packet's clock */
       void set_clock(uint32_t clk6, bool have27);
 
@@ -132,6 +162,9 @@ namespace gr {
       /* format payload for tun interface */
       char *tun_format();
 
+      /* format packet as a LINKTYPE_BLUETOOTH_BREDR_BB record */
+      int pcap_format(uint8_t *buf, int buflen);
+
       /* check to see if the classic_packet has a header */
       bool header_present();
 
@@ -157,6 +190,7 @@ namespace gr {
       uint32_t d_AA;
 
       uint8_t  d_PDU_Type;
+      uint8_t  d_ChSel;
       uint8_t  d_TxAdd;
       uint8_t  d_RxAdd;
       uint8_t  d_LLID;
@@ -165,24 +199,53 @@ namespace gr {
       uint8_t  d_MD;
       unsigned d_PDU_Length;
 
+      /* link layer symbols from the preamble on, whitened as received */
       char    d_link_symbols[LE_MAX_SYMBOLS];
-      uint8_t d_pdu[LE_MAX_PDU_OCTETS];
+      int     d_num_symbols;
+
+      /* header, PDU and CRC, de-whitened by unwhiten(); d_pdu points past the header */
+      uint8_t  d_octets[2 + LE_MAX_PDU_OCTETS + 3];
+      uint8_t *d_pdu;
+      bool     d_unwhitened;
+
+      int      d_phy;
+
+      uint32_t d_CRCInit;
+      bool     d_have_CRCInit;
+      bool     d_crc_checked;
+      bool     d_have_header;
+
+      /* octets of header, PDU and CRC */
+      unsigned octets() { return 2 + d_PDU_Length + 3; }
+
+      /* fill d_octets, false if the packet runs past the available symbols */
+      bool unwhiten();
+
+      /* the CRC as received */
+      uint32_t received_crc();
 
     public:
-      le_packet_impl(char *stream, int length, double freq=0.0);
+      le_packet_impl(char *stream, int length, double freq=0.0, int phy=PHY_1M);
       ~le_packet_impl();
 
-      /* decode the packet header */
+      /* de-whiten and check header and CRC */
       bool decode_header();
       
-      /* decode the packet header */
+      /* make the PDU available as payload */
       void decode_payload();
+
+      void set_CRCInit(uint32_t crc_init) { d_CRCInit = crc_init; d_have_CRCInit = true; }
+      bool crc_checked() { return d_crc_checked; }
+      uint32_t recover_CRCInit();
       
       /* print packet information */
       void print();
       
       /* format payload for tun interface */
       char *tun_format();
+
+      /* format packet as a LINKTYPE_BLUETOOTH_LE_LL record */
+      int pcap_format(uint8_t *buf, int buflen);
       
       /* check to see if the packet has a header */
       bool header_present();
@@ -191,6 +254,14 @@ namespace gr {
       uint32_t get_AA() { return d_AA; }
 
       int get_channel( ) { return d_channel; }
+
+      int get_index() { return d_index; }
+      int get_PHY() { return d_phy; }
+      int get_PDU_type() { return (d_index >= 37) ? d_PDU_Type : -1; }
+      bool get_ChSel() { return (d_index >= 37) && d_ChSel; }
+      int get_LLID() { return (d_index < 37) ? d_LLID : -1; }
+      unsigned get_PDU_length() { return d_PDU_Length; }
+      const uint8_t *get_pdu() { return d_pdu; }
     };
 
   } // namespace bluetooth
@@ -0,0 +1,111 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "packet_pdu.h"
+#include <math.h>
+
+namespace gr {
+  namespace bluetooth {
+
+    packet_pdu::packet_pdu()
+    {
+      d_port      = pmt::mp("packets");
+      d_kind      = pmt::mp("kind");
+      d_linktype  = pmt::mp("linktype");
+      d_channel   = pmt::mp("channel");
+      d_clkn      = pmt::mp("clkn");
+      d_timestamp = pmt::mp("timestamp_us");
+      d_sample    = pmt::mp("sample");
+      d_snr       = pmt::mp("snr");
+      d_lap       = pmt::mp("lap");
+      d_uap       = pmt::mp("uap");
+      d_clock     = pmt::mp("clock");
+      d_type      = pmt::mp("type");
+      d_rate      = pmt::mp("rate");
+      d_aa        = pmt::mp("aa");
+      d_phy       = pmt::mp("phy");
+      d_id        = pmt::mp("id");
+      d_classic   = pmt::mp("classic");
+      d_le        = pmt::mp("le");
+    }
+
+    pmt::pmt_t
+    packet_pdu::common(pmt::pmt_t kind, long linktype, int channel,
+                       uint32_t clkn, uint64_t timestamp_us, uint64_t sample,
+                       double snr)
+    {
+      pmt::pmt_t meta = pmt::make_dict();
+
+      meta = pmt::dict_add(meta, d_kind, kind);
+      meta = pmt::dict_add(meta, d_linktype, pmt::from_long(linktype));
+      meta = pmt::dict_add(meta, d_channel, pmt::from_long(channel));
+      meta = pmt::dict_add(meta, d_clkn, pmt::from_long(clkn));
+      meta = pmt::dict_add(meta, d_timestamp, pmt::from_uint64(timestamp_us));
+      meta = pmt::dict_add(meta, d_sample, pmt::from_uint64(sample));
+      if (!isnan(snr))
+        meta = pmt::dict_add(meta, d_snr, pmt::from_double(snr));
+      return meta;
+    }
+
+    pmt::pmt_t
+    packet_pdu::make(classic_packet::sptr pkt, uint32_t clkn,
+                     uint64_t timestamp_us, uint64_t sample, double snr)
+    {
+      bool decoded = pkt->got_payload();
+      pmt::pmt_t meta = common(decoded ? d_classic : d_id, LINKTYPE_BLUETOOTH_BREDR_BB,
+                               pkt->get_channel(), clkn, timestamp_us, sample, snr);
+
+      meta = pmt::dict_add(meta, d_lap, pmt::from_long(pkt->get_LAP()));
+      if (decoded) {
+        meta = pmt::dict_add(meta, d_uap, pmt::from_long(pkt->get_UAP()));
+        meta = pmt::dict_add(meta, d_clock, pmt::from_long(pkt->get_clock()));
+        meta = pmt::dict_add(meta, d_type, pmt::from_long(pkt->get_type()));
+        meta = pmt::dict_add(meta, d_rate, pmt::from_long(pkt->get_rate()));
+      }
+
+      int length = pkt->pcap_format(d_record, MAX_RECORD_LENGTH);
+      return pmt::cons(meta, pmt::init_u8vector(length, d_record));
+    }
+
+    pmt::pmt_t
+    packet_pdu::make(le_packet::sptr pkt, int index, uint32_t clkn,
+                     uint64_t timestamp_us, uint64_t sample, double snr)
+    {
+      pmt::pmt_t meta = common(d_le, LINKTYPE_BLUETOOTH_LE_LL,
+                               index, clkn, timestamp_us, sample, snr);
+
+      meta = pmt::dict_add(meta, d_aa, pmt::from_long(pkt->get_AA()));
+      meta = pmt::dict_add(meta, d_phy, pmt::from_long(pkt->get_PHY()));
+
+      int length = pkt->pcap_format(d_record, MAX_RECORD_LENGTH);
+      return pmt::cons(meta, pmt::init_u8vector(length, d_record));
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
@@ -0,0 +1,88 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_PACKET_PDU_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_PACKET_PDU_H
+
+#include "gr_bluetooth/packet.h"
+#include <pmt/pmt.h>
+#include <stdint.h>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * Decoded packets are published on the "packets" message port as
+     * PDUs: a pair of a metadata dict and a u8vector.  The u8vector is
+     * the packet's pcap record (LINKTYPE_BLUETOOTH_BREDR_BB pseudo-header
+     * and payload, or LINKTYPE_BLUETOOTH_LE_LL AA through CRC), so
+     * consumers can write or dissect it without touching the decoder.
+     *
+     * Metadata keys: "kind" ("id", "classic" or "le"), "linktype",
+     * "channel", "clkn", "timestamp_us", "sample" (input sample offset
+     * of the start of the access code or access address, packets
+     * decoded after UAP discovery are placed at the start of their
+     * slot), "lap" or "aa" and "phy" (1M, 2M or
+     * Coded as 1, 2 or 3), and where known "snr", "uap", "clock",
+     * "type" and "rate" (1 for basic rate, 2 or 3 for EDR).
+     */
+    class packet_pdu
+    {
+    public:
+      packet_pdu();
+
+      /* name of the output port */
+      const pmt::pmt_t &port() const { return d_port; }
+
+      /* classic packet, ID packets have no header or payload */
+      pmt::pmt_t make(classic_packet::sptr pkt, uint32_t clkn,
+                      uint64_t timestamp_us, uint64_t sample, double snr);
+
+      /* LE packet on the given channel index */
+      pmt::pmt_t make(le_packet::sptr pkt, int index, uint32_t clkn,
+                      uint64_t timestamp_us, uint64_t sample, double snr);
+
+    private:
+      static const int MAX_RECORD_LENGTH = 22 + packet::MAX_PAYLOAD_BITS / 8;
+      static const long LINKTYPE_BLUETOOTH_BREDR_BB = 255;
+      static const long LINKTYPE_BLUETOOTH_LE_LL    = 251;
+
+      /* interned once, symbol lookups are not free */
+      pmt::pmt_t d_port;
+      pmt::pmt_t d_kind, d_linktype, d_channel, d_clkn, d_timestamp, d_sample;
+      pmt::pmt_t d_snr, d_lap, d_uap, d_clock, d_type, d_rate, d_aa, d_phy;
+      pmt::pmt_t d_id, d_classic, d_le;
+
+      uint8_t d_record[MAX_RECORD_LENGTH];
+
+      pmt::pmt_t common(pmt::pmt_t kind, long linktype, int channel,
+                        uint32_t clkn, uint64_t timestamp_us, uint64_t sample,
+                        double snr);
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_PACKET_PDU_H */
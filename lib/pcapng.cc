@@ -0,0 +1,186 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "pcapng.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace gr {
+  namespace bluetooth {
+
+    /* pcapng block types */
+    static const uint32_t SECTION_HEADER_BLOCK        = 0x0A0D0D0A;
+    static const uint32_t INTERFACE_DESCRIPTION_BLOCK = 0x00000001;
+    static const uint32_t ENHANCED_PACKET_BLOCK       = 0x00000006;
+
+    static const uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+
+    pcapng_writer::sptr
+    pcapng_writer::make(const std::string &filename, size_t buffer_size)
+    {
+      return pcapng_writer::sptr(new pcapng_writer(filename, buffer_size));
+    }
+
+    pcapng_writer::pcapng_writer(const std::string &filename, size_t buffer_size)
+      : d_buffer_used(0), d_last_flush(time(NULL))
+    {
+      /* the buffer must hold at least one full packet block */
+      if (buffer_size < (size_t) (4 * MAX_RECORD_LENGTH))
+        buffer_size = 4 * MAX_RECORD_LENGTH;
+      d_buffer.resize(buffer_size);
+
+      d_fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (d_fd == -1) {
+        perror("open");
+        fprintf(stderr, "warning: was not able to open %s, "
+                "disabling pcapng output\n", filename.c_str());
+        return;
+      }
+
+      write_section_header();
+      write_interface_description(LINKTYPE_BLUETOOTH_BREDR_BB);
+      write_interface_description(LINKTYPE_BLUETOOTH_LE_LL);
+      flush();
+    }
+
+    pcapng_writer::~pcapng_writer()
+    {
+      if (d_fd >= 0) {
+        flush();
+        close(d_fd);
+      }
+    }
+
+    /* pcapng is written in host byte order, announced by BYTE_ORDER_MAGIC */
+    void pcapng_writer::put16(uint16_t value)
+    {
+      memcpy(&d_buffer[d_buffer_used], &value, sizeof(value));
+      d_buffer_used += sizeof(value);
+    }
+
+    void pcapng_writer::put32(uint32_t value)
+    {
+      memcpy(&d_buffer[d_buffer_used], &value, sizeof(value));
+      d_buffer_used += sizeof(value);
+    }
+
+    void pcapng_writer::put64(uint64_t value)
+    {
+      memcpy(&d_buffer[d_buffer_used], &value, sizeof(value));
+      d_buffer_used += sizeof(value);
+    }
+
+    void pcapng_writer::write_section_header()
+    {
+      uint32_t length = 28;
+
+      put32(SECTION_HEADER_BLOCK);
+      put32(length);
+      put32(BYTE_ORDER_MAGIC);
+      put16(1);                 /* major version */
+      put16(0);                 /* minor version */
+      put64(0xffffffffffffffffULL); /* section length unknown */
+      put32(length);
+    }
+
+    void pcapng_writer::write_interface_description(uint16_t linktype)
+    {
+      uint32_t length = 20;
+
+      put32(INTERFACE_DESCRIPTION_BLOCK);
+      put32(length);
+      put16(linktype);
+      put16(0);                 /* reserved */
+      put32(MAX_RECORD_LENGTH); /* snaplen */
+      put32(length);
+    }
+
+    void pcapng_writer::write_enhanced_packet(uint32_t interface, uint64_t timestamp_us,
+                                              const uint8_t *data, uint32_t length)
+    {
+      uint32_t padded = (length + 3) & ~3U;
+      uint32_t block_length = 32 + padded;
+
+      if (d_fd < 0)
+        return;
+
+      if ((d_buffer_used + block_length) > d_buffer.size())
+        flush();
+
+      put32(ENHANCED_PACKET_BLOCK);
+      put32(block_length);
+      put32(interface);
+      /* default if_tsresol is microseconds */
+      put32((uint32_t) (timestamp_us >> 32));
+      put32((uint32_t) (timestamp_us & 0xffffffff));
+      put32(length);            /* captured length */
+      put32(length);            /* original length */
+      memcpy(&d_buffer[d_buffer_used], data, length);
+      memset(&d_buffer[d_buffer_used + length], 0, padded - length);
+      d_buffer_used += padded;
+      put32(block_length);
+
+      if ((time(NULL) - d_last_flush) >= FLUSH_INTERVAL)
+        flush();
+    }
+
+    void pcapng_writer::write(classic_packet::sptr pkt, uint64_t timestamp_us)
+    {
+      int length = pkt->pcap_format(d_record, MAX_RECORD_LENGTH);
+      if (length > 0)
+        write_enhanced_packet(BREDR_INTERFACE, timestamp_us, d_record, length);
+    }
+
+    void pcapng_writer::write(le_packet::sptr pkt, uint64_t timestamp_us)
+    {
+      int length = pkt->pcap_format(d_record, MAX_RECORD_LENGTH);
+      if (length > 0)
+        write_enhanced_packet(LE_INTERFACE, timestamp_us, d_record, length);
+    }
+
+    void pcapng_writer::flush()
+    {
+      size_t written = 0;
+
+      while ((d_fd >= 0) && (written < d_buffer_used)) {
+        ssize_t r = ::write(d_fd, &d_buffer[written], d_buffer_used - written);
+        if (r == -1) {
+          perror("write");
+          break;
+        }
+        written += r;
+      }
+      d_buffer_used = 0;
+      d_last_flush = time(NULL);
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
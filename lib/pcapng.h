@@ -0,0 +1,102 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_PCAPNG_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_PCAPNG_H
+
+#include "gr_bluetooth/packet.h"
+#include <boost/shared_ptr.hpp>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * Buffered pcapng file writer.  Classic packets go to an interface
+     * with LINKTYPE_BLUETOOTH_BREDR_BB, LE packets to one with
+     * LINKTYPE_BLUETOOTH_LE_LL, so the file opens directly in Wireshark.
+     * Blocks are collected in memory and written with a single write()
+     * when the buffer fills or FLUSH_INTERVAL seconds have passed.
+     */
+    class pcapng_writer
+    {
+    private:
+      static const uint16_t LINKTYPE_BLUETOOTH_BREDR_BB = 255;
+      static const uint16_t LINKTYPE_BLUETOOTH_LE_LL    = 251;
+
+      /* interface IDs, in the order the IDBs are written */
+      static const uint32_t BREDR_INTERFACE = 0;
+      static const uint32_t LE_INTERFACE    = 1;
+
+      /* largest packet record we will ever be asked to write,
+         a 3-DH5 behind the 22 byte BR/EDR pseudo-header */
+      static const int MAX_RECORD_LENGTH = 22 + packet::MAX_PAYLOAD_BITS / 8;
+
+      /* seconds between forced flushes */
+      static const int FLUSH_INTERVAL = 1;
+
+      int                  d_fd;
+      std::vector<uint8_t> d_buffer;
+      size_t               d_buffer_used;
+      time_t               d_last_flush;
+
+      /* scratch space for packet records */
+      uint8_t d_record[MAX_RECORD_LENGTH];
+
+      void put16(uint16_t value);
+      void put32(uint32_t value);
+      void put64(uint64_t value);
+
+      void write_section_header();
+      void write_interface_description(uint16_t linktype);
+      void write_enhanced_packet(uint32_t interface, uint64_t timestamp_us,
+                                 const uint8_t *data, uint32_t length);
+
+    public:
+      typedef boost::shared_ptr<pcapng_writer> sptr;
+
+      static sptr make(const std::string &filename, size_t buffer_size = 65536);
+
+      pcapng_writer(const std::string &filename, size_t buffer_size);
+      ~pcapng_writer();
+
+      /* did the output file open successfully? */
+      bool is_open() { return d_fd >= 0; }
+
+      /* append a packet, timestamp in microseconds since start of capture */
+      void write(classic_packet::sptr pkt, uint64_t timestamp_us);
+      void write(le_packet::sptr pkt, uint64_t timestamp_us);
+
+      /* push buffered blocks to the file */
+      void flush();
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_PCAPNG_H */
@@ -29,6 +29,7 @@
 
 #include <gnuradio/io_signature.h>
 #include "piconet_impl.h"
+#include <limits.h>
 #include <stdio.h>
 
 namespace gr {
@@ -61,6 +62,9 @@ namespace gr {
 
     // ---------------------------------------------------------------------
 
+    char basic_rate_piconet_impl::d_perm_table[0x20][0x20][0x200];
+    std::once_flag basic_rate_piconet_impl::d_perm_once;
+
     /*
      * The private constructor
      */
@@ -73,6 +77,9 @@ namespace gr {
       d_packets_observed = 0;
       d_total_packets_observed = 0;
       d_hop_reversal_inited = false;
+      d_hop_address = -1;
+      d_clock_candidates = NULL;
+      d_sequence = NULL;
       d_afh = false;
       d_looks_like_afh = false;
       d_have_UAP = false;
@@ -86,10 +93,8 @@ namespace gr {
      */
     basic_rate_piconet_impl::~basic_rate_piconet_impl()
     {
-      if(d_hop_reversal_inited) {
-        free(d_clock_candidates);
-        free(d_sequence);
-      }
+      free(d_clock_candidates);
+      free(d_sequence);
     }
 
     /* initialize the hop reversal process */
@@ -107,6 +112,10 @@ namespace gr {
         max_candidates = (SEQUENCE_LENGTH / CHANNELS) / 32;
       }
 		
+      /* a restarted reversal replaces the previous one */
+      free(d_clock_candidates);
+      free(d_sequence);
+
       /* this can hold twice the approximate number of initial candidates */
       d_clock_candidates = (uint32_t*) malloc(sizeof(uint32_t) * max_candidates);
 
@@ -114,7 +123,8 @@ namespace gr {
       d_sequence = (char*) malloc(SEQUENCE_LENGTH);
 
       precalc();
-      address_precalc(((d_UAP<<24) | d_LAP) & 0xfffffff);
+      d_hop_address = ((d_UAP<<24) | d_LAP) & 0xfffffff;
+      address_precalc(d_hop_address);
       gen_hops();
       clock = (d_clk_offset + d_first_pkt_time) & 0x3f;
       d_num_candidates = init_candidates(d_pattern_channels[0], clock);
@@ -132,18 +142,19 @@ namespace gr {
     void basic_rate_piconet_impl::precalc()
     {
       int i;
-      int z, p_high, p_low;
 
       /* populate frequency register bank*/
       for (i = 0; i < CHANNELS; i++)
         d_bank[i] = ((i * 2) % CHANNELS);
       /* actual frequency is 2402 + d_bank[i] MHz */
 
-      /* populate perm_table for all possible inputs */
-      for (z = 0; z < 0x20; z++)
-        for (p_high = 0; p_high < 0x20; p_high++)
-          for (p_low = 0; p_low < 0x200; p_low++)
-            d_perm_table[z][p_high][p_low] = perm5(z, p_high, p_low);
+      /* populate perm_table for all possible inputs, once per process */
+      std::call_once(d_perm_once, [this]() {
+        for (int z = 0; z < 0x20; z++)
+          for (int p_high = 0; p_high < 0x20; p_high++)
+            for (int p_low = 0; p_low < 0x200; p_low++)
+              d_perm_table[z][p_high][p_low] = perm5(z, p_high, p_low);
+      });
     }
 
     /* do precalculation that requires the address */
@@ -278,7 +289,24 @@ namespace gr {
     /* look up channel for a particular hop */
     char basic_rate_piconet_impl::hop(int clock)
     {
-      return d_sequence[clock];
+      if (d_sequence)
+        return d_sequence[clock];
+
+      /*
+       * A clock learned from an FHS packet, or one whose sequence has
+       * been freed, comes without the sequence, so work out this one
+       * hop.  clock is CLK1-27, CLK0 is 0.
+       */
+      if (!d_have_UAP)
+        return -1;
+      int address = ((d_UAP << 24) | d_LAP) & 0xfffffff;
+      if (d_hop_address != address) {
+        if (d_hop_address < 0)
+          precalc();
+        address_precalc(address);
+        d_hop_address = address;
+      }
+      return single_hop(clock << 1);
     }
 
     /* create list of initial candidate clock values (hops with same channel as first observed hop) */
@@ -308,6 +336,10 @@ namespace gr {
       int new_count = 0; /* number of candidates after winnowing */
       char observable_channel; /* accounts for aliasing if necessary */
 
+      /* the clock is already known and the sequence gone */
+      if (!d_sequence)
+        return d_num_candidates;
+
       /* check every candidate */
       for (i = 0; i < d_num_candidates; i++) {
         if (d_aliased)
@@ -363,7 +395,18 @@ namespace gr {
             d_looks_like_afh = true;
         }
       }
-	
+
+      /*
+       * With CLK1-27 known, hop() can work out single hops, so give
+       * back the 128 MB sequence.  This lets one block follow many
+       * piconets at once: only those still reversing their clock hold
+       * a sequence.
+       */
+      if (d_have_clk27 && d_sequence) {
+        free(d_sequence);
+        d_sequence = NULL;
+      }
+
       return new_count;
     }
 
@@ -527,10 +570,10 @@ namespace gr {
     {
       printf("no candidates remaining! starting over . . .\n");
 
-      if(d_hop_reversal_inited) {
-        free(d_clock_candidates);
-        free(d_sequence);
-      }
+      free(d_clock_candidates);
+      free(d_sequence);
+      d_clock_candidates = NULL;
+      d_sequence = NULL;
       d_got_first_packet = false;
       d_packets_observed = 0;
       d_hop_reversal_inited = false;
@@ -556,31 +599,285 @@ namespace gr {
 
     // ---------------------------------------------------------------------
 
-    low_energy_piconet_impl::low_energy_piconet_impl(uint32_t aa) {
-      // TODO
+    low_energy_piconet_impl::low_energy_piconet_impl(uint32_t aa)
+      : d_aa(aa), d_crc_init(0), d_following(false), d_csa2(false),
+        d_hop_increment(0), d_channel_id(0), d_map_instant(INT_MAX),
+        d_interval_us(0), d_anchor_us(0), d_anchor_event(0),
+        d_early_us(0), d_late_us(0), d_update_instant(INT_MAX),
+        d_timeout_us(MAX_TIMEOUT_US), d_last_seen_us(0)
+    {
+      set_map(d_map, 0);
+      set_map(d_next_map, 0);
     }
 
     low_energy_piconet_impl::~low_energy_piconet_impl( ) {
-      // TODO
+    }
+
+    void low_energy_piconet_impl::set_map(channel_map &map, uint64_t mask)
+    {
+      map.mask = mask & ((1ULL << DATA_CHANNELS) - 1);
+      map.num_used = 0;
+      for (int i = 0; i < DATA_CHANNELS; i++) {
+        if (map.mask & (1ULL << i))
+          map.used[map.num_used++] = i;
+      }
+    }
+
+    /* start following a connection from the parameters in its CONNECT_REQ */
+    bool low_energy_piconet_impl::follow(le_packet::sptr pkt, uint64_t timestamp_us)
+    {
+      if ((pkt->get_index() < 37) || (pkt->get_PDU_type() != le_packet::CONNECT_REQ) ||
+          (pkt->get_PDU_length() < 34))
+        return false;
+
+      /* InitA and AdvA come first, then the LLData fields */
+      const uint8_t *p = pkt->get_pdu();
+      uint32_t aa         = p[12] | (p[13] << 8) | (p[14] << 16) | ((uint32_t) p[15] << 24);
+      uint32_t crc_init   = p[16] | (p[17] << 8) | (p[18] << 16);
+      uint8_t  win_size   = p[19];
+      uint16_t win_offset = p[20] | (p[21] << 8);
+      uint16_t interval   = p[22] | (p[23] << 8);
+      uint16_t timeout    = p[26] | (p[27] << 8);
+      uint64_t chm        = p[28] | (p[29] << 8) | (p[30] << 16) |
+        ((uint64_t) p[31] << 24) | ((uint64_t) p[32] << 32);
+      uint8_t  hop        = p[33] & 0x1f;
+
+      /* a corrupted CONNECT_REQ must not send us off following noise */
+      channel_map map;
+      set_map(map, chm);
+      if ((interval < 6) || (interval > 3200) || (timeout < 10) || (timeout > 3200) ||
+          (win_size < 1) || (win_size > 8) || (win_offset > interval) ||
+          (hop < 5) || (hop > 16) || (map.num_used < 2))
+        return false;
+
+      d_aa            = aa;
+      d_crc_init      = crc_init;
+      d_csa2          = pkt->get_ChSel();
+      d_hop_increment = hop;
+      d_channel_id    = (uint16_t) ((aa >> 16) ^ (aa & 0xffff));
+      d_map           = map;
+      d_map_instant   = INT_MAX;
+      d_update_instant = INT_MAX;
+
+      /* the transmit window opens 1.25 ms plus WinOffset after the CONNECT_REQ */
+      d_interval_us  = interval * UNIT_US;
+      d_anchor_event = 0;
+      d_anchor_us    = timestamp_us + CONNECT_REQ_US + UNIT_US + win_offset * UNIT_US;
+      d_early_us     = TIMING_SLACK_US;
+      d_late_us      = win_size * UNIT_US + TIMING_SLACK_US;
+
+      d_timeout_us   = timeout * 10000;
+      d_last_seen_us = timestamp_us;
+      d_following    = true;
+
+      return true;
+    }
+
+    int low_energy_piconet_impl::event(uint64_t timestamp_us)
+    {
+      if (!d_following)
+        return -1;
+
+      /* measure from the middle of the anchor's uncertainty window */
+      int64_t center = (int64_t) d_anchor_us + ((int64_t) d_late_us - (int64_t) d_early_us) / 2;
+      int64_t rel = (int64_t) timestamp_us - center + d_interval_us / 2;
+      int64_t n = (rel >= 0) ? rel / d_interval_us : -((d_interval_us - 1 - rel) / d_interval_us);
+
+      n += d_anchor_event;
+      return (n < 0) ? -1 : (int) n;
+    }
+
+    uint64_t low_energy_piconet_impl::anchor(int counter)
+    {
+      int64_t a = (int64_t) d_anchor_us + ((int64_t) counter - d_anchor_event) * d_interval_us;
+      return (a < 0) ? 0 : (uint64_t) a;
+    }
+
+    /* connection or channel map updates whose instant has passed */
+    void low_energy_piconet_impl::apply_update(uint64_t timestamp_us)
+    {
+      if ((d_update_instant != INT_MAX) && (event(timestamp_us) >= d_update_instant)) {
+        /* the new transmit window opens WinOffset after the old anchor of the instant */
+        d_anchor_us      = anchor(d_update_instant) + d_update_offset_us;
+        d_anchor_event   = d_update_instant;
+        d_interval_us    = d_update_interval_us;
+        d_early_us       = TIMING_SLACK_US;
+        d_late_us        = d_update_window_us + TIMING_SLACK_US;
+        d_timeout_us     = d_update_timeout_us;
+        d_update_instant = INT_MAX;
+      }
+      if ((d_map_instant != INT_MAX) && (event(timestamp_us) >= d_map_instant)) {
+        d_map         = d_next_map;
+        d_map_instant = INT_MAX;
+      }
+    }
+
+    uint64_t low_energy_piconet_impl::channels(uint64_t start_us, uint64_t end_us)
+    {
+      uint64_t mask = 0;
+
+      if (!d_following)
+        return 0;
+      apply_update(start_us);
+
+      /* events whose window [anchor - early, anchor + late] overlaps [start, end] */
+      int n = event((start_us > d_late_us) ? start_us - d_late_us : 0);
+      for (n = (n > 0) ? n - 1 : 0; ; n++) {
+        uint64_t a = anchor(n);
+        if (a > end_us + d_early_us)
+          break;
+        if (a + d_late_us >= start_us)
+          mask |= 1ULL << hop(n);
+      }
+
+      return mask;
+    }
+
+    int low_energy_piconet_impl::observe(le_packet::sptr pkt, uint64_t timestamp_us)
+    {
+      if (!d_following) {
+        if (d_timeout_us > 0)
+          d_last_seen_us = timestamp_us;
+        return -1;
+      }
+      apply_update(timestamp_us);
+
+      int n = event(timestamp_us);
+      if (n < 0)
+        return -1;
+
+      /*
+       * Take the packet as the anchor point.  It may have been a later
+       * packet of the event, so the real anchor could be a little earlier.
+       */
+      d_anchor_event = n;
+      d_anchor_us    = timestamp_us;
+      d_early_us     = 2 * TIMING_SLACK_US;
+      d_late_us      = TIMING_SLACK_US;
+      d_last_seen_us = timestamp_us;
+
+      if ((pkt->get_LLID() == le_packet::LLID_CONTROL) && (pkt->get_PDU_length() > 0))
+        control(pkt, n);
+
+      return n;
+    }
+
+    /* pick up the LL control procedures that change the hopping */
+    void low_energy_piconet_impl::control(le_packet::sptr pkt, int counter)
+    {
+      const uint8_t *p = pkt->get_pdu();
+      unsigned length = pkt->get_PDU_length();
+
+      switch (p[0]) {
+      case LL_CONNECTION_UPDATE_IND:
+        if (length >= 12) {
+          uint8_t  win_size   = p[1];
+          uint16_t win_offset = p[2] | (p[3] << 8);
+          uint16_t interval   = p[4] | (p[5] << 8);
+          uint16_t timeout    = p[8] | (p[9] << 8);
+          uint16_t instant    = p[10] | (p[11] << 8);
+
+          if ((interval >= 6) && (interval <= 3200) && (timeout >= 10) && (timeout <= 3200) &&
+              (win_size >= 1) && (win_size <= 8)) {
+            /* instants are 16 bit event counters in the near future */
+            d_update_instant     = counter + ((instant - counter) & 0xffff);
+            d_update_interval_us = interval * UNIT_US;
+            d_update_offset_us   = win_offset * UNIT_US;
+            d_update_window_us   = win_size * UNIT_US;
+            d_update_timeout_us  = timeout * 10000;
+          }
+        }
+        break;
+      case LL_CHANNEL_MAP_IND:
+        if (length >= 8) {
+          uint64_t chm = p[1] | (p[2] << 8) | (p[3] << 16) |
+            ((uint64_t) p[4] << 24) | ((uint64_t) p[5] << 32);
+          uint16_t instant = p[6] | (p[7] << 8);
+
+          set_map(d_next_map, chm);
+          if (d_next_map.num_used >= 2)
+            d_map_instant = counter + ((instant - counter) & 0xffff);
+        }
+        break;
+      case LL_TERMINATE_IND:
+        d_following = false;
+        d_timeout_us = 0;
+        break;
+      default:
+        break;
+      }
+    }
+
+    bool low_energy_piconet_impl::expired(uint64_t timestamp_us)
+    {
+      return timestamp_us > d_last_seen_us + d_timeout_us;
     }
 
     int low_energy_piconet_impl::init_hop_reversal(bool aliased) {
-      // TODO
-      return -1;
+      /* the hopping parameters come from the CONNECT_REQ, nothing to reverse */
+      return d_following ? 1 : 0;
+    }
+
+    /* bits of each byte reversed, PERM of channel selection algorithm #2 */
+    static uint16_t
+    csa2_perm(uint16_t v)
+    {
+      uint16_t r = 0;
+      for (int i = 0; i < 8; i++) {
+        r |= ((v >> i) & 0x0101) << (7 - i);
+      }
+      return r;
     }
 
+    uint16_t low_energy_piconet_impl::prn_e(int counter)
+    {
+      uint16_t prn = (uint16_t) counter ^ d_channel_id;
+
+      /* three rounds of PERM followed by MAM (multiply, add, modulo 2^16) */
+      for (int round = 0; round < 3; round++) {
+        prn = csa2_perm(prn);
+        prn = (uint16_t) (17 * prn + d_channel_id);
+      }
+      return prn ^ d_channel_id;
+    }
+
+    /* data channel of a connection event, channel selection algorithm #1 or #2 */
     char low_energy_piconet_impl::hop(int clock) {
-      // TODO
-      return -1;
+      if (!d_following || (clock < 0))
+        return -1;
+
+      const channel_map &map = (clock >= d_map_instant) ? d_next_map : d_map;
+      int unmapped;
+
+      if (d_csa2) {
+        uint16_t prn = prn_e(clock & 0xffff);
+        unmapped = prn % DATA_CHANNELS;
+        if (map.mask & (1ULL << unmapped))
+          return unmapped;
+        return map.used[(map.num_used * prn) >> 16];
+      }
+      else {
+        /* lastUnmappedChannel starts at 0, so event n is (n+1) hops along */
+        unmapped = (((clock % DATA_CHANNELS) + 1) * d_hop_increment) % DATA_CHANNELS;
+        if (map.mask & (1ULL << unmapped))
+          return unmapped;
+        return map.used[unmapped % map.num_used];
+      }
     }
 
+    /* observable classic channel of a data channel, as for basic rate */
     char low_energy_piconet_impl::aliased_channel(char channel) {
-      // TODO
-      return -1;
+      if ((channel < 0) || (channel >= DATA_CHANNELS))
+        return -1;
+      int classic = (int) ((le_packet::index2freq(channel) - 2402000000.0) / 1000000.0);
+      return ((classic + 24) % ALIASED_CHANNELS) + 26;
     }
 
     void low_energy_piconet_impl::reset( ) {
-      // TODO
+      d_following = false;
+      d_timeout_us = 0;
+      d_map_instant = INT_MAX;
+      d_update_instant = INT_MAX;
     }
 
   } /* namespace bluetooth */
@@ -28,6 +28,8 @@
 
 #include "gr_bluetooth/piconet.h"
 #include "gr_bluetooth/packet.h"
+#include <stdint.h>
+#include <mutex>
 #include <vector>
 
 namespace gr {
@@ -35,6 +37,12 @@ namespace gr {
 
     class basic_rate_piconet_impl : public basic_rate_piconet {
     private:
+      /* bench_bluetooth times gen_hops() and winnow() */
+      friend class bench_hooks;
+
+      /* the synthesizer hops a slot at a time with single_hop() */
+      friend class synth_piconet;
+
       /* number of channels in use */
       static const int CHANNELS = 79;
 
@@ -75,10 +83,17 @@ namespace gr {
       /* frequency register bank */
       int d_bank[CHANNELS];
 
-      /* speed up the perm5 function with a lookup table */
-      char d_perm_table[0x20][0x20][0x200];
-
-      /* this holds the entire hopping sequence */
+      /*
+       * speed up the perm5 function with a lookup table, it does not
+       * depend on the address so all piconets share one copy
+       */
+      static char d_perm_table[0x20][0x20][0x200];
+      static std::once_flag d_perm_once;
+
+      /*
+       * this holds the entire hopping sequence while the clock is being
+       * reversed, it is freed once CLK1-27 is known (see winnow())
+       */
       char *d_sequence;
 
       /* number of candidates for CLK1-27 */
@@ -105,6 +120,9 @@ namespace gr {
 
       bool d_hop_reversal_inited;
 
+      /* address single_hop() is set up for, -1 if none, see hop() */
+      int d_hop_address;
+
       /* do all the precalculation that can be done before knowing the address */
       void precalc();
 
@@ -187,17 +205,105 @@ namespace gr {
 
     class low_energy_piconet_impl : public low_energy_piconet {
     private:
-      uint8_t  d_chan_list[38];
-      
+      /* aliased receiver channels, as for basic rate */
+      static const int ALIASED_CHANNELS = 25;
+
+      /* connection parameters are in units of 1.25 ms */
+      static const int UNIT_US = 1250;
+
+      /* uncertainty of a packet timestamp (a time slot plus margin) */
+      static const int TIMING_SLACK_US = 1250;
+
+      /* on-air time of a CONNECT_REQ: preamble, AA, header, 34 octet PDU, CRC */
+      static const int CONNECT_REQ_US = (1 + 4 + 2 + 34 + 3) * 8;
+
+      /* longest supervision timeout, for connections we do not follow */
+      static const uint32_t MAX_TIMEOUT_US = 32000000;
+
+      /* LL control PDU opcodes */
+      static const int LL_CONNECTION_UPDATE_IND = 0x00;
+      static const int LL_CHANNEL_MAP_IND       = 0x01;
+      static const int LL_TERMINATE_IND         = 0x02;
+
+      /* a channel map and the used channels it gives, in ascending order */
+      struct channel_map {
+        uint64_t mask;
+        int      num_used;
+        uint8_t  used[DATA_CHANNELS];
+      };
+
+      uint32_t d_aa;
+      uint32_t d_crc_init;
+      bool     d_following;
+      bool     d_csa2;
+      uint8_t  d_hop_increment;
+
+      /* channel identifier for channel selection algorithm #2 */
+      uint16_t d_channel_id;
+
+      channel_map d_map;
+
+      /* map taking effect at event d_map_instant (INT_MAX if none pending) */
+      channel_map d_next_map;
+      int         d_map_instant;
+
+      /*
+       * Anchor points: event d_anchor_event is expected at d_anchor_us,
+       * later ones every d_interval_us.  The actual anchor may be up to
+       * d_early_us before and d_late_us after the expected one.
+       */
+      uint32_t d_interval_us;
+      uint64_t d_anchor_us;
+      int      d_anchor_event;
+      uint32_t d_early_us;
+      uint32_t d_late_us;
+
+      /* connection update taking effect at event d_update_instant (INT_MAX if none) */
+      int      d_update_instant;
+      uint32_t d_update_interval_us;
+      uint32_t d_update_offset_us;
+      uint32_t d_update_window_us;
+      uint32_t d_update_timeout_us;
+
+      /* supervision timeout and the last time the connection was heard */
+      uint32_t d_timeout_us;
+      uint64_t d_last_seen_us;
+
+      static void set_map(channel_map &map, uint64_t mask);
+
+      /* channel selection algorithm #2 pseudo random number for an event */
+      uint16_t prn_e(int counter);
+
+      /* apply a pending connection update whose instant is before timestamp_us */
+      void apply_update(uint64_t timestamp_us);
+
+      /* handle an LL control PDU received in event counter */
+      void control(le_packet::sptr pkt, int counter);
+
     public:
       low_energy_piconet_impl(uint32_t aa);
       ~low_energy_piconet_impl();
 
+      bool follow(le_packet::sptr connect_req, uint64_t timestamp_us);
+      bool following() { return d_following; }
+      uint32_t get_AA() { return d_aa; }
+      uint32_t get_CRCInit() { return d_crc_init; }
+      uint32_t get_interval_us() { return d_interval_us; }
+      uint8_t get_hop_increment() { return d_hop_increment; }
+      uint64_t get_channel_map() { return d_map.mask; }
+      bool csa2() { return d_csa2; }
+      void set_CRCInit(uint32_t crc_init) { d_crc_init = crc_init; }
+
+      int event(uint64_t timestamp_us);
+      uint64_t anchor(int counter);
+      uint64_t channels(uint64_t start_us, uint64_t end_us);
+      int observe(le_packet::sptr pkt, uint64_t timestamp_us);
+      bool expired(uint64_t timestamp_us);
+
       int init_hop_reversal(bool aliased);
       char hop(int clock);
       char aliased_channel(char channel);
       void reset();
-      
     };
 
   } // namespace bluetooth
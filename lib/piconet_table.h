@@ -0,0 +1,177 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_PICONET_TABLE_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_PICONET_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * Open-addressing (linear probing) table keyed by a 24-bit LAP or a
+     * 32-bit LE access address.  Slots live in one flat array so a lookup
+     * is a hash and a short forward scan, no tree walk and no sptr copy.
+     *
+     * References returned by find() and operator[] are only valid until
+     * the next insertion, which may grow and rehash the table.
+     */
+    template <class T>
+    class piconet_table
+    {
+    private:
+      struct slot {
+        uint32_t key;
+        bool     used;
+        T        value;
+
+        slot() : key(0), used(false), value() {}
+      };
+
+      /* never let the table get more than half full */
+      static const size_t MIN_CAPACITY = 64;
+
+      std::vector<slot> d_slots;
+      size_t            d_mask;
+      unsigned          d_shift;
+      size_t            d_count;
+
+      /* Fibonacci hashing, spreads the low-entropy LAP bits over the table */
+      size_t home(uint32_t key) const
+      {
+        return (size_t) ((key * 2654435769U) >> d_shift) & d_mask;
+      }
+
+      void resize(size_t capacity)
+      {
+        std::vector<slot> old;
+        old.swap(d_slots);
+        d_slots.resize(capacity);
+        d_mask  = capacity - 1;
+        d_shift = 32;
+        for (size_t c = capacity; c > 1; c >>= 1)
+          d_shift--;
+        d_count = 0;
+
+        for (size_t i = 0; i < old.size(); i++) {
+          if (old[i].used) {
+            size_t j = insert_slot(old[i].key);
+            d_slots[j].value = old[i].value;
+          }
+        }
+      }
+
+      /* index of key, or of the empty slot where it would be inserted */
+      size_t probe(uint32_t key) const
+      {
+        size_t i = home(key);
+        while (d_slots[i].used && d_slots[i].key != key)
+          i = (i + 1) & d_mask;
+        return i;
+      }
+
+      size_t insert_slot(uint32_t key)
+      {
+        size_t i = probe(key);
+        if (!d_slots[i].used) {
+          d_slots[i].used = true;
+          d_slots[i].key  = key;
+          d_count++;
+        }
+        return i;
+      }
+
+    public:
+      piconet_table(size_t capacity = MIN_CAPACITY)
+        : d_mask(0), d_shift(32), d_count(0)
+      {
+        size_t c = MIN_CAPACITY;
+        while (c < capacity)
+          c <<= 1;
+        resize(c);
+      }
+
+      /* number of keys stored */
+      size_t size() const { return d_count; }
+
+      /* return the value stored for key, or NULL if there is none */
+      T *find(uint32_t key)
+      {
+        size_t i = probe(key);
+        return d_slots[i].used ? &d_slots[i].value : NULL;
+      }
+
+      /* return the value stored for key, inserting a default one if needed */
+      T &operator[](uint32_t key)
+      {
+        if (2 * (d_count + 1) > d_slots.size())
+          resize(2 * d_slots.size());
+        return d_slots[insert_slot(key)].value;
+      }
+
+      /* remove key, shifting later members of its probe run back */
+      bool erase(uint32_t key)
+      {
+        size_t i = probe(key);
+        if (!d_slots[i].used)
+          return false;
+
+        size_t j = i;
+        for (;;) {
+          j = (j + 1) & d_mask;
+          if (!d_slots[j].used)
+            break;
+          size_t k = home(d_slots[j].key);
+          /* leave j alone if its home lies cyclically in (i, j] */
+          if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)))
+            continue;
+          d_slots[i].key   = d_slots[j].key;
+          d_slots[i].value = d_slots[j].value;
+          i = j;
+        }
+        d_slots[i].used  = false;
+        d_slots[i].value = T();
+        d_count--;
+        return true;
+      }
+
+      /* call f(key, value) for every stored entry */
+      template <class F>
+      void for_each(F f)
+      {
+        for (size_t i = 0; i < d_slots.size(); i++) {
+          if (d_slots[i].used)
+            f(d_slots[i].key, d_slots[i].value);
+        }
+      }
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_PICONET_TABLE_H */
@@ -0,0 +1,382 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <boost/test/unit_test.hpp>
+#include "gr_bluetooth/packet.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using gr::bluetooth::packet;
+using gr::bluetooth::classic_packet;
+using gr::bluetooth::le_packet;
+
+/*
+ * Bit serial CRC, straight from the LFSR of the core spec (Vol 6, Part
+ * B, 3.1.1): position 0 holds the LSB of CRCInit, PDU bits are shifted
+ * in LSB first and position 23 is transmitted first.  Returns the
+ * register, not the on-air order that le_packet::crc24() uses.
+ */
+static uint32_t
+lfsr_crc24(uint32_t crc_init, const uint8_t *data, int length)
+{
+  uint32_t state = crc_init & 0xffffff;
+  for (int i = 0; i < length; i++) {
+    for (int bit = 0; bit < 8; bit++) {
+      uint32_t feedback = ((state >> 23) ^ (data[i] >> bit)) & 1;
+      state = (state << 1) & 0xffffff;
+      if (feedback)
+        state ^= 0x00065b;    /* x^10 + x^9 + x^6 + x^4 + x^3 + x + 1 */
+    }
+  }
+  return state;
+}
+
+/* the register in transmit order, first transmitted bit in bit 0 */
+static uint32_t
+air_order(uint32_t state)
+{
+  uint32_t crc = 0;
+  for (int i = 0; i < 24; i++) {
+    if (state & (1 << i))
+      crc |= 1 << (23 - i);
+  }
+  return crc;
+}
+
+/* ADV_IND, AdvA 00:00:47:9e:8b:33 and a flags AD structure */
+static const uint8_t ADV_IND[] = {
+  0x00, 0x09, 0x33, 0x8b, 0x9e, 0x47, 0x00, 0x00, 0x02, 0x01, 0x06
+};
+
+/* SCAN_REQ with both addresses random */
+static const uint8_t SCAN_REQ[] = {
+  0xc3, 0x0c, 0x11, 0x22, 0x33, 0x44, 0x55, 0xc6,
+  0x33, 0x8b, 0x9e, 0x47, 0x00, 0x00
+};
+
+BOOST_AUTO_TEST_CASE(t_crc24_advertising)
+{
+  BOOST_CHECK(le_packet::ADVERTISING_CRC_INIT == 0x555555);
+
+  BOOST_CHECK_EQUAL(le_packet::crc24(le_packet::ADVERTISING_CRC_INIT, ADV_IND, sizeof(ADV_IND)),
+                    air_order(lfsr_crc24(0x555555, ADV_IND, sizeof(ADV_IND))));
+  BOOST_CHECK_EQUAL(le_packet::crc24(le_packet::ADVERTISING_CRC_INIT, SCAN_REQ, sizeof(SCAN_REQ)),
+                    air_order(lfsr_crc24(0x555555, SCAN_REQ, sizeof(SCAN_REQ))));
+
+  /* nothing shifted in leaves the preset register */
+  BOOST_CHECK_EQUAL(le_packet::crc24(0x555555, ADV_IND, 0), air_order(0x555555));
+}
+
+BOOST_AUTO_TEST_CASE(t_crc24_residue)
+{
+  /* a PDU followed by its own CRC clears the register */
+  uint8_t buf[sizeof(ADV_IND) + 3];
+  for (unsigned i = 0; i < sizeof(ADV_IND); i++)
+    buf[i] = ADV_IND[i];
+
+  uint32_t crc = le_packet::crc24(0x555555, ADV_IND, sizeof(ADV_IND));
+  buf[sizeof(ADV_IND)]     = crc & 0xff;
+  buf[sizeof(ADV_IND) + 1] = (crc >> 8) & 0xff;
+  buf[sizeof(ADV_IND) + 2] = (crc >> 16) & 0xff;
+  BOOST_CHECK_EQUAL(lfsr_crc24(0x555555, buf, sizeof(buf)), 0u);
+
+  /* and a flipped bit anywhere does not */
+  buf[4] ^= 0x10;
+  BOOST_CHECK(lfsr_crc24(0x555555, buf, sizeof(buf)) != 0u);
+}
+
+BOOST_AUTO_TEST_CASE(t_crc24_data_channel)
+{
+  /* any CRCInit a CONNECT_REQ may carry */
+  static const uint32_t inits[] = { 0x000000, 0x000001, 0x800000, 0x123456, 0xabcdef, 0xffffff };
+  for (unsigned i = 0; i < sizeof(inits) / sizeof(inits[0]); i++) {
+    BOOST_CHECK_EQUAL(le_packet::crc24(inits[i], SCAN_REQ, sizeof(SCAN_REQ)),
+                      air_order(lfsr_crc24(inits[i], SCAN_REQ, sizeof(SCAN_REQ))));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(t_crc24_init_round_trip)
+{
+  static const uint32_t inits[] = { 0x555555, 0x000000, 0x000001, 0x800000, 0x123456, 0xffffff };
+  for (unsigned i = 0; i < sizeof(inits) / sizeof(inits[0]); i++) {
+    uint32_t crc = le_packet::crc24(inits[i], ADV_IND, sizeof(ADV_IND));
+    BOOST_CHECK_EQUAL(le_packet::crc24_init(crc, ADV_IND, sizeof(ADV_IND)), inits[i]);
+
+    crc = le_packet::crc24(inits[i], SCAN_REQ, sizeof(SCAN_REQ));
+    BOOST_CHECK_EQUAL(le_packet::crc24_init(crc, SCAN_REQ, sizeof(SCAN_REQ)), inits[i]);
+  }
+}
+
+/*
+ * LE 1M symbols of a packet on channel index: preamble, AA, then
+ * header, PDU and CRC (from the bit serial LFSR), whitened.
+ */
+static int
+le_symbols(int index, uint32_t aa, uint8_t header0, const uint8_t *pdu, int length,
+           uint32_t crc_init, char *symbols)
+{
+  uint8_t octets[2 + LE_MAX_PDU_OCTETS + 3];
+  int i, pos = 0;
+
+  octets[0] = header0;
+  octets[1] = length;
+  for (i = 0; i < length; i++)
+    octets[2 + i] = pdu[i];
+  uint32_t crc = air_order(lfsr_crc24(crc_init, octets, 2 + length));
+  octets[2 + length]     = crc & 0xff;
+  octets[2 + length + 1] = (crc >> 8) & 0xff;
+  octets[2 + length + 2] = (crc >> 16) & 0xff;
+
+  packet::host_to_air((aa & 0x01) ? 0x55 : 0xaa, &symbols[pos], 8);
+  pos += 8;
+  for (i = 0; i < 4; i++, pos += 8)
+    packet::host_to_air((aa >> (8 * i)) & 0xff, &symbols[pos], 8);
+  for (i = 0; i < 2 + length + 3; i++, pos += 8)
+    packet::host_to_air(octets[i], &symbols[pos], 8);
+
+  int wi = le_packet::INDICES[index];
+  for (i = 40; i < pos; i++, wi = (wi + 1) % 127)
+    symbols[i] ^= packet::WHITENING_DATA[wi];
+
+  return pos;
+}
+
+/* a PDU longer than the 37 octets of Bluetooth 4.0 */
+static void
+check_long_pdu(int index, uint32_t aa, uint8_t header0, int length, uint32_t crc_init)
+{
+  uint8_t pdu[LE_MAX_PDU_OCTETS];
+  char symbols[LE_MAX_SYMBOLS];
+  for (int i = 0; i < length; i++)
+    pdu[i] = (uint8_t) (i * 7 + 3);
+
+  int n = le_symbols(index, aa, header0, pdu, length, crc_init, symbols);
+  le_packet::sptr pkt = le_packet::make(symbols, n, le_packet::index2freq(index));
+  if (index < 37)
+    pkt->set_CRCInit(crc_init);
+
+  BOOST_REQUIRE(pkt->decode_header());
+  BOOST_CHECK(pkt->crc_checked());
+  BOOST_CHECK_EQUAL(pkt->get_AA(), aa);
+  BOOST_REQUIRE_EQUAL(pkt->get_PDU_length(), (unsigned) length);
+  for (int i = 0; i < length; i++)
+    BOOST_CHECK_EQUAL(pkt->get_pdu()[i], pdu[i]);
+
+  /* the pcap record carries all of it: AA, header, PDU and CRC */
+  uint8_t record[4 + 2 + LE_MAX_PDU_OCTETS + 3];
+  BOOST_CHECK_EQUAL(pkt->pcap_format(record, sizeof(record)), 4 + 2 + length + 3);
+}
+
+BOOST_AUTO_TEST_CASE(t_long_pdu)
+{
+  /* extended advertising sized PDUs on an advertising channel */
+  check_long_pdu(37, 0x8e89bed6, 0x07, 100, le_packet::ADVERTISING_CRC_INIT);
+  check_long_pdu(39, 0x8e89bed6, 0x07, 255, le_packet::ADVERTISING_CRC_INIT);
+
+  /* data length extension on a data channel, LLID 2 */
+  check_long_pdu(10, 0x50655a19, 0x02, 38, 0x123456);
+  check_long_pdu(10, 0x50655a19, 0x02, 251, 0x123456);
+}
+
+BOOST_AUTO_TEST_CASE(t_data_pdu_too_long)
+{
+  uint8_t pdu[LE_MAX_PDU_OCTETS] = { 0 };
+  char symbols[LE_MAX_SYMBOLS];
+
+  int n = le_symbols(10, 0x50655a19, 0x02, pdu, 252, 0x123456, symbols);
+  le_packet::sptr pkt = le_packet::make(symbols, n, le_packet::index2freq(10));
+  pkt->set_CRCInit(0x123456);
+  BOOST_CHECK(!pkt->decode_header());
+}
+
+BOOST_AUTO_TEST_CASE(t_long_pdu_2m)
+{
+  uint8_t pdu[200];
+  char stream[100 + 8 + LE_MAX_SYMBOLS];
+  for (unsigned i = 0; i < sizeof(pdu); i++)
+    pdu[i] = (uint8_t) (i * 5 + 1);
+
+  /* noise, then the first of the two preamble octets of the 2M PHY */
+  for (int i = 0; i < 100; i++)
+    stream[i] = (i * 37 / 11) & 1;
+  int n = le_symbols(10, 0x50655a19, 0x02, pdu, sizeof(pdu), 0x123456, &stream[108]);
+  for (int i = 0; i < 8; i++)
+    stream[100 + i] = stream[108 + i];
+
+  int i = le_packet::sniff_aa_2m(stream, 110, le_packet::index2freq(10));
+  BOOST_REQUIRE_EQUAL(i, 108);
+
+  le_packet::sptr pkt = le_packet::make(&stream[i], n, le_packet::index2freq(10), le_packet::PHY_2M);
+  pkt->set_CRCInit(0x123456);
+  BOOST_REQUIRE(pkt->decode_header());
+  BOOST_CHECK(pkt->crc_checked());
+  BOOST_CHECK_EQUAL(pkt->get_PHY(), (int) le_packet::PHY_2M);
+  BOOST_REQUIRE_EQUAL(pkt->get_PDU_length(), sizeof(pdu));
+  for (unsigned j = 0; j < sizeof(pdu); j++)
+    BOOST_CHECK_EQUAL(pkt->get_pdu()[j], pdu[j]);
+}
+
+/*
+ * LE Coded FEC: the K=4 convolutional encoder (G0 = 1+D+D^2+D^3,
+ * G1 = 1+D^2+D^3) and the pattern mapper, S=8 maps 0 to 0011 and 1 to
+ * 1100.  Appends to symbols, returns the new length.
+ */
+static int
+coded_encode(const char *bits, int nbits, int coding, int &state, char *symbols, int pos)
+{
+  for (int n = 0; n < nbits; n++) {
+    int b = bits[n] & 1;
+    int s0 = state & 1, s1 = (state >> 1) & 1, s2 = (state >> 2) & 1;
+    int coded[2] = { b ^ s0 ^ s1 ^ s2, b ^ s1 ^ s2 };
+    state = ((state << 1) | b) & 7;
+    for (int c = 0; c < 2; c++) {
+      if (coding == 8) {
+        symbols[pos++] = coded[c];
+        symbols[pos++] = coded[c];
+        symbols[pos++] = !coded[c];
+        symbols[pos++] = !coded[c];
+      }
+      else {
+        symbols[pos++] = coded[c];
+      }
+    }
+  }
+  return pos;
+}
+
+static void
+check_long_pdu_coded(int coding, int length)
+{
+  uint8_t pdu[LE_MAX_PDU_OCTETS];
+  char link[LE_MAX_SYMBOLS];
+  for (int i = 0; i < length; i++)
+    pdu[i] = (uint8_t) (i * 3 + 2);
+  int n = le_symbols(10, 0x50655a19, 0x02, pdu, length, 0x123456, link);
+
+  /* preamble, FEC block 1 (AA, CI, TERM1) at S=8, FEC block 2 (whitened PDU, TERM2) */
+  std::vector<char> stream(le_packet::CODED_PREAMBLE_SYMBOLS + le_packet::CODED_BLOCK1_SYMBOLS +
+                           2 * 8 * (n - 40 + 3));
+  int pos = 0, state = 0;
+  for (; pos < le_packet::CODED_PREAMBLE_SYMBOLS; pos++)
+    stream[pos] = (pos >> 2) & 1;
+  char block1[32 + 2 + 3] = { 0 };
+  for (int i = 0; i < 32; i++)
+    block1[i] = link[8 + i];
+  block1[32] = (coding == 2);
+  pos = coded_encode(block1, sizeof(block1), 8, state, &stream[0], pos);
+  BOOST_REQUIRE_EQUAL(state, 0);
+  char term2[3] = { 0 };
+  pos = coded_encode(&link[40], n - 40, coding, state, &stream[0], pos);
+  pos = coded_encode(term2, 3, coding, state, &stream[0], pos);
+
+  char out[LE_MAX_SYMBOLS];
+  int decoded_coding = 0;
+  int m = le_packet::decode_coded(&stream[0], pos, out, &decoded_coding);
+  BOOST_REQUIRE(m >= n);
+  BOOST_CHECK_EQUAL(decoded_coding, coding);
+
+  le_packet::sptr pkt = le_packet::make(out, m, le_packet::index2freq(10), le_packet::PHY_CODED);
+  pkt->set_CRCInit(0x123456);
+  BOOST_REQUIRE(pkt->decode_header());
+  BOOST_CHECK(pkt->crc_checked());
+  BOOST_CHECK_EQUAL(pkt->get_AA(), 0x50655a19u);
+  BOOST_REQUIRE_EQUAL(pkt->get_PDU_length(), (unsigned) length);
+  for (int i = 0; i < length; i++)
+    BOOST_CHECK_EQUAL(pkt->get_pdu()[i], pdu[i]);
+}
+
+BOOST_AUTO_TEST_CASE(t_long_pdu_coded)
+{
+  check_long_pdu_coded(2, 251);
+  check_long_pdu_coded(8, 60);
+  check_long_pdu_coded(8, 251);
+}
+
+/* one (15,10) block of 10 data bits and the parity lfsr() generates */
+static void
+fec23_encode(int data, char *block)
+{
+  uint8_t g[] = {1,1,0,1,0,1};
+  for (int i = 0; i < 10; i++)
+    block[i] = (data >> (9 - i)) & 1;
+  uint8_t *parity = classic_packet::lfsr((uint8_t *) block, 15, 10, g);
+  for (int i = 0; i < 5; i++)
+    block[10 + i] = parity[i];
+  free(parity);
+}
+
+BOOST_AUTO_TEST_CASE(t_fec23_hard)
+{
+  /* every single error is corrected, every double error detected */
+  for (int data = 0; data < 1024; data += 37) {
+    char block[15];
+    fec23_encode(data, block);
+    for (int i = -1; i < 15; i++) {
+      for (int j = i + 1; j < 15; j++) {
+        char trial[15];
+        memcpy(trial, block, 15);
+        if (i >= 0)
+          trial[i] ^= 1;
+        trial[j] ^= 1;
+        char *out = classic_packet::unfec23(trial, 10);
+        if (i >= 0) {
+          BOOST_CHECK(!out);
+        }
+        else {
+          BOOST_REQUIRE(out);
+          BOOST_CHECK(memcmp(out, block, 10) == 0);
+        }
+        free(out);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(t_fec23_soft)
+{
+  /* two weak errors are corrected with soft symbols */
+  char block[15], trial[15];
+  int8_t soft[15];
+  fec23_encode(0x2b5, block);
+  for (int i = 0; i < 15; i++)
+    soft[i] = block[i] ? classic_packet::SOFT_NOMINAL : -classic_packet::SOFT_NOMINAL;
+  memcpy(trial, block, 15);
+  trial[2] ^= 1;
+  trial[11] ^= 1;
+  soft[2] = block[2] ? -2 : 2;
+  soft[11] = block[11] ? -3 : 3;
+
+  char *out = classic_packet::unfec23(trial, 10, soft);
+  BOOST_REQUIRE(out);
+  BOOST_CHECK(memcmp(out, block, 10) == 0);
+  free(out);
+  BOOST_CHECK(!classic_packet::unfec23(trial, 10));
+}
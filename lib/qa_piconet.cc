@@ -0,0 +1,142 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <boost/test/unit_test.hpp>
+#include "gr_bluetooth/piconet.h"
+#include <stdint.h>
+
+using gr::bluetooth::packet;
+using gr::bluetooth::le_packet;
+using gr::bluetooth::low_energy_piconet;
+
+/* symbols of a CONNECT_REQ on advertising channel index 37 */
+static int
+connect_req_symbols(char *symbols, uint32_t aa, uint64_t channel_map, bool chsel)
+{
+  uint8_t pdu[2 + 34 + 3];
+  int i, pos = 0;
+
+  /* header: CONNECT_REQ, ChSel, length */
+  pdu[0] = le_packet::CONNECT_REQ | (chsel ? 0x20 : 0);
+  pdu[1] = 34;
+
+  /* InitA and AdvA */
+  for (i = 0; i < 12; i++)
+    pdu[2 + i] = 0x10 + i;
+
+  /* LLData: AA, CRCInit, WinSize, WinOffset, Interval, Latency, Timeout, ChM, Hop and SCA */
+  uint8_t lldata[22] = {
+    (uint8_t) aa, (uint8_t) (aa >> 8), (uint8_t) (aa >> 16), (uint8_t) (aa >> 24),
+    0x56, 0x34, 0x12,
+    2,
+    0, 0,
+    24, 0,
+    0, 0,
+    100, 0,
+    (uint8_t) channel_map, (uint8_t) (channel_map >> 8), (uint8_t) (channel_map >> 16),
+    (uint8_t) (channel_map >> 24), (uint8_t) (channel_map >> 32),
+    7
+  };
+  for (i = 0; i < 22; i++)
+    pdu[14 + i] = lldata[i];
+
+  uint32_t crc = le_packet::crc24(le_packet::ADVERTISING_CRC_INIT, pdu, 2 + 34);
+  pdu[36] = crc & 0xff;
+  pdu[37] = (crc >> 8) & 0xff;
+  pdu[38] = (crc >> 16) & 0xff;
+
+  uint32_t adv_aa = low_energy_piconet::ADVERTISING_AA;
+  packet::host_to_air((adv_aa & 0x01) ? 0x55 : 0xaa, &symbols[pos], 8);
+  pos += 8;
+  for (i = 0; i < 4; i++, pos += 8)
+    packet::host_to_air((adv_aa >> (8 * i)) & 0xff, &symbols[pos], 8);
+  for (i = 0; i < (int) sizeof(pdu); i++, pos += 8)
+    packet::host_to_air(pdu[i], &symbols[pos], 8);
+
+  /* whitening covers header, PDU and CRC */
+  int wi = le_packet::INDICES[37];
+  for (i = 40; i < pos; i++, wi = (wi + 1) % 127)
+    symbols[i] ^= packet::WHITENING_DATA[wi];
+
+  return pos;
+}
+
+static low_energy_piconet::sptr
+follow(uint32_t aa, uint64_t channel_map, bool chsel)
+{
+  char symbols[le_packet::MAX_SYMBOLS];
+  int length = connect_req_symbols(symbols, aa, channel_map, chsel);
+
+  le_packet::sptr pkt = le_packet::make(symbols, length, le_packet::index2freq(37));
+  BOOST_REQUIRE(pkt->decode_header());
+
+  low_energy_piconet::sptr pn = low_energy_piconet::make(aa);
+  BOOST_REQUIRE(pn->follow(pkt, 0));
+  return pn;
+}
+
+/*
+ * Sample data of channel selection algorithm #2 (core spec Vol 6,
+ * Part C, 3), access address 0x8e89bed6, so channelIdentifier 0x305f.
+ */
+BOOST_AUTO_TEST_CASE(t_csa2_all_channels)
+{
+  low_energy_piconet::sptr pn = follow(0x8e89bed6, 0x1fffffffffULL, true);
+
+  BOOST_CHECK(pn->csa2());
+  BOOST_CHECK_EQUAL(pn->get_AA(), 0x8e89bed6u);
+  BOOST_CHECK_EQUAL(pn->get_CRCInit(), 0x123456u);
+  BOOST_CHECK_EQUAL((int) pn->hop(1), 20);
+  BOOST_CHECK_EQUAL((int) pn->hop(2), 6);
+  BOOST_CHECK_EQUAL((int) pn->hop(3), 21);
+}
+
+BOOST_AUTO_TEST_CASE(t_csa2_nine_channels)
+{
+  /* channels 9, 10, 21, 22, 23, 33, 34, 35 and 36 used */
+  uint64_t map = (1ULL << 9) | (1ULL << 10) | (1ULL << 21) | (1ULL << 22) | (1ULL << 23) |
+    (1ULL << 33) | (1ULL << 34) | (1ULL << 35) | (1ULL << 36);
+  low_energy_piconet::sptr pn = follow(0x8e89bed6, map, true);
+
+  BOOST_CHECK_EQUAL(pn->get_channel_map(), map);
+  BOOST_CHECK_EQUAL((int) pn->hop(6), 23);
+  BOOST_CHECK_EQUAL((int) pn->hop(7), 9);
+  BOOST_CHECK_EQUAL((int) pn->hop(8), 34);
+}
+
+BOOST_AUTO_TEST_CASE(t_csa1)
+{
+  /* without ChSel the hop increment of 7 steps through every channel */
+  low_energy_piconet::sptr pn = follow(0x8e89bed6, 0x1fffffffffULL, false);
+
+  BOOST_CHECK(!pn->csa2());
+  BOOST_CHECK_EQUAL((int) pn->get_hop_increment(), 7);
+  for (int counter = 0; counter < 37; counter++)
+    BOOST_CHECK_EQUAL((int) pn->hop(counter), ((counter + 1) * 7) % 37);
+}
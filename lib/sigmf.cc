@@ -0,0 +1,116 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sigmf.h"
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <stdexcept>
+
+namespace gr {
+  namespace bluetooth {
+
+    /* SigMF keys contain ':' but never '.', the default path separator */
+    typedef boost::property_tree::ptree ptree;
+
+    sigmf_meta
+    sigmf_meta::read(const std::string &meta_file)
+    {
+      ptree root;
+      sigmf_meta meta;
+
+      try {
+        boost::property_tree::read_json(meta_file, root);
+      }
+      catch (const boost::property_tree::json_parser_error &e) {
+        throw std::runtime_error(meta_file + ": " + e.what());
+      }
+
+      boost::optional<ptree &> global_child = root.get_child_optional("global");
+      if (!global_child)
+        throw std::runtime_error(meta_file + ": no global object");
+      const ptree &global = *global_child;
+      std::string datatype = global.get<std::string>("core:datatype", "");
+      if (datatype == "cf32_le")
+        meta.format = multi_block::FORMAT_CF32;
+      else if (datatype == "ci16_le")
+        meta.format = multi_block::FORMAT_SC16;
+      else if ((datatype == "ci8") || (datatype == "ci8_le"))
+        meta.format = multi_block::FORMAT_SC8;
+      else
+        throw std::runtime_error(meta_file + ": unsupported datatype \"" + datatype + "\"");
+
+      meta.sample_rate = global.get<double>("core:sample_rate", 0.0);
+      if (meta.sample_rate <= 0)
+        throw std::runtime_error(meta_file + ": no core:sample_rate");
+      meta.description = global.get<std::string>("core:description", "");
+
+      /* the first capture segment describes the whole file for us */
+      meta.frequency = 0.0;
+      meta.sample_start = 0;
+      boost::optional<ptree &> captures = root.get_child_optional("captures");
+      if (captures && !captures->empty()) {
+        const ptree &capture = captures->begin()->second;
+        meta.frequency = capture.get<double>("core:frequency", 0.0);
+        meta.sample_start = capture.get<uint64_t>("core:sample_start", 0);
+      }
+      if (meta.frequency <= 0)
+        throw std::runtime_error(meta_file + ": no core:frequency in captures");
+
+      return meta;
+    }
+
+    std::string
+    sigmf_meta::base_name(const std::string &path)
+    {
+      static const std::string extensions[] = { ".sigmf-meta", ".sigmf-data" };
+
+      for (int i = 0; i < 2; i++) {
+        const std::string &ext = extensions[i];
+        if ((path.size() > ext.size()) &&
+            (path.compare(path.size() - ext.size(), ext.size(), ext) == 0))
+          return path.substr(0, path.size() - ext.size());
+      }
+      return path;
+    }
+
+    const char *
+    sigmf_meta::datatype(multi_block::sample_format_t format)
+    {
+      switch (format) {
+      case multi_block::FORMAT_SC16:
+        return "ci16_le";
+      case multi_block::FORMAT_SC8:
+        return "ci8";
+      default:
+        return "cf32_le";
+      }
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
@@ -0,0 +1,61 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_SIGMF_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_SIGMF_H
+
+#include "gr_bluetooth/multi_block.h"
+#include <stdint.h>
+#include <string>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * The parts of a SigMF recording's metadata we use: the global
+     * datatype and sample rate, and the first capture segment.
+     */
+    struct sigmf_meta
+    {
+      multi_block::sample_format_t format;
+      double   sample_rate;
+      double   frequency;
+      uint64_t sample_start;
+      std::string description;
+
+      /* parse a .sigmf-meta file, throws std::runtime_error */
+      static sigmf_meta read(const std::string &meta_file);
+
+      /* "foo" from "foo", "foo.sigmf-meta" or "foo.sigmf-data" */
+      static std::string base_name(const std::string &path);
+
+      /* SigMF datatype of a sample format, e.g. "ci16_le" */
+      static const char *datatype(multi_block::sample_format_t format);
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_SIGMF_H */
@@ -0,0 +1,235 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann                                                                                            
+ * Copyright 2007 Dominic Spill                                                                                                                   
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ * 
+ * This file is part of gr-bluetooth
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "sigmf_sink_impl.h"
+#include "gr_bluetooth/packet.h"
+#include "sigmf.h"
+#include <boost/bind.hpp>
+#include <stdio.h>
+#include <algorithm>
+
+namespace gr {
+  namespace bluetooth {
+
+    sigmf_sink::sptr
+    sigmf_sink::make(const std::string &meta_file, double sample_rate, double center_freq,
+                     const std::string &input_format, uint64_t sample_offset)
+    {
+      return gnuradio::get_initial_sptr (new sigmf_sink_impl(meta_file, sample_rate, center_freq,
+                                                             input_format, sample_offset));
+    }
+
+    /*
+     * The private constructor
+     */
+    sigmf_sink_impl::sigmf_sink_impl(const std::string &meta_file, double sample_rate,
+                                     double center_freq, const std::string &input_format,
+                                     uint64_t sample_offset)
+      : gr::block ("bluetooth sigmf sink",
+                   gr::io_signature::make (0, 0, 0),
+                   gr::io_signature::make (0, 0, 0)),
+        d_meta_file(meta_file),
+        d_sample_rate(sample_rate),
+        d_center_freq(center_freq),
+        d_format(multi_block::sample_format(input_format)),
+        d_sample_offset(sample_offset),
+        d_written(false)
+    {
+      d_port    = pmt::mp("packets");
+      d_kind    = pmt::mp("kind");
+      d_channel = pmt::mp("channel");
+      d_sample  = pmt::mp("sample");
+      d_snr     = pmt::mp("snr");
+      d_lap     = pmt::mp("lap");
+      d_uap     = pmt::mp("uap");
+      d_type    = pmt::mp("type");
+      d_aa      = pmt::mp("aa");
+      d_phy     = pmt::mp("phy");
+
+      message_port_register_in(d_port);
+      set_msg_handler(d_port, boost::bind(&sigmf_sink_impl::packet, this, _1));
+    }
+
+    /*
+     * Our virtual destructor.
+     */
+    sigmf_sink_impl::~sigmf_sink_impl()
+    {
+      write();
+    }
+
+    bool
+    sigmf_sink_impl::stop()
+    {
+      write();
+      return true;
+    }
+
+    uint64_t
+    sigmf_sink_impl::annotations()
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+      return d_annotations.size();
+    }
+
+    long
+    sigmf_sink_impl::meta_long(pmt::pmt_t meta, pmt::pmt_t key, long not_found)
+    {
+      pmt::pmt_t value = pmt::dict_ref(meta, key, pmt::PMT_NIL);
+      return pmt::is_integer(value) ? pmt::to_long(value) : not_found;
+    }
+
+    void
+    sigmf_sink_impl::packet(pmt::pmt_t msg)
+    {
+      if (!pmt::is_pair(msg))
+        return;
+      pmt::pmt_t meta = pmt::car(msg);
+      pmt::pmt_t data = pmt::cdr(msg);
+      if (!pmt::is_dict(meta) || !pmt::dict_has_key(meta, d_sample))
+        return;
+
+      annotation a;
+      char text[128];
+      std::string kind = pmt::symbol_to_string(pmt::dict_ref(meta, d_kind, pmt::PMT_NIL));
+      long channel = meta_long(meta, d_channel, 0);
+      double center, half_width = 500000.0;
+      double seconds;
+
+      a.sample_start = d_sample_offset +
+        pmt::to_uint64(pmt::dict_ref(meta, d_sample, pmt::PMT_NIL));
+
+      if (kind == "le") {
+        /* channel is the LE channel index, advertising channels at the band edges */
+        if (channel == 37)
+          center = 2402e6;
+        else if (channel == 38)
+          center = 2426e6;
+        else if (channel == 39)
+          center = 2480e6;
+        else if (channel <= 10)
+          center = 2404e6 + channel * 2e6;
+        else
+          center = 2428e6 + (channel - 11) * 2e6;
+
+        /* AA through CRC, after the preamble of the PHY */
+        size_t octets = pmt::length(data);
+        switch (meta_long(meta, d_phy, le_packet::PHY_1M)) {
+        case le_packet::PHY_2M:
+          seconds = (2 + octets) * 8 * 0.5e-6;
+          break;
+        case le_packet::PHY_CODED:
+          /*
+           * preamble, AA, CI and TERM1 at S=8, then the rest with
+           * TERM2, also taken at S=8 as the PDU does not say
+           */
+          seconds = (80 + 256 + 16 + 24 + ((octets - 4) * 8 + 3) * 8) * 1e-6;
+          break;
+        default:
+          seconds = (1 + octets) * 8 * 1e-6;
+          break;
+        }
+        a.label = "LE";
+        snprintf(text, sizeof(text), "AA 0x%08lx", meta_long(meta, d_aa, 0));
+      }
+      else {
+        center = 2402e6 + channel * 1e6;
+        if (kind == "id") {
+          seconds = 68e-6;
+          a.label = "ID";
+          snprintf(text, sizeof(text), "LAP 0x%06lx", meta_long(meta, d_lap, 0));
+        }
+        else {
+          int type = (int) meta_long(meta, d_type, 0) & 0xf;
+          /* DM3/DH3/EV4/EV5 take three slots, DM5/DH5 five */
+          int slots = (type >= 14) ? 5 : (type >= 10) ? 3 : 1;
+          seconds = slots * 625e-6;
+          a.label = classic_packet::TYPE_NAMES[type];
+          snprintf(text, sizeof(text), "LAP 0x%06lx UAP 0x%02lx",
+                   meta_long(meta, d_lap, 0), meta_long(meta, d_uap, 0));
+        }
+      }
+      a.comment = text;
+
+      pmt::pmt_t snr = pmt::dict_ref(meta, d_snr, pmt::PMT_NIL);
+      if (pmt::is_real(snr)) {
+        snprintf(text, sizeof(text), " SNR %.1f dB", pmt::to_double(snr));
+        a.comment += text;
+      }
+
+      a.sample_count = (uint64_t) (seconds * d_sample_rate + 0.5);
+      a.freq_lower_edge = center - half_width;
+      a.freq_upper_edge = center + half_width;
+
+      std::lock_guard<std::mutex> lock(d_mutex);
+      d_annotations.push_back(a);
+    }
+
+    void
+    sigmf_sink_impl::write()
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+      if (d_written)
+        return;
+      d_written = true;
+
+      FILE *out = fopen(d_meta_file.c_str(), "w");
+      if (!out) {
+        perror(d_meta_file.c_str());
+        return;
+      }
+
+      /* annotations must be sorted, packets may arrive slightly out of order */
+      std::stable_sort(d_annotations.begin(), d_annotations.end());
+
+      fprintf(out, "{\n  \"global\": {\n");
+      fprintf(out, "    \"core:datatype\": \"%s\",\n", sigmf_meta::datatype(d_format));
+      fprintf(out, "    \"core:sample_rate\": %.17g,\n", d_sample_rate);
+      fprintf(out, "    \"core:version\": \"1.0.0\",\n");
+      fprintf(out, "    \"core:recorder\": \"gr-bluetooth\",\n");
+      fprintf(out, "    \"core:description\": \"Bluetooth packets decoded by gr-bluetooth\"\n");
+      fprintf(out, "  },\n  \"captures\": [\n");
+      fprintf(out, "    { \"core:sample_start\": 0, \"core:frequency\": %.17g }\n", d_center_freq);
+      fprintf(out, "  ],\n  \"annotations\": [");
+      for (size_t i = 0; i < d_annotations.size(); i++) {
+        const annotation &a = d_annotations[i];
+        fprintf(out, "%s\n    { \"core:sample_start\": %llu, \"core:sample_count\": %llu, "
+                "\"core:freq_lower_edge\": %.17g, \"core:freq_upper_edge\": %.17g, "
+                "\"core:label\": \"%s\", \"core:comment\": \"%s\" }",
+                i ? "," : "",
+                (unsigned long long) a.sample_start, (unsigned long long) a.sample_count,
+                a.freq_lower_edge, a.freq_upper_edge, a.label.c_str(), a.comment.c_str());
+      }
+      fprintf(out, "\n  ]\n}\n");
+      fclose(out);
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
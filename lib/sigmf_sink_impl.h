@@ -0,0 +1,90 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann                                                                                            
+ * Copyright 2007 Dominic Spill                                                                                                                   
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ * 
+ * This file is part of gr-bluetooth
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_SIGMF_SINK_IMPL_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_SIGMF_SINK_IMPL_H
+
+#include "gr_bluetooth/sigmf_sink.h"
+#include "gr_bluetooth/multi_block.h"
+#include <pmt/pmt.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    class sigmf_sink_impl : virtual public sigmf_sink
+    {
+    private:
+      struct annotation {
+        uint64_t    sample_start;
+        uint64_t    sample_count;
+        double      freq_lower_edge;
+        double      freq_upper_edge;
+        std::string label;
+        std::string comment;
+
+        bool operator<(const annotation &other) const
+        {
+          return sample_start < other.sample_start;
+        }
+      };
+
+      std::string d_meta_file;
+      double      d_sample_rate;
+      double      d_center_freq;
+      multi_block::sample_format_t d_format;
+      uint64_t    d_sample_offset;
+
+      /* filled by the message handler, written out by stop() */
+      std::mutex              d_mutex;
+      std::vector<annotation> d_annotations;
+      bool                    d_written;
+
+      /* metadata keys, interned once */
+      pmt::pmt_t d_port;
+      pmt::pmt_t d_kind, d_channel, d_sample, d_snr, d_lap, d_uap, d_type, d_aa, d_phy;
+
+      void packet(pmt::pmt_t msg);
+      void write();
+
+      /* convenience for optional integer metadata */
+      long meta_long(pmt::pmt_t meta, pmt::pmt_t key, long not_found);
+
+    public:
+      sigmf_sink_impl(const std::string &meta_file, double sample_rate, double center_freq,
+                      const std::string &input_format, uint64_t sample_offset);
+      ~sigmf_sink_impl();
+
+      uint64_t annotations();
+
+      bool stop();
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_SIGMF_SINK_IMPL_H */
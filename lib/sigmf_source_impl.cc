@@ -0,0 +1,151 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann                                                                                            
+ * Copyright 2007 Dominic Spill                                                                                                                   
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ * 
+ * This file is part of gr-bluetooth
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "sigmf_source_impl.h"
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace gr {
+  namespace bluetooth {
+
+    sigmf_source::sptr
+    sigmf_source::make(const std::string &path, uint64_t start, uint64_t nsamples)
+    {
+      return gnuradio::get_initial_sptr (new sigmf_source_impl(path, start, nsamples));
+    }
+
+    /*
+     * The private constructor
+     */
+    sigmf_source_impl::sigmf_source_impl(const std::string &path, uint64_t start, uint64_t nsamples)
+      : sigmf_source_impl(sigmf_meta::read(sigmf_meta::base_name(path) + ".sigmf-meta"),
+                          path, start, nsamples)
+    {
+    }
+
+    /* the output item size comes from the metadata, so read it first */
+    sigmf_source_impl::sigmf_source_impl(const sigmf_meta &meta, const std::string &path,
+                                         uint64_t start, uint64_t nsamples)
+      : gr::sync_block ("bluetooth sigmf source",
+                       gr::io_signature::make (0, 0, 0),
+                       gr::io_signature::make (1, 1, multi_block::sample_size (meta.format))),
+        d_meta(meta)
+    {
+      std::string data_file = sigmf_meta::base_name(path) + ".sigmf-data";
+
+      d_file = mapped_file::make(data_file, d_meta.format);
+      if (!d_file->is_open())
+        throw std::runtime_error("cannot map " + data_file);
+
+      d_item_size = multi_block::sample_size(d_meta.format);
+      d_nsamples = nsamples;
+      d_running = false;
+      set_window(start);
+    }
+
+    /*
+     * Our virtual destructor.
+     */
+    sigmf_source_impl::~sigmf_source_impl()
+    {
+    }
+
+    std::string
+    sigmf_source_impl::input_format()
+    {
+      switch (d_meta.format) {
+      case multi_block::FORMAT_SC16:
+        return "sc16";
+      case multi_block::FORMAT_SC8:
+        return "sc8";
+      default:
+        return "cf32";
+      }
+    }
+
+    /* caller holds d_mutex, or is the constructor */
+    void
+    sigmf_source_impl::set_window(uint64_t start)
+    {
+      d_pos = std::min(start, d_file->size());
+      d_end = d_file->size();
+      if (d_nsamples && (d_nsamples < d_end - d_pos))
+        d_end = d_pos + d_nsamples;
+    }
+
+    /*
+     * Downstream blocks number samples by the items they have seen,
+     * a jump in the middle of the stream would throw them off.
+     */
+    void
+    sigmf_source_impl::seek(uint64_t sample)
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+      if (d_running)
+        throw std::runtime_error("sigmf_source: cannot seek while the flowgraph runs");
+      set_window(sample);
+    }
+
+    bool
+    sigmf_source_impl::start()
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+      d_running = true;
+      return true;
+    }
+
+    bool
+    sigmf_source_impl::stop()
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+      d_running = false;
+      return true;
+    }
+
+    int
+    sigmf_source_impl::work(int                        noutput_items,
+                            gr_vector_const_void_star& input_items,
+                            gr_vector_void_star&       output_items)
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+
+      if (d_pos >= d_end)
+        return WORK_DONE;
+
+      int n = (int) std::min((uint64_t) noutput_items, d_end - d_pos);
+      memcpy(output_items[0], d_file->items(d_pos, n, d_buf), n * d_item_size);
+      d_pos += n;
+
+      return n;
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
@@ -0,0 +1,83 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann                                                                                            
+ * Copyright 2007 Dominic Spill                                                                                                                   
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ * 
+ * This file is part of gr-bluetooth
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_SIGMF_SOURCE_IMPL_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_SIGMF_SOURCE_IMPL_H
+
+#include "gr_bluetooth/sigmf_source.h"
+#include "mapped_file.h"
+#include "sigmf.h"
+#include <mutex>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    class sigmf_source_impl : virtual public sigmf_source
+    {
+    private:
+      sigmf_meta        d_meta;
+      mapped_file::sptr d_file;
+      size_t            d_item_size;
+      uint64_t          d_nsamples;
+
+      /* next sample to produce and the end of playback, guarded by d_mutex */
+      std::mutex d_mutex;
+      uint64_t   d_pos;
+      uint64_t   d_end;
+
+      /* between start() and stop(), when seek() is refused */
+      bool       d_running;
+
+      /* scratch for mapped_file::items(), reads stay inside the file */
+      std::vector<char> d_buf;
+
+      void set_window(uint64_t start);
+
+      sigmf_source_impl(const sigmf_meta &meta, const std::string &path,
+                        uint64_t start, uint64_t nsamples);
+
+    public:
+      sigmf_source_impl(const std::string &path, uint64_t start, uint64_t nsamples);
+      ~sigmf_source_impl();
+
+      double sample_rate() { return d_meta.sample_rate; }
+      double center_freq() { return d_meta.frequency; }
+      std::string input_format();
+      uint64_t size() { return d_file->size(); }
+      void seek(uint64_t sample);
+
+      bool start();
+      bool stop();
+
+      int work(int                        noutput_items,
+               gr_vector_const_void_star& input_items,
+               gr_vector_void_star&       output_items);
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_SIGMF_SOURCE_IMPL_H */
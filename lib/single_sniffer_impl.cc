@@ -30,7 +30,6 @@
 #include <gnuradio/digital/clock_recovery_mm_ff.h>
 #include <gnuradio/analog/quadrature_demod_cf.h>
 #include <gnuradio/digital/binary_slicer_fb.h>
-#include "gr_bluetooth/no_filter_sniffer.h"
 
 namespace gr {
 namespace bluetooth {
@@ -63,13 +62,16 @@ namespace bluetooth {
         gr::digital::binary_slicer_fb::sptr bin_slice =
             gr::digital::binary_slicer_fb::make();
 
-        no_filter_sniffer::sptr sniffer =
-            no_filter_sniffer::make(sample_rate, center_freq);
+        d_sniffer = no_filter_sniffer::make(sample_rate, center_freq);
 
         connect(self(), 0, fm_demod, 0);
         connect(fm_demod, 0, mm_cr, 0);
         connect(mm_cr, 0, bin_slice, 0);
-        connect(bin_slice, 0, sniffer, 0);
+        connect(bin_slice, 0, d_sniffer, 0);
+
+        /* pass decoded packets through */
+        message_port_register_hier_out(pmt::mp("packets"));
+        msg_connect(d_sniffer, pmt::mp("packets"), self(), pmt::mp("packets"));
     }
 
     /*
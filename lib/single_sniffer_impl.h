@@ -24,15 +24,25 @@
 #define INCLUDED_BLUETOOTH_GR_BLUETOOTH_SINGLE_SNIFFER_IMPL_H
 
 #include "gr_bluetooth/single_sniffer.h"
+#include "gr_bluetooth/no_filter_sniffer.h"
 
 namespace gr {
 namespace bluetooth {
 
     class single_sniffer_impl : virtual public single_sniffer
     {
+        private:
+            no_filter_sniffer::sptr d_sniffer;
+
         public:
             single_sniffer_impl(double sample_rate, double center_freq);
             ~single_sniffer_impl();
+
+            /* benchmark counters of the sniffer */
+            uint64_t channel_slots(int channel) { return d_sniffer->channel_slots(channel); }
+            uint64_t packets_detected() { return d_sniffer->packets_detected(); }
+            uint64_t packets_decoded() { return d_sniffer->packets_decoded(); }
+            uint64_t skipped_channel_slots() { return 0; }
     };
 
 } // namespace bluetooth
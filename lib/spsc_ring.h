@@ -0,0 +1,107 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_SPSC_RING_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_SPSC_RING_H
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * Bounded lock-free ring for exactly one producer thread and one
+     * consumer thread.  Slots are filled in place: the producer calls
+     * reserve(), fills the slot and then commit(); the consumer calls
+     * front(), uses the slot and then pop().
+     */
+    template <class T>
+    class spsc_ring
+    {
+    private:
+      std::vector<T> d_slots;
+      size_t         d_mask;
+
+      /* d_head is only written by the producer, d_tail by the consumer */
+      std::atomic<size_t> d_head;
+      std::atomic<size_t> d_tail;
+
+    public:
+      spsc_ring(size_t depth)
+        : d_head(0), d_tail(0)
+      {
+        size_t size = 1;
+        while (size < depth)
+          size <<= 1;
+        d_slots.resize(size);
+        d_mask = size - 1;
+      }
+
+      /* producer: next free slot, or NULL if the ring is full */
+      T *reserve()
+      {
+        size_t head = d_head.load(std::memory_order_relaxed);
+        if ((head - d_tail.load(std::memory_order_acquire)) > d_mask)
+          return NULL;
+        return &d_slots[head & d_mask];
+      }
+
+      /* producer: publish the reserved slot, true if the ring was empty */
+      bool commit()
+      {
+        size_t head = d_head.load(std::memory_order_relaxed);
+        d_head.store(head + 1, std::memory_order_release);
+        return head == d_tail.load(std::memory_order_acquire);
+      }
+
+      /* consumer: oldest published slot, or NULL if the ring is empty */
+      T *front()
+      {
+        size_t tail = d_tail.load(std::memory_order_relaxed);
+        if (tail == d_head.load(std::memory_order_acquire))
+          return NULL;
+        return &d_slots[tail & d_mask];
+      }
+
+      /* consumer: release the slot returned by front() */
+      void pop()
+      {
+        d_tail.store(d_tail.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+      }
+
+      bool empty()
+      {
+        return d_tail.load(std::memory_order_acquire) ==
+          d_head.load(std::memory_order_acquire);
+      }
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_SPSC_RING_H */
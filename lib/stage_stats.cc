@@ -0,0 +1,157 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "stage_stats.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace gr {
+  namespace bluetooth {
+
+    const char *stage_stats::STAGE_NAMES[] = {
+      "channel_samples", "check_snr", "demod", "mm_cr", "slicer",
+      "sniff_ac", "sniff_aa", "packet", "decode", "discovery"
+    };
+
+    stage_stats::sptr
+    stage_stats::make()
+    {
+      return stage_stats::sptr(new stage_stats());
+    }
+
+    stage_stats::stage_stats()
+      : d_enabled(false), d_channel(-1)
+    {
+      reset();
+    }
+
+    void
+    stage_stats::reset()
+    {
+      memset(d_stages, 0, sizeof(d_stages));
+      memset(d_channel_ticks, 0, sizeof(d_channel_ticks));
+      d_start_ticks = now();
+      d_start_time = std::chrono::steady_clock::now();
+    }
+
+    void
+    stage_stats::merge(const stage_stats &other)
+    {
+      int s, i;
+      for (s = 0; s < NUM_STAGES; s++) {
+        counters &c = d_stages[s];
+        const counters &o = other.d_stages[s];
+        c.calls += o.calls;
+        c.ticks += o.ticks;
+        if (o.max > c.max)
+          c.max = o.max;
+        for (i = 0; i < BUCKETS; i++)
+          c.histogram[i] += o.histogram[i];
+        for (i = 0; i < CHANNELS; i++)
+          d_channel_ticks[s][i] += other.d_channel_ticks[s][i];
+      }
+    }
+
+    double
+    stage_stats::ticks_per_ns() const
+    {
+#if defined(__i386__) || defined(__x86_64__)
+      double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - d_start_time).count();
+      /* too short to calibrate, assume a 1 GHz counter */
+      if (ns < 1e6)
+        return 1.0;
+      return (now() - d_start_ticks) / ns;
+#else
+      return 1.0;
+#endif
+    }
+
+    double
+    stage_stats::percentile_ns(const counters &c, double fraction) const
+    {
+      uint64_t seen = 0;
+      int b;
+      for (b = 0; b < BUCKETS; b++) {
+        seen += c.histogram[b];
+        if (seen >= fraction * c.calls)
+          break;
+      }
+      uint64_t edge = (b < 63) ? (2ULL << b) : c.max;
+      return ((edge < c.max) ? edge : c.max) / ticks_per_ns();
+    }
+
+    std::string
+    stage_stats::report() const
+    {
+      std::string out;
+      char line[256];
+      double scale = ticks_per_ns();
+      int s, ch;
+
+      snprintf(line, sizeof(line), "%-16s %12s %12s %10s %10s %10s %10s\n",
+               "stage", "calls", "total ms", "mean ns", "p50 ns", "p99 ns", "max ns");
+      out += line;
+      for (s = 0; s < NUM_STAGES; s++) {
+        const counters &c = d_stages[s];
+        if (c.calls == 0)
+          continue;
+        snprintf(line, sizeof(line), "%-16s %12llu %12.3f %10.0f %10.0f %10.0f %10.0f\n",
+                 STAGE_NAMES[s], (unsigned long long) c.calls,
+                 c.ticks / scale / 1e6, c.ticks / scale / c.calls,
+                 percentile_ns(c, 0.5), percentile_ns(c, 0.99), c.max / scale);
+        out += line;
+      }
+
+      /* per-channel totals, in ms, for the channels that saw any work */
+      out += "\nchannel";
+      for (s = 0; s < NUM_STAGES; s++) {
+        snprintf(line, sizeof(line), " %10.10s", STAGE_NAMES[s]);
+        out += line;
+      }
+      out += "\n";
+      for (ch = 0; ch < CHANNELS; ch++) {
+        uint64_t any = 0;
+        for (s = 0; s < NUM_STAGES; s++)
+          any |= d_channel_ticks[s][ch];
+        if (!any)
+          continue;
+        snprintf(line, sizeof(line), "%7d", ch);
+        out += line;
+        for (s = 0; s < NUM_STAGES; s++) {
+          snprintf(line, sizeof(line), " %10.3f", d_channel_ticks[s][ch] / scale / 1e6);
+          out += line;
+        }
+        out += "\n";
+      }
+      return out;
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
@@ -0,0 +1,166 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_STAGE_STATS_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_STAGE_STATS_H
+
+#include <boost/shared_ptr.hpp>
+#include <stdint.h>
+#include <chrono>
+#include <string>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * Time spent in each stage of a multi_block's work(), for profiling
+     * in the field.  Always compiled in: with profiling off a stage
+     * costs one branch, with it on two timestamp counter reads.  Each
+     * stage keeps calls, total and maximum ticks, a log2 histogram and
+     * a per-channel total; ticks are converted to nanoseconds only when
+     * reporting.
+     */
+    class stage_stats
+    {
+    public:
+      enum stage_t {
+        STAGE_CHANNEL_SAMPLES = 0,
+        STAGE_CHECK_SNR,
+        STAGE_DEMOD,
+        STAGE_MM_CR,
+        STAGE_SLICER,
+        STAGE_SNIFF_AC,
+        STAGE_SNIFF_AA,
+        STAGE_PACKET,           /* classic/LE packet construction */
+        STAGE_DECODE,
+        STAGE_DISCOVERY,        /* UAP/clock discovery and hop reversal */
+        NUM_STAGES
+      };
+
+      static const char *STAGE_NAMES[NUM_STAGES];
+
+      static const int CHANNELS = 79;
+      static const int BUCKETS  = 48;
+
+      typedef boost::shared_ptr<stage_stats> sptr;
+
+      static sptr make();
+
+      stage_stats();
+
+      void set_enabled(bool enabled) { d_enabled = enabled; }
+      bool enabled() const { return d_enabled; }
+
+      /* classic channel that following stages are charged to, -1 for none */
+      void set_channel(int channel) { d_channel = channel; }
+
+      /* timestamp counter, or nanoseconds where there is none */
+      static inline uint64_t now()
+      {
+#if defined(__i386__) || defined(__x86_64__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+      }
+
+      void record(int stage, uint64_t ticks)
+      {
+        counters &c = d_stages[stage];
+        c.calls++;
+        c.ticks += ticks;
+        if (ticks > c.max)
+          c.max = ticks;
+        int bucket = 63 - __builtin_clzll(ticks | 1);
+        c.histogram[(bucket < BUCKETS) ? bucket : BUCKETS - 1]++;
+        if ((d_channel >= 0) && (d_channel < CHANNELS))
+          d_channel_ticks[stage][d_channel] += ticks;
+      }
+
+      uint64_t calls(int stage) const { return d_stages[stage].calls; }
+      double total_ns(int stage) const { return d_stages[stage].ticks / ticks_per_ns(); }
+
+      /* human readable table of all stages and channels */
+      std::string report() const;
+
+      void reset();
+
+      /* add the counts of another instance, e.g. a replay worker */
+      void merge(const stage_stats &other);
+
+    private:
+      struct counters {
+        uint64_t calls;
+        uint64_t ticks;
+        uint64_t max;
+        uint64_t histogram[BUCKETS];
+      };
+
+      bool     d_enabled;
+      int      d_channel;
+      counters d_stages[NUM_STAGES];
+      uint64_t d_channel_ticks[NUM_STAGES][CHANNELS];
+
+      /* for calibrating the timestamp counter against the wall clock */
+      uint64_t d_start_ticks;
+      std::chrono::steady_clock::time_point d_start_time;
+
+      double ticks_per_ns() const;
+
+      /* upper edge of the histogram bucket holding the given fraction */
+      double percentile_ns(const counters &c, double fraction) const;
+    };
+
+    /* charges the lifetime of a scope to one stage */
+    class stage_timer
+    {
+    private:
+      stage_stats *d_stats;
+      int          d_stage;
+      uint64_t     d_start;
+
+    public:
+      stage_timer(const stage_stats::sptr &stats, int stage)
+        : d_stats(stats->enabled() ? stats.get() : NULL), d_stage(stage)
+      {
+        if (d_stats)
+          d_start = stage_stats::now();
+      }
+
+      ~stage_timer()
+      {
+        if (d_stats)
+          d_stats->record(d_stage, stage_stats::now() - d_start);
+      }
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_STAGE_STATS_H */
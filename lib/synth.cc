@@ -0,0 +1,335 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "synth.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace gr {
+  namespace bluetooth {
+
+    const packet_synth::type_info packet_synth::TYPES[] = {
+      /* classic, the maximum is the payload body without header and CRC */
+      { "ID",              false, -1,   0 },
+      { "NULL",            false,  0,   0 },
+      { "POLL",            false,  1,   0 },
+      { "FHS",             false,  2,   0 },
+      { "DM1",             false,  3,  17 },
+      { "DH1",             false,  4,  27 },
+      { "EV3",             false,  7,  30 },
+      { "DM3",             false, 10, 121 },
+      { "DH3",             false, 11, 183 },
+      { "EV4",             false, 12, 120 },
+      { "EV5",             false, 13, 180 },
+      { "DM5",             false, 14, 224 },
+      { "DH5",             false, 15, 339 },
+      /* LE advertising channel PDUs, the maximum is AdvData/ScanRspData */
+      { "ADV_IND",         true,   0,  31 },
+      { "ADV_DIRECT_IND",  true,   1,   0 },
+      { "ADV_NONCONN_IND", true,   2,  31 },
+      { "SCAN_RSP",        true,   4,  31 },
+      { "ADV_SCAN_IND",    true,   6,  31 },
+      { NULL,              false,  0,   0 }
+    };
+
+    int packet_synth::lookup(const std::string &name)
+    {
+      int i;
+      for (i = 0; TYPES[i].name; i++)
+        if (name == TYPES[i].name)
+          return i;
+      return -1;
+    }
+
+    packet_synth::packet_synth(uint32_t LAP, uint8_t UAP, unsigned int seed)
+      : d_LAP(LAP & 0xffffff), d_UAP(UAP), d_rng(seed)
+    {
+      int i;
+      uint8_t *ac = classic_packet::acgen(d_LAP);
+      for (i = 0; i < 9; i++)
+        classic_packet::convert_to_grformat(ac[i], (uint8_t *) &d_access_code[i*8]);
+      free(ac);
+    }
+
+    int packet_synth::encode(int index, uint32_t clock, int chan_index, char *symbols)
+    {
+      const type_info &info = TYPES[index];
+      if (info.le)
+        return le_adv(info, chan_index, symbols);
+      return classic(info, clock, symbols);
+    }
+
+    /* the inverse of classic_packet::UAP_from_hec(), one step per data bit */
+    uint8_t packet_synth::hecgen(uint16_t data, uint8_t UAP)
+    {
+      int i;
+      uint8_t hec = packet::reverse(UAP);
+
+      for (i = 0; i < 10; i++) {
+        uint8_t t = ((((hec & 0x01) ^ (data >> i)) & 0x01) << 7) | (hec >> 1);
+        hec = (t & 0x80) ? (t ^ 0x65) : t;
+      }
+      return hec;
+    }
+
+    uint32_t packet_synth::le_crcgen(uint32_t init, const uint8_t *data, int length)
+    {
+      int i, j;
+      uint32_t state = init;
+
+      for (i = 0; i < length; i++) {
+        uint8_t byte = data[i];
+        for (j = 0; j < 8; j++) {
+          int feedback = (state ^ byte) & 0x01;
+          byte >>= 1;
+          state >>= 1;
+          if (feedback)
+            state = (state | (1 << 23)) ^ 0x5a6000;
+        }
+      }
+      return state;
+    }
+
+    int packet_synth::body_length(int max_length)
+    {
+      int length = 1 + (int) (d_rng.ran1() * max_length);
+      return (length > max_length) ? max_length : length;
+    }
+
+    int packet_synth::put_bits(char *air_order, int pos, uint32_t value, int bits)
+    {
+      int i;
+      for (i = 0; i < bits; i++)
+        air_order[pos + i] = (value >> i) & 0x01;
+      return pos + bits;
+    }
+
+    void packet_synth::whiten(char *data, int length, uint32_t clock, int skip)
+    {
+      int count, index;
+      index = (classic_packet::INDICES[clock & 0x3f] + skip) % 127;
+
+      for (count = 0; count < length; count++) {
+        data[count] ^= packet::WHITENING_DATA[index];
+        index = (index + 1) % 127;
+      }
+    }
+
+    int packet_synth::fec23(const char *input, int length, char *output)
+    {
+      int i, count, blocks;
+      uint8_t block[10], *codeword;
+      uint8_t fecgen[] = {1,1,0,1,0,1};
+
+      /* the last block is padded with zeros, as unfec23() expects */
+      blocks = (length + 9) / 10;
+      for (i = 0; i < blocks; i++) {
+        for (count = 0; count < 10; count++)
+          block[count] = (i*10 + count < length) ? input[i*10 + count] : 0;
+
+        codeword = classic_packet::lfsr(block, 15, 10, fecgen);
+        for (count = 0; count < 10; count++)
+          output[i*15 + count] = block[count];
+        for (count = 0; count < 5; count++)
+          output[i*15 + 10 + count] = codeword[count];
+        free(codeword);
+      }
+      return blocks * 15;
+    }
+
+    int packet_synth::fec13(const char *input, int length, char *output)
+    {
+      int i;
+      for (i = 0; i < length; i++)
+        output[3*i] = output[3*i + 1] = output[3*i + 2] = input[i];
+      return 3 * length;
+    }
+
+    int packet_synth::classic(const type_info &info, uint32_t clock, char *symbols)
+    {
+      int i, pos, length, header_bytes;
+      bool fec;
+      char header[18];
+
+      memcpy(symbols, d_access_code, 72);
+
+      /* an ID packet is just the access code without trailer */
+      if (info.type < 0)
+        return classic_packet::SYMBOLS_PER_BASIC_RATE_ACCESS_CODE;
+
+      /* packet header: LT_ADDR 1, TYPE, FLOW 1, ARQN 0, SEQN 0, HEC */
+      uint16_t hdr_data = 0x01 | (info.type << 3) | (1 << 7);
+      put_bits(header, 0, hdr_data, 10);
+      put_bits(header, 10, hecgen(hdr_data, d_UAP), 8);
+      whiten(header, 18, clock, 0);
+      fec13(header, 18, symbols + 72);
+
+      switch (info.type) {
+      case 2: /* FHS */
+        header_bytes = -1;
+        fec = true;
+        break;
+      case 3:  /* DM1 */
+        header_bytes = 1;
+        fec = true;
+        break;
+      case 10: /* DM3 */
+      case 14: /* DM5 */
+        header_bytes = 2;
+        fec = true;
+        break;
+      case 4:  /* DH1 */
+        header_bytes = 1;
+        fec = false;
+        break;
+      case 11: /* DH3 */
+      case 15: /* DH5 */
+        header_bytes = 2;
+        fec = false;
+        break;
+      case 12: /* EV4 */
+        header_bytes = 0;
+        fec = true;
+        break;
+      case 7:  /* EV3 */
+      case 13: /* EV5 */
+        header_bytes = 0;
+        fec = false;
+        break;
+      default: /* NULL, POLL: no payload */
+        return 126;
+      }
+
+      if (header_bytes < 0) {
+        /* FHS: parity bits from the sync word, then our own address and clock */
+        pos = 0;
+        for (i = 0; i < 34; i++)
+          d_bits[pos++] = d_access_code[4 + i];
+        pos = put_bits(d_bits, pos, d_LAP, 24);
+        pos = put_bits(d_bits, pos, 0, 2);          /* EIR, undefined */
+        pos = put_bits(d_bits, pos, 0, 2);          /* SR */
+        pos = put_bits(d_bits, pos, 2, 2);          /* SP */
+        pos = put_bits(d_bits, pos, d_UAP, 8);
+        pos = put_bits(d_bits, pos, 0, 16);         /* NAP */
+        pos = put_bits(d_bits, pos, 0x5a020c, 24);  /* class of device */
+        pos = put_bits(d_bits, pos, 1, 3);          /* LT_ADDR */
+        pos = put_bits(d_bits, pos, (clock >> 1) & 0x3ffffff, 26);
+        pos = put_bits(d_bits, pos, 0, 3);          /* page scan mode */
+      } else {
+        length = body_length(info.max_length);
+
+        /* payload header: LLID 2 (L2CAP start), FLOW 1, LENGTH */
+        pos = put_bits(d_bits, 0, 2, 2);
+        pos = put_bits(d_bits, pos, 1, 1);
+        if (header_bytes == 1) {
+          pos = put_bits(d_bits, pos, length, 5);
+        } else if (header_bytes == 2) {
+          pos = put_bits(d_bits, pos, length, 10);
+          pos = put_bits(d_bits, pos, 0, 3);
+        } else {
+          pos = 0;
+        }
+        for (i = 0; i < length; i++)
+          pos = put_bits(d_bits, pos, (uint32_t) (d_rng.ran1() * 256) & 0xff, 8);
+      }
+      pos = put_bits(d_bits, pos, classic_packet::crcgen(d_bits, pos, d_UAP), 16);
+
+      /* whitening continues from the packet header, FEC is applied after it */
+      whiten(d_bits, pos, clock, 18);
+      if (fec)
+        return 126 + fec23(d_bits, pos, symbols + 126);
+
+      memcpy(symbols + 126, d_bits, pos);
+      return 126 + pos;
+    }
+
+    int packet_synth::le_adv(const type_info &info, int chan_index, char *symbols)
+    {
+      int i, pos, length;
+      uint8_t pdu[2 + LE_MAX_PDU_OCTETS + 3];
+
+      /* AdvA: public address built from LAP, UAP and a zero NAP */
+      uint8_t *adva = &pdu[2];
+      adva[0] = d_LAP & 0xff;
+      adva[1] = (d_LAP >> 8) & 0xff;
+      adva[2] = (d_LAP >> 16) & 0xff;
+      adva[3] = d_UAP;
+      adva[4] = adva[5] = 0;
+      length = 6;
+
+      if (info.type == 1) {
+        /* ADV_DIRECT_IND: InitA */
+        for (i = 0; i < 6; i++)
+          pdu[2 + length++] = (uint8_t) (d_rng.ran1() * 256);
+      } else {
+        /* flags AD structure, then manufacturer specific data */
+        int data_length = body_length(info.max_length - 5);
+        pdu[2 + length++] = 0x02;
+        pdu[2 + length++] = 0x01;
+        pdu[2 + length++] = 0x06;
+        pdu[2 + length++] = data_length + 1;
+        pdu[2 + length++] = 0xff;
+        for (i = 0; i < data_length; i++)
+          pdu[2 + length++] = (uint8_t) (d_rng.ran1() * 256);
+      }
+
+      /* header: PDU type, TxAdd 0, RxAdd 0, length */
+      pdu[0] = info.type & 0x0f;
+      pdu[1] = length & 0xff;
+
+      /* CRC init 0x555555, bit reversed to match the shift register */
+      uint32_t crc = le_crcgen(0xaaaaaa, pdu, 2 + length);
+      pdu[2 + length]     = crc & 0xff;
+      pdu[2 + length + 1] = (crc >> 8) & 0xff;
+      pdu[2 + length + 2] = (crc >> 16) & 0xff;
+
+      /* the preamble alternates into the first bit of the AA */
+      pos = put_bits(symbols, 0, (ADV_AA & 0x01) ? 0x55 : 0xaa, 8);
+      pos = put_bits(symbols, pos, ADV_AA, 32);
+      for (i = 0; i < 2 + length + 3; i++)
+        pos = put_bits(symbols, pos, pdu[i], 8);
+
+      /* whitening covers header, PDU and CRC */
+      int wi = le_packet::INDICES[chan_index];
+      for (i = 40; i < pos; i++, wi = (wi + 1) % 127)
+        symbols[i] ^= packet::WHITENING_DATA[wi];
+
+      return pos;
+    }
+
+    synth_piconet::synth_piconet(uint32_t LAP, uint8_t UAP)
+      : basic_rate_piconet_impl(LAP)
+    {
+      set_UAP(UAP);
+      precalc();
+      address_precalc(((UAP << 24) | LAP) & 0xfffffff);
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
@@ -0,0 +1,132 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_SYNTH_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_SYNTH_H
+
+#include "gr_bluetooth/packet.h"
+#include "piconet_impl.h"
+#include <gnuradio/random.h>
+#include <stdint.h>
+#include <string>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * Packet encoder for synthetic input.  This is the transmit side of
+     * the decoder in packet_impl.cc: it produces the air order symbol
+     * stream (one bit per char) of a classic or LE advertising packet,
+     * whitened and FEC encoded exactly the way the decoder undoes it.
+     * Payload lengths and contents come from a seeded generator, so the
+     * same seed always gives the same packets.
+     */
+    class packet_synth
+    {
+    public:
+      /* a packet type that can be synthesized */
+      struct type_info {
+        const char *name;
+        bool        le;         /* LE advertising PDU instead of classic */
+        int         type;       /* classic TYPE code, LE PDU type, -1 for ID */
+        int         max_length; /* maximum payload body in bytes */
+      };
+
+      /* every type we know how to build, terminated by a NULL name */
+      static const type_info TYPES[];
+
+      /* index into TYPES for a name such as "DM1" or "ADV_IND", or -1 */
+      static int lookup(const std::string &name);
+
+      /* largest packet we can produce (DH5) in symbols */
+      static const int MAX_SYMBOLS = 3125;
+
+      /* LE advertising channel access address */
+      static const uint32_t ADV_AA = 0x8e89bed6;
+
+      packet_synth(uint32_t LAP, uint8_t UAP, unsigned int seed);
+
+      /*
+       * Encode one packet of TYPES[index] into symbols, which must hold
+       * MAX_SYMBOLS.  clock is CLK1-27 of the first slot (classic) and
+       * chan_index the LE channel index (37-39).  Returns the number of
+       * symbols.
+       */
+      int encode(int index, uint32_t clock, int chan_index, char *symbols);
+
+      /* generate the 8 bit HEC of a classic packet header */
+      static uint8_t hecgen(uint16_t data, uint8_t UAP);
+
+      /* generate the LE CRC-24, init is in the air order used on the wire */
+      static uint32_t le_crcgen(uint32_t init, const uint8_t *data, int length);
+
+    private:
+      uint32_t d_LAP;
+      uint8_t  d_UAP;
+
+      gr::random d_rng;
+
+      /* the 72 symbol access code, computed once */
+      char d_access_code[72];
+
+      /* scratch space for payloads before whitening and FEC */
+      char d_bits[MAX_SYMBOLS];
+
+      int classic(const type_info &info, uint32_t clock, char *symbols);
+      int le_adv(const type_info &info, int chan_index, char *symbols);
+
+      /* random payload body length in bytes */
+      int body_length(int max_length);
+
+      /* append host order bits in air order, returns new bit position */
+      static int put_bits(char *air_order, int pos, uint32_t value, int bits);
+
+      /* whiten (the inverse is its own) using CLK1-6 and a bit offset */
+      static void whiten(char *data, int length, uint32_t clock, int skip);
+
+      /* rate 2/3 FEC, a (15,10) shortened Hamming code, returns symbols */
+      static int fec23(const char *input, int length, char *output);
+
+      /* rate 1/3 FEC, each bit repeated three times */
+      static int fec13(const char *input, int length, char *output);
+    };
+
+    /*
+     * Hopping sequence of one piconet, computed a hop at a time with
+     * single_hop() instead of the 128 MB table gen_hops() builds.
+     */
+    class synth_piconet : public basic_rate_piconet_impl
+    {
+    public:
+      synth_piconet(uint32_t LAP, uint8_t UAP);
+
+      /* channel (0-78) of the slot starting at CLK1-27 */
+      int channel(uint32_t clock) { return single_hop(clock << 1); }
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_SYNTH_H */
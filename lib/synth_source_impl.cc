@@ -0,0 +1,213 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann                                                                                            
+ * Copyright 2007 Dominic Spill                                                                                                                   
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ * 
+ * This file is part of gr-bluetooth
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "synth_source_impl.h"
+#include <math.h>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace bluetooth {
+
+    const double synth_source_impl::BT           = 0.5;
+    const double synth_source_impl::BR_DEVIATION = 160000.0;
+    const double synth_source_impl::LE_DEVIATION = 250000.0;
+
+    synth_source::sptr
+    synth_source::make(double sample_rate, double center_freq, int LAP, int UAP,
+                       int clock, const std::string &types, int channel,
+                       double density, double snr, double freq_offset, int seed)
+    {
+      return gnuradio::get_initial_sptr (new synth_source_impl(sample_rate, center_freq, LAP, UAP,
+                                                               clock, types, channel,
+                                                               density, snr, freq_offset, seed));
+    }
+
+    /*
+     * The private constructor
+     */
+    synth_source_impl::synth_source_impl(double sample_rate, double center_freq, int LAP, int UAP,
+                                         int clock, const std::string &types, int channel,
+                                         double density, double snr, double freq_offset, int seed)
+      : gr::sync_block ("bluetooth synth source",
+                       gr::io_signature::make (0, 0, 0),
+                       gr::io_signature::make (1, 1, sizeof (gr_complex))),
+        d_synth(LAP, UAP, seed),
+        d_rng(seed ? seed + 1 : 0)
+    {
+      d_sample_rate = sample_rate;
+      d_center_freq = center_freq;
+      d_samples_per_slot = sample_rate * SYMBOLS_PER_SLOT / SYMBOL_RATE;
+      d_density = density;
+      d_freq_offset = freq_offset;
+      d_channel = channel;
+
+      /* unit signal power, the noise power scales with the sampled bandwidth */
+      d_noise_sigma = (float) sqrt(pow(10.0, -snr / 10.0) * sample_rate / SYMBOL_RATE / 2.0);
+
+      if (channel < 0)
+        d_piconet.reset(new synth_piconet(LAP, UAP));
+      else if (channel > 78)
+        throw std::invalid_argument("channel must be -1 or 0-78");
+
+      std::stringstream ss(types);
+      std::string name;
+      while (std::getline(ss, name, ',')) {
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        if (name.empty())
+          continue;
+        int index = packet_synth::lookup(name);
+        if (index < 0)
+          throw std::invalid_argument("unknown packet type " + name);
+        d_types.push_back(index);
+      }
+      if (d_types.empty())
+        throw std::invalid_argument("no packet types given");
+      d_next_type = 0;
+      d_next_adv = 0;
+
+      /* frequency pulse of a Gaussian filtered rectangular symbol */
+      double k = 2 * M_PI * BT / sqrt(log(2.0));
+      int i;
+      for (i = 0; i <= 2 * SHAPE_SPAN * SHAPE_STEPS; i++) {
+        double x = (double) i / SHAPE_STEPS - SHAPE_SPAN;
+        d_shape.push_back((float) (0.5 * erfc(k * (x - 0.5) / M_SQRT2) -
+                                   0.5 * erfc(k * (x + 0.5) / M_SQRT2)));
+      }
+
+      d_slot = 0;
+      d_clock = clock & 0x7ffffff;
+      d_sample = 0;
+      d_slot_end = (uint64_t) llround(d_samples_per_slot);
+      d_busy_until = 0;
+      d_active = false;
+      d_packets = 0;
+      start_slot();
+    }
+
+    /*
+     * Our virtual destructor.
+     */
+    synth_source_impl::~synth_source_impl()
+    {
+    }
+
+    void
+    synth_source_impl::start_slot()
+    {
+      /* ADV_IND, SCAN_RSP etc. rotate through the advertising channels */
+      static const double ADV_FREQS[3] = { 2402e6, 2426e6, 2480e6 };
+      double freq;
+      int chan_index = 0;
+
+      /* still sending a multi-slot packet, or a slave to master slot */
+      if ((d_slot < d_busy_until) || (d_clock & 1))
+        return;
+      if (d_rng.ran1() >= d_density)
+        return;
+
+      int index = d_types[d_next_type];
+      d_next_type = (d_next_type + 1) % d_types.size();
+      const packet_synth::type_info &info = packet_synth::TYPES[index];
+
+      if (info.le) {
+        chan_index = 37 + d_next_adv;
+        freq = ADV_FREQS[d_next_adv];
+        d_next_adv = (d_next_adv + 1) % 3;
+        d_deviation = LE_DEVIATION;
+      } else {
+        int channel = d_piconet ? d_piconet->channel(d_clock) : d_channel;
+        freq = 2402e6 + channel * 1e6;
+        d_deviation = BR_DEVIATION;
+      }
+      d_length = d_synth.encode(index, d_clock, chan_index, d_symbols);
+
+      /* packets occupy an odd number of slots */
+      int slots = ((d_length + SYMBOLS_PER_SLOT - 1) / SYMBOLS_PER_SLOT) | 1;
+      d_busy_until = d_slot + slots;
+      d_packets++;
+
+      d_active = (fabs(freq - d_center_freq) + 500000.0) <= (d_sample_rate / 2);
+      d_start = d_sample;
+      d_offset = freq - d_center_freq + d_freq_offset;
+      d_phase = 0;
+    }
+
+    gr_complex
+    synth_source_impl::modulate(uint64_t sample)
+    {
+      double t = (double) (sample - d_start) * SYMBOL_RATE / d_sample_rate;
+      if (t >= d_length) {
+        d_active = false;
+        return gr_complex(0, 0);
+      }
+
+      /* sum the pulses of the neighbouring symbols */
+      int j, k = (int) t;
+      float f = 0;
+      for (j = k - SHAPE_SPAN; j <= k + SHAPE_SPAN; j++) {
+        if ((j < 0) || (j >= d_length))
+          continue;
+        int i = (int) ((t - j - 0.5 + SHAPE_SPAN) * SHAPE_STEPS + 0.5);
+        if ((i < 0) || (i >= (int) d_shape.size()))
+          continue;
+        f += d_symbols[j] ? d_shape[i] : -d_shape[i];
+      }
+
+      d_phase += 2 * M_PI * (d_deviation * f + d_offset) / d_sample_rate;
+      d_phase = remainder(d_phase, 2 * M_PI);
+      return gr_complex((float) cos(d_phase), (float) sin(d_phase));
+    }
+
+    int
+    synth_source_impl::work(int noutput_items,
+                            gr_vector_const_void_star &input_items,
+                            gr_vector_void_star &output_items)
+    {
+      gr_complex *out = (gr_complex *) output_items[0];
+      int i;
+
+      for (i = 0; i < noutput_items; i++, d_sample++) {
+        if (d_sample >= d_slot_end) {
+          d_slot++;
+          d_clock = (d_clock + 1) & 0x7ffffff;
+          d_slot_end = (uint64_t) llround((d_slot + 1) * d_samples_per_slot);
+          start_slot();
+        }
+        out[i] = d_active ? modulate(d_sample) : gr_complex(0, 0);
+        out[i] += gr_complex(d_noise_sigma * d_rng.gasdev(), d_noise_sigma * d_rng.gasdev());
+      }
+
+      return noutput_items;
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
@@ -0,0 +1,119 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann                                                                                            
+ * Copyright 2007 Dominic Spill                                                                                                                   
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ * 
+ * This file is part of gr-bluetooth
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_SYNTH_SOURCE_IMPL_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_SYNTH_SOURCE_IMPL_H
+
+#include "gr_bluetooth/synth_source.h"
+#include "synth.h"
+#include <gnuradio/random.h>
+#include <boost/scoped_ptr.hpp>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    class synth_source_impl : virtual public synth_source
+    {
+    private:
+      static const int SYMBOL_RATE = 1000000;
+      static const int SYMBOLS_PER_SLOT = 625;
+
+      /* Gaussian filter bandwidth-time product, BR and LE alike */
+      static const double BT;
+
+      /* frequency deviation: modulation index 0.32 (BR) and 0.5 (LE) */
+      static const double BR_DEVIATION;
+      static const double LE_DEVIATION;
+
+      /* pulse shape table resolution and half length in symbols */
+      static const int SHAPE_STEPS = 64;
+      static const int SHAPE_SPAN  = 3;
+
+      double d_sample_rate;
+      double d_center_freq;
+      double d_samples_per_slot;
+      double d_density;
+      double d_freq_offset;
+      int    d_channel;
+
+      /* per component standard deviation of the added noise */
+      float  d_noise_sigma;
+
+      packet_synth d_synth;
+      boost::scoped_ptr<synth_piconet> d_piconet;
+      gr::random   d_rng;
+
+      /* indices into packet_synth::TYPES, used round robin */
+      std::vector<int> d_types;
+      size_t           d_next_type;
+      int              d_next_adv;
+
+      /* frequency pulse of one symbol, sampled every 1/SHAPE_STEPS symbol */
+      std::vector<float> d_shape;
+
+      /* current slot and the sample that starts the next one */
+      uint64_t d_slot;
+      uint32_t d_clock;
+      uint64_t d_sample;
+      uint64_t d_slot_end;
+
+      /* first slot after the packet in flight */
+      uint64_t d_busy_until;
+
+      /* packet in flight */
+      char     d_symbols[packet_synth::MAX_SYMBOLS];
+      int      d_length;
+      bool     d_active;
+      uint64_t d_start;
+      double   d_deviation;
+      double   d_offset;
+      double   d_phase;
+
+      uint64_t d_packets;
+
+      /* decide what (if anything) the master sends in slot d_slot */
+      void start_slot();
+
+      /* baseband sample of the packet in flight, 0 outside of it */
+      gr_complex modulate(uint64_t sample);
+
+    public:
+      synth_source_impl(double sample_rate, double center_freq, int LAP, int UAP,
+                        int clock, const std::string &types, int channel,
+                        double density, double snr, double freq_offset, int seed);
+      ~synth_source_impl();
+
+      uint64_t packets() { return d_packets; }
+
+      int work(int noutput_items,
+               gr_vector_const_void_star &input_items,
+               gr_vector_void_star &output_items);
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_SYNTH_SOURCE_IMPL_H */
@@ -88,14 +88,8 @@ static inline int min(int a, int b) {
 static const unsigned int DEFAULT_MTU = 1500;
 //static const unsigned short ether_type = 0xFFFE; // magic number, in case we need it for a wireshark filter
 
-int write_interface(int fd, unsigned char *data, unsigned int data_len,
-   uint64_t src_addr, uint64_t dst_addr, unsigned short ether_type) {
-
-	unsigned char frame[DEFAULT_MTU]; // XXX buffer overflow?
-	struct ethhdr eh;
-
-	if(fd < 0)
-		return data_len;
+void make_ethhdr(struct ethhdr *eh, uint64_t src_addr, uint64_t dst_addr,
+   unsigned short ether_type) {
 
 	unsigned char src_mac[6];
 	unsigned char dst_mac[6];
@@ -106,13 +100,26 @@ int write_interface(int fd, unsigned char *data, unsigned int data_len,
 		dst_mac[i] = (dst_addr >> shift) & 0xff;
 	}
 
-	memcpy(eh.h_dest, dst_mac, ETH_ALEN);
-	memcpy(eh.h_source, src_mac, ETH_ALEN);
-	eh.h_proto = htons(ether_type);
+	memcpy(eh->h_dest, dst_mac, ETH_ALEN);
+	memcpy(eh->h_source, src_mac, ETH_ALEN);
+	eh->h_proto = htons(ether_type);
+}
+
+int write_interface(int fd, unsigned char *data, unsigned int data_len,
+   uint64_t src_addr, uint64_t dst_addr, unsigned short ether_type) {
+
+	unsigned char frame[DEFAULT_MTU];
+	struct ethhdr eh;
+
+	if(fd < 0)
+		return data_len;
+
+	make_ethhdr(&eh, src_addr, dst_addr, ether_type);
 
+	// never send more than the frame can hold
+	data_len = min(data_len, sizeof(frame) - sizeof(eh));
 	memcpy(frame, &eh, sizeof(eh));
-	memcpy(frame + sizeof(eh), data,
-	   min(data_len, sizeof(frame) - sizeof(eh)));
+	memcpy(frame + sizeof(eh), data, data_len);
 
 	if(write(fd, frame, sizeof(eh) + data_len) == -1) {
 		perror("write");
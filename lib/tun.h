@@ -20,6 +20,7 @@
 
 
 int mktun(const char *, unsigned char *);
+void make_ethhdr(struct ethhdr *, uint64_t, uint64_t, unsigned short);
 int write_interface(int, unsigned char *, unsigned int, uint64_t, uint64_t, unsigned short);
 
 #endif /* INCLUDED_TUN_H */
@@ -0,0 +1,129 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "tun_writer.h"
+#include <sys/uio.h>
+#include <chrono>
+
+namespace gr {
+  namespace bluetooth {
+
+    tun_writer::sptr
+    tun_writer::make(const char *chan_name, size_t queue_depth)
+    {
+      return tun_writer::sptr(new tun_writer(chan_name, queue_depth));
+    }
+
+    tun_writer::tun_writer(const char *chan_name, size_t queue_depth)
+      : d_ring(queue_depth), d_written(0), d_dropped(0), d_running(false)
+    {
+      strncpy(d_chan_name, chan_name, sizeof(d_chan_name)-1);
+      d_chan_name[sizeof(d_chan_name)-1] = '\0';
+      if ((d_fd = mktun(d_chan_name, d_ether_addr)) == -1) {
+        fprintf(stderr,
+                "warning: was not able to open TUN device, "
+                "disabling Wireshark interface\n");
+        return;
+      }
+
+      d_running = true;
+      d_thread = std::thread(&tun_writer::run, this);
+    }
+
+    tun_writer::~tun_writer()
+    {
+      if (d_running) {
+        d_running = false;
+        d_cond.notify_one();
+        d_thread.join();
+      }
+      if (d_dropped > 0) {
+        fprintf(stderr, "%s: %llu frames written, %llu dropped\n", d_chan_name,
+                (unsigned long long) d_written.load(),
+                (unsigned long long) d_dropped.load());
+      }
+    }
+
+    bool
+    tun_writer::push(const unsigned char *data, unsigned int data_len,
+                     uint64_t src_addr, uint64_t dst_addr, unsigned short ether_type)
+    {
+      if (d_fd < 0)
+        return false;
+
+      frame *f = d_ring.reserve();
+      if (!f) {
+        d_dropped++;
+        return false;
+      }
+
+      make_ethhdr(&f->eh, src_addr, dst_addr, ether_type);
+      f->length = (data_len < MAX_DATA_LENGTH) ? data_len : MAX_DATA_LENGTH;
+      if (f->length > 0)
+        memcpy(f->data, data, f->length);
+
+      /* only wake the writer if it may have gone to sleep on an empty ring */
+      if (d_ring.commit())
+        d_cond.notify_one();
+
+      return true;
+    }
+
+    void
+    tun_writer::run()
+    {
+      /* two iovecs per frame: ethernet header and payload */
+      struct iovec iov[2];
+
+      while (d_running || !d_ring.empty()) {
+        frame *f;
+
+        if (d_ring.empty()) {
+          std::unique_lock<std::mutex> lock(d_mutex);
+          d_cond.wait_for(lock, std::chrono::milliseconds(10));
+          continue;
+        }
+
+        /* drain everything queued so far in one pass */
+        while ((f = d_ring.front())) {
+          iov[0].iov_base = &f->eh;
+          iov[0].iov_len  = sizeof(f->eh);
+          iov[1].iov_base = f->data;
+          iov[1].iov_len  = f->length;
+          if (writev(d_fd, iov, 2) == -1)
+            perror("writev");
+          else
+            d_written++;
+          d_ring.pop();
+        }
+      }
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
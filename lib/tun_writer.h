@@ -0,0 +1,101 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_TUN_WRITER_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_TUN_WRITER_H
+
+#include "gr_bluetooth/packet.h"
+#include "spsc_ring.h"
+#include "tun.h"
+#include <boost/shared_ptr.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * TUN output decoupled from the DSP thread.  work() pushes frames
+     * into a bounded single-producer/single-consumer ring and returns
+     * immediately; a writer thread drains the ring and does the write()
+     * calls.  When the ring is full the frame is dropped and counted,
+     * so a slow reader of the interface can never stall the flowgraph.
+     */
+    class tun_writer
+    {
+    private:
+      /* 6 bytes meta data + 3 bytes packet header + the largest payload */
+      static const unsigned int MAX_DATA_LENGTH = 9 + packet::MAX_PAYLOAD_BITS / 8;
+
+      struct frame {
+        struct ethhdr eh;
+        unsigned int  length;
+        unsigned char data[MAX_DATA_LENGTH];
+      };
+
+      int           d_fd;
+      char          d_chan_name[20];
+      unsigned char d_ether_addr[ETH_ALEN];
+
+      /* frames waiting for the writer thread */
+      spsc_ring<frame> d_ring;
+
+      std::atomic<uint64_t> d_written;
+      std::atomic<uint64_t> d_dropped;
+
+      std::atomic<bool>       d_running;
+      std::mutex              d_mutex;
+      std::condition_variable d_cond;
+      std::thread             d_thread;
+
+      /* writer thread body */
+      void run();
+
+    public:
+      typedef boost::shared_ptr<tun_writer> sptr;
+
+      static sptr make(const char *chan_name, size_t queue_depth = 256);
+
+      tun_writer(const char *chan_name, size_t queue_depth);
+      ~tun_writer();
+
+      /* did the TUN device open successfully? */
+      bool is_open() { return d_fd >= 0; }
+
+      /* queue one frame, returns false if it had to be dropped */
+      bool push(const unsigned char *data, unsigned int data_len,
+                uint64_t src_addr, uint64_t dst_addr, unsigned short ether_type);
+
+      /* frames handed to the interface / dropped because the ring was full */
+      uint64_t written() { return d_written.load(); }
+      uint64_t dropped() { return d_dropped.load(); }
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_TUN_WRITER_H */
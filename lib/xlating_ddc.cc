@@ -0,0 +1,142 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "xlating_ddc.h"
+#include <math.h>
+
+namespace gr {
+  namespace bluetooth {
+
+    xlating_ddc::sptr
+    xlating_ddc::make(int decimation, const std::vector<float> &taps,
+                      double center_freq, double sample_rate)
+    {
+      return xlating_ddc::sptr(new xlating_ddc(decimation, taps, center_freq, sample_rate));
+    }
+
+    xlating_ddc::xlating_ddc(int decimation, const std::vector<float> &taps,
+                             double center_freq, double sample_rate)
+      : d_decimation(decimation), d_ntaps(taps.size()), d_center_freq(center_freq),
+        d_phase(1, 0)
+    {
+      d_padded_ntaps = ((d_ntaps + LANES - 1) / LANES) * LANES;
+      double fwT0 = 2 * M_PI * center_freq / sample_rate;
+
+      /*
+       * Same composite filter as freq_xlating_fir_filter: taps[i] is
+       * rotated by exp(j*fwT0*i) and applied to the newest sample
+       * first, so it is stored reversed to walk the input forwards.
+       */
+      d_taps_re.assign(d_padded_ntaps, 0.0f);
+      d_taps_im.assign(d_padded_ntaps, 0.0f);
+      for (int i = 0; i < d_ntaps; i++) {
+        int j = d_ntaps - 1 - i;
+        d_taps_re[j] = taps[i] * cos(fwT0 * i);
+        d_taps_im[j] = taps[i] * sin(fwT0 * i);
+      }
+      d_phase_inc = gr_complex(cos(-fwT0 * decimation), sin(-fwT0 * decimation));
+    }
+
+    int
+    xlating_ddc::filter(const int16_t *in, int noutput, gr_complex *out)
+    {
+      return filter_int(in, noutput, out);
+    }
+
+    int
+    xlating_ddc::filter(const int8_t *in, int noutput, gr_complex *out)
+    {
+      return filter_int(in, noutput, out);
+    }
+
+    template <class T>
+    int
+    xlating_ddc::filter_int(const T *in, int noutput, gr_complex *out)
+    {
+      if (noutput <= 0)
+        return 0;
+
+      /*
+       * Widen the input once, rather than once per tap that reads it.
+       * The zeros past the end meet the zero padded taps.
+       */
+      int ninput = (noutput - 1) * d_decimation + d_ntaps;
+      int nscratch = (noutput - 1) * d_decimation + d_padded_ntaps;
+      d_in_i.resize(nscratch);
+      d_in_q.resize(nscratch);
+      float *xi = &d_in_i[0];
+      float *xq = &d_in_q[0];
+      for (int k = 0; k < ninput; k++) {
+        xi[k] = in[2*k];
+        xq[k] = in[2*k+1];
+      }
+      for (int k = ninput; k < nscratch; k++)
+        xi[k] = xq[k] = 0.0f;
+
+      const float *tr = &d_taps_re[0];
+      const float *ti = &d_taps_im[0];
+
+      for (int n = 0; n < noutput; n++) {
+        const float *pi = xi + n * d_decimation;
+        const float *pq = xq + n * d_decimation;
+
+        /*
+         * Independent lanes, a single sum would serialize on the adds.
+         * Left rolled, the lane loop becomes SIMD; fully unrolled (as
+         * -O3 would) it is vectorized across k instead, which runs
+         * about three times slower.
+         */
+        float re[LANES] = { 0 }, im[LANES] = { 0 };
+        for (int k = 0; k < d_padded_ntaps; k += LANES) {
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC unroll 1
+#endif
+          for (int l = 0; l < LANES; l++) {
+            re[l] += tr[k+l] * pi[k+l] - ti[k+l] * pq[k+l];
+            im[l] += tr[k+l] * pq[k+l] + ti[k+l] * pi[k+l];
+          }
+        }
+        float sum_re = 0, sum_im = 0;
+        for (int l = 0; l < LANES; l++) {
+          sum_re += re[l];
+          sum_im += im[l];
+        }
+
+        out[n] = gr_complex(sum_re, sum_im) * d_phase;
+        d_phase *= d_phase_inc;
+      }
+
+      /* keep the mixer on the unit circle */
+      d_phase /= std::abs(d_phase);
+
+      return noutput;
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
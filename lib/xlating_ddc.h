@@ -0,0 +1,101 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_GR_BLUETOOTH_XLATING_DDC_H
+#define INCLUDED_BLUETOOTH_GR_BLUETOOTH_XLATING_DDC_H
+
+#include <gnuradio/types.h>
+#include <boost/shared_ptr.hpp>
+#include <stdint.h>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * Frequency translating decimating FIR filter for interleaved
+     * integer I/Q input, the equivalent of freq_xlating_fir_filter_ccf
+     * with the int to float conversion done in place.  The 8 or 16 bit
+     * input span of a call is widened once into split I and Q scratch
+     * arrays instead of going through a separate conversion block and
+     * its buffers, then filtered with LANES independent accumulators
+     * that the compiler turns into SIMD.  Output is scaled like the
+     * unscaled conversion blocks.
+     */
+    class xlating_ddc
+    {
+    public:
+      typedef boost::shared_ptr<xlating_ddc> sptr;
+
+      static sptr make(int decimation, const std::vector<float> &taps,
+                       double center_freq, double sample_rate);
+
+      xlating_ddc(int decimation, const std::vector<float> &taps,
+                  double center_freq, double sample_rate);
+
+      int ntaps() const { return d_ntaps; }
+      int decimation() const { return d_decimation; }
+      double center_freq() const { return d_center_freq; }
+
+      /* filter noutput samples from interleaved I/Q, returns noutput */
+      int filter(const int16_t *in, int noutput, gr_complex *out);
+      int filter(const int8_t *in, int noutput, gr_complex *out);
+
+    private:
+      /* accumulators per dot product, enough for 8 wide float SIMD */
+      static const int LANES = 8;
+
+      int d_decimation;
+      int d_ntaps;
+
+      /* offset the taps were rotated to, for retuning */
+      double d_center_freq;
+
+      /* d_ntaps rounded up to a multiple of LANES */
+      int d_padded_ntaps;
+
+      /*
+       * band pass taps in time order, split into real and imaginary
+       * and zero padded to d_padded_ntaps
+       */
+      std::vector<float> d_taps_re;
+      std::vector<float> d_taps_im;
+
+      /* input widened to float, split into I and Q */
+      std::vector<float> d_in_i;
+      std::vector<float> d_in_q;
+
+      /* output mixer, brings the band pass result down to baseband */
+      gr_complex d_phase;
+      gr_complex d_phase_inc;
+
+      template <class T>
+      int filter_int(const T *in, int noutput, gr_complex *out);
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_GR_BLUETOOTH_XLATING_DDC_H */
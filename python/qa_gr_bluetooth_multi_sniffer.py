@@ -18,8 +18,40 @@
 # Boston, MA 02110-1301, USA.
 # 
 
-from gnuradio import gr, gr_unittest
-import bluetooth.swig as bluetooth
+from gnuradio import gr, gr_unittest, blocks
+import os
+import tempfile
+import pmt
+import gr_bluetooth_swig as bluetooth
+
+LAP = 0x9e8b33
+UAP = 0x47
+ADVERTISING_AA = 0x8e89bed6
+
+def le_crc24 (crc_init, data):
+    """ CRC of an LE PDU in on-air byte order, as it follows the PDU """
+    state = crc_init
+    for byte in data:
+        for bit in range(8):
+            feedback = ((state >> 23) ^ (byte >> bit)) & 1
+            state = (state << 1) & 0xffffff
+            if feedback:
+                state ^= 0x00065b
+    crc = 0
+    for i in range(24):
+        if state & (1 << i):
+            crc |= 1 << (23 - i)
+    return crc
+
+def classic_crc16 (uap, data):
+    """ payload CRC of a classic packet, initialized from the UAP """
+    reg = int('{:08b}'.format(uap)[::-1], 2) << 8
+    for byte in data:
+        for bit in range(8):
+            reg = (reg >> 1) | (((reg & 1) ^ ((byte >> bit) & 1)) << 15)
+            reg ^= (reg & 0x8000) >> 5
+            reg ^= (reg & 0x8000) >> 12
+    return reg
 
 class qa_gr_bluetooth_multi_sniffer (gr_unittest.TestCase):
 
@@ -29,10 +61,112 @@ class qa_gr_bluetooth_multi_sniffer (gr_unittest.TestCase):
     def tearDown (self):
         self.tb = None
 
-    def test_001_t (self):
-        # set up fg
+    def sniff (self, center_freq, types, channel, seconds):
+        """ synthesize packets of the test piconet and return the PDUs decoded """
+        sample_rate = 4e6
+        src = bluetooth.synth_source(sample_rate, center_freq, LAP, UAP, 0,
+                                     types, channel, 1.0, 30.0, 0.0, 1)
+        head = blocks.head(gr.sizeof_gr_complex, int(seconds * sample_rate))
+        dst = bluetooth.multi_sniffer(sample_rate, center_freq, 3.0, False)
+        debug = blocks.message_debug()
+        self.tb.connect(src, head, dst)
+        self.tb.msg_connect(dst, "packets", debug, "store")
         self.tb.run ()
-        # check data
+
+        pdus = []
+        for i in range(debug.num_messages()):
+            msg = debug.get_message(i)
+            meta = pmt.to_python(pmt.car(msg))
+            record = bytearray(pmt.u8vector_elements(pmt.cdr(msg)))
+            pdus.append((meta, record))
+        return pdus
+
+    def replay (self, filename, center_freq, threads):
+        """ replay a recording on the given number of threads, return its JSON log and counters """
+        fd, log = tempfile.mkstemp(suffix=".json")
+        os.close(fd)
+        dst = bluetooth.multi_sniffer(4e6, center_freq, 3.0, False)
+        dst.set_log_format("json")
+        dst.set_log_file(log)
+        dst.replay(filename, "cf32", threads)
+        counts = (dst.packets_detected(), dst.packets_decoded())
+        # the log is flushed when the block goes
+        dst = None
+        with open(log) as f:
+            lines = f.read().splitlines()
+        os.unlink(log)
+        return lines, counts
+
+    def test_001_ev (self):
+        # EV3, EV4 and EV5 on channel 39, decoded once the UAP is discovered
+        pdus = self.sniff(2.441e9, "DM1,EV3,EV4,EV5", 39, 0.5)
+        decoded = [p for p in pdus if p[0]["kind"] == "classic" and p[0]["type"] in (7, 12, 13)]
+        self.assertEqual(set(meta["type"] for meta, record in decoded), set([7, 12, 13]))
+
+        for meta, record in decoded:
+            # pseudo-header, then the payload and its CRC, EV packets have no payload header
+            payload = record[22:]
+            self.assertTrue(len(payload) > 2)
+            self.assertEqual(classic_crc16(UAP, payload[:-2]), payload[-2] | (payload[-1] << 8))
+
+    def test_002_classic (self):
+        # DM1 on channel 39, decoded once the UAP is discovered
+        pdus = self.sniff(2.441e9, "DM1", 39, 0.5)
+        self.assertTrue(pdus)
+        decoded = [p for p in pdus if p[0]["kind"] == "classic"]
+        self.assertTrue(decoded)
+
+        for meta, record in pdus:
+            self.assertEqual(meta["lap"], LAP)
+        for meta, record in decoded:
+            self.assertEqual(meta["channel"], 39)
+            self.assertEqual(meta["uap"], UAP)
+            self.assertEqual(meta["type"], 3)
+            # pseudo-header, then payload header, data and CRC
+            payload = record[22:]
+            self.assertTrue(len(payload) > 3)
+            self.assertEqual(classic_crc16(UAP, payload[:-2]), payload[-2] | (payload[-1] << 8))
+
+    def test_003_le_advertising (self):
+        # ADV_IND rotates through 37-39, only index 37 (2402 MHz) is in band
+        pdus = self.sniff(2.402e9, "ADV_IND", -1, 0.2)
+        le = [p for p in pdus if p[0]["kind"] == "le"]
+        self.assertTrue(le)
+
+        for meta, record in le:
+            self.assertEqual(meta["aa"], ADVERTISING_AA)
+            self.assertEqual(meta["channel"], 37)
+            # AA, header, AdvA (LAP and UAP), AdvData and CRC
+            self.assertEqual(record[0] | (record[1] << 8) | (record[2] << 16) | (record[3] << 24),
+                             ADVERTISING_AA)
+            self.assertEqual(record[6] | (record[7] << 8) | (record[8] << 16), LAP)
+            self.assertEqual(record[9], UAP)
+            pdu = record[4:-3]
+            self.assertEqual(len(pdu), 2 + record[5])
+            self.assertEqual(le_crc24(0x555555, pdu),
+                             record[-3] | (record[-2] << 8) | (record[-1] << 16))
+
+    def test_004_replay_threads (self):
+        # several replay segments, decoded the same whatever the number of threads
+        sample_rate = 4e6
+        fd, recording = tempfile.mkstemp(suffix=".cf32")
+        os.close(fd)
+        src = bluetooth.synth_source(sample_rate, 2.441e9, LAP, UAP, 0,
+                                     "DM1", 39, 1.0, 30.0, 0.0, 1)
+        head = blocks.head(gr.sizeof_gr_complex, int(0.8 * sample_rate))
+        sink = blocks.file_sink(gr.sizeof_gr_complex, recording)
+        self.tb.connect(src, head, sink)
+        self.tb.run ()
+        sink.close()
+
+        one, one_counts = self.replay(recording, 2.441e9, 1)
+        many, many_counts = self.replay(recording, 2.441e9, 4)
+        os.unlink(recording)
+
+        self.assertTrue(one)
+        self.assertTrue(one_counts[1] > 0)
+        self.assertEqual(one_counts, many_counts)
+        self.assertEqual(one, many)
 
 
 if __name__ == '__main__':
@@ -27,6 +27,9 @@ BASE_NAME = BASE_NAME.make;
 #include "gr_bluetooth/multi_UAP.h"
 #include "gr_bluetooth/no_filter_sniffer.h"
 #include "gr_bluetooth/single_sniffer.h"
+#include "gr_bluetooth/sigmf_sink.h"
+#include "gr_bluetooth/sigmf_source.h"
+#include "gr_bluetooth/synth_source.h"
 %}
 
 %include "gr_bluetooth/packet.h"
@@ -51,3 +54,12 @@ GR_SWIG_BLOCK_MAGIC2(bluetooth, no_filter_sniffer);
 
 %include "gr_bluetooth/single_sniffer.h"
 GR_SWIG_BLOCK_MAGIC2(bluetooth, single_sniffer);
+
+%include "gr_bluetooth/sigmf_sink.h"
+GR_SWIG_BLOCK_MAGIC2(bluetooth, sigmf_sink);
+
+%include "gr_bluetooth/sigmf_source.h"
+GR_SWIG_BLOCK_MAGIC2(bluetooth, sigmf_source);
+
+%include "gr_bluetooth/synth_source.h"
+GR_SWIG_BLOCK_MAGIC2(bluetooth, synth_source);